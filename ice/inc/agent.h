@@ -2,11 +2,19 @@
 
 #include <string>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <assert.h>
 
 #include "stundef.h"
+#include "streamdef.h"
+#include "netif.h"
 #include "pg_msg.h"
 
+namespace STUN {
+    class FoundationInterner;
+}
+
 namespace ICE {
     class CSession;
 
@@ -37,6 +45,7 @@ namespace ICE {
             uint16_t m_upper;
         };
         using ServerContainer = std::map<std::string, int16_t>; // @std::string: ip address, @int : port
+        using CredentialContainer = std::map<std::string, std::pair<std::string, std::string>>; // @std::string: ip address, @pair: username, password
 
     public:
         CAgentConfig();
@@ -51,15 +60,27 @@ namespace ICE {
         uint16_t Rm()  const { return m_Rm; }
         uint16_t Ti()  const { return m_Ti; }
         uint16_t Rc()  const { return m_Rc; }
+        uint16_t Tr()  const { return m_Tr; }
+        uint16_t ConsentInterval() const { return m_consent_interval; }
+        uint16_t ConsentTimeout()  const { return m_consent_timeout; }
         uint16_t CandPairsLimits() const { return m_cand_pairs_limits; }
         bool     IPv4Supported()   const { return m_ipv4_supported; }
 
         const std::string& DefaultIP() const { return m_default_address; }
+        const InterfaceMonitor::AddressList& LocalAddresses() const { return m_local_addresses; }
+
+        /* the highest ranked address becomes the default ip, IPv4 first while IPv4 is supported */
+        void LocalAddresses(const InterfaceMonitor::AddressList& addresses);
+
+        /* RFC8421 local preference of a local address, preference if the ip is none of them */
+        uint16_t LocalPreference(const std::string& ip, uint16_t preference) const;
         const ServerContainer& StunServer() const { return m_stun_servers; }
         const ServerContainer& TurnServer() const { return m_turn_servers; }
 
         bool AddStunServer(const std::string& stun, int port = 3478);
         bool AddTurnServer(const std::string& turn, int port = 3478);
+        bool AddTurnServer(const std::string& turn, int port, const std::string& username, const std::string& password);
+        bool TurnCredential(const std::string& turn, std::string& username, std::string& password) const;
 
         STUN::AgentRole Role() const { return m_role; }
         void Role(const STUN::AgentRole &role)
@@ -70,6 +91,21 @@ namespace ICE {
 
         const PortRange& GetPortRange() const { return m_PortRange; }
 
+        Nomination NominationMode()      const { return m_nomination; }
+        uint32_t   NominationThreshold() const { return m_nomination_threshold; }
+        void NominationMode(Nomination mode, uint32_t threshold = 0)
+        {
+            m_nomination = mode;
+            m_nomination_threshold = threshold;
+        }
+
+        /* RFC8421 4 pairs of the preferred family checked before one of the other, 0 for the plain priority order */
+        uint16_t FamilyInterleave() const { return m_family_interleave; }
+        void FamilyInterleave(uint16_t interleave) { m_family_interleave = interleave; }
+
+        /* shared by the copies of the config, so every candidate of the agent is interned once */
+        const std::shared_ptr<STUN::FoundationInterner>& Foundations() const { return m_foundations; }
+
     private:
         static bool AddServer(ServerContainer &serverContainer, const std::string& server, int port);
 
@@ -79,14 +115,23 @@ namespace ICE {
         uint16_t m_Rm;  /* default value 16   */
         uint16_t m_Ti;  /* default value 39500ms(39.5s) */
         uint16_t m_Rc;  /* default value 7 */
+        uint16_t m_Tr;  /* default value 15000ms, RFC8445 11 keepalive */
+        uint16_t m_consent_interval;  /* default value 5000ms, RFC7675 5.1 */
+        uint16_t m_consent_timeout;   /* default value 30000ms, RFC7675 5.1 */
         uint16_t m_cand_pairs_limits; /* defualt value 100*/
         bool     m_ipv4_supported;    /* default value true */
         std::string m_default_address;/* default ip for candidate gathering */
+        InterfaceMonitor::AddressList m_local_addresses; /* host candidates of streams without a host ip */
+        Nomination  m_nomination;     /* default value regular */
+        uint32_t    m_nomination_threshold; /* lowest MIN(G,D) of a pair nominated early, default value 0 */
+        uint16_t    m_family_interleave;    /* default value 1, IPv6 and IPv4 pairs alternate */
 
         STUN::AgentRole m_role;
         PortRange       m_PortRange;
         ServerContainer m_stun_servers;
         ServerContainer m_turn_servers;
+        CredentialContainer m_turn_credentials; /* RFC8656 long-term credentials */
+        std::shared_ptr<STUN::FoundationInterner> m_foundations;
 
     private:
         static const uint16_t sDefaultRTO = 500;
@@ -94,7 +139,11 @@ namespace ICE {
         static const uint16_t sDefaultRm = 16;
         static const uint16_t sDefaultTi = 39500;
         static const uint16_t sDefaultRc = 7;
+        static const uint16_t sDefaultTr = 15000;
+        static const uint16_t sConsentInterval = 5000;
+        static const uint16_t sConsentTimeout = 30000;
         static const uint16_t sCandPairsLimits = 100;
+        static const uint16_t sFamilyInterleave = 1;
         static const uint16_t sIPv4Supported = 1;
         static const uint16_t sLowerPort = 30000;
         static const uint16_t sUpperPort = 32000;
@@ -104,9 +153,31 @@ namespace ICE {
     public:
         CAgent() {}
         virtual ~CAgent() {}
-        const CAgentConfig& AgentConfig() const { return m_config; }
+        /* a copy, the monitor thread refreshes the local addresses of m_config */
+        CAgentConfig AgentConfig() const
+        {
+            std::lock_guard<decltype(m_ConfigMutex)> locker(m_ConfigMutex);
+            return m_config;
+        }
+
+        void AgentConfig(const CAgentConfig& config)
+        {
+            std::lock_guard<decltype(m_ConfigMutex)> locker(m_ConfigMutex);
+            m_config = config;
+        }
+
+        /*
+         the handler is called from the monitor thread with the new addresses once the local
+         addresses of the config are updated, typically it restarts ICE of the sessions
+         with AgentConfig()
+         */
+        bool WatchInterfaces(const InterfaceMonitor::ChangeHandler& handler);
+
+        void StopWatching() { m_monitor.Stop(); }
 
     private:
-        CAgentConfig m_config;
+        mutable std::mutex m_ConfigMutex;
+        CAgentConfig       m_config;
+        InterfaceMonitor   m_monitor;
     };
 }
\ No newline at end of file
@@ -6,9 +6,15 @@
 #include "streamdef.h"
 
 namespace STUN {
+    class FoundationInterner;
+
+    /*
+     a local candidate, a plain value without a vtable, the kinds only differ by type and
+     transport so HostCandidate() & co build them instead of a class each
+     */
     class Candidate {
     public:
-        enum class TypeRef {
+        enum class TypeRef : uint8_t {
             /*RFC8445 5.1.2.2.  Guidelines for Choosing Type and Local Preferences*/
             server_reflexive = 100,
             relayed = 0,
@@ -17,144 +23,166 @@ namespace STUN {
         };
 
     public:
-        Candidate(TypeRef eType, uint8_t compId, uint16_t localPref, ICE::Protocol protocol,
+        Candidate(FoundationInterner& foundations, TypeRef eType, uint8_t compId, uint16_t localPref, ICE::Protocol protocol,
             const std::string& baseIP, uint16_t basePort,
             const std::string& relatedIP, uint16_t relatedPort, const std::string& serverIP);
         
-        Candidate(TypeRef eType, ICE::Protocol protocol, uint8_t compId, uint32_t pri, const std::string& foundation,
+        Candidate(TypeRef eType, ICE::Protocol protocol, uint8_t compId, uint32_t pri, uint32_t foundation,
             const std::string& baseIP, uint16_t basePort,
             const std::string& relatedIP, uint16_t relatedPort):
-            m_TypeRef(eType), m_CompId(compId), m_Priority(pri),
-            m_IP(baseIP),m_Port(basePort),
-            m_RelatedIP(relatedIP), m_RelatedPort(relatedPort),
-            m_Foundation(foundation),
+            m_Addr(ToAddress(baseIP, basePort)),
+            m_Related(ToAddress(relatedIP, relatedPort)),
+            m_Foundation(foundation), m_Priority(pri),
+            m_TypeRef(eType), m_CompId(compId),
             m_Protocol(protocol)
         {
         }
 
-        virtual ~Candidate() = 0 {}
-
-        const std::string& Foundation()   const { return m_Foundation; }
+        uint32_t           Foundation()   const { return m_Foundation; }   /* interned per agent, see FoundationInterner */
         uint32_t           Priority()     const { return m_Priority; }
         uint16_t           ComponentId()  const { return m_CompId; }
         ICE::Protocol      Protocol()     const { return m_Protocol; }
 
-        const std::string& TransationIP() const { return m_IP;  }
-        uint16_t TransationPort()         const { return m_Port;}
+        const ICE::TransportAddress& Address()        const { return m_Addr; }
+        const ICE::TransportAddress& RelatedAddress() const { return m_Related; }
 
-        const std::string& RelatedIP() const { return m_RelatedIP; }
-        uint16_t RelatedPort()         const { return m_RelatedPort; }
+        /* formatted on every call, for the SDP and the logs */
+        std::string TransationIP()     const { return m_Addr.IP(); }
+        uint16_t    TransationPort()   const { return m_Addr.m_Port; }
+        std::string RelatedIP()        const { return m_Related.IP(); }
+        uint16_t    RelatedPort()      const { return m_Related.m_Port; }
 
-        std::string TypeName() const;
+        const char* TypeName() const;
+
+        /*
+        RFC8445[7.1.1.  PRIORITY]
+        the priority a peer reflexive candidate learned from this candidate would have,
+        carried in the PRIORITY attribute of connectivity checks
+        */
+        uint32_t PeerReflexivePriority() const
+        {
+            return (static_cast<uint32_t>(TypeRef::peer_reflexive) << 24) | (m_Priority & 0x00FFFFFF);
+        }
 
         bool IsHost() const { return m_TypeRef == TypeRef::host; }
+        TypeRef Type() const { return m_TypeRef; }
 
-    protected:
         static uint32_t ComputePriority(TypeRef type, uint32_t localPref, uint8_t comp_id)
         {
             return ((static_cast<uint8_t>(type) & 0xFF) << 24) + ((localPref & 0xFFFF) << 8) + (((256 - comp_id) & 0xFF) << 0);
         }
 
-        static std::string ComputeFoundations(TypeRef type, const std::string& baseIP, const std::string& serverIP, ICE::Protocol protocol);
+        static uint32_t ComputeFoundations(FoundationInterner& foundations, TypeRef type, const std::string& baseIP, const std::string& serverIP, ICE::Protocol protocol);
 
     private:
-        const std::string m_IP;
-        const std::string m_RelatedIP;
-        const std::string m_Foundation;
-
-        const uint32_t    m_Priority;
-        const uint16_t    m_Port;
-        const uint16_t    m_RelatedPort;
-
-        const TypeRef  m_TypeRef;
-        const uint8_t  m_CompId;
-        const ICE::Protocol  m_Protocol;
-    };
-
-    class HostCandidate : public Candidate {
-    public:
-        HostCandidate(uint8_t compId, uint16_t localPref,
-            const std::string& baseIP, uint16_t basePort) :
-            Candidate(TypeRef::host, compId, localPref, ICE::Protocol::udp, baseIP, basePort, baseIP, basePort, baseIP)
-        {
-        }
-        
-        HostCandidate(uint8_t compId, uint32_t pri, const std::string& foundation, const std::string& ip, uint16_t port):
-            Candidate(TypeRef::host, ICE::Protocol::udp, compId, pri, foundation, ip, port, ip, port)
-        {
-        }
-
-        virtual ~HostCandidate() {}
-    };
-
-    class ActiveCandidate : public Candidate {
-    public:
-        ActiveCandidate(uint8_t compId, uint16_t localPref,
-            const std::string& baseIP, uint16_t basePort,
-            const std::string& relatedIP, uint16_t relatedPort, const std::string& serverIP) :
-            Candidate(TypeRef::host, compId, localPref, ICE::Protocol::tcp_act, baseIP, basePort, relatedIP, relatedPort, serverIP)
-        {
-        }
-        ActiveCandidate(uint8_t compId, uint32_t pri, const std::string& foundation,const std::string& ip, uint16_t port) :
-            Candidate(TypeRef::host, ICE::Protocol::tcp_act, compId, pri, foundation, ip, port, ip, port)
-        {
-        }
-
-        virtual ~ActiveCandidate() {}
-    };
+        static ICE::TransportAddress ToAddress(const std::string& ip, uint16_t port);
 
-    class PassiveCandidate : public Candidate {
-    public:
-        PassiveCandidate(uint8_t compId, uint16_t localPref,
-            const std::string& baseIP, uint16_t basePort,
-            const std::string& relatedIP, uint16_t relatedPort, const std::string& serverIP) :
-            Candidate(TypeRef::host, compId, localPref, ICE::Protocol::tcp_pass, baseIP, basePort, relatedIP, relatedPort,serverIP)
-        {
-        }
-        
-        PassiveCandidate(uint8_t compId, uint32_t pri, const std::string& foundation, const std::string& ip, uint16_t port) :
-            Candidate(TypeRef::host, ICE::Protocol::tcp_pass, compId, pri, foundation, ip, port, ip, port)
-        {
-        }
-
-        virtual ~PassiveCandidate() {}
-    };
+    private:
+        ICE::TransportAddress m_Addr;
+        ICE::TransportAddress m_Related;    /* the base for a host candidate */
 
-    class SrflxCandidate : public Candidate {
-    public:
-        SrflxCandidate(uint8_t compId, uint16_t localPref,
-            const std::string& baseIP, uint16_t basePort,
-            const std::string& relatedIP, uint16_t relatedPort, const std::string& serverIP):
-            Candidate(TypeRef::server_reflexive, compId, localPref, ICE::Protocol::udp, baseIP, basePort, relatedIP, relatedPort, serverIP)
-        {
-        }
-        
-        SrflxCandidate(uint8_t compId, uint32_t pri, const std::string& foundation,
-            const std::string& baseIP, uint16_t basePort,
-            const std::string& relatedIP, uint16_t relatedPort) :
-            Candidate(TypeRef::server_reflexive, ICE::Protocol::udp, compId, pri, foundation, baseIP, basePort, relatedIP, relatedPort)
-        {
-        }
+        uint32_t        m_Foundation;
+        uint32_t        m_Priority;
 
-        virtual ~SrflxCandidate() {}
+        TypeRef         m_TypeRef;
+        uint8_t         m_CompId;
+        ICE::Protocol   m_Protocol;
     };
 
-    class RelayedCandidate : public Candidate {
-    public:
-        RelayedCandidate(uint8_t compId, uint16_t localPref,
-            const std::string& baseIP, uint16_t basePort,
-            const std::string& relatedIP, uint16_t relatedPort, const std::string& serverIP) :
-            Candidate(TypeRef::relayed, compId, localPref, ICE::Protocol::udp, baseIP, basePort, relatedIP, relatedPort, serverIP)
-        {
-        }
-
-        RelayedCandidate(uint8_t compId, uint32_t pri, const std::string& foundation,
-            const std::string& baseIP, uint16_t basePort,
-            const std::string& relatedIP, uint16_t relatedPort) :
-            Candidate(TypeRef::relayed, ICE::Protocol::udp, compId, pri, foundation, baseIP, basePort, relatedIP, relatedPort)
-        {
-        }
-        virtual ~RelayedCandidate() {}
+    /*
+     a candidate of the peer as decoded from its SDP, a POD record living in the arena of the
+     CSDP which decoded it (or of the checklist which learned it), the address is binary
+     */
+    struct RemoteCandidate {
+        ICE::TransportAddress   m_Addr;
+        ICE::TransportAddress   m_Related;      /* raddr/rport, all zero for a host candidate */
+        const char             *m_Foundation;   /* NUL terminated, in the same arena */
+        uint32_t                m_FoundationId; /* equal foundations of one session have equal ids, compared instead of the string */
+        uint32_t                m_Priority;
+        Candidate::TypeRef      m_Type;
+        ICE::Protocol           m_Protocol;
+        uint8_t                 m_CompId;
     };
 
+    inline Candidate HostCandidate(FoundationInterner& foundations, uint8_t compId, uint16_t localPref,
+        const std::string& baseIP, uint16_t basePort)
+    {
+        return Candidate(foundations, Candidate::TypeRef::host, compId, localPref, ICE::Protocol::udp, baseIP, basePort, baseIP, basePort, baseIP);
+    }
+
+    inline Candidate HostCandidate(uint8_t compId, uint32_t pri, uint32_t foundation, const std::string& ip, uint16_t port)
+    {
+        return Candidate(Candidate::TypeRef::host, ICE::Protocol::udp, compId, pri, foundation, ip, port, ip, port);
+    }
+
+    inline Candidate ActiveCandidate(FoundationInterner& foundations, uint8_t compId, uint16_t localPref,
+        const std::string& baseIP, uint16_t basePort,
+        const std::string& relatedIP, uint16_t relatedPort, const std::string& serverIP)
+    {
+        return Candidate(foundations, Candidate::TypeRef::host, compId, localPref, ICE::Protocol::tcp_act, baseIP, basePort, relatedIP, relatedPort, serverIP);
+    }
+
+    inline Candidate ActiveCandidate(uint8_t compId, uint32_t pri, uint32_t foundation, const std::string& ip, uint16_t port)
+    {
+        return Candidate(Candidate::TypeRef::host, ICE::Protocol::tcp_act, compId, pri, foundation, ip, port, ip, port);
+    }
+
+    inline Candidate PassiveCandidate(FoundationInterner& foundations, uint8_t compId, uint16_t localPref,
+        const std::string& baseIP, uint16_t basePort,
+        const std::string& relatedIP, uint16_t relatedPort, const std::string& serverIP)
+    {
+        return Candidate(foundations, Candidate::TypeRef::host, compId, localPref, ICE::Protocol::tcp_pass, baseIP, basePort, relatedIP, relatedPort, serverIP);
+    }
+
+    inline Candidate PassiveCandidate(uint8_t compId, uint32_t pri, uint32_t foundation, const std::string& ip, uint16_t port)
+    {
+        return Candidate(Candidate::TypeRef::host, ICE::Protocol::tcp_pass, compId, pri, foundation, ip, port, ip, port);
+    }
+
+    inline Candidate SrflxCandidate(FoundationInterner& foundations, uint8_t compId, uint16_t localPref,
+        const std::string& baseIP, uint16_t basePort,
+        const std::string& relatedIP, uint16_t relatedPort, const std::string& serverIP)
+    {
+        return Candidate(foundations, Candidate::TypeRef::server_reflexive, compId, localPref, ICE::Protocol::udp, baseIP, basePort, relatedIP, relatedPort, serverIP);
+    }
+
+    inline Candidate SrflxCandidate(uint8_t compId, uint32_t pri, uint32_t foundation,
+        const std::string& baseIP, uint16_t basePort,
+        const std::string& relatedIP, uint16_t relatedPort)
+    {
+        return Candidate(Candidate::TypeRef::server_reflexive, ICE::Protocol::udp, compId, pri, foundation, baseIP, basePort, relatedIP, relatedPort);
+    }
+
+    inline Candidate PrflxCandidate(uint8_t compId, uint32_t pri, uint32_t foundation,
+        const std::string& baseIP, uint16_t basePort,
+        const std::string& relatedIP, uint16_t relatedPort)
+    {
+        return Candidate(Candidate::TypeRef::peer_reflexive, ICE::Protocol::udp, compId, pri, foundation, baseIP, basePort, relatedIP, relatedPort);
+    }
+
+    /*
+    RFC8445[7.2.5.3.1.  Discovering Peer-Reflexive Candidates]
+    RFC8445[7.3.1.3.  Learning Peer-Reflexive Candidates]
+    learned from a connectivity check, the priority is the one carried in the PRIORITY attribute
+    */
+    inline Candidate PrflxCandidate(FoundationInterner& foundations, uint8_t compId, uint32_t pri,
+        const std::string& ip, uint16_t port, const std::string& baseIP, uint16_t basePort)
+    {
+        return Candidate(Candidate::TypeRef::peer_reflexive, ICE::Protocol::udp, compId, pri,
+            Candidate::ComputeFoundations(foundations, Candidate::TypeRef::peer_reflexive, baseIP, ip, ICE::Protocol::udp), ip, port, baseIP, basePort);
+    }
+
+    inline Candidate RelayedCandidate(FoundationInterner& foundations, uint8_t compId, uint16_t localPref,
+        const std::string& baseIP, uint16_t basePort,
+        const std::string& relatedIP, uint16_t relatedPort, const std::string& serverIP)
+    {
+        return Candidate(foundations, Candidate::TypeRef::relayed, compId, localPref, ICE::Protocol::udp, baseIP, basePort, relatedIP, relatedPort, serverIP);
+    }
+
+    inline Candidate RelayedCandidate(uint8_t compId, uint32_t pri, uint32_t foundation,
+        const std::string& baseIP, uint16_t basePort,
+        const std::string& relatedIP, uint16_t relatedPort)
+    {
+        return Candidate(Candidate::TypeRef::relayed, ICE::Protocol::udp, compId, pri, foundation, baseIP, basePort, relatedIP, relatedPort);
+    }
 }
\ No newline at end of file
@@ -70,8 +70,16 @@ namespace ICE {
 
     public:
         bool BindRemote(const std::string &ip, uint16_t port) noexcept;
+
+        /* several sockets bound to the same address, the kernel spreads the flows over them (SO_REUSEPORT, linux 3.9+) */
+        bool Bind(const std::string& ip, uint16_t port, bool bReusePort) noexcept;
         boost::asio::ip::udp::socket& Socket() { return m_Socket; }
 
+        /* the same socket talks to many peers during connectivity checks, so the peer is given per call */
+        int16_t Write(const void* buffer, int16_t size, const boost::asio::ip::udp::endpoint& to) noexcept;
+        int16_t Read(void* buffer, int16_t size, boost::asio::ip::udp::endpoint& from) noexcept;
+        int16_t Read(void* buffer, int16_t size, boost::asio::ip::udp::endpoint& from, uint32_t timeoutMS) noexcept; /* 0 on timeout */
+
     public:
         virtual bool Bind(const std::string& ip, uint16_t port) noexcept override;
         virtual int16_t Write(const void* buffer, int16_t size) noexcept override;
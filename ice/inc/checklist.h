@@ -0,0 +1,245 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <chrono>
+#include <unordered_map>
+#include <memory>
+#include <functional>
+#include <string.h>
+
+#include "stundef.h"
+#include "streamdef.h"
+#include "candidate.h"
+#include "pairtable.h"
+#include "pg_arena.h"
+
+namespace STUN {
+    class FoundationInterner;
+}
+
+namespace ICE {
+    class Stream;
+
+    class CheckList {
+    public:
+        /* RFC8445 6.1.2.1.  Checklist State */
+        enum class State : uint8_t {
+            Running,
+            Completed,
+            Failed,
+        };
+
+        using Clock     = std::chrono::steady_clock;
+        using Handle    = CandPeerTable::Handle;
+        using PeerState = CandPeerTable::State;
+
+        /* one STUN transaction of an ordinary or triggered check */
+        struct Transaction {
+            STUN::TransId       m_Id;
+            Handle              m_Peer;
+            uint16_t            m_Sent;       /* number of transmissions */
+            uint32_t            m_RTO;        /* current retransmission timeout in ms */
+            bool                m_bCancelled; /* RFC8445 7.2.5.3.1, wait for response but never retransmit */
+            bool                m_bNominate;  /* check carries USE-CANDIDATE */
+            bool                m_bControlling; /* ICE-CONTROLLING or ICE-CONTROLLED, the role the check is sent with */
+            Clock::time_point   m_Start;
+            Clock::time_point   m_Expire;
+        };
+
+        using PeerAddress = TransportAddress;
+
+        struct LocalCand {
+            const STUN::Candidate *m_Cand;
+            Stream                *m_Stream;
+            PeerAddress            m_Base;
+            const STUN::Candidate *m_Sender;   /* candidate owning the channel, the base of a peer reflexive candidate */
+        };
+
+        struct RemoteCand {
+            const STUN::RemoteCandidate *m_Cand;
+            bool                         m_bLearned;    /* peer reflexive, never signaled */
+        };
+
+        using LocalCandContainer    = std::vector<LocalCand>;
+        using RemoteCandContainer   = std::vector<RemoteCand>;
+        using TriggeredQueue        = std::deque<Handle>;
+        using NominateQueue         = std::deque<Handle>;
+        using ValidList             = std::vector<Handle>;
+        using ComponentContainer    = std::vector<uint8_t>;
+        using TransactionContainer  = std::unordered_map<uint64_t, Transaction>;  /* key = random part of the transaction id */
+        using TransactionList       = std::vector<Transaction*>;
+        using LearnedCandContainer  = std::deque<STUN::Candidate>;   /* stable addresses, pointers to them are indexed */
+
+        static const Handle   sInvalidPeer  = CandPeerTable::sInvalidHandle;
+        static const uint16_t sInvalidIndex = 0xFFFF;
+        static const uint32_t sMinRTO       = 100;  /* ms, bounds of the RTO measured on a pair */
+        static const uint32_t sMaxRTO       = 3000;
+
+        static uint64_t PairPriority(uint32_t G, uint32_t D);
+
+        /* RFC8445 6.1.2.6 the foundation of a pair is the local and the remote foundation together */
+        static uint64_t PairFoundation(uint32_t local, uint32_t remote) { return (static_cast<uint64_t>(local) << 32) | remote; }
+
+    public:
+        CheckList(const std::string& localUfrag, const std::string& localPwd, const std::string& remoteUfrag, const std::string& remotePwd,
+            const std::shared_ptr<STUN::FoundationInterner>& foundations);
+        virtual ~CheckList();
+
+        const std::string& LocalUfrag()  const { return m_LocalUfrag; }
+        const std::string& LocalPwd()    const { return m_LocalPwd; }
+        const std::string& RemoteUfrag() const { return m_RemoteUfrag; }
+        const std::string& RemotePwd()   const { return m_RemotePwd; }
+
+        State GetState() const { return m_State; }
+        bool  IsControlling() const { return m_bControlling; }
+        const CandPeerTable& Peers() const { return m_Peers; }
+        const ValidList& Valid() const { return m_ValidList; }
+        const ComponentContainer& Components() const { return m_Components; }
+
+        const STUN::Candidate* LocalCandidate(Handle peer)  const { return m_LocalCands[m_Peers.LocalIndex(peer)].m_Cand; }
+        Stream*                PeerStream(Handle peer)      const { return m_LocalCands[m_Peers.LocalIndex(peer)].m_Stream; }
+        const STUN::Candidate* SenderCandidate(Handle peer) const { return m_LocalCands[m_Peers.LocalIndex(peer)].m_Sender; }
+        const STUN::RemoteCandidate* RemoteCandidate(Handle peer) const { return m_RemoteCands[m_Peers.RemoteIndex(peer)].m_Cand; }
+        const PeerAddress&           RemoteAddress(Handle peer) const;
+
+        /* once prepared, a new pair goes straight into its place in the order, Frozen */
+        bool AddPeer(uint64_t pri, const STUN::Candidate* lcand, const STUN::RemoteCandidate* rcand, Stream* stream);
+        void Prepare(uint16_t maxPeers);
+
+        /*
+         a remote description without a candidate it signaled before: the Frozen and Waiting
+         pairs of the candidates 'signaled' returns false for are failed, returns their number
+         */
+        uint16_t Withdraw(const std::function<bool(const STUN::RemoteCandidate& rcand)>& signaled);
+
+        void Controlling(bool bControlling) { m_bControlling = bControlling; }
+        void SwitchRole(bool bControlling);
+        void SetNomination(Nomination mode, uint32_t threshold);
+
+        /*
+         RFC8421 4 ordinary checks alternate between the address families, interleave
+         pairs of the family of the best pair go before one pair of the other family,
+         0 keeps the plain priority order
+         */
+        void SetFamilyInterleave(uint16_t interleave);
+
+        Handle NextCheck();
+        Handle NextNomination();
+        Handle Selected(uint8_t compId) const;
+
+        /*
+         RFC8839 5.2 the controlling peer concluded on the pair of 'compId' whose local candidate
+         has the address 'local', it becomes the selected pair, returns sInvalidPeer without one
+         */
+        Handle Select(uint8_t compId, const PeerAddress& local);
+        Handle FindPeer(const STUN::Candidate* lcand, const std::string& ip, uint16_t port) const;
+        void   Trigger(Handle peer);
+        void   Unfreeze(uint64_t foundation);
+
+        Handle AddRemotePrflx(const STUN::Candidate* lcand, const std::string& ip, uint16_t port, uint32_t pri);
+        bool   OnMappedAddress(Handle peer, const std::string& ip, uint16_t port);
+
+        const Transaction* StartTransaction(Handle peer, uint32_t rto, bool bNominate = false);
+        Transaction*       FindTransaction(STUN::TransIdConstRef id);
+
+        /* a response ended the transaction, a request sent only once gives an RTT sample */
+        void               EndTransaction(STUN::TransIdConstRef id);
+        void               CollectRetransmissions(uint16_t maxSent, uint16_t lastWaitFactor, TransactionList& retransmit);
+
+        /*
+         RFC5389 7.2.1 RTO of a new request on the pair, computed from the RTT measured on it
+         or on another pair to the same remote candidate, initialRTO until there is none
+         */
+        uint32_t RTO(Handle peer, uint32_t initialRTO) const;
+
+        /* RFC8445 14.3 Num-Waiting + Num-In-Progress */
+        uint16_t PendingCount() const;
+
+        void OnSent(Handle peer, uint16_t bytes)     { m_Peers.OnSent(peer, bytes); }
+        void OnReceived(Handle peer, uint16_t bytes) { m_Peers.OnReceived(peer, bytes); }
+        void OnRTTSample(Handle peer, uint32_t rtt)  { m_Peers.OnRTTSample(peer, rtt); }
+        void OnLost(Handle peer)                     { m_Peers.OnLost(peer); }
+
+        void OnSucceeded(Handle peer, bool bNominate);
+        void OnFailed(Handle peer, bool bNominate);
+        void OnUseCandidate(Handle peer);
+
+    private:
+        /* RFC8445 6.1.2.4, pairs are redundant if they have the same local base, remote candidate and component */
+        struct PeerKey {
+            PeerKey(const PeerAddress& base, const PeerAddress& remote, uint8_t compId) :
+                m_Base(base), m_Remote(remote), m_CompId(compId)
+            {
+            }
+
+            bool operator==(const PeerKey& other) const
+            {
+                return m_CompId == other.m_CompId &&
+                    m_Base.m_Port == other.m_Base.m_Port && m_Remote.m_Port == other.m_Remote.m_Port &&
+                    !memcmp(m_Base.m_IP, other.m_Base.m_IP, sizeof(m_Base.m_IP)) &&
+                    !memcmp(m_Remote.m_IP, other.m_Remote.m_IP, sizeof(m_Remote.m_IP));
+            }
+
+            PeerAddress m_Base;
+            PeerAddress m_Remote;
+            uint8_t     m_CompId;
+        };
+
+        struct PeerKeyHash {
+            size_t operator()(const PeerKey& key) const;
+        };
+
+        using PeerIndex = std::unordered_map<PeerKey, Handle, PeerKeyHash>;
+
+    private:
+        static uint64_t TransactionKey(STUN::TransIdConstRef id);
+        const CandPeerTable::HandleContainer& CheckOrder();
+        PeerKey MakeKey(Handle peer) const;
+        void RebuildIndex();
+        Handle BestValid(uint8_t compId) const;
+        bool HasPendingAbove(uint8_t compId, uint64_t pri) const;
+        void Nominate(Handle peer);
+        uint16_t LocalIndex(const STUN::Candidate* lcand, Stream* stream);
+        uint16_t RemoteIndex(const STUN::RemoteCandidate* rcand);
+        uint32_t FoundationId(uint64_t foundation);
+        bool IsLocalAddress(const std::string& ip, uint16_t port) const;
+        void UpdateState();
+
+    private:
+        using CandIndex         = std::unordered_map<const STUN::Candidate*, uint16_t>;
+        using RemoteCandIndex   = std::unordered_map<const STUN::RemoteCandidate*, uint16_t>;
+        using FoundationIndex   = std::unordered_map<uint64_t, uint32_t>;
+
+        const std::string       m_LocalUfrag;
+        const std::string       m_LocalPwd;
+        const std::string       m_RemoteUfrag;
+        const std::string       m_RemotePwd;
+        const std::shared_ptr<STUN::FoundationInterner> m_Foundations;    /* of the agent, local prflx candidates are interned in it */
+
+        State                   m_State;
+        bool                    m_bControlling;
+        Nomination              m_Nomination;
+        uint32_t                m_NominationThreshold;  /* compared against MIN(G,D) of the pair */
+        uint16_t                m_FamilyInterleave;
+        bool                    m_bCheckOrderDirty;     /* the pair order changed since m_CheckOrder was built */
+        bool                    m_bPrepared;
+        CandPeerTable::HandleContainer m_CheckOrder;    /* the order ordinary checks are sent in */
+        CandPeerTable           m_Peers;
+        LocalCandContainer      m_LocalCands;
+        RemoteCandContainer     m_RemoteCands;
+        CandIndex               m_LocalIndex;
+        RemoteCandIndex         m_RemoteIndex;
+        PeerIndex               m_PeerIndex;
+        FoundationIndex         m_FoundationIds;   /* pair foundation (local + remote) -> id */
+        TriggeredQueue          m_TriggeredQueue;
+        NominateQueue           m_NominateQueue;
+        ValidList               m_ValidList;
+        ComponentContainer      m_Components;
+        LearnedCandContainer    m_LearnedCands;    /* local peer reflexive candidates, owned by the checklist */
+        PG::Arena               m_LearnedArena;    /* remote peer reflexive candidates */
+        TransactionContainer    m_Transactions;
+    };
+}
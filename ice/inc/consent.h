@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <mutex>
+#include <unordered_map>
+
+#include "pg_timer.h"
+#include "pg_timing_wheel.h"
+
+namespace ICE {
+    /*
+     RFC7675 consent freshness and RFC8445 11 keepalives of every session in the process
+     run on one hierarchical timing wheel driven by one PG::timer instead of a timer per pair.
+     each tick collects the due entries per client and hands them over in one call,
+     so a session sends all of its due Binding requests under a single lock
+     */
+    class ConsentScheduler {
+    public:
+        using Cookie     = uint32_t;
+        using CookieList = std::vector<Cookie>;
+
+        class Client {
+        public:
+            virtual ~Client() {}
+            virtual void OnConsentTimer(const CookieList& due) = 0;
+        };
+
+        static const uint32_t sTickMS = 100;
+
+    public:
+        static ConsentScheduler& Instance();
+
+        void Register(Client *client);
+
+        /* once it returns the client is never called again, it MAY be called from OnConsentTimer */
+        void Unregister(Client *client);
+
+        /* one-shot, the cookie is handed back to the client after delayMS */
+        bool Schedule(Client *client, Cookie cookie, uint32_t delayMS);
+
+    private:
+        ConsentScheduler();
+        ~ConsentScheduler();
+        ConsentScheduler(const ConsentScheduler&) = delete;
+        ConsentScheduler& operator=(const ConsentScheduler&) = delete;
+
+        void OnTick();
+
+    private:
+        using ClientContainer = std::unordered_map<Client*, uint64_t>;     /* client -> registration generation */
+        using Batch           = std::unordered_map<Client*, CookieList>;
+
+        std::mutex              m_Mutex;            /* guards the wheel, the clients and the batch */
+        std::recursive_mutex    m_DispatchMutex;    /* held while the clients are called */
+        PG::TimingWheel         m_Wheel;
+        ClientContainer         m_Clients;
+        Batch                   m_Batch;
+        uint64_t                m_Generation;
+        PG::timer               m_Timer;
+    };
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <mutex>
+
+#include <boost/utility/string_view.hpp>
+
+#include "candidate.h"
+#include "pg_arena.h"
+#include "pg_flat_hash.h"
+
+namespace STUN {
+    /*
+     RFC8445[5.1.1.3.  Computing Foundations]
+     candidates of the same type, base IP, server IP and transport share a foundation.
+     one interner per agent hands out small integer ids for them so pairing and unfreezing
+     compare integers, the decimal form of the id is the foundation written to the SDP.
+     candidates are gathered from several threads, Intern is thread safe
+     */
+    class FoundationInterner {
+    public:
+        FoundationInterner() {}
+
+        uint32_t Intern(Candidate::TypeRef type, const std::string& baseIP, const std::string& serverIP, ICE::Protocol protocol);
+        size_t   Size() const;
+
+    private:
+        FoundationInterner(const FoundationInterner&) = delete;
+        FoundationInterner& operator=(const FoundationInterner&) = delete;
+
+        struct Key {
+            uint8_t m_Base[16];     /* binary addresses, IPv4 mapped */
+            uint8_t m_Server[16];
+            uint8_t m_Type;
+            uint8_t m_Protocol;
+        };
+
+        struct KeyHash {
+            size_t operator()(const Key& key) const;
+        };
+
+        struct KeyEqual {
+            bool operator()(const Key& key1, const Key& key2) const;
+        };
+
+        using IdIndex = PG::FlatHash<Key, uint32_t, KeyHash, KeyEqual>;
+
+        mutable std::mutex m_Mutex;
+        IdIndex            m_Ids;
+    };
+
+    /*
+     the foundations of the peer, one id space for every description of a session so pairs
+     formed from an updated SDP share foundation ids (and unfreeze) with the pairs formed before it.
+     the ids learned prflx candidates get count down from UINT32_MAX and never meet these
+     */
+    class RemoteFoundationInterner {
+    public:
+        RemoteFoundationInterner() {}
+
+        uint32_t Intern(boost::string_view foundation);
+        size_t   Size() const { return m_Ids.Size(); }
+
+    private:
+        RemoteFoundationInterner(const RemoteFoundationInterner&) = delete;
+        RemoteFoundationInterner& operator=(const RemoteFoundationInterner&) = delete;
+
+        struct ViewHash {
+            size_t operator()(boost::string_view view) const;
+        };
+
+        using IdIndex = PG::FlatHash<boost::string_view, uint32_t, ViewHash>;   /* keys point into m_Arena */
+
+        PG::Arena m_Arena;
+        IdIndex   m_Ids;
+    };
+}
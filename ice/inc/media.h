@@ -18,19 +18,30 @@ namespace ICE {
         using StreamContainer = std::map<uint8_t, Stream*>; /*key = component id*/
 
     public:
-        Media();
+        explicit Media(bool bRtcpMux = false);
+
+        /* RFC8843 bundled on 'transport': its streams and credentials are the ones of 'transport' */
+        explicit Media(const Media* transport);
         virtual ~Media();
 
-        const StreamContainer& GetStreams() const { return m_Streams; }
+        const StreamContainer& GetStreams() const { return m_Transport ? m_Transport->GetStreams() : m_Streams; }
         const Stream* GetStreamById(uint8_t id) const;
-        const std::string& IcePwd() const { return m_icepwd; }
-        const std::string& IceUfrag() const { return m_iceufrag; }
+        const std::string& IcePwd() const { return m_Transport ? m_Transport->IcePwd() : m_icepwd; }
+        const std::string& IceUfrag() const { return m_Transport ? m_Transport->IceUfrag() : m_iceufrag; }
+        const Media* Transport() const { return m_Transport; }
+        bool IsBundled() const { return m_Transport != nullptr; }
+        bool IsRtcpMux() const { return m_bRtcpMux; }
         bool CreateStream(uint8_t compId, Protocol protocol, const std::string& hostIP, uint16_t port, const CAgentConfig& config);
 
+        /* RFC8445 9 new ice-ufrag/ice-pwd, every stream gathers its server candidates again */
+        bool Restart(const CAgentConfig& config);
+
     private:
         StreamContainer     m_Streams;
-        const std::string   m_icepwd;
-        const std::string   m_iceufrag;
+        std::string         m_icepwd;
+        std::string         m_iceufrag;
+        const Media        *m_Transport;
+        const bool          m_bRtcpMux;
 
     };
 }
\ No newline at end of file
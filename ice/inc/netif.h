@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+
+namespace ICE {
+    /* a local address host candidates may be gathered on */
+    struct LocalAddress {
+        std::string m_IP;
+        std::string m_Interface;
+        uint32_t    m_Index;        /* interface index */
+        uint16_t    m_LocalPref;    /* RFC8421 4 */
+        bool        m_bIPv6;
+        bool        m_bVPN;         /* tunnel or point-to-point interface */
+    };
+
+    /*
+     enumerates the addresses of every interface which is up, straight from the kernel
+     (netlink on linux, GetAdaptersAddresses on windows) without resolving the hostname,
+     and reports the new list whenever the kernel notifies an address or link change
+     */
+    class InterfaceMonitor {
+    public:
+        using AddressList   = std::vector<LocalAddress>;    /* ordered by local preference, highest first */
+        using ChangeHandler = std::function<void(const AddressList& addresses)>;
+
+    public:
+        InterfaceMonitor();
+        virtual ~InterfaceMonitor();
+
+        static bool Enumerate(bool bIPv4Supported, AddressList& addresses);
+
+        /* the handler is called from the monitor thread, only when the list changed */
+        bool Start(bool bIPv4Supported, const ChangeHandler& handler);
+        void Stop();
+
+        AddressList Addresses() const;
+
+    private:
+        InterfaceMonitor(const InterfaceMonitor&) = delete;
+        InterfaceMonitor& operator=(const InterfaceMonitor&) = delete;
+
+        struct Interface {
+            std::string m_Name;
+            uint32_t    m_Index;
+            bool        m_bVPN;
+        };
+        using InterfaceList = std::vector<Interface>;
+
+        static bool IsUsable(const std::string& ip, bool bIPv4Supported);
+        static void AssignPreference(const InterfaceList& interfaces, AddressList& addresses);
+        static bool EnumerateInterfaces(bool bIPv4Supported, InterfaceList& interfaces, AddressList& addresses);
+
+        void OnChanged();
+        static void MonitorThread(InterfaceMonitor *pThis);
+
+    private:
+        mutable std::mutex  m_Mutex;
+        AddressList         m_Addresses;
+        ChangeHandler       m_Handler;
+        bool                m_bIPv4Supported;
+        std::atomic_bool    m_bQuit;
+        std::thread         m_Thread;
+
+#ifdef _WIN32
+        void               *m_Notify;       /* NotifyUnicastIpAddressChange handle */
+        void               *m_Events[2];    /* change event, Stop event */
+#else
+        int                 m_Netlink;
+        int                 m_Wakeup[2];    /* Stop writes to it to wake up the monitor thread */
+#endif
+    };
+}
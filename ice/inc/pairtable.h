@@ -0,0 +1,118 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <chrono>
+#include <assert.h>
+
+namespace ICE {
+    /*
+     struct-of-arrays candidate pair table.
+     a pair is addressed by a small integer handle which never changes once the pair is added,
+     the handles are kept ordered by pair priority in m_Order so scheduling only walks
+     the packed priority/state arrays
+     */
+    class CandPeerTable {
+    public:
+        /* RFC8445 6.1.2.6.  Computing Candidate Pair States */
+        enum class State : uint8_t {
+            Frozen,
+            Waiting,
+            InProgress,
+            Succeeded,
+            Failed,
+        };
+
+        /* RFC8445 8.  Concluding ICE Processing */
+        enum Flag : uint8_t {
+            Nominated           = 0x01,
+            Nominating          = 0x02,   /* a check with USE-CANDIDATE is outstanding */
+            NominateOnSuccess   = 0x04,   /* USE-CANDIDATE received before the pair succeeded */
+        };
+
+        /* RFC6298 round trip estimation and the traffic of a pair, STUN checks, consent and keepalives */
+        struct Stats {
+            uint32_t    m_SRTT;             /* smoothed RTT in ms, sUnknownRTT until the first sample */
+            uint32_t    m_RTTVar;           /* RTT variation in ms */
+            uint32_t    m_Lost;             /* requests sent and never answered */
+            uint32_t    m_PacketsSent;
+            uint32_t    m_PacketsReceived;
+            uint64_t    m_BytesSent;
+            uint64_t    m_BytesReceived;
+            std::chrono::steady_clock::time_point m_LastActivity;  /* last packet received */
+        };
+
+        using Handle            = uint16_t;
+        using HandleContainer   = std::vector<Handle>;
+
+        static const Handle   sInvalidHandle = 0xFFFF;
+        static const uint32_t sUnknownRTT    = 0xFFFFFFFF;
+
+    public:
+        CandPeerTable() :
+            m_bSorted(true)
+        {
+        }
+
+        virtual ~CandPeerTable() {}
+
+        uint16_t Size() const { return static_cast<uint16_t>(m_Priority.size()); }
+        bool     IsFull() const { return m_Priority.size() >= sInvalidHandle; }
+
+        Handle Add(uint64_t pri, uint16_t local, uint16_t remote, uint32_t foundation, uint8_t compId);
+        Handle Insert(uint64_t pri, uint16_t local, uint16_t remote, uint32_t foundation, uint8_t compId);
+        void   Update(Handle peer, uint64_t pri, uint16_t local, uint16_t remote, uint32_t foundation);
+        void   Sort();
+        void   Reorder(Handle peer);
+        void   Truncate(uint16_t size);
+        void   Clear();
+
+        /* handles ordered by decreasing pair priority, valid after Sort() */
+        const HandleContainer& Order() const { assert(m_bSorted); return m_Order; }
+
+        uint64_t Priority(Handle peer)    const { return m_Priority[peer]; }
+        State    GetState(Handle peer)    const { return m_State[peer]; }
+        uint16_t LocalIndex(Handle peer)  const { return m_LocalIdx[peer]; }
+        uint16_t RemoteIndex(Handle peer) const { return m_RemoteIdx[peer]; }
+        uint32_t Foundation(Handle peer)  const { return m_Foundation[peer]; }
+        uint8_t  ComponentId(Handle peer) const { return m_CompId[peer]; }
+        uint32_t RTT(Handle peer)         const { return m_Stats[peer].m_SRTT; }
+        const Stats& GetStats(Handle peer) const { return m_Stats[peer]; }
+        bool     HasFlag(Handle peer, Flag flag) const { return (m_Flags[peer] & flag) != 0; }
+
+        void Priority(Handle peer, uint64_t pri) { m_Priority[peer] = pri; m_bSorted = false; }
+        void SetState(Handle peer, State state) { m_State[peer] = state; }
+        void SetFlag(Handle peer, Flag flag)    { m_Flags[peer] |= flag; }
+        void ClearFlag(Handle peer, Flag flag)  { m_Flags[peer] &= ~flag; }
+
+        void OnRTTSample(Handle peer, uint32_t rtt);
+        void OnLost(Handle peer)                    { ++m_Stats[peer].m_Lost; }
+        void OnSent(Handle peer, uint16_t bytes)    { ++m_Stats[peer].m_PacketsSent; m_Stats[peer].m_BytesSent += bytes; }
+        void OnReceived(Handle peer, uint16_t bytes);
+
+    private:
+        HandleContainer::iterator OrderPosition(uint64_t pri);
+
+        template<class T>
+        static void Gather(std::vector<T>& values, const HandleContainer& handles)
+        {
+            std::vector<T> gathered;
+            gathered.reserve(handles.size());
+            for (auto itor = handles.begin(); itor != handles.end(); ++itor)
+                gathered.push_back(values[*itor]);
+            values.swap(gathered);
+        }
+
+    private:
+        std::vector<uint64_t>   m_Priority;
+        std::vector<State>      m_State;
+        std::vector<uint16_t>   m_LocalIdx;
+        std::vector<uint16_t>   m_RemoteIdx;
+        std::vector<uint32_t>   m_Foundation;
+        std::vector<uint8_t>    m_CompId;
+        std::vector<uint8_t>    m_Flags;
+        std::vector<Stats>      m_Stats;    /* cold, only touched when a packet of the pair is sent or received */
+        HandleContainer         m_Order;
+        bool                    m_bSorted;
+    };
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <atomic>
+#include <memory>
+
+#include "stundef.h"
+
+namespace ICE {
+    /*
+     answers Binding requests directly from the checking thread which received them,
+     RFC8445 7.3.1: the response is built in the caller's buffer, no allocation. the credentials
+     are shared_ptrs swapped with std::atomic_load/atomic_store, a request holds the ones it
+     read until the response is sealed, the library may implement those with a lock
+     */
+    class BindingResponder {
+    public:
+        enum class Result : uint8_t {
+            NotRequest,     /* not a Binding request, nothing written */
+            Success,        /* success response written, the request goes on to the session */
+            RoleConflict,   /* 487 written, RFC8445 7.3.1.1 */
+            BadRequest,     /* 400 written */
+            Unauthorized,   /* 401 written */
+            Previous,       /* success response written with the credentials an ICE restart replaced, the session does not see it */
+            Discard,        /* malformed or bad FINGERPRINT, silently dropped */
+        };
+
+    public:
+        BindingResponder();
+
+        /* MAY be changed while the checking threads are running */
+        void Credentials(const std::string& ufrag, const std::string& pwd);
+
+        /*
+         RFC8445 9 ICE restart, the replaced credentials are still answered
+         until Retire, media goes on over the old pair meanwhile
+         */
+        void Restart(const std::string& ufrag, const std::string& pwd);
+        void Retire();
+        void Role(bool bControlling, uint64_t tiebreaker);
+        void Role(bool bControlling) { m_bControlling = bControlling; }
+
+        Result Respond(const STUN::PACKET::stun_packet& request, uint16_t size, const boost::asio::ip::udp::endpoint& from,
+            STUN::PACKET::stun_packet& response, uint16_t& responseSize) const;
+
+    private:
+        struct Credential {
+            std::string m_Ufrag;
+            std::string m_Pwd;
+        };
+        using CredentialPtr = std::shared_ptr<const Credential>;
+
+        static bool IsUsername(const Credential* credential, const uint8_t* username, uint16_t length);
+
+        uint16_t WriteError(const STUN::PACKET::stun_packet& request, STUN::ErrorCode code, const char* reason, const std::string* pwd,
+            STUN::PACKET::stun_packet& response) const;
+        uint16_t WriteSuccess(const STUN::PACKET::stun_packet& request, const boost::asio::ip::udp::endpoint& from, const std::string& pwd,
+            STUN::PACKET::stun_packet& response) const;
+        uint16_t Seal(STUN::PACKET::stun_packet& response, uint16_t offset, const std::string* pwd) const;
+
+    private:
+        CredentialPtr           m_Current;     /* swapped with std::atomic_load/atomic_store */
+        CredentialPtr           m_Previous;
+        std::atomic_bool        m_bControlling;
+        std::atomic<uint64_t>   m_Tiebreaker;
+    };
+}
\ No newline at end of file
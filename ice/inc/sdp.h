@@ -2,58 +2,104 @@
 
 #include <stdint.h>
 
-#include <unordered_set>
 #include <unordered_map>
+#include <vector>
 #include <string>
+#include <functional>
+
+#include <boost/utility/string_view.hpp>
+
+#include "streamdef.h"
+#include "foundation.h"
+#include "pg_arena.h"
+#include "pg_flat_hash.h"
 
 namespace STUN {
     class Candidate;
+    struct RemoteCandidate;
 }
 
 namespace ICE {
     class Session;
+    class Media;
 }
 
 class CSDP {
 public:
+    /* RFC8839 5.6 ice-options tags, session level ones apply to every m-section */
+    enum IceOption : uint8_t {
+        trickle = 0x01,     /* RFC8838, candidates may come later than the description */
+        ice2    = 0x02,     /* RFC8445 agent */
+    };
+
+    /* an m-section left undecoded, offset and length in the decoded SDP */
+    struct SectionIndex {
+        uint32_t m_Offset;
+        uint32_t m_Length;
+    };
+
+    using SectionIndexes = std::vector<SectionIndex>;
+
+    /* tells by media type if an m-section is to be decoded */
+    using MediaFilter = std::function<bool(boost::string_view type)>;
+
+    /* RFC8843 a=group:BUNDLE, the mids of a group, the first one is the tagged m-section */
+    using BundleGroup  = std::vector<std::string>;
+    using BundleGroups = std::vector<BundleGroup>;
+
     class RemoteMedia {
     public:
-        using CandContainer     = std::unordered_set<const STUN::Candidate*>;
-        using ComponentCands    = std::unordered_map<uint8_t, CandContainer*>;
+        /* the candidates of one component, contiguous in the arena of the CSDP, in SDP order */
+        struct Component {
+            uint8_t                      m_CompId;
+            uint16_t                     m_Count;
+            const STUN::RemoteCandidate *m_Cands;
+        };
+
+        using ComponentCands = std::vector<Component>;
+
+        /* RFC8839 5.2 a=remote-candidates, the candidates of ours the controlling peer selected */
+        struct SelectedCand {
+            uint8_t               m_CompId;
+            ICE::TransportAddress m_Addr;
+        };
+
+        using SelectedCands = std::vector<SelectedCand>;
 
     public:
-        RemoteMedia(const std::string& type, const std::string& pwd, const std::string& ufrag) :
-            m_type(type), m_icepwd(pwd), m_iceufrag(ufrag)
+        RemoteMedia(const std::string& type, const std::string& pwd, const std::string& ufrag, uint8_t iceOptions) :
+            m_type(type), m_icepwd(pwd), m_iceufrag(ufrag), m_IceOptions(iceOptions), m_bRtcpMux(false)
         {
         }
 
-        virtual ~RemoteMedia();
+        virtual ~RemoteMedia() {}
 
         const std::string& Type() const { return m_type; }
+        const std::string& IcePwd() const { return m_icepwd; }
+        const std::string& IceUfrag() const { return m_iceufrag; }
         const ComponentCands& Candidates() const { return m_Cands; }
-
-        bool AddHostCandidate(uint8_t compId, uint32_t pri, const std::string& foundation, const std::string& baseIP, uint16_t basePort);
-
-        bool AddSrflxCandidate(uint8_t compId, uint32_t pri, const std::string& foundation,
-            const std::string& baseIP, uint16_t basePort,
-            const std::string& relatedIP, uint16_t relatedPort);
-
-        bool AddPrflxCandidate(uint8_t compId, uint32_t pri, const std::string& foundation,
-            const std::string& baseIP, uint16_t basePort,
-            const std::string& relatedIP, uint16_t relatedPort);
-
-        bool AddRelayCandidate(uint8_t compId, uint32_t pri, const std::string& foundation,
-            const std::string& baseIP, uint16_t basePort,
-            const std::string& relatedIP, uint16_t relatedPort);
+        const Component* FindComponent(uint8_t compId) const;
+        const SelectedCands& RemoteCandidates() const { return m_Selected; }
+        const std::string& Mid() const { return m_Mid; }
+        bool IsRtcpMux() const { return m_bRtcpMux; }
+        bool IsTrickle() const { return (m_IceOptions & IceOption::trickle) != 0; }
+        bool IsICE2() const { return (m_IceOptions & IceOption::ice2) != 0; }
 
     private:
-        bool AddCandidate(uint8_t compId, STUN::Candidate* can);
+        friend class CSDP;
+
+        /* 'cands' MUST be sorted by component */
+        void AssignCandidates(const STUN::RemoteCandidate* cands, uint16_t count);
 
     private:
         const std::string   m_icepwd;
         const std::string   m_iceufrag;
         const std::string   m_type;
         ComponentCands      m_Cands;
+        SelectedCands       m_Selected;
+        std::string         m_Mid;          /* RFC5888 a=mid */
+        const uint8_t       m_IceOptions;
+        bool                m_bRtcpMux;
     };
 
 public:
@@ -61,21 +107,67 @@ public:
     using ConnectContainer     = std::unordered_map<std::string, bool>; /* IPV*/
 
 public:
-    CSDP();
+    /* remote foundation ids are taken from 'foundations' when given, else they are numbered per CSDP */
+    explicit CSDP(STUN::RemoteFoundationInterner* foundations = nullptr);
     virtual ~CSDP();
 
 public:
-    bool Decode(const std::string& offer);
+    /*
+     the m-sections 'wanted' returns false for are only indexed, their attributes and
+     candidates are not decoded, without filter every m-section is decoded
+     */
+    bool Decode(const std::string& offer, const MediaFilter& wanted = MediaFilter());
+
+    /* the whole SDP of the session, replaces the content of 'offer' but keeps its capacity */
     bool Encode(const ICE::Session & session, std::string& offer);
+
+    /* fragments appended to 'sdp', an m-section with its candidates and a single a=candidate line (trickle) */
+    static bool EncodeMedia(const std::string& name, const ICE::Media& media, std::string& sdp);
+    static void EncodeCandidate(const STUN::Candidate& cand, bool bUDP, std::string& sdp);
     const RemoteMediaContainer& GetRemoteMedia() const { return m_RemoteMedias; }
+    const std::string& IcePwd() const { return m_IcePwd; }
+    const std::string& IceUfrag() const { return m_IceUfrag; }
+    const SectionIndexes& SkippedSections() const { return m_Skipped; }
+    const BundleGroups& Bundles() const { return m_Bundles; }
+
+    /* RFC8843 the m-section carrying the transport of 'media', the tagged one of its BUNDLE group, or 'media' itself */
+    const RemoteMedia* BundleTransport(const RemoteMedia& media) const;
+
+    /* RFC8445 2.5 a=ice-lite at session level, the peer only answers checks */
+    bool IsIceLite() const { return m_bIceLite; }
 
 private:
-    RemoteMedia* DecodeMediaLine(const std::string& mediaLine, bool bSesUfragPwdExisted);
-    bool DecodeCLine(const std::string& cline);
+    struct MediaSection;
+
+    static uint8_t DecodeIceOptions(boost::string_view options);
+    void DecodeGroup(boost::string_view group);
+    bool IsBundled(boost::string_view mid) const;
+    bool DecodeMediaSection(const MediaSection& section, bool bSesUfragPwdExisted);
+    bool DecodeCandidate(boost::string_view candidate, STUN::RemoteCandidate& cand);
+    bool DecodeCLine(boost::string_view cline);
+    void InternFoundation(boost::string_view foundation, STUN::RemoteCandidate& cand);
 
 private:
+    struct ViewHash {
+        size_t operator()(boost::string_view view) const;
+    };
+
+    struct Foundation {
+        const char *m_Foundation;   /* in m_Arena */
+        uint32_t    m_Id;
+    };
+
+    using FoundationIndex = PG::FlatHash<boost::string_view, Foundation, ViewHash>;   /* keys point into m_Arena */
+
+    PG::Arena            m_Arena;           /* the remote candidates and their foundations */
+    FoundationIndex      m_Foundations;
+    STUN::RemoteFoundationInterner* m_FoundationIds;    /* of the session, outlives the CSDP */
     RemoteMediaContainer m_RemoteMedias;
     std::string          m_IcePwd;
     std::string          m_IceUfrag;
     ConnectContainer     m_Cline;
+    SectionIndexes       m_Skipped;
+    BundleGroups         m_Bundles;
+    uint8_t              m_IceOptions;
+    bool                 m_bIceLite;
 };
\ No newline at end of file
@@ -1,7 +1,23 @@
 #pragma once
 
 #include <map>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+
 #include "streamdef.h"
+#include "checklist.h"
+#include "stream.h"
+#include "consent.h"
+#include "foundation.h"
+
+#include "pg_msg.h"
+#include "pg_timer.h"
+
+class CSDP;
 
 namespace STUN {
     class Candidate;
@@ -10,7 +26,7 @@ namespace STUN {
 namespace ICE {
     class CAgentConfig;
     class Media;
-    class Session
+    class Session : public PG::CListener, private ConsentScheduler::Client
     {
     public:
         class SessionConfig {
@@ -18,6 +34,7 @@ namespace ICE {
             SessionConfig(uint64_t tiebreak, const std::string& defaultIP) :
                 m_Tiebreaker(tiebreak),
                 m_DefaultIP(defaultIP),
+                m_bControlling(true),
                 m_Username("-"),
                 m_SessionName("-")
             {
@@ -74,6 +91,8 @@ namespace ICE {
             }
 
             bool IsControlling() const { return m_bControlling; }
+            void Controlling(bool bControlling) { m_bControlling = bControlling; }
+            uint64_t Tiebreaker() const { return m_Tiebreaker; }
 
         private:
             /* rfc5245 15.4 */
@@ -89,38 +108,126 @@ namespace ICE {
         };
 
     public:
-        class CandidatePeer {
-        public:
-            CandidatePeer(uint64_t PRI, const STUN::Candidate* lcand, const STUN::Candidate* rcand);
-            virtual ~CandidatePeer();
-
-            void Priority(uint64_t pri) { m_PRI = pri; }
-            uint64_t Priority() const { return m_PRI; }
-
-        private:
-            uint64_t m_PRI;
-            const STUN::Candidate *m_LCand;
-            const STUN::Candidate *m_RCand;
+        using MediaContainer        = std::map<std::string, const Media*>;
+        using CheckListContainer    = std::map<std::string, CheckList*>;           /* key = media name */
+        using StreamCheckLists      = std::unordered_map<const Stream*, CheckList*>;
+        using SelectedCandidates    = std::vector<std::pair<uint8_t, TransportAddress>>;   /* component, remote candidate */
+
+        /* fired once, from the consent scheduler thread, when a selected pair lost consent, RFC7675 5.1 */
+        using TeardownHandler       = std::function<void(Session* session, const std::string& media)>;
+
+        /* RFC3264 offer/answer exchange of the session */
+        enum class Negotiation : uint8_t {
+            Stable,         /* no offer outstanding */
+            LocalOffer,     /* our offer is out, ConnectivityCheck takes the answer */
         };
 
-    public:
-        using CandPeerContainer = std::map<uint64_t, CandidatePeer>;/*@uint32_t : PRI*/
-        using MediaContainer = std::map<std::string, const Media*>;
-
     public:
         Session(const std::string& defaultIP);
         virtual ~Session();
 
         bool CreateMedia(const MediaAttr& mediaAttr, const CAgentConfig& config);
-        bool ConnectivityCheck(const std::string& offer);
+
+        /*
+         applies the remote description: the first one or one with new ice-ufrag/ice-pwd forms
+         new checklists, a later one with the same credentials only pairs the candidates it adds
+         and withdraws the ones it dropped, the pairs already checked keep their state
+         */
+        bool ConnectivityCheck(const std::string& offer, const CAgentConfig& config);
+
+        /*
+         RFC8445 9 ICE restart: new credentials for every media and the server candidates
+         gathered again, the host sockets are kept. media goes on over the selected pairs
+         until the ConnectivityCheck with the answer completes the new checklists
+         */
+        bool Restart(const CAgentConfig& config);
         bool MakeOffer(std::string& offer);
-        bool MakeAnswer(const std::string& remoteOffer, std::string& answer);
+        bool MakeAnswer(const std::string& remoteOffer, const CAgentConfig& config, std::string& answer);
+        Negotiation NegotiationState() const { return m_Negotiation; }
         const MediaContainer& GetMedias() const { return m_Medias; }
         const SessionConfig& Config() const { return m_Config; }
 
+        /* RTT, loss and traffic of the selected pair of a component, false if none is selected yet */
+        bool SelectedPairStats(const std::string& media, uint8_t compId, CandPeerTable::Stats& stats);
+
+        /* the remote candidates of the selected pairs of every component, only once a checklist we control completed */
+        bool SelectedRemoteCandidates(const std::string& media, SelectedCandidates& selected) const;
+        void OnTeardown(const TeardownHandler& handler);
+
+    private:
+        void OnEventFired(PG::MsgEntity *pSender, PG::MsgEntity::MSG_ID msg_id, PG::MsgEntity::WPARAM wParam, PG::MsgEntity::LPARAM lParam) override;
+
+        bool ApplyRemote(std::unique_ptr<CSDP> sdp, const CAgentConfig& config, bool bControlling);
+        bool IsUpdate(const CSDP& sdp) const;
+        bool UpdateCheckLists(std::unique_ptr<CSDP> sdp);
+        void StopChecking();
+        void Switchover(const std::string& media);
+        void ReleaseRetired();
+        void OnTaTimer();
+        bool SendCheck(CheckList& checklist, const CheckList::Transaction& transaction);
+        uint32_t CheckRTO(const CheckList& checklist, CheckList::Handle peer) const;
+        void OnBindingResp(CheckList& checklist, const Stream::CheckingPacket& packet, const STUN::MessagePacket& msg);
+        void OnBindingErrResp(CheckList& checklist, const Stream::CheckingPacket& packet, const STUN::MessagePacket& msg);
+        void OnBindingRequest(CheckList& checklist, const Stream::CheckingPacket& packet, const STUN::MessagePacket& msg);
+        void CheckRoleConflict(const STUN::MessagePacket& msg);
+        void SwitchRole(bool bControlling);
+
+        void OnConsentTimer(const ConsentScheduler::CookieList& due) override;
+        void StartConsent(const std::string& media, CheckList& checklist);
+        void StopConsent();
+        bool OnConsentResp(const Stream::CheckingPacket& packet, const STUN::MessagePacket& msg, bool bSuccess);
+        bool SendKeepalive(CheckList& checklist, CheckList::Handle peer);
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        /* RFC7675 consent of a selected pair */
+        struct Consent {
+            std::string         m_Media;
+            CheckList          *m_CheckList;
+            CheckList::Handle   m_Peer;
+            Clock::time_point   m_Fresh;        /* last successful consent check */
+            Clock::time_point   m_LastSent;     /* keepalives are only needed when nothing was sent for Tr */
+            bool                m_bRevoked;
+        };
+
+        struct ConsentTransaction {
+            uint32_t            m_Index;
+            Clock::time_point   m_Sent;
+        };
+
+        using ConsentContainer   = std::vector<Consent>;
+        using ConsentTransactions = std::unordered_map<uint64_t, ConsentTransaction>;   /* key = random part of the transaction id */
+        using ConsentCheckLists  = std::vector<const CheckList*>;
+
     private:
         SessionConfig           m_Config;
         MediaContainer          m_Medias;
-        CandPeerContainer       m_CandPeers;
+        STUN::RemoteFoundationInterner m_RemoteFoundations;   /* declared before the CSDPs which intern in it */
+
+        std::unique_ptr<CSDP>   m_RemoteSDP;       /* owns the remote candidates referenced by the checklists */
+        CheckListContainer      m_CheckLists;
+        CheckListContainer      m_PreviousCheckLists;   /* selected pairs before a restart, until the new checklist completes */
+        std::vector<std::unique_ptr<CSDP>> m_PreviousSDPs;
+        std::vector<std::unique_ptr<CSDP>> m_RemoteUpdates;     /* own the candidates later descriptions added */
+        Negotiation             m_Negotiation;
+        std::atomic_bool        m_bReleaseRetired;
+        StreamCheckLists        m_StreamCheckLists;
+        mutable std::mutex      m_CheckMutex;
+        PG::timer               m_TaTimer;
+        uint16_t                m_NextCheckList;   /* round robin over the checklists, RFC8445 6.1.4.2 */
+        uint16_t                m_RTO;             /* RTO of a pair without RTT sample */
+        uint16_t                m_Ta;
+        uint16_t                m_Rc;
+        uint16_t                m_Rm;
+
+        TeardownHandler         m_TeardownHandler;
+        ConsentContainer        m_Consents;
+        ConsentTransactions     m_ConsentTransactions;
+        ConsentCheckLists       m_ConsentCheckLists;   /* checklists whose selected pairs are monitored */
+        uint16_t                m_Tr;
+        uint16_t                m_ConsentInterval;
+        uint16_t                m_ConsentTimeout;
+        bool                    m_bTeardown;
     };
 }
\ No newline at end of file
@@ -2,21 +2,27 @@
 
 #include <stdint.h>
 #include <unordered_map>
+#include <deque>
+#include <memory>
 #include <assert.h>
 
 #include "streamdef.h"
+#include "candidate.h"
 #include "stunmsg.h"
+#include "responder.h"
 
 #include "pg_msg.h"
 #include "pg_log.h"
 
 namespace STUN {
-    class Candidate;
+    class FoundationInterner;
 }
 
 namespace ICE {
     class CAgentConfig;
     class Channel;
+    class UDPChannel;
+    class TurnClient;
 
     class Stream : public PG::MsgEntity{
     public:
@@ -26,7 +32,17 @@ namespace ICE {
         };
 
     public:
-        using CandidateContainer = std::unordered_map<STUN::Candidate*, ICE::Channel*>;
+        using CandidateContainer = std::unordered_map<const STUN::Candidate*, ICE::Channel*>;
+        using TurnClientContainer = std::unordered_map<const STUN::Candidate*, TurnClient*>;  /* relayed candidate -> its allocation */
+        using CheckingThreads = std::unordered_map<const STUN::Candidate*, std::thread>;
+
+        /* carried by Message::Checking, only valid during the notification */
+        struct CheckingPacket {
+            const STUN::Candidate                *m_LCand;
+            const boost::asio::ip::udp::endpoint &m_From;
+            const STUN::PACKET::stun_packet      &m_Packet;
+            uint16_t                              m_Size;
+        };
 
     public:
         Stream(uint8_t compId, Protocol protocol, uint16_t localPref, const std::string& hostIp, uint16_t hostPort);
@@ -35,12 +51,27 @@ namespace ICE {
         bool Create(const CAgentConfig& config);
         bool GatheringCandidate(const CAgentConfig& config);
 
+        /*
+         RFC8445 9 ICE restart: the host candidates keep their sockets, the server reflexive
+         and relayed ones are retired and gathered again in the background,
+         Message::Gathering is fired when done. the retired candidates keep their
+         sockets and checking threads, so media goes on over them until ReleaseRetired
+         */
+        bool Regather(const CAgentConfig& config);
+        void ReleaseRetired();
+
         std::string GetHostIP() const { return std::string(); }
         uint16_t    GetHostPort() const  { return m_HostPort;}
-        std::string GetTransportProtocol() const { return "RTP/SVAP";}
+        const char* GetTransportProtocol() const { return "RTP/SVAP";}
         std::string GetFmtDescription() const { return "0"; }
         const CandidateContainer& GetCandidates() const { return m_Cands; }
         bool IsUDP() const { return m_Protocol == Protocol::udp;}
+        uint8_t ComponentId() const { return m_CompId; }
+        BindingResponder& Responder() { return m_Responder; }
+
+        bool StartChecking();
+        void StopChecking();
+        bool SendData(const STUN::Candidate* lcand, const STUN::MessagePacket& msg, const std::string& ip, uint16_t port);
 
     public:
         template<class T>
@@ -114,12 +145,21 @@ namespace ICE {
         };
 
         bool CheckConnectivity(Stream* pThis);
-        bool GatherHostCandidate(const std::string &ip, uint16_t port, Protocol protocol);
+        bool IsMultihomed() const;
+        bool GatherHostCandidates(const CAgentConfig& config);
+        bool GatherServerCandidates(const CAgentConfig& config);
+        bool GatherHostCandidate(const std::string &ip, uint16_t port, Protocol protocol, uint16_t localPref);
         bool GatherReflexiveCandidate(const std::string &ip, uint16_t lowerPort, uint16_t upperPort, const std::string& stunIP, uint16_t stunPort);
-        bool GatherRelayedCandidate(const std::string &ip, uint16_t lowerPort, uint16_t upperPort, const std::string& turnServer, uint16_t turnPort);
+        bool GatherRelayedCandidate(const std::string &ip, uint16_t lowerPort, uint16_t upperPort, const std::string& turnServer, uint16_t turnPort,
+            const std::string& username, const std::string& password);
+        const STUN::Candidate* AddCandidate(const STUN::Candidate& cand, Channel *channel, TurnClient *turn);
+        void OnCheckingPacket(const STUN::Candidate *lcand, UDPChannel *channel, TurnClient *turn, const boost::asio::ip::udp::endpoint& from,
+            const STUN::PACKET::stun_packet& packet, uint16_t size, STUN::PACKET::stun_packet& response);
 
     private:
         static void WaitGatheringDoneThread(Stream *pThis);
+        static void CheckingThread(Stream *pThis, const STUN::Candidate *lcand, UDPChannel *channel, TurnClient *turn);
+        static void TurnGatheringThread(Stream *pThis, TurnClient *turn, UDPChannel *channel);
 
     private:
         class StunGatherHelper;
@@ -143,9 +183,19 @@ namespace ICE {
         const std::string       m_HostIP;
         const int16_t           m_HostPort;
         const uint16_t          m_LocalPref;
+        uint16_t                m_ServerLocalPref;  /* of the default ip the server candidates are gathered on */
+        std::shared_ptr<STUN::FoundationInterner> m_Foundations;  /* of the agent, set by GatheringCandidate and Regather */
         std::thread             m_GatherThrd;
         std::mutex              m_CandsMutex;
+
+        /*
+         the candidates themselves, by value. a deque never moves its elements when it grows,
+         the checklists and the checking threads keep pointers to them, released slots are reused
+         */
+        std::deque<STUN::Candidate>     m_CandStore;
+        std::vector<STUN::Candidate*>   m_FreeCands;
         CandidateContainer      m_Cands;
+        CandidateContainer      m_RetiredCands;     /* replaced by Regather, still carrying media */
         std::atomic<State>      m_State;
         std::atomic_bool        m_Quit;
 
@@ -163,6 +213,11 @@ namespace ICE {
         std::mutex              m_WaitingGatherMutex;
         std::condition_variable m_WaitingGatherCond;
 
+        CheckingThreads         m_CheckingThrds;
+        std::vector<std::thread> m_TurnGatherThrds;
+        TurnClientContainer     m_TurnClients;
+        BindingResponder        m_Responder;
+
     private:
         static const uint16_t m_MaxTries = 5;
 
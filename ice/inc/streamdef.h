@@ -15,6 +15,26 @@ namespace ICE {
         tcp_pass
     };
 
+    /* RFC8445 8.1.1.  Nominating Pairs */
+    enum class Nomination : uint8_t {
+        regular,         /* nominate the best valid pair once no higher-priority pair is pending */
+        first_succeeded, /* nominate the first succeeded pair above the threshold, switch to a better one later */
+    };
+
+    /* binary transport address, IPv4 is kept as IPv4-mapped IPv6, text only for SDP, logs and sockets */
+    struct TransportAddress {
+        uint8_t  m_IP[16];
+        uint16_t m_Port;
+
+        static bool Parse(const char* ip, uint16_t port, TransportAddress& address);
+        static bool Parse(const std::string& ip, uint16_t port, TransportAddress& address) { return Parse(ip.c_str(), port, address); }
+
+        bool        IsIPv4() const;
+        std::string IP() const;
+        bool operator==(const TransportAddress& other) const;
+        bool operator!=(const TransportAddress& other) const { return !(*this == other); }
+    };
+
     struct MediaAttr{
         struct StreamAttr {
             Protocol    m_Protocol;
@@ -25,5 +45,7 @@ namespace ICE {
 
         std::string             m_Name;
         std::vector<StreamAttr> m_StreamAttrs;
+        std::string             m_Bundle;       /* RFC8843, a media created before whose transport this one shares, no streams of its own */
+        bool                    m_bRtcpMux;     /* RFC5761, rtcp goes over the rtp component, the other components are not created */
     };
 }
\ No newline at end of file
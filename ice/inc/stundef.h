@@ -38,13 +38,20 @@ namespace STUN {
     };
 
     enum class ErrorCode : uint16_t {
-        BadRequest = 404,
+        BadRequest = 400,
         Unauthorized = 401,
         UnknownAttribute = 420,
         StaleCredentials = 430,
         IntegrityCheckFailure = 431,
         MissingUsername = 432,
         UseTLS = 433,
+        AllocationMismatch = 437,       /* RFC8656 18 */
+        StaleNonce = 438,
+        WrongCredentials = 441,
+        UnsupportedTransport = 442,
+        AllocationQuotaReached = 486,
+        RoleConflict = 487, /* RFC8445 7.3.1.1 */
+        InsufficientCapacity = 508,
         ServerError = 500,
         GlobalFailure = 600,
     };
@@ -54,9 +61,26 @@ namespace STUN {
         BindingRequest  = 0x0001,
         BindingResp     = 0x0101,
         BindingErrResp  = 0x0111,
+        BindingIndication = 0x0011,   /* RFC8445 11 keepalive */
         SSRequest       = 0x0002,
         SSResponse      = 0x0102,
         SSErrResp       = 0x1102,
+
+        /* RFC8656 17 */
+        AllocateRequest         = 0x0003,
+        AllocateResp            = 0x0103,
+        AllocateErrResp         = 0x0113,
+        RefreshRequest          = 0x0004,
+        RefreshResp             = 0x0104,
+        RefreshErrResp          = 0x0114,
+        SendIndication          = 0x0016,
+        DataIndication          = 0x0017,
+        CreatePermissionRequest = 0x0008,
+        CreatePermissionResp    = 0x0108,
+        CreatePermissionErrResp = 0x0118,
+        ChannelBindRequest      = 0x0009,
+        ChannelBindResp         = 0x0109,
+        ChannelBindErrResp      = 0x0119,
     };
 
     enum class AddressFamily : uint8_t {
@@ -100,10 +124,18 @@ namespace STUN {
             UnknownAttributes = 0x000A,
             ReflectedFrom = 0x000B,
 
+            ChannelNumber = 0x000C,      /* RFC8656 18 */
+            Lifetime = 0x000D,
+            XorPeerAddress = 0x0012,
+            Data = 0x0013,
+            XorRelayedAddress = 0x0016,
+            RequestedTransport = 0x0019,
+            DontFragment = 0x001A,
+
             Realm = 0x0014,
             Nonce = 0x0015,
 
-            XorMappedAddress = 0x8020,
+            XorMappedAddress = 0x0020, /* RFC5389 15.2 */
 
             Software = 0x8022,
             AlternateServer = 0x8023,
@@ -138,7 +170,7 @@ namespace STUN {
 
             void ContentLength(uint16_t length)
             {
-                m_length = PG::network_to_host(m_length);
+                m_length = PG::host_to_network(length);
             }
 
             Id Type() const
@@ -164,7 +196,7 @@ namespace STUN {
         class MappedAddress : public Header {
         public:
             MappedAddress(Id id = Id::MappedAddress) :
-                Header(id, 8)
+                Header(id, 8), m_Reserved(0), m_Family(static_cast<uint8_t>(AddressFamily::IPv4)), m_Port(0), m_Address(0)
             {}
 
             int16_t Port() const
@@ -190,7 +222,7 @@ namespace STUN {
 
             void Address(uint32_t address)
             {
-                m_Address = PG::host_to_network(m_Address);
+                m_Address = PG::host_to_network(address);
             }
 
             AddressFamily Family() const
@@ -198,8 +230,13 @@ namespace STUN {
                 return  static_cast<AddressFamily>(m_Family);
             }
 
+            void Family(AddressFamily family)
+            {
+                m_Family = static_cast<uint8_t>(family);
+            }
+
         private:
-            unsigned : 8;
+            unsigned m_Reserved : 8;
             unsigned m_Family : 8;
             unsigned m_Port :   16;
             unsigned m_Address : 32;
@@ -315,6 +352,11 @@ namespace STUN {
                 Header(Id::MessageIntegrity, sSHA1Size)
             {}
 
+            const uint8_t* Digest() const
+            {
+                return m_SHA1;
+            }
+
         private:
             SHA1 m_SHA1;
         };
@@ -336,14 +378,14 @@ namespace STUN {
 
             uint32_t Class() const
             {
-                return m_Class;
+                return m_Class & 0x07;
             }
 
             void Class(uint16_t classCode)
             {
                 assert(classCode >= 3 && classCode <= 6);
 
-                m_Class = classCode;
+                m_Class = static_cast<uint8_t>(classCode);
             }
 
             uint32_t Number() const
@@ -354,7 +396,12 @@ namespace STUN {
             void Number(uint16_t number)
             {
                 assert(number >= 0 && number <= 99);
-                m_Number = number;
+                m_Number = static_cast<uint8_t>(number);
+            }
+
+            uint16_t Code() const
+            {
+                return static_cast<uint16_t>(Class() * 100 + Number());
             }
 
             void Reason(const std::string& reason)
@@ -373,10 +420,9 @@ namespace STUN {
             }
 
         private:
-            unsigned int : 16;
-            unsigned int m_Class : 3;
-            unsigned int : 5;
-            unsigned int m_Number: 8;
+            uint16_t m_Reserved;
+            uint8_t  m_Class;   /* high 5 bits reserved */
+            uint8_t  m_Number;
             uint8_t  m_Reason[0];
         };
 
@@ -413,14 +459,14 @@ namespace STUN {
                 memcpy(m_Realm, realm.data(), len);
             }
 
-            std::string& GetRealm() const
+            std::string GetRealm() const
             {
                 assert(ContentLength());
                 return std::string(reinterpret_cast<const char*>(m_Realm), ContentLength());
             }
 
         private:
-            char* m_Realm[0];
+            char m_Realm[0];
         };
 
         class Nonce : public Header {
@@ -437,7 +483,7 @@ namespace STUN {
                 memcpy(m_Nonce, realm.data(), len);
             }
 
-            std::string& GetNonce() const
+            std::string GetNonce() const
             {
                 assert(ContentLength());
                 return std::string(reinterpret_cast<const char*>(m_Nonce), ContentLength());
@@ -448,8 +494,8 @@ namespace STUN {
 
         class XorMappedAddress : public Header {
         public:
-            XorMappedAddress() :
-                Header(Id::XorMappedAddress, 4)
+            XorMappedAddress(Id id = Id::XorMappedAddress) :
+                Header(id, 8), m_Reserved(0), m_Family(static_cast<uint8_t>(AddressFamily::IPv4)), m_Port(0), m_Address(0)
             {}
 
             uint16_t Port() const
@@ -483,18 +529,38 @@ namespace STUN {
                 return  static_cast<AddressFamily>(m_Family);
             }
 
+            void Family(AddressFamily family)
+            {
+                m_Family = static_cast<uint8_t>(family);
+            }
+
             const uint8_t* RawData() const
             {
                 return reinterpret_cast<const uint8_t*>(this);
             }
 
         private:
-            unsigned :8;
+            unsigned m_Reserved : 8;
             unsigned m_Family : 8;
             unsigned m_Port   : 16;
             unsigned m_Address: 32;
         };
 
+        /* RFC8656 14.3 / 14.5, same layout as XOR-MAPPED-ADDRESS */
+        class XorPeerAddress : public XorMappedAddress {
+        public:
+            XorPeerAddress() :
+                XorMappedAddress(Id::XorPeerAddress)
+            {}
+        };
+
+        class XorRelayedAddress : public XorMappedAddress {
+        public:
+            XorRelayedAddress() :
+                XorMappedAddress(Id::XorRelayedAddress)
+            {}
+        };
+
         class Software : public Header {
         public:
             Software() :
@@ -530,6 +596,11 @@ namespace STUN {
                 Header(Id::Fingerprint, 4)
             {}
 
+            uint32_t CRC32() const
+            {
+                return PG::network_to_host(m_CRC32);
+            }
+
         private:
             uint32_t m_CRC32;
         };
@@ -575,6 +646,54 @@ namespace STUN {
             uint64_t m_Tiebreaker;
         };
 
+        /* RFC8656 14.2 LIFETIME in seconds */
+        class Lifetime : public Header {
+        public:
+            Lifetime(uint32_t lifetime = 0) :
+                Header(Id::Lifetime, 4), m_Lifetime(PG::host_to_network(lifetime))
+            {}
+
+            uint32_t Seconds() const
+            {
+                return PG::network_to_host(m_Lifetime);
+            }
+
+        private:
+            uint32_t m_Lifetime;
+        };
+
+        /* RFC8656 14.7 REQUESTED-TRANSPORT, the protocol number followed by 3 bytes RFFU */
+        class RequestedTransport : public Header {
+        public:
+            RequestedTransport(uint8_t protocol = 17 /* UDP */) :
+                Header(Id::RequestedTransport, 4), m_Protocol(PG::host_to_network(static_cast<uint32_t>(protocol) << 24))
+            {}
+
+            uint8_t Protocol() const
+            {
+                return static_cast<uint8_t>(PG::network_to_host(m_Protocol) >> 24);
+            }
+
+        private:
+            uint32_t m_Protocol;
+        };
+
+        /* RFC8656 14.1 CHANNEL-NUMBER, the number followed by 2 bytes RFFU */
+        class ChannelNumber : public Header {
+        public:
+            ChannelNumber(uint16_t channel = 0) :
+                Header(Id::ChannelNumber, 4), m_Channel(PG::host_to_network(static_cast<uint32_t>(channel) << 16))
+            {}
+
+            uint16_t Channel() const
+            {
+                return static_cast<uint16_t>(PG::network_to_host(m_Channel) >> 16);
+            }
+
+        private:
+            uint32_t m_Channel;
+        };
+
     }
 
     namespace PACKET {
@@ -2,6 +2,7 @@
 
 #include "pg_log.h"
 #include "stundef.h"
+#include "pg_crypto.h"
 
 #include <type_traits>
 #include <unordered_map>
@@ -66,9 +67,16 @@ namespace STUN {
         const ATTR::MappedAddress*    GetAttribute(const ATTR::MappedAddress*& mapAddr) const;
         const ATTR::ChangeRequest*    GetAttribute(const ATTR::ChangeRequest*& changeReq) const;
         const ATTR::XorMappedAddress* GetAttribute(const ATTR::XorMappedAddress*& xorMap) const;
+        const ATTR::XorPeerAddress*   GetAttribute(const ATTR::XorPeerAddress*& peer) const;
+        const ATTR::XorRelayedAddress* GetAttribute(const ATTR::XorRelayedAddress*& relayed) const;
+        const ATTR::Lifetime*         GetAttribute(const ATTR::Lifetime*& lifetime) const;
+        const ATTR::ChannelNumber*    GetAttribute(const ATTR::ChannelNumber*& channel) const;
+        const ATTR::RequestedTransport* GetAttribute(const ATTR::RequestedTransport*& transport) const;
+        bool                          GetDataAttribute(const uint8_t*& data, uint16_t& size) const;
         const ATTR::Role*             GetAttribute(const ATTR::Role*& role) const;
         const ATTR::Priority*         GetAttribute(const ATTR::Priority*& pri) const;
         const ATTR::UseCandidate*     GetAttribute(const ATTR::UseCandidate*& useCan) const;
+        const ATTR::ErrorCode*        GetAttribute(const ATTR::ErrorCode*& errCode) const;
         const ATTR::Software*         GetAttribute(const ATTR::Software*& software) const;
         const ATTR::Realm*            GetAttribute(const ATTR::Realm*& realm) const;
         const ATTR::Nonce*            GetAttribute(const ATTR::Nonce*& nonce) const;
@@ -91,6 +99,10 @@ namespace STUN {
             AddAttribute(attr);
         }
         void AddAttribute(const ATTR::UseCandidate &attr);
+        void AddAttribute(const ATTR::Lifetime &attr);
+        void AddAttribute(const ATTR::RequestedTransport &attr);
+        void AddAttribute(const ATTR::ChannelNumber &attr);
+        void AddData(const void* data, uint16_t size);
 
         void AddSoftware(const std::string& desc);
         void AddRealm(const std::string& realm);
@@ -100,10 +112,17 @@ namespace STUN {
         void AddUsername(const std::string& username);
         void AddUnknownAttributes(std::vector<ATTR::Id> unknownattributes);
 
+        /* MUST be the last ones added, in this order */
+        void AddMessageIntegrity(const std::string& key);
+        void AddFingerprint();
+
         static void GenerateRFC5389TransationId(TransIdRef id);
         static void GenerateRFC3489TransationId(TransIdRef id);
         static void ComputeSHA1(const MessagePacket &packet, const std::string& key, SHA1Ref sha1);
         static bool VerifyMsgIntegrity(const MessagePacket &packet, const std::string& key);
+        static bool VerifyFingerprint(const MessagePacket &packet);
+        static void ComputeMsgIntegrity(const PACKET::stun_packet& packet, uint16_t offset, const std::string& key, SHA1& sha1);
+        static uint32_t ComputeFingerprint(const PACKET::stun_packet& packet, uint16_t offset);
         static bool IsValidStunPacket(const PACKET::stun_packet& packet, uint16_t packet_size);
 
     protected:
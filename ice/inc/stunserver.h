@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+
+#include "stundef.h"
+#include "channel.h"
+
+namespace STUN {
+    /*
+     RFC5389 Binding server, enough for gathering server reflexive candidates
+     without a public STUN server, optionally pretending to sit behind a NAT
+     */
+    class Server {
+    public:
+        /* RFC4787 4.1 mapping behaviours */
+        enum class NatMapping : uint8_t {
+            None,                   /* reflect the source address */
+            EndpointIndependent,    /* same mapping for a source whatever the server address */
+            AddressPortDependent,   /* "symmetric", the mapping also depends on the server address */
+        };
+
+    public:
+        Server(const std::string& ip, uint16_t port, uint16_t workers = 1);
+        virtual ~Server();
+
+        /* MUST be called before Start */
+        bool SimulateNat(NatMapping mapping, const std::string& publicIP, uint16_t lowPort, uint16_t upperPort);
+
+        bool Start();
+        void Stop();
+        bool IsRunning() const { return !m_WorkerThrds.empty(); }
+        uint64_t Answered() const { return m_Answered; }
+
+        const std::string& IP() const { return m_IP; }
+        uint16_t Port() const { return m_Port; }
+
+    private:
+        static const uint32_t sPollInterval = 100;  /* ms, the workers notice Stop within it */
+
+        static void WorkerThread(Server *pThis);
+        bool Answer(const PACKET::stun_packet& request, uint16_t size, const boost::asio::ip::udp::endpoint& from);
+        bool Map(const boost::asio::ip::udp::endpoint& from, uint32_t& ip, uint16_t& port) const;
+
+    private:
+        const std::string           m_IP;
+        const uint16_t              m_Port;
+        const uint16_t              m_Workers;
+        ICE::UDPChannel             m_Channel;
+        std::vector<std::thread>    m_WorkerThrds;
+        std::atomic_bool            m_Quit;
+        std::atomic<uint64_t>       m_Answered;
+
+        NatMapping                  m_Mapping;
+        uint32_t                    m_PublicIP;
+        uint16_t                    m_LowPort;
+        uint16_t                    m_UpperPort;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <mutex>
+#include <chrono>
+
+#include "stunmsg.h"
+#include "pg_timer.h"
+
+namespace ICE {
+    class UDPChannel;
+
+    /*
+     RFC8656 TURN client over UDP with long-term credentials
+     Allocate is blocking and reads the channel itself, it MUST run before anybody else
+     reads the channel; afterwards the reader of the channel hands TURN responses,
+     ChannelData and Data indications to the client
+     */
+    class TurnClient {
+    public:
+        using Endpoint = boost::asio::ip::udp::endpoint;
+        using Clock    = std::chrono::steady_clock;
+
+        static const uint32_t sDefaultLifetime          = 600;    /* seconds, RFC8656 3.2 */
+        static const uint32_t sPermissionRefresh        = 240;    /* permissions last 300s, RFC8656 9 */
+        static const uint32_t sChannelRefresh           = 240;    /* bindings last 600s and refresh the permission, RFC8656 12 */
+        static const uint16_t sMinChannel               = 0x4000;
+        static const uint16_t sMaxChannel               = 0x4FFF;
+        static const uint16_t sChannelDataHeaderLength  = 4;
+
+    public:
+        TurnClient(UDPChannel *channel, const std::string& serverIP, uint16_t serverPort, const std::string& username, const std::string& password);
+        virtual ~TurnClient();
+
+        bool Allocate(uint32_t lifetime = sDefaultLifetime);
+        void Release();
+
+        bool CreatePermission(const Endpoint& peer);
+        bool ChannelBind(const Endpoint& peer);
+
+        /* relays to peer, ChannelData once the channel is bound, a Send indication before */
+        int16_t Send(const Endpoint& peer, const void* data, uint16_t size);
+
+        /* true if the packet is a response to one of our TURN requests */
+        bool OnStunPacket(const STUN::PACKET::stun_packet& packet, uint16_t size);
+        bool OnChannelData(const void* data, uint16_t size, Endpoint& peer, const uint8_t*& payload, uint16_t& payloadSize) const;
+        bool OnDataIndication(const STUN::MessagePacket& msg, Endpoint& peer, const uint8_t*& payload, uint16_t& payloadSize) const;
+
+        static bool IsChannelData(const void* data, uint16_t size);
+
+        bool IsAllocated() const { return m_bAllocated; }
+        const std::string& ServerIP()   const { return m_ServerIP; }
+        const std::string& RelayedIP()  const { return m_RelayedIP; }
+        uint16_t           RelayedPort() const { return m_RelayedPort; }
+        const std::string& MappedIP()   const { return m_MappedIP; }
+        uint16_t           MappedPort() const { return m_MappedPort; }
+
+    private:
+        struct Request {
+            STUN::MsgType           m_Type;
+            Endpoint                m_Peer;
+            uint16_t                m_Channel;
+            uint32_t                m_Lifetime;
+            uint16_t                m_Sent;
+            uint32_t                m_RTO;
+            Clock::time_point       m_Expire;
+            std::vector<uint8_t>    m_Data;
+        };
+
+        struct Binding {
+            uint16_t            m_Channel;
+            bool                m_bBound;
+            Clock::time_point   m_Refresh;
+        };
+
+        using RequestContainer    = std::unordered_map<uint64_t, Request>;   /* key = random part of the transaction id */
+        using BindingContainer    = std::map<Endpoint, Binding>;
+        using ChannelContainer    = std::unordered_map<uint16_t, Endpoint>;
+        using PermissionContainer = std::map<boost::asio::ip::address, Clock::time_point>;
+
+    private:
+        static uint64_t TransactionKey(STUN::TransIdConstRef id);
+        bool Transact(const STUN::MessagePacket& request, STUN::PACKET::stun_packet& response, uint16_t& size);
+        bool UpdateNonce(const STUN::MessagePacket& msg);
+        bool OnAllocated(const STUN::MessagePacket& msg);
+        void Sign(STUN::MessagePacket& msg) const;
+
+        /* m_Mutex MUST be held */
+        bool SendRequest(STUN::MsgType type, const Endpoint& peer, uint16_t channel, uint32_t lifetime);
+        void OnResponse(const Request& request, STUN::MsgType type, const STUN::MessagePacket& msg);
+        void OnTimer();
+
+    private:
+        UDPChannel             *m_Channel;
+        const Endpoint          m_Server;
+        const std::string       m_ServerIP;
+        const std::string       m_Username;
+        const std::string       m_Password;
+
+        mutable std::mutex      m_Mutex;
+        std::string             m_Realm;
+        std::string             m_Nonce;
+        std::string             m_Key;          /* MD5(username:realm:password), RFC5389 15.4 */
+
+        bool                    m_bAllocated;
+        std::string             m_RelayedIP;
+        uint16_t                m_RelayedPort;
+        std::string             m_MappedIP;
+        uint16_t                m_MappedPort;
+        uint32_t                m_Lifetime;
+        Clock::time_point       m_RefreshAt;
+
+        RequestContainer        m_Requests;
+        BindingContainer        m_Bindings;
+        ChannelContainer        m_ChannelPeers;
+        PermissionContainer     m_Permissions;
+        uint16_t                m_NextChannel;
+        PG::timer               m_Timer;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <atomic>
+
+#include "stundef.h"
+
+namespace STUN {
+    class MessagePacket;
+
+    /*
+     RFC8656 TURN relay over UDP with long-term credentials.
+     the server runs N shards, each one owns a listening socket bound with SO_REUSEPORT,
+     an io_service, its own allocation table and timing wheel, so a client always lands
+     on the same shard and the data path never takes a lock.
+     ChannelData from clients is forwarded without any STUN parsing.
+     addresses are IPv4 only, the codec does not encode IPv6 address attributes
+     */
+    class TurnServer {
+    public:
+        static const uint32_t sDefaultLifetime      = 600;     /* RFC8656 3.2 */
+        static const uint32_t sMaxLifetime          = 3600;
+        static const uint32_t sPermissionLifetime   = 300;     /* RFC8656 9 */
+        static const uint32_t sChannelLifetime      = 600;     /* RFC8656 12 */
+        static const uint16_t sMaxPermissions       = 64;      /* per allocation */
+        static const uint16_t sMaxChannels          = 64;      /* per allocation */
+
+    public:
+        TurnServer(const std::string& ip, uint16_t port, const std::string& relayIP, const std::string& realm, uint16_t shards = 1);
+        virtual ~TurnServer();
+
+        /* MUST be called before Start */
+        void AddUser(const std::string& username, const std::string& password);
+
+        bool Start();
+        void Stop();
+        bool IsRunning() const { return !m_Shards.empty(); }
+
+        uint64_t Relayed() const;
+        uint64_t Allocations() const;
+
+        const std::string& IP() const { return m_IP; }
+        uint16_t Port() const { return m_Port; }
+
+    private:
+        using Endpoint = boost::asio::ip::udp::endpoint;
+
+        struct Shard;
+        struct Allocation;
+        using AllocationPtr = std::shared_ptr<Allocation>;
+
+        /*
+         the server address and the protocol are the same for every allocation,
+         so the 5-tuple reduces to client ip:port and the listening port packed in 64 bits
+         */
+        static uint64_t FiveTuple(const Endpoint& client, uint16_t serverPort);
+
+        void Receive(Shard& shard);
+        void ReceivePeer(Shard& shard, const AllocationPtr& allocation);
+        void Tick(Shard& shard);
+
+        void OnClientPacket(Shard& shard, const uint8_t* data, uint16_t size, const Endpoint& from);
+        void OnPeerPacket(Shard& shard, Allocation& allocation, uint16_t size, const Endpoint& from);
+        void OnRequest(Shard& shard, const PACKET::stun_packet& packet, uint16_t size, const Endpoint& from);
+        void OnSendIndication(Shard& shard, const PACKET::stun_packet& packet, uint16_t size, const Endpoint& from);
+        void OnBindingRequest(Shard& shard, const PACKET::stun_packet& packet, const Endpoint& from);
+
+        bool Authenticate(Shard& shard, const MessagePacket& msg, const Endpoint& from, std::string& username, const std::string*& key);
+        void OnAllocate(Shard& shard, const MessagePacket& msg, const Endpoint& from, const std::string& username, const std::string& key);
+        void OnRefresh(Shard& shard, Allocation& allocation, const MessagePacket& msg, const Endpoint& from);
+        void OnCreatePermission(Shard& shard, Allocation& allocation, const MessagePacket& msg, const Endpoint& from);
+        void OnChannelBind(Shard& shard, Allocation& allocation, const MessagePacket& msg, const Endpoint& from);
+
+        bool InstallPermission(Shard& shard, Allocation& allocation, uint32_t address);
+        bool IsPermitted(const Shard& shard, const Allocation& allocation, uint32_t address) const;
+        void Schedule(Shard& shard, Allocation& allocation, uint32_t lifetime);
+        void Deallocate(Shard& shard, uint64_t tuple);
+
+        void SendError(Shard& shard, MsgType type, TransIdConstRef id, ErrorCode code, const char* reason, const Endpoint& to,
+            const std::string* key = nullptr);
+        void SendResponse(Shard& shard, MessagePacket& msg, const std::string& key, const Endpoint& to);
+
+    private:
+        const std::string           m_IP;
+        const uint16_t              m_Port;
+        const std::string           m_RelayIP;
+        const std::string           m_Realm;
+        const uint16_t              m_ShardCnt;
+        std::string                 m_Nonce;
+        std::unordered_map<std::string, std::string> m_Keys;   /* username -> MD5(username:realm:password) */
+        std::vector<std::unique_ptr<Shard>> m_Shards;
+    };
+}
@@ -1,59 +1,11 @@
 #include "agent.h"
+#include "foundation.h"
 #include "pg_log.h"
 
 #include <fstream>
 #include <boost/filesystem.hpp>
 #include <boost/asio.hpp>
 
-namespace{
-    std::string GetDefaultIPAddress(bool bSupportIPv4)
-    {
-        using boost::asio::ip::tcp;
-
-        boost::asio::io_service io_service;
-        tcp::resolver resolver(io_service);
-        tcp::resolver::query query(boost::asio::ip::host_name(), "");
-        tcp::resolver::iterator itor = resolver.resolve(query);
-        tcp::resolver::iterator end;
-
-        while (itor != end)
-        {
-            auto ep = *itor++;
-            auto ep_address = ep.endpoint().address();
-
-            /*
-            Addresses from a loopback interface MUST NOT be included in the
-            candidate addresses
-            */
-            if (ep_address.is_loopback())
-                continue;
-
-            if (ep_address.is_v6())
-            {
-                /*
-                Deprecated IPv4-compatible IPv6 addresses [RFC4291] and IPv6 sitelocal
-                unicast addresses [RFC3879] MUST NOT be included in the
-                address candidates
-
-
-                IPv4-mapped IPv6 addresses SHOULD NOT be included in the address
-                candidates unless the application using ICE does not support IPv4
-                (i.e., it is an IPv6-only application [RFC4038]).
-                */
-
-                auto ipv6 = ep_address.to_v6();
-                if (ipv6.is_v4_compatible() || ipv6.is_site_local() || ipv6.is_link_local() || (bSupportIPv4 && ipv6.is_v4_mapped()))
-                    continue;
-            }
-            else if (0 == ep_address.to_string().find("169.254"))  // ipv4 lock-link
-                continue;
-
-            return ep.endpoint().address().to_string();
-        }
-        return std::string();
-    }
-}
-
 namespace ICE {
 
     CAgentConfig::CAgentConfig() :
@@ -62,11 +14,21 @@ namespace ICE {
         m_Rm(sDefaultRm),
         m_Ti(sDefaultTi),
         m_Rc(sDefaultRc),
+        m_Tr(sDefaultTr),
+        m_consent_interval(sConsentInterval),
+        m_consent_timeout(sConsentTimeout),
         m_cand_pairs_limits(sCandPairsLimits),
         m_ipv4_supported(sIPv4Supported),
-        m_PortRange(sLowerPort, sUpperPort)
+        m_nomination(Nomination::regular),
+        m_nomination_threshold(0),
+        m_family_interleave(sFamilyInterleave),
+        m_role(STUN::AgentRole::Controlling),
+        m_PortRange(sLowerPort, sUpperPort),
+        m_foundations(std::make_shared<STUN::FoundationInterner>())
     {
-        m_default_address = GetDefaultIPAddress(sIPv4Supported);
+        InterfaceMonitor::AddressList addresses;
+        InterfaceMonitor::Enumerate(sIPv4Supported, addresses);
+        LocalAddresses(addresses);
     }
 
     CAgentConfig::CAgentConfig(const CAgentConfig & config)
@@ -77,13 +39,24 @@ namespace ICE {
         m_Rm    = config.m_Rm;
         m_Ti    = config.m_Ti;
         m_Rc    = config.m_Rc;
+        m_Tr    = config.m_Tr;
 
-        m_cand_pairs_limits = config.m_Rc;
+        m_consent_interval  = config.m_consent_interval;
+        m_consent_timeout   = config.m_consent_timeout;
+
+        m_cand_pairs_limits = config.m_cand_pairs_limits;
         m_ipv4_supported    = config.m_ipv4_supported;
         m_default_address   = config.m_default_address;
+        m_local_addresses   = config.m_local_addresses;
+        m_nomination        = config.m_nomination;
+        m_nomination_threshold = config.m_nomination_threshold;
+        m_family_interleave = config.m_family_interleave;
+        m_role              = config.m_role;
 
         m_stun_servers = config.m_stun_servers;
         m_turn_servers = config.m_turn_servers;
+        m_turn_credentials = config.m_turn_credentials;
+        m_foundations  = config.m_foundations;
     }
 
     bool CAgentConfig::LoadConfigFile(const std::string & config_file)
@@ -95,13 +68,48 @@ namespace ICE {
         }
 
         if (!m_default_address.length())
-            m_default_address = GetDefaultIPAddress(m_ipv4_supported);
+        {
+            InterfaceMonitor::AddressList addresses;
+            InterfaceMonitor::Enumerate(m_ipv4_supported, addresses);
+            LocalAddresses(addresses);
+        }
 
         assert(m_default_address.length());
 
         return true;
     }
 
+    void CAgentConfig::LocalAddresses(const InterfaceMonitor::AddressList & addresses)
+    {
+        m_local_addresses = addresses;
+        if (addresses.empty())
+        {
+            LOG_WARNING("Agent", "no usable local address");
+            return;
+        }
+
+        // the servers are mostly reached over IPv4, the default stays IPv4 while it is supported
+        m_default_address = addresses.front().m_IP;
+        for (auto itor = addresses.begin(); m_ipv4_supported && itor != addresses.end(); ++itor)
+        {
+            if (!itor->m_bIPv6)
+            {
+                m_default_address = itor->m_IP;
+                break;
+            }
+        }
+    }
+
+    uint16_t CAgentConfig::LocalPreference(const std::string & ip, uint16_t preference) const
+    {
+        for (auto itor = m_local_addresses.begin(); itor != m_local_addresses.end(); ++itor)
+        {
+            if (itor->m_IP == ip)
+                return itor->m_LocalPref;
+        }
+        return preference;
+    }
+
     bool CAgentConfig::AddStunServer(const std::string & stun, int port /*= 3478*/)
     {
         return AddServer(m_stun_servers, stun, port);
@@ -112,6 +120,26 @@ namespace ICE {
         return AddServer(m_turn_servers, turn, port);
     }
 
+    bool CAgentConfig::AddTurnServer(const std::string & turn, int port, const std::string & username, const std::string & password)
+    {
+        if (!AddServer(m_turn_servers, turn, port))
+            return false;
+
+        m_turn_credentials[turn] = std::make_pair(username, password);
+        return true;
+    }
+
+    bool CAgentConfig::TurnCredential(const std::string & turn, std::string & username, std::string & password) const
+    {
+        auto itor = m_turn_credentials.find(turn);
+        if (itor == m_turn_credentials.end())
+            return false;
+
+        username = itor->second.first;
+        password = itor->second.second;
+        return true;
+    }
+
     bool CAgentConfig::AddServer(ServerContainer & serverContainer, const std::string & server, int port)
     {
         if (serverContainer.find(server) != serverContainer.end())
@@ -119,4 +147,21 @@ namespace ICE {
 
         return serverContainer.insert(std::make_pair(server, port)).second;
     }
+
+    bool CAgent::WatchInterfaces(const InterfaceMonitor::ChangeHandler& handler)
+    {
+        bool bIPv4Supported = false;
+        {
+            std::lock_guard<decltype(m_ConfigMutex)> locker(m_ConfigMutex);
+            bIPv4Supported = m_config.IPv4Supported();
+        }
+
+        return m_monitor.Start(bIPv4Supported, [this, handler](const InterfaceMonitor::AddressList& addresses) {
+            {
+                std::lock_guard<decltype(m_ConfigMutex)> locker(m_ConfigMutex);
+                m_config.LocalAddresses(addresses);
+            }
+            handler(addresses);
+        });
+    }
 }
\ No newline at end of file
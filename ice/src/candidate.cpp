@@ -1,38 +1,36 @@
 
 #include "candidate.h"
-#include <functional>
-#include <boost/function.hpp>
-#include <boost/lexical_cast.hpp>
+#include "foundation.h"
 
 #include "pg_log.h"
 
 namespace STUN {
-    Candidate::Candidate(TypeRef eType, uint8_t compId, uint16_t localPref, ICE::Protocol protocol,
+    Candidate::Candidate(FoundationInterner& foundations, TypeRef eType, uint8_t compId, uint16_t localPref, ICE::Protocol protocol,
         const std::string & baseIP, uint16_t basePort,
         const std::string & relatedIP, uint16_t relatedPort, const std::string& serverIP):
-        m_TypeRef(eType), m_CompId(compId),m_Protocol(protocol),
-        m_IP(baseIP),m_Port(basePort), m_RelatedIP(relatedIP),m_RelatedPort(relatedPort),
-        m_Priority(ComputePriority(eType, localPref, compId)), m_Foundation(ComputeFoundations(eType, baseIP, serverIP, protocol))
+        m_Addr(ToAddress(baseIP, basePort)), m_Related(ToAddress(relatedIP, relatedPort)),
+        m_Foundation(ComputeFoundations(foundations, eType, baseIP, serverIP, protocol)), m_Priority(ComputePriority(eType, localPref, compId)),
+        m_TypeRef(eType), m_CompId(compId), m_Protocol(protocol)
     {
     }
 
-    std::string Candidate::ComputeFoundations(TypeRef type, const std::string & baseIP, const std::string & serverIP, ICE::Protocol protocol)
+    uint32_t Candidate::ComputeFoundations(FoundationInterner& foundations, TypeRef type, const std::string & baseIP, const std::string & serverIP, ICE::Protocol protocol)
     {
-        char hashInfo[1024] = "";
+        return foundations.Intern(type, baseIP, serverIP, protocol);
+    }
 
-        sprintf_s(hashInfo, sizeof(hashInfo), "%s%s%d%d", baseIP.c_str(), serverIP.c_str(), protocol, type);
-        try
-        {
-            return boost::lexical_cast<std::string>(std::hash<std::string>{}(hashInfo));
-        }
-        catch (const std::exception&)
+    ICE::TransportAddress Candidate::ToAddress(const std::string & ip, uint16_t port)
+    {
+        ICE::TransportAddress address = {};
+        if (!ICE::TransportAddress::Parse(ip, port, address))
         {
-            LOG_ERROR("Candidate","ComputeFoundation failed");
-            return "0000";
+            LOG_ERROR("Candidate", "invalid address [%s:%d]", ip.c_str(), port);
+            address.m_Port = port;
         }
+        return address;
     }
 
-    std::string Candidate::TypeName() const
+    const char* Candidate::TypeName() const
     {
         /*
          RFC5245
@@ -86,6 +86,35 @@ namespace ICE {
         }
     }
 
+    bool UDPChannel::Bind(const std::string & ip, uint16_t port, bool bReusePort) noexcept
+    {
+        if (!bReusePort)
+            return Bind(ip, port);
+
+        assert(!m_Socket.is_open());
+        using namespace boost::asio::ip;
+        try
+        {
+            udp::endpoint ep(address::from_string(ip), port);
+            m_Socket.open(ep.protocol());
+            m_Socket.set_option(boost::asio::socket_base::reuse_address(true));
+#ifdef SO_REUSEPORT
+            int reuse = 1;
+            if (setsockopt(m_Socket.native_handle(), SOL_SOCKET, SO_REUSEPORT, reinterpret_cast<const char*>(&reuse), sizeof(reuse)))
+                LOG_WARNING("UDPChannel", "SO_REUSEPORT not supported on [%s:%d]", ip.c_str(), port);
+#endif
+            m_Socket.bind(ep);
+            return true;
+        }
+        catch (const boost::system::system_error &e)
+        {
+            LOG_ERROR("UDPChannel", "Bind exception : %s", e.what());
+            if (m_Socket.is_open())
+                Close();
+            return false;
+        }
+    }
+
     int16_t UDPChannel::Write(const void* buffer, int16_t size) noexcept
     {
         assert(m_Socket.is_open());
@@ -124,6 +153,59 @@ namespace ICE {
         }
     }
 
+    int16_t UDPChannel::Write(const void* buffer, int16_t size, const boost::asio::ip::udp::endpoint& to) noexcept
+    {
+        assert(m_Socket.is_open());
+        try
+        {
+            boost::system::error_code error;
+            auto bytes = m_Socket.send_to(boost::asio::buffer(buffer, size), to, 0, error);
+            return error ? -1 : static_cast<int16_t>(bytes);
+        }
+        catch (const boost::system::system_error& e)
+        {
+            LOG_ERROR("UDPChannel", "write exception : %s", e.what());
+            return -1;
+        }
+    }
+
+    int16_t UDPChannel::Read(void* buffer, int16_t size, boost::asio::ip::udp::endpoint& from) noexcept
+    {
+        assert(buffer && size);
+        try
+        {
+            boost::system::error_code error;
+            auto bytes = m_Socket.receive_from(boost::asio::buffer(buffer, size), from, 0, error);
+            return error ? -1 : static_cast<int16_t>(bytes);
+        }
+        catch (const boost::system::system_error& e)
+        {
+            LOG_ERROR("UDPChannel", "read exception : %s", e.what());
+            return -1;
+        }
+    }
+
+    int16_t UDPChannel::Read(void* buffer, int16_t size, boost::asio::ip::udp::endpoint& from, uint32_t timeoutMS) noexcept
+    {
+        assert(buffer && size);
+
+        // select() is available on both winsock and posix, the socket itself stays blocking
+        auto fd = m_Socket.native_handle();
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(fd, &fds);
+
+        timeval timeout;
+        timeout.tv_sec  = static_cast<long>(timeoutMS / 1000);
+        timeout.tv_usec = static_cast<long>((timeoutMS % 1000) * 1000);
+
+        auto ret = select(static_cast<int>(fd + 1), &fds, nullptr, nullptr, &timeout);
+        if (ret < 0)
+            return -1;
+
+        return ret ? Read(buffer, size, from) : 0;
+    }
+
     std::string UDPChannel::IP() const noexcept
     {
         try
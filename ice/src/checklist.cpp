@@ -0,0 +1,959 @@
+#include "checklist.h"
+#include "candidate.h"
+#include "foundation.h"
+#include "stunmsg.h"
+#include "pg_log.h"
+#include "pg_hash.h"
+
+#include <algorithm>
+#include <atomic>
+#include <assert.h>
+
+namespace ICE {
+    CheckList::CheckList(const std::string & localUfrag, const std::string & localPwd, const std::string & remoteUfrag, const std::string & remotePwd,
+        const std::shared_ptr<STUN::FoundationInterner>& foundations) :
+        m_LocalUfrag(localUfrag), m_LocalPwd(localPwd), m_RemoteUfrag(remoteUfrag), m_RemotePwd(remotePwd), m_Foundations(foundations), m_State(State::Running),
+        m_bControlling(false), m_Nomination(Nomination::regular), m_NominationThreshold(0),
+        m_FamilyInterleave(0), m_bCheckOrderDirty(true), m_bPrepared(false)
+    {
+    }
+
+    CheckList::~CheckList()
+    {
+    }
+
+    bool CheckList::AddPeer(uint64_t pri, const STUN::Candidate * lcand, const STUN::RemoteCandidate * rcand, Stream * stream)
+    {
+        assert(lcand && rcand && stream);
+        assert(lcand->ComponentId() == rcand->m_CompId);
+        assert((lcand->Protocol() == rcand->m_Protocol && lcand->Protocol() == Protocol::udp) ||
+            (lcand->Protocol() != rcand->m_Protocol && lcand->Protocol() != Protocol::udp && rcand->m_Protocol != Protocol::udp));
+
+        if (m_Peers.IsFull())
+        {
+            LOG_ERROR("CheckList", "too many candidate peers");
+            return false;
+        }
+
+        auto local = LocalIndex(lcand, stream);
+        if (local == sInvalidIndex)
+        {
+            LOG_WARNING("CheckList", "invalid candidate address [%s]", lcand->TransationIP().c_str());
+            return false;
+        }
+
+        /*
+        RFC8445[6.1.2.4.  Pruning the Pairs]
+        a pair is redundant if its local base and remote candidate match an existing pair,
+        only the one with the higher priority is kept
+        */
+        auto compId = static_cast<uint8_t>(lcand->ComponentId());
+        PeerKey key(m_LocalCands[local].m_Base, rcand->m_Addr, compId);
+        auto itor = m_PeerIndex.find(key);
+
+        // a pair being checked keeps its candidates and state, the signaled again one is not indexed
+        if (itor != m_PeerIndex.end() && m_bPrepared)
+            return true;
+
+        auto remote = RemoteIndex(rcand);
+        if (remote == sInvalidIndex)
+        {
+            LOG_WARNING("CheckList", "invalid candidate address [%s]", rcand->m_Addr.IP().c_str());
+            return false;
+        }
+
+        auto foundation = FoundationId(PairFoundation(lcand->Foundation(), rcand->m_FoundationId));
+        if (itor != m_PeerIndex.end())
+        {
+            if (pri > m_Peers.Priority(itor->second))
+                m_Peers.Update(itor->second, pri, local, remote, foundation);
+            return true;
+        }
+
+        if (!m_bPrepared)
+        {
+            auto peer = m_Peers.Add(pri, local, remote, foundation, compId);
+            if (peer == sInvalidPeer)
+                return false;
+
+            m_PeerIndex.insert(std::make_pair(key, peer));
+            return true;
+        }
+
+        /*
+        RFC8838[11.  Receiving Candidates]
+        a candidate signaled once the checks are running is paired like the others,
+        the pair waits Frozen in its place until its foundation is unfrozen
+        */
+        auto peer = m_Peers.Insert(pri, local, remote, foundation, compId);
+        if (peer == sInvalidPeer)
+            return false;
+
+        m_PeerIndex.insert(std::make_pair(key, peer));
+        if (std::find(m_Components.begin(), m_Components.end(), compId) == m_Components.end())
+            m_Components.push_back(compId);
+
+        m_bCheckOrderDirty = true;
+        if (m_State == State::Failed)
+            m_State = State::Running;
+        return true;
+    }
+
+    uint16_t CheckList::Withdraw(const std::function<bool(const STUN::RemoteCandidate&rcand)>& signaled)
+    {
+        std::vector<bool> withdrawn(m_RemoteCands.size(), false);
+        bool bAny = false;
+        for (size_t i = 0; i < m_RemoteCands.size(); ++i)
+        {
+            if (!m_RemoteCands[i].m_bLearned && !signaled(*m_RemoteCands[i].m_Cand))
+                withdrawn[i] = bAny = true;
+        }
+
+        if (!bAny)
+            return 0;
+
+        uint16_t count = 0;
+        for (Handle peer = 0; peer < m_Peers.Size(); ++peer)
+        {
+            auto state = m_Peers.GetState(peer);
+            if (withdrawn[m_Peers.RemoteIndex(peer)] && (state == PeerState::Frozen || state == PeerState::Waiting))
+            {
+                m_Peers.SetState(peer, PeerState::Failed);
+                ++count;
+            }
+        }
+
+        if (count && m_State == State::Running)
+            UpdateState();
+        return count;
+    }
+
+    uint64_t CheckList::PairPriority(uint32_t G, uint32_t D)
+    {
+        /*
+        RFC8445[6.1.2.3.  Computing Pair Priority and Ordering Pairs]
+        Let G be the priority for the candidate provided by the controlling agent.
+        Let D be the priority for the candidate provided by the controlled agent
+        pair priority = 2^32*MIN(G,D) + 2*MAX(G,D) + (G>D?1:0)
+        */
+        return ((uint64_t)1 << 32) * std::min(G, D) + 2 * (uint64_t)std::max(G, D) + (G > D ? 1 : 0);
+    }
+
+    void CheckList::SwitchRole(bool bControlling)
+    {
+        if (m_bControlling == bControlling)
+            return;
+
+        /*
+        RFC8445[7.3.1.1.  Detecting and Repairing Role Conflicts]
+        the agent recomputes the pair priorities with its new role, the pairs
+        keep their handles and states, only the priority order is rebuilt
+        */
+        m_bControlling = bControlling;
+        for (Handle peer = 0; peer < m_Peers.Size(); ++peer)
+        {
+            auto lpri = LocalCandidate(peer)->Priority();
+            auto rpri = RemoteCandidate(peer)->m_Priority;
+            m_Peers.Priority(peer, bControlling ? PairPriority(lpri, rpri) : PairPriority(rpri, lpri));
+        }
+        m_Peers.Sort();
+        m_bCheckOrderDirty = true;
+
+        // only the controlling agent nominates
+        if (!bControlling)
+        {
+            while (!m_NominateQueue.empty())
+            {
+                m_Peers.ClearFlag(m_NominateQueue.front(), CandPeerTable::Nominating);
+                m_NominateQueue.pop_front();
+            }
+        }
+
+        if (m_State != State::Failed)
+            UpdateState();
+    }
+
+    void CheckList::SetNomination(Nomination mode, uint32_t threshold)
+    {
+        m_Nomination = mode;
+        m_NominationThreshold = threshold;
+    }
+
+    void CheckList::SetFamilyInterleave(uint16_t interleave)
+    {
+        m_FamilyInterleave = interleave;
+        m_bCheckOrderDirty = true;
+    }
+
+    void CheckList::Prepare(uint16_t maxPeers)
+    {
+        /*
+        RFC8445[6.1.2.2.  Forming Candidate Pairs]
+        the pairs are ordered in decreasing order of priority, pairs with
+        the same priority keep the order they were formed
+        */
+        m_Peers.Sort();
+
+        /*
+        RFC8445[6.1.2.5.  Removing Lower-Priority Pairs]
+        */
+        if (m_Peers.Size() > maxPeers)
+        {
+            LOG_INFO("CheckList", "prune [%d] lower-priority pairs, limit [%d]", m_Peers.Size() - maxPeers, maxPeers);
+            m_Peers.Truncate(maxPeers);
+            RebuildIndex();
+        }
+
+        /*
+        RFC8445[6.1.2.6.  Computing Candidate Pair States]
+        for each foundation, the pair with the lowest component ID (the highest
+        priority one for ties) is set to Waiting, all the others stay Frozen
+        */
+        std::vector<Handle> first_peers(m_FoundationIds.size(), sInvalidPeer);
+        m_Components.clear();
+
+        auto &order = m_Peers.Order();
+        for (auto itor = order.begin(); itor != order.end(); ++itor)
+        {
+            auto peer = *itor;
+            auto compId = m_Peers.ComponentId(peer);
+            m_Peers.SetState(peer, PeerState::Frozen);
+
+            if (std::find(m_Components.begin(), m_Components.end(), compId) == m_Components.end())
+                m_Components.push_back(compId);
+
+            auto &first = first_peers[m_Peers.Foundation(peer)];
+            if (first == sInvalidPeer || compId < m_Peers.ComponentId(first))
+                first = peer;
+        }
+
+        for (auto itor = first_peers.begin(); itor != first_peers.end(); ++itor)
+        {
+            if (*itor != sInvalidPeer)
+                m_Peers.SetState(*itor, PeerState::Waiting);
+        }
+
+        m_TriggeredQueue.clear();
+        m_NominateQueue.clear();
+        m_ValidList.clear();
+        m_Transactions.clear();
+        m_bCheckOrderDirty = true;
+        m_bPrepared = true;
+        m_State = m_Peers.Size() ? State::Running : State::Failed;
+    }
+
+    CheckList::Handle CheckList::NextCheck()
+    {
+        if (m_State != State::Running)
+            return sInvalidPeer;
+
+        /*
+        RFC8445[6.1.4.2.  Performing Connectivity Checks]
+        triggered check queue first
+        */
+        while (!m_TriggeredQueue.empty())
+        {
+            auto peer = m_TriggeredQueue.front();
+            m_TriggeredQueue.pop_front();
+            if (m_Peers.GetState(peer) == PeerState::Waiting)
+                return peer;
+        }
+
+        // then the highest-priority pair in the Waiting state, the families take turns
+        auto &order = CheckOrder();
+        for (auto itor = order.begin(); itor != order.end(); ++itor)
+        {
+            if (m_Peers.GetState(*itor) == PeerState::Waiting)
+                return *itor;
+        }
+
+        /*
+        no Waiting pair, pick the highest-priority Frozen pair whose foundation
+        does not match the foundation of any Waiting or In-Progress pair
+        */
+        std::vector<bool> active_foundations(m_FoundationIds.size(), false);
+        for (Handle peer = 0; peer < m_Peers.Size(); ++peer)
+        {
+            auto state = m_Peers.GetState(peer);
+            if (state == PeerState::Waiting || state == PeerState::InProgress)
+                active_foundations[m_Peers.Foundation(peer)] = true;
+        }
+
+        for (auto itor = order.begin(); itor != order.end(); ++itor)
+        {
+            if (m_Peers.GetState(*itor) == PeerState::Frozen && !active_foundations[m_Peers.Foundation(*itor)])
+                return *itor;
+        }
+
+        return sInvalidPeer;
+    }
+
+    CheckList::Handle CheckList::NextNomination()
+    {
+        while (!m_NominateQueue.empty())
+        {
+            auto peer = m_NominateQueue.front();
+            m_NominateQueue.pop_front();
+            if (m_Peers.HasFlag(peer, CandPeerTable::Nominating) && m_Peers.GetState(peer) == PeerState::Succeeded)
+                return peer;
+        }
+        return sInvalidPeer;
+    }
+
+    CheckList::Handle CheckList::Selected(uint8_t compId) const
+    {
+        /*
+        RFC8445[8.1.1.  Nominating Pairs]
+        the highest-priority nominated pair of a component is used for media
+        */
+        Handle selected = sInvalidPeer;
+        for (auto itor = m_ValidList.begin(); itor != m_ValidList.end(); ++itor)
+        {
+            if (m_Peers.ComponentId(*itor) != compId || !m_Peers.HasFlag(*itor, CandPeerTable::Nominated))
+                continue;
+
+            if (selected == sInvalidPeer || m_Peers.Priority(*itor) > m_Peers.Priority(selected))
+                selected = *itor;
+        }
+        return selected;
+    }
+
+    CheckList::Handle CheckList::Select(uint8_t compId, const PeerAddress & local)
+    {
+        /*
+        RFC5245[9.2.2.3.  Existing Media Streams with ICE Running]
+        the controlled agent takes the pair of the candidates listed in a=remote-candidates as
+        the selected pair of the component. the default destination of the peer is not kept,
+        of the pairs with the listed local candidate a valid one goes first, then the priority
+        */
+        Handle selected = sInvalidPeer;
+        for (Handle peer = 0; peer < m_Peers.Size(); ++peer)
+        {
+            if (m_Peers.ComponentId(peer) != compId || LocalCandidate(peer)->Address() != local)
+                continue;
+
+            if (selected == sInvalidPeer)
+            {
+                selected = peer;
+                continue;
+            }
+
+            auto bValid = m_Peers.GetState(peer) == PeerState::Succeeded;
+            auto bSelectedValid = m_Peers.GetState(selected) == PeerState::Succeeded;
+            if (bValid != bSelectedValid ? bValid : m_Peers.Priority(peer) > m_Peers.Priority(selected))
+                selected = peer;
+        }
+
+        if (selected == sInvalidPeer)
+            return sInvalidPeer;
+
+        // the listed pair is the only one nominated, Selected() returns it from now on
+        for (auto itor = m_ValidList.begin(); itor != m_ValidList.end(); ++itor)
+        {
+            if (m_Peers.ComponentId(*itor) == compId)
+                m_Peers.ClearFlag(*itor, CandPeerTable::Nominated);
+        }
+
+        m_Peers.ClearFlag(selected, CandPeerTable::NominateOnSuccess);
+        m_Peers.SetState(selected, PeerState::Succeeded);
+        m_Peers.SetFlag(selected, CandPeerTable::Nominated);
+        if (std::find(m_ValidList.begin(), m_ValidList.end(), selected) == m_ValidList.end())
+            m_ValidList.push_back(selected);
+
+        LOG_INFO("CheckList", "component [%d] pair selected by peer", compId);
+        UpdateState();
+        return selected;
+    }
+
+    CheckList::Handle CheckList::FindPeer(const STUN::Candidate * lcand, const std::string & ip, uint16_t port) const
+    {
+        auto local_itor = m_LocalIndex.find(lcand);
+        PeerAddress remote;
+        if (local_itor == m_LocalIndex.end() || !PeerAddress::Parse(ip, port, remote))
+            return sInvalidPeer;
+
+        auto itor = m_PeerIndex.find(PeerKey(m_LocalCands[local_itor->second].m_Base, remote, static_cast<uint8_t>(lcand->ComponentId())));
+        return itor != m_PeerIndex.end() ? itor->second : sInvalidPeer;
+    }
+
+    void CheckList::Trigger(Handle peer)
+    {
+        assert(peer < m_Peers.Size());
+
+        /*
+        RFC8445[7.3.1.4.  Triggered Checks]
+        */
+        switch (m_Peers.GetState(peer))
+        {
+        case PeerState::Succeeded:
+            return;
+
+        case PeerState::InProgress:
+            // cancel the in-progress transaction, it will not be retransmitted
+            for (auto itor = m_Transactions.begin(); itor != m_Transactions.end(); ++itor)
+            {
+                if (itor->second.m_Peer == peer && !itor->second.m_bNominate)
+                    itor->second.m_bCancelled = true;
+            }
+            break;
+
+        default:
+            break;
+        }
+
+        m_Peers.SetState(peer, PeerState::Waiting);
+        if (std::find(m_TriggeredQueue.begin(), m_TriggeredQueue.end(), peer) == m_TriggeredQueue.end())
+            m_TriggeredQueue.push_back(peer);
+
+        if (m_State != State::Running)
+            m_State = State::Running;
+    }
+
+    void CheckList::Unfreeze(uint64_t foundation)
+    {
+        // foundation ids are local to the checklist
+        auto itor = m_FoundationIds.find(foundation);
+        if (itor == m_FoundationIds.end())
+            return;
+
+        for (Handle peer = 0; peer < m_Peers.Size(); ++peer)
+        {
+            if (m_Peers.GetState(peer) == PeerState::Frozen && m_Peers.Foundation(peer) == itor->second)
+                m_Peers.SetState(peer, PeerState::Waiting);
+        }
+    }
+
+    CheckList::Handle CheckList::AddRemotePrflx(const STUN::Candidate * lcand, const std::string & ip, uint16_t port, uint32_t pri)
+    {
+        assert(lcand);
+
+        auto local_itor = m_LocalIndex.find(lcand);
+        PeerAddress address;
+        if (local_itor == m_LocalIndex.end() || m_Peers.IsFull() || m_RemoteCands.size() >= sInvalidIndex || !PeerAddress::Parse(ip, port, address))
+            return sInvalidPeer;
+
+        auto local  = local_itor->second;
+        auto compId = static_cast<uint8_t>(lcand->ComponentId());
+        PeerKey key(m_LocalCands[local].m_Base, address, compId);
+        auto itor = m_PeerIndex.find(key);
+        if (itor != m_PeerIndex.end())
+            return itor->second;
+
+        /*
+        RFC8445[7.3.1.3.  Learning Peer-Reflexive Candidates]
+        the source of a request matches no remote candidate, it becomes a remote peer
+        reflexive candidate with the priority of the PRIORITY attribute
+        */
+        auto prflx = m_LearnedArena.AllocateArray<STUN::RemoteCandidate>(1);
+        *prflx = STUN::RemoteCandidate();
+        prflx->m_Addr       = address;
+        prflx->m_Related    = address;
+        prflx->m_Priority   = pri;
+        prflx->m_Type       = STUN::Candidate::TypeRef::peer_reflexive;
+        prflx->m_Protocol   = Protocol::udp;
+        prflx->m_CompId     = compId;
+
+        /*
+        RFC8445 7.3.1.3 any value different from the foundations of all other remote candidates,
+        the ids interned from an SDP count up from 0, the learned ones count down from the top
+        so they never meet, across checklists either
+        */
+        static std::atomic<uint32_t> sLearnedFoundation(UINT32_MAX);
+        prflx->m_Foundation   = m_LearnedArena.CopyString(ip.c_str(), ip.length());
+        prflx->m_FoundationId = sLearnedFoundation--;
+
+        RemoteCand remote = { prflx, true };
+        auto remote_index = static_cast<uint16_t>(m_RemoteCands.size());
+        m_RemoteCands.push_back(remote);
+        m_RemoteIndex[prflx] = remote_index;
+
+        // the pair goes straight into its place in the priority order
+        auto pair_pri = m_bControlling ? PairPriority(lcand->Priority(), prflx->m_Priority) : PairPriority(prflx->m_Priority, lcand->Priority());
+        auto peer = m_Peers.Insert(pair_pri, local, remote_index, FoundationId(PairFoundation(lcand->Foundation(), prflx->m_FoundationId)), compId);
+        if (peer == sInvalidPeer)
+            return sInvalidPeer;
+        m_bCheckOrderDirty = true;
+
+        m_PeerIndex.insert(std::make_pair(key, peer));
+        if (std::find(m_Components.begin(), m_Components.end(), compId) == m_Components.end())
+            m_Components.push_back(compId);
+
+        LOG_INFO("CheckList", "remote peer reflexive candidate [%s:%d] learned", ip.c_str(), port);
+        return peer;
+    }
+
+    bool CheckList::OnMappedAddress(Handle peer, const std::string & ip, uint16_t port)
+    {
+        assert(peer < m_Peers.Size());
+
+        /*
+        RFC8445[7.2.5.3.1.  Discovering Peer-Reflexive Candidates]
+        a mapped address which matches no local candidate is a local peer reflexive
+        candidate, its base is the base of the pair's local candidate and its priority
+        the one sent in the PRIORITY attribute. the valid pair is made of it and the
+        remote candidate, it shares the pair's base so the pair is updated in place
+        */
+        if (IsLocalAddress(ip, port))
+            return false;
+
+        auto& base = m_LocalCands[m_Peers.LocalIndex(peer)];
+        if (m_LocalCands.size() >= sInvalidIndex)
+            return false;
+
+        m_LearnedCands.push_back(STUN::PrflxCandidate(*m_Foundations, m_Peers.ComponentId(peer),
+            base.m_Sender->PeerReflexivePriority(), ip, port, base.m_Sender->TransationIP(), base.m_Sender->TransationPort()));
+        auto prflx = &m_LearnedCands.back();
+
+        LocalCand local = { prflx, base.m_Stream, base.m_Base, base.m_Sender };
+        auto index = static_cast<uint16_t>(m_LocalCands.size());
+        m_LocalCands.push_back(local);
+        m_LocalIndex[prflx] = index;
+
+        auto rcand = RemoteCandidate(peer);
+        auto pair_pri = m_bControlling ? PairPriority(prflx->Priority(), rcand->m_Priority) : PairPriority(rcand->m_Priority, prflx->Priority());
+        m_Peers.Update(peer, pair_pri, index, m_Peers.RemoteIndex(peer), FoundationId(PairFoundation(prflx->Foundation(), rcand->m_FoundationId)));
+        m_Peers.Reorder(peer);
+        m_bCheckOrderDirty = true;
+
+        LOG_INFO("CheckList", "local peer reflexive candidate [%s:%d] discovered", ip.c_str(), port);
+        return true;
+    }
+
+    const CheckList::Transaction* CheckList::StartTransaction(Handle peer, uint32_t rto, bool bNominate /*= false*/)
+    {
+        assert(peer < m_Peers.Size() && rto);
+
+        Transaction transaction;
+        STUN::MessagePacket::GenerateRFC5389TransationId(transaction.m_Id);
+        transaction.m_Peer       = peer;
+        transaction.m_Sent       = 1;
+        transaction.m_RTO        = rto;
+        transaction.m_bCancelled = false;
+        transaction.m_bNominate  = bNominate;
+        transaction.m_bControlling = m_bControlling;
+        transaction.m_Start      = Clock::now();
+        transaction.m_Expire     = transaction.m_Start + std::chrono::milliseconds(rto);
+
+        auto result = m_Transactions.insert(std::make_pair(TransactionKey(transaction.m_Id), transaction));
+        if (!result.second)
+        {
+            LOG_ERROR("CheckList", "duplicated transaction id");
+            return nullptr;
+        }
+
+        // a nominating check is sent on a pair which has already succeeded
+        if (!bNominate)
+            m_Peers.SetState(peer, PeerState::InProgress);
+        return &result.first->second;
+    }
+
+    CheckList::Transaction* CheckList::FindTransaction(STUN::TransIdConstRef id)
+    {
+        auto itor = m_Transactions.find(TransactionKey(id));
+        if (itor == m_Transactions.end() || memcmp(itor->second.m_Id, id, sizeof(itor->second.m_Id)))
+            return nullptr;
+
+        return &itor->second;
+    }
+
+    void CheckList::EndTransaction(STUN::TransIdConstRef id)
+    {
+        auto itor = m_Transactions.find(TransactionKey(id));
+        if (itor == m_Transactions.end())
+            return;
+
+        /*
+        RFC6298[3.  Taking RTT Samples]
+        Karn's algorithm, a retransmitted request is ambiguous and gives no sample
+        */
+        auto& transaction = itor->second;
+        if (transaction.m_Sent == 1)
+        {
+            auto rtt = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - transaction.m_Start).count();
+            m_Peers.OnRTTSample(transaction.m_Peer, static_cast<uint32_t>(rtt));
+        }
+        m_Transactions.erase(itor);
+    }
+
+    uint32_t CheckList::RTO(Handle peer, uint32_t initialRTO) const
+    {
+        assert(peer < m_Peers.Size());
+
+        // RFC5389 7.2.1 the RTO may be cached from previous transactions with the same remote address
+        auto measured = peer;
+        if (m_Peers.RTT(measured) == CandPeerTable::sUnknownRTT)
+        {
+            auto remote = m_Peers.RemoteIndex(peer);
+            for (measured = 0; measured < m_Peers.Size(); ++measured)
+            {
+                if (m_Peers.RemoteIndex(measured) == remote && m_Peers.RTT(measured) != CandPeerTable::sUnknownRTT)
+                    break;
+            }
+
+            if (measured == m_Peers.Size())
+                return initialRTO;
+        }
+
+        /*
+        RFC6298[2.  The Basic Algorithm]
+        RTO = SRTT + max(G, 4 * RTTVAR), the clock granularity G is taken as half of sMinRTO
+        */
+        auto& stats = m_Peers.GetStats(measured);
+        auto rto = stats.m_SRTT + std::max<uint32_t>(sMinRTO / 2, 4 * stats.m_RTTVar);
+        return std::min(std::max(rto, sMinRTO), sMaxRTO);
+    }
+
+    uint16_t CheckList::PendingCount() const
+    {
+        uint16_t count = 0;
+        for (Handle peer = 0; peer < m_Peers.Size(); ++peer)
+        {
+            auto state = m_Peers.GetState(peer);
+            if (state == PeerState::Waiting || state == PeerState::InProgress)
+                ++count;
+        }
+        return count;
+    }
+
+    void CheckList::CollectRetransmissions(uint16_t maxSent, uint16_t lastWaitFactor, TransactionList & retransmit)
+    {
+        /*
+        RFC5389[7.2.1.  Sending over UDP]
+        retransmit with doubled RTO, after Rc transmissions wait Rm * RTO before
+        the transaction is considered failed
+        */
+        auto now = Clock::now();
+        for (auto itor = m_Transactions.begin(); itor != m_Transactions.end();)
+        {
+            auto& transaction = itor->second;
+            if (now < transaction.m_Expire)
+            {
+                ++itor;
+                continue;
+            }
+
+            if (!transaction.m_bCancelled)
+                m_Peers.OnLost(transaction.m_Peer);
+
+            if (transaction.m_bCancelled || transaction.m_Sent >= maxSent)
+            {
+                // a cancelled transaction's peer has been queued as a triggered check
+                if (!transaction.m_bCancelled)
+                    OnFailed(transaction.m_Peer, transaction.m_bNominate);
+
+                itor = m_Transactions.erase(itor);
+                continue;
+            }
+
+            auto initial_rto = transaction.m_RTO >> (transaction.m_Sent - 1);
+            ++transaction.m_Sent;
+            transaction.m_RTO <<= 1;
+            transaction.m_Expire = now + std::chrono::milliseconds(transaction.m_Sent >= maxSent ? initial_rto * lastWaitFactor : transaction.m_RTO);
+            retransmit.push_back(&transaction);
+            ++itor;
+        }
+    }
+
+    void CheckList::OnSucceeded(Handle peer, bool bNominate)
+    {
+        assert(peer < m_Peers.Size());
+
+        if (bNominate)
+        {
+            /*
+            RFC8445[8.1.1.  Nominating Pairs]
+            the pair is nominated once the check with USE-CANDIDATE succeeds
+            */
+            m_Peers.ClearFlag(peer, CandPeerTable::Nominating);
+            m_Peers.SetFlag(peer, CandPeerTable::Nominated);
+            LOG_INFO("CheckList", "component [%d] pair nominated", m_Peers.ComponentId(peer));
+            UpdateState();
+            return;
+        }
+
+        m_Peers.SetState(peer, PeerState::Succeeded);
+        if (std::find(m_ValidList.begin(), m_ValidList.end(), peer) == m_ValidList.end())
+            m_ValidList.push_back(peer);
+
+        /*
+        RFC8445[7.3.1.5.  Updating the Nominated Flag]
+        USE-CANDIDATE was received while the triggered check was in flight
+        */
+        if (m_Peers.HasFlag(peer, CandPeerTable::NominateOnSuccess))
+        {
+            m_Peers.ClearFlag(peer, CandPeerTable::NominateOnSuccess);
+            m_Peers.SetFlag(peer, CandPeerTable::Nominated);
+        }
+
+        /*
+        nominate the first good enough pair right away to shorten the time to media,
+        UpdateState() switches to a better pair once it is known to be the best
+        */
+        if (m_bControlling && m_Nomination == Nomination::first_succeeded &&
+            static_cast<uint32_t>(m_Peers.Priority(peer) >> 32) >= m_NominationThreshold)
+        {
+            auto selected = Selected(m_Peers.ComponentId(peer));
+            if (selected == sInvalidPeer || m_Peers.Priority(peer) > m_Peers.Priority(selected))
+                Nominate(peer);
+        }
+
+        UpdateState();
+    }
+
+    void CheckList::OnFailed(Handle peer, bool bNominate)
+    {
+        assert(peer < m_Peers.Size());
+
+        if (bNominate)
+        {
+            // the pair is not usable anymore, a following UpdateState() nominates the next one
+            LOG_WARNING("CheckList", "component [%d] nomination failed", m_Peers.ComponentId(peer));
+            m_Peers.ClearFlag(peer, CandPeerTable::Nominating);
+            m_ValidList.erase(std::remove(m_ValidList.begin(), m_ValidList.end(), peer), m_ValidList.end());
+        }
+
+        m_Peers.SetState(peer, PeerState::Failed);
+        UpdateState();
+    }
+
+    void CheckList::OnUseCandidate(Handle peer)
+    {
+        assert(peer < m_Peers.Size());
+
+        /*
+        RFC8445[7.3.1.5.  Updating the Nominated Flag]
+        controlled agent, a succeeded pair is nominated at once, otherwise
+        it is nominated when the triggered check succeeds
+        */
+        if (m_Peers.GetState(peer) == PeerState::Succeeded)
+        {
+            if (!m_Peers.HasFlag(peer, CandPeerTable::Nominated))
+            {
+                m_Peers.SetFlag(peer, CandPeerTable::Nominated);
+                LOG_INFO("CheckList", "component [%d] pair nominated by peer", m_Peers.ComponentId(peer));
+                UpdateState();
+            }
+            return;
+        }
+
+        m_Peers.SetFlag(peer, CandPeerTable::NominateOnSuccess);
+    }
+
+    size_t CheckList::PeerKeyHash::operator()(const PeerKey & key) const
+    {
+        auto hash = PG::FNV1a(key.m_Base.m_IP, sizeof(key.m_Base.m_IP));
+        hash = PG::FNV1a(&key.m_Base.m_Port, sizeof(key.m_Base.m_Port), hash);
+        hash = PG::FNV1a(key.m_Remote.m_IP, sizeof(key.m_Remote.m_IP), hash);
+        hash = PG::FNV1a(&key.m_Remote.m_Port, sizeof(key.m_Remote.m_Port), hash);
+        return PG::FNV1a(&key.m_CompId, sizeof(key.m_CompId), hash);
+    }
+
+    uint64_t CheckList::TransactionKey(STUN::TransIdConstRef id)
+    {
+        // the last 8 bytes of a RFC5389 transaction id are random
+        uint64_t key;
+        memcpy(&key, &id[8], sizeof(key));
+        return key;
+    }
+
+    const CheckList::PeerAddress & CheckList::RemoteAddress(Handle peer) const
+    {
+        return RemoteCandidate(peer)->m_Addr;
+    }
+
+    const CandPeerTable::HandleContainer & CheckList::CheckOrder()
+    {
+        if (!m_bCheckOrderDirty)
+            return m_CheckOrder;
+
+        m_bCheckOrderDirty = false;
+        auto& order = m_Peers.Order();
+        if (!m_FamilyInterleave || order.empty())
+        {
+            m_CheckOrder = order;
+            return m_CheckOrder;
+        }
+
+        /*
+        RFC8421[4.  Compatibility with Dual-Stack]
+        the pairs are checked alternating between IPv6 and IPv4, within a family
+        they keep their priority order. the best pair of each family is checked
+        within the first Ta ticks, a broken path of one family does not delay
+        the other until all its pairs have failed
+        */
+        auto bPreferredV4 = RemoteAddress(order.front()).IsIPv4();
+        CandPeerTable::HandleContainer preferred, other;
+        for (auto itor = order.begin(); itor != order.end(); ++itor)
+        {
+            auto bV4 = RemoteAddress(*itor).IsIPv4();
+            (bV4 == bPreferredV4 ? preferred : other).push_back(*itor);
+        }
+
+        m_CheckOrder.clear();
+        auto preferred_itor = preferred.begin();
+        auto other_itor = other.begin();
+        while (preferred_itor != preferred.end() || other_itor != other.end())
+        {
+            for (uint16_t i = 0; i < m_FamilyInterleave && preferred_itor != preferred.end(); ++i)
+                m_CheckOrder.push_back(*preferred_itor++);
+
+            if (other_itor != other.end())
+                m_CheckOrder.push_back(*other_itor++);
+        }
+        return m_CheckOrder;
+    }
+
+    CheckList::PeerKey CheckList::MakeKey(Handle peer) const
+    {
+        return PeerKey(m_LocalCands[m_Peers.LocalIndex(peer)].m_Base, RemoteAddress(peer), m_Peers.ComponentId(peer));
+    }
+
+    void CheckList::RebuildIndex()
+    {
+        m_PeerIndex.clear();
+        for (Handle peer = 0; peer < m_Peers.Size(); ++peer)
+            m_PeerIndex.insert(std::make_pair(MakeKey(peer), peer));
+    }
+
+    uint16_t CheckList::LocalIndex(const STUN::Candidate * lcand, Stream * stream)
+    {
+        auto itor = m_LocalIndex.find(lcand);
+        if (itor != m_LocalIndex.end())
+            return itor->second;
+
+        /*
+        RFC8445[6.1.2.4.  Pruning the Pairs]
+        a server reflexive local candidate is replaced by its base, our srflx candidates
+        carry the address of the channel they were gathered on (their base) as transport address
+        */
+        LocalCand local = { lcand, stream, lcand->Address(), lcand };
+        if (m_LocalCands.size() >= sInvalidIndex)
+            return sInvalidIndex;
+
+        auto index = static_cast<uint16_t>(m_LocalCands.size());
+        m_LocalCands.push_back(local);
+        m_LocalIndex[lcand] = index;
+        return index;
+    }
+
+    uint16_t CheckList::RemoteIndex(const STUN::RemoteCandidate * rcand)
+    {
+        auto itor = m_RemoteIndex.find(rcand);
+        if (itor != m_RemoteIndex.end())
+            return itor->second;
+
+        // the address was parsed when the SDP was decoded
+        RemoteCand remote = { rcand, false };
+        if (m_RemoteCands.size() >= sInvalidIndex)
+            return sInvalidIndex;
+
+        auto index = static_cast<uint16_t>(m_RemoteCands.size());
+        m_RemoteCands.push_back(remote);
+        m_RemoteIndex[rcand] = index;
+        return index;
+    }
+
+    uint32_t CheckList::FoundationId(uint64_t foundation)
+    {
+        auto result = m_FoundationIds.insert(std::make_pair(foundation, static_cast<uint32_t>(m_FoundationIds.size())));
+        return result.first->second;
+    }
+
+    CheckList::Handle CheckList::BestValid(uint8_t compId) const
+    {
+        Handle best = sInvalidPeer;
+        for (auto itor = m_ValidList.begin(); itor != m_ValidList.end(); ++itor)
+        {
+            if (m_Peers.ComponentId(*itor) != compId || m_Peers.GetState(*itor) != PeerState::Succeeded)
+                continue;
+
+            if (best == sInvalidPeer || m_Peers.Priority(*itor) > m_Peers.Priority(best))
+                best = *itor;
+        }
+        return best;
+    }
+
+    bool CheckList::HasPendingAbove(uint8_t compId, uint64_t pri) const
+    {
+        for (Handle peer = 0; peer < m_Peers.Size(); ++peer)
+        {
+            if (m_Peers.ComponentId(peer) != compId || m_Peers.Priority(peer) <= pri)
+                continue;
+
+            auto state = m_Peers.GetState(peer);
+            if (state == PeerState::Frozen || state == PeerState::Waiting || state == PeerState::InProgress)
+                return true;
+        }
+        return false;
+    }
+
+    void CheckList::Nominate(Handle peer)
+    {
+        if (m_Peers.HasFlag(peer, CandPeerTable::Nominating) || m_Peers.HasFlag(peer, CandPeerTable::Nominated))
+            return;
+
+        m_Peers.SetFlag(peer, CandPeerTable::Nominating);
+        m_NominateQueue.push_back(peer);
+    }
+
+    bool CheckList::IsLocalAddress(const std::string & ip, uint16_t port) const
+    {
+        PeerAddress address;
+        if (!PeerAddress::Parse(ip, port, address))
+            return false;
+
+        for (auto itor = m_LocalCands.begin(); itor != m_LocalCands.end(); ++itor)
+        {
+            auto cand = itor->m_Cand;
+            if (cand->Address() == address)
+                return true;
+
+            // the mapped address of our srflx candidates is kept as related address
+            if (cand->Type() == STUN::Candidate::TypeRef::server_reflexive && cand->RelatedAddress() == address)
+                return true;
+        }
+        return false;
+    }
+
+    void CheckList::UpdateState()
+    {
+        /*
+        RFC8445[7.2.5.3.3.  Updating Checklist and Candidate Pair States]
+        RFC8445[8.1.2.  Updating Checklist and ICE States]
+        the controlling agent is done with a component once its best possible pair is
+        nominated, the controlled one as soon as the peer nominated any valid pair of it.
+        the checklist fails if a component ends without any valid pair
+        */
+        bool completed = true;
+        for (auto comp_itor = m_Components.begin(); comp_itor != m_Components.end(); ++comp_itor)
+        {
+            if (!m_bControlling && Selected(*comp_itor) != sInvalidPeer)
+                continue;
+
+            auto valid = BestValid(*comp_itor);
+            if (valid == sInvalidPeer)
+            {
+                if (!HasPendingAbove(*comp_itor, 0))
+                {
+                    LOG_WARNING("CheckList", "component [%d] has no valid pair", *comp_itor);
+                    m_State = State::Failed;
+                    return;
+                }
+                completed = false;
+                continue;
+            }
+
+            // no pair left which could beat the best valid one
+            auto settled = !HasPendingAbove(*comp_itor, m_Peers.Priority(valid));
+            if (Selected(*comp_itor) == valid && settled)
+                continue;
+
+            completed = false;
+            if (m_bControlling && settled)
+                Nominate(valid);
+        }
+
+        if (completed)
+            m_State = State::Completed;
+    }
+}
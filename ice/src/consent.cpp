@@ -0,0 +1,84 @@
+#include "consent.h"
+#include "pg_log.h"
+
+#include <assert.h>
+
+namespace ICE {
+    ConsentScheduler & ConsentScheduler::Instance()
+    {
+        static ConsentScheduler sScheduler;
+        return sScheduler;
+    }
+
+    ConsentScheduler::ConsentScheduler() :
+        m_Generation(0)
+    {
+        m_Timer.Start(sTickMS, [this] {
+            OnTick();
+        });
+    }
+
+    ConsentScheduler::~ConsentScheduler()
+    {
+        m_Timer.Stop();
+    }
+
+    void ConsentScheduler::Register(Client * client)
+    {
+        assert(client);
+
+        std::lock_guard<decltype(m_Mutex)> locker(m_Mutex);
+        m_Clients[client] = ++m_Generation;
+    }
+
+    void ConsentScheduler::Unregister(Client * client)
+    {
+        // waits out a dispatch in progress, the timers of the client are dropped when they fire
+        std::lock_guard<decltype(m_DispatchMutex)> dispatch(m_DispatchMutex);
+        std::lock_guard<decltype(m_Mutex)> locker(m_Mutex);
+        m_Clients.erase(client);
+        m_Batch.erase(client);
+    }
+
+    bool ConsentScheduler::Schedule(Client * client, Cookie cookie, uint32_t delayMS)
+    {
+        std::lock_guard<decltype(m_Mutex)> locker(m_Mutex);
+        auto itor = m_Clients.find(client);
+        if (itor == m_Clients.end())
+            return false;
+
+        auto generation = itor->second;
+        m_Wheel.Schedule((delayMS + sTickMS - 1) / sTickMS, [this, client, cookie, generation] {
+            // runs inside Advance with m_Mutex held
+            auto itor = m_Clients.find(client);
+            if (itor != m_Clients.end() && itor->second == generation)
+                m_Batch[client].push_back(cookie);
+        });
+        return true;
+    }
+
+    void ConsentScheduler::OnTick()
+    {
+        std::lock_guard<decltype(m_DispatchMutex)> dispatch(m_DispatchMutex);
+
+        Batch batch;
+        {
+            std::lock_guard<decltype(m_Mutex)> locker(m_Mutex);
+            m_Wheel.Advance();
+            if (m_Batch.empty())
+                return;
+            batch.swap(m_Batch);
+        }
+
+        for (auto itor = batch.begin(); itor != batch.end(); ++itor)
+        {
+            // a client called earlier in this batch may have unregistered another one
+            {
+                std::lock_guard<decltype(m_Mutex)> locker(m_Mutex);
+                if (m_Clients.find(itor->first) == m_Clients.end())
+                    continue;
+            }
+            itor->first->OnConsentTimer(itor->second);
+        }
+    }
+}
@@ -0,0 +1,62 @@
+#include "foundation.h"
+#include "pg_log.h"
+#include "pg_hash.h"
+
+#include <string.h>
+
+namespace STUN {
+    uint32_t FoundationInterner::Intern(Candidate::TypeRef type, const std::string & baseIP, const std::string & serverIP, ICE::Protocol protocol)
+    {
+        Key key;
+        memset(&key, 0, sizeof(key));
+        key.m_Type     = static_cast<uint8_t>(type);
+        key.m_Protocol = static_cast<uint8_t>(protocol);
+
+        // an address which cannot be parsed only shares its foundation with other such ones
+        ICE::TransportAddress address;
+        if (ICE::TransportAddress::Parse(baseIP, 0, address))
+            memcpy(key.m_Base, address.m_IP, sizeof(key.m_Base));
+        else
+            LOG_WARNING("Foundation", "invalid base address [%s]", baseIP.c_str());
+
+        if (ICE::TransportAddress::Parse(serverIP, 0, address))
+            memcpy(key.m_Server, address.m_IP, sizeof(key.m_Server));
+        else
+            LOG_WARNING("Foundation", "invalid server address [%s]", serverIP.c_str());
+
+        std::lock_guard<decltype(m_Mutex)> locker(m_Mutex);
+        return *m_Ids.Insert(key, static_cast<uint32_t>(m_Ids.Size())).first;
+    }
+
+    size_t FoundationInterner::Size() const
+    {
+        std::lock_guard<decltype(m_Mutex)> locker(m_Mutex);
+        return m_Ids.Size();
+    }
+
+    size_t FoundationInterner::KeyHash::operator()(const Key & key) const
+    {
+        // the packed key has no padding
+        return PG::FNV1a(&key, sizeof(key));
+    }
+
+    bool FoundationInterner::KeyEqual::operator()(const Key & key1, const Key & key2) const
+    {
+        return !memcmp(&key1, &key2, sizeof(Key));
+    }
+
+    uint32_t RemoteFoundationInterner::Intern(boost::string_view foundation)
+    {
+        auto found = m_Ids.Find(foundation);
+        if (found)
+            return *found;
+
+        auto copy = m_Arena.CopyString(foundation.data(), foundation.size());
+        return *m_Ids.Insert(boost::string_view(copy, foundation.size()), static_cast<uint32_t>(m_Ids.Size())).first;
+    }
+
+    size_t RemoteFoundationInterner::ViewHash::operator()(boost::string_view view) const
+    {
+        return PG::FNV1a(view.data(), view.size());
+    }
+}
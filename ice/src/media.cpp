@@ -1,5 +1,8 @@
 #include "media.h"
 
+#include <memory>
+#include <vector>
+
 namespace {
     static const std::string BASE64 =
         "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
@@ -24,12 +27,58 @@ namespace {
             pwd += BASE64[PG::GenerateRandom(0, BASE64_CNT - 1)];
         return pwd;
     }
+
+    /* waits for Stream::Message::Gathering of one stream */
+    class GatheringWaiter : public PG::CListener {
+    public:
+        GatheringWaiter(ICE::Stream* pStream) :
+            m_pStream(pStream), m_bDone(false), m_bResult(false)
+        {
+            assert(pStream);
+        }
+
+        virtual ~GatheringWaiter()
+        {
+        }
+
+        void OnEventFired(PG::MsgEntity * pSender, PG::MsgEntity::MSG_ID msg_id, PG::MsgEntity::WPARAM wParam, PG::MsgEntity::LPARAM lParam) override
+        {
+            assert(static_cast<ICE::Stream::Message>(msg_id) == ICE::Stream::Message::Gathering && wParam == (PG::MsgEntity::WPARAM)m_pStream);
+            std::unique_lock<decltype(m_Mutex)> locker(m_Mutex);
+            m_bResult = lParam > 0;
+            m_bDone = true;
+            m_Cond.notify_one();
+        }
+
+        bool WaitResult()
+        {
+            // the notification may come before the wait when there is nothing to gather
+            std::unique_lock<decltype(m_Mutex)> locker(m_Mutex);
+            m_Cond.wait(locker, [this] {
+                return m_bDone;
+            });
+            return m_bResult;
+        }
+
+    private:
+        ICE::Stream *m_pStream;
+        bool     m_bDone;
+        bool     m_bResult;
+        std::condition_variable m_Cond;
+        std::mutex              m_Mutex;
+    };
 }
 
 namespace ICE {
-    ICE::Media::Media() :
-        m_icepwd(GenerateUserPwd()), m_iceufrag(GenerateUserFrag())
+    ICE::Media::Media(bool bRtcpMux) :
+        m_icepwd(GenerateUserPwd()), m_iceufrag(GenerateUserFrag()), m_Transport(nullptr), m_bRtcpMux(bRtcpMux)
+    {
+    }
+
+    ICE::Media::Media(const Media* transport) :
+        m_Transport(transport), m_bRtcpMux(true)
     {
+        assert(transport && !transport->IsBundled());
     }
 
     ICE::Media::~Media()
@@ -40,46 +89,18 @@ namespace ICE {
     {
         assert(id >= static_cast<uint16_t>(ClassicID::RTP));
 
-        auto itor = m_Streams.find(id);
-        return itor != m_Streams.end() ? itor->second : nullptr;
+        auto& streams = GetStreams();
+        auto itor = streams.find(id);
+        return itor != streams.end() ? itor->second : nullptr;
     }
 
     bool Media::CreateStream(uint8_t compId, Protocol protocol, const std::string & hostIP, uint16_t port, const CAgentConfig& config)
     {
-        class EventHelper : public PG::CListener {
-        public:
-            EventHelper(Media* pOwner, Stream* pStream) :
-                m_pOwner(pOwner), m_pStream(pStream)
-            {
-                assert(pOwner && pStream);
-            }
-
-            virtual ~EventHelper()
-            {
-            }
-
-            void OnEventFired(PG::MsgEntity * pSender, PG::MsgEntity::MSG_ID msg_id, PG::MsgEntity::WPARAM wParam, PG::MsgEntity::LPARAM lParam) override
-            {
-                assert(static_cast<Stream::Message>(msg_id) == Stream::Message::Gathering && wParam == (PG::MsgEntity::WPARAM)m_pStream);
-                m_bResult = lParam > 0;
-                std::unique_lock<decltype(m_Mutex)> locker(m_Mutex);
-                m_Cond.notify_one();
-            }
-
-            bool WaitResult()
-            {
-                std::unique_lock<decltype(m_Mutex)> locker(m_Mutex);
-                m_Cond.wait(locker);
-                return m_bResult;
-            }
-
-        private:
-            Media   *m_pOwner;
-            Stream  *m_pStream;
-            bool     m_bResult;
-            std::condition_variable m_Cond;
-            std::mutex              m_Mutex;
-        };
+        if (m_Transport)
+        {
+            LOG_ERROR("Media", "a bundled media has no stream of its own");
+            return false;
+        }
 
         std::auto_ptr<Stream> stream(new Stream(compId, protocol, 0xFFFF, hostIP, port));
         if (!stream.get())
@@ -88,7 +109,7 @@ namespace ICE {
             return false;
         }
 
-        EventHelper helper(this, stream.get());
+        GatheringWaiter helper(stream.get());
         if (!stream->RegisterEventListener(static_cast<uint16_t>(Stream::Message::Gathering), &helper) ||
             !stream->GatheringCandidate(config))
         {
@@ -106,4 +127,50 @@ namespace ICE {
         stream.release();
         return true;
     }
-}
\ No newline at end of file
+
+    bool Media::Restart(const CAgentConfig & config)
+    {
+        // the transport restarts for the media bundled on it
+        if (m_Transport)
+            return true;
+
+        /*
+        RFC8445[9.  ICE Restarts]
+        an agent restarts ICE for a data stream by changing the ice-pwd
+        and ice-ufrag for the data stream in an offer
+        */
+        m_icepwd   = GenerateUserPwd();
+        m_iceufrag = GenerateUserFrag();
+
+        // the streams gather in parallel, a restart costs one round of gathering
+        std::vector<std::pair<Stream*, std::unique_ptr<GatheringWaiter>>> waiters;
+        bool bResult = true;
+        for (auto itor = m_Streams.begin(); itor != m_Streams.end(); ++itor)
+        {
+            auto stream = itor->second;
+            std::unique_ptr<GatheringWaiter> waiter(new GatheringWaiter(stream));
+            if (!stream->RegisterEventListener(static_cast<uint16_t>(Stream::Message::Gathering), waiter.get()))
+            {
+                bResult = false;
+                break;
+            }
+
+            if (!stream->Regather(config))
+            {
+                LOG_ERROR("Media", "Stream [%d] Regather failed", itor->first);
+                stream->UnregisterEventListenner(static_cast<uint16_t>(Stream::Message::Gathering), waiter.get());
+                bResult = false;
+                break;
+            }
+            waiters.push_back(std::make_pair(stream, std::move(waiter)));
+        }
+
+        for (auto itor = waiters.begin(); itor != waiters.end(); ++itor)
+        {
+            if (!itor->second->WaitResult())
+                bResult = false;
+            itor->first->UnregisterEventListenner(static_cast<uint16_t>(Stream::Message::Gathering), itor->second.get());
+        }
+        return bResult;
+    }
+}
@@ -0,0 +1,564 @@
+#include "netif.h"
+#include "pg_log.h"
+
+#include <boost/asio.hpp>
+#include <algorithm>
+#include <assert.h>
+
+#ifdef _WIN32
+#include <iphlpapi.h>
+#include <netioapi.h>
+#pragma comment(lib, "iphlpapi.lib")
+#else
+#include <unistd.h>
+#include <poll.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#endif
+
+namespace {
+    using namespace ICE;
+
+    bool IsTunnelName(const std::string& name)
+    {
+        static const char* const prefixes[] = { "tun", "tap", "ppp", "wg", "utun", "ipsec", "vpn", "zt" };
+        for (auto prefix : prefixes)
+        {
+            if (!name.compare(0, strlen(prefix), prefix))
+                return true;
+        }
+        return false;
+    }
+
+#ifdef _WIN32
+    VOID NETIOAPI_API_ OnAddressNotify(PVOID context, PMIB_UNICASTIPADDRESS_ROW row, MIB_NOTIFICATION_TYPE type)
+    {
+        SetEvent(static_cast<HANDLE>(context));
+    }
+#else
+    /* sends one RTM_GETLINK/RTM_GETADDR dump request and walks the multipart answer */
+    bool NetlinkDump(int fd, uint16_t type, const std::function<void(const nlmsghdr*)>& handler)
+    {
+        struct {
+            nlmsghdr    m_Header;
+            rtgenmsg    m_Gen;
+        } request = {};
+
+        request.m_Header.nlmsg_len   = NLMSG_LENGTH(sizeof(rtgenmsg));
+        request.m_Header.nlmsg_type  = type;
+        request.m_Header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+        request.m_Header.nlmsg_seq   = type;
+        request.m_Gen.rtgen_family   = AF_UNSPEC;
+
+        sockaddr_nl kernel = {};
+        kernel.nl_family = AF_NETLINK;
+        if (sendto(fd, &request, request.m_Header.nlmsg_len, 0, reinterpret_cast<sockaddr*>(&kernel), sizeof(kernel)) < 0)
+            return false;
+
+        alignas(nlmsghdr) char buffer[16 * 1024];
+        while (true)
+        {
+            auto bytes = recv(fd, buffer, sizeof(buffer), 0);
+            if (bytes <= 0)
+                return false;
+
+            auto len = static_cast<uint32_t>(bytes);
+            for (auto header = reinterpret_cast<const nlmsghdr*>(buffer); NLMSG_OK(header, len); header = NLMSG_NEXT(header, len))
+            {
+                if (header->nlmsg_type == NLMSG_DONE)
+                    return true;
+
+                if (header->nlmsg_type == NLMSG_ERROR)
+                    return false;
+
+                handler(header);
+            }
+        }
+    }
+#endif
+}
+
+namespace ICE {
+    InterfaceMonitor::InterfaceMonitor() :
+        m_bIPv4Supported(true), m_bQuit(false)
+    {
+#ifdef _WIN32
+        m_Notify = nullptr;
+        m_Events[0] = m_Events[1] = nullptr;
+#else
+        m_Netlink = -1;
+        m_Wakeup[0] = m_Wakeup[1] = -1;
+#endif
+    }
+
+    InterfaceMonitor::~InterfaceMonitor()
+    {
+        Stop();
+    }
+
+    bool InterfaceMonitor::Enumerate(bool bIPv4Supported, AddressList & addresses)
+    {
+        InterfaceList interfaces;
+        addresses.clear();
+        if (!EnumerateInterfaces(bIPv4Supported, interfaces, addresses))
+            return false;
+
+        AssignPreference(interfaces, addresses);
+        return true;
+    }
+
+    bool InterfaceMonitor::IsUsable(const std::string & ip, bool bIPv4Supported)
+    {
+        boost::system::error_code error;
+        auto address = boost::asio::ip::address::from_string(ip, error);
+        if (error)
+            return false;
+
+        /*
+        RFC8445[5.1.1.1.  Host Candidates]
+        Addresses from a loopback interface MUST NOT be included in the
+        candidate addresses
+        */
+        if (address.is_loopback() || address.is_unspecified() || address.is_multicast())
+            return false;
+
+        if (address.is_v6())
+        {
+            /*
+            Deprecated IPv4-compatible IPv6 addresses [RFC4291] and IPv6 sitelocal
+            unicast addresses [RFC3879] MUST NOT be included in the
+            address candidates
+
+            IPv4-mapped IPv6 addresses SHOULD NOT be included in the address
+            candidates unless the application using ICE does not support IPv4
+            (i.e., it is an IPv6-only application [RFC4038]).
+            */
+            auto ipv6 = address.to_v6();
+            return !(ipv6.is_v4_compatible() || ipv6.is_site_local() || ipv6.is_link_local() || (bIPv4Supported && ipv6.is_v4_mapped()));
+        }
+
+        // ipv4 link-local
+        return bIPv4Supported && (address.to_v4().to_ulong() & 0xFFFF0000) != 0xA9FE0000;
+    }
+
+    void InterfaceMonitor::AssignPreference(const InterfaceList & interfaces, AddressList & addresses)
+    {
+        /*
+        RFC8421[4.  Compatibility with Dual-Stack]
+        the local preference ranks the interfaces first and the addresses of
+        an interface second. IPv6 and IPv4 addresses of an interface are
+        interleaved, IPv6 first, so the checks of both families are raced
+        instead of one family waiting for the other to fail.
+        a VPN or tunnel interface goes after every other interface
+        */
+        std::vector<const Interface*> ranked;
+        for (auto itor = interfaces.begin(); itor != interfaces.end(); ++itor)
+            ranked.push_back(&*itor);
+
+        std::stable_sort(ranked.begin(), ranked.end(), [](const Interface* lhs, const Interface* rhs) {
+            return !lhs->m_bVPN && rhs->m_bVPN;
+        });
+
+        for (size_t rank = 0; rank < ranked.size(); ++rank)
+        {
+            uint16_t interface_pref = static_cast<uint16_t>(rank < 0xFF ? 0xFF - rank : 0);
+            uint16_t v6 = 0, v4 = 0;
+            for (auto itor = addresses.begin(); itor != addresses.end(); ++itor)
+            {
+                if (itor->m_Index != ranked[rank]->m_Index)
+                    continue;
+
+                itor->m_Interface = ranked[rank]->m_Name;
+                itor->m_bVPN      = ranked[rank]->m_bVPN;
+
+                // 0, 2, 4... for IPv6, 1, 3, 5... for IPv4
+                uint16_t position = itor->m_bIPv6 ? static_cast<uint16_t>(v6++ * 2) : static_cast<uint16_t>(v4++ * 2 + 1);
+                uint16_t address_pref = static_cast<uint16_t>(position < 0xFF ? 0xFF - position : 0);
+                itor->m_LocalPref = static_cast<uint16_t>((interface_pref << 8) | address_pref);
+            }
+        }
+
+        std::stable_sort(addresses.begin(), addresses.end(), [](const LocalAddress& lhs, const LocalAddress& rhs) {
+            return lhs.m_LocalPref > rhs.m_LocalPref;
+        });
+    }
+
+#ifdef _WIN32
+    bool InterfaceMonitor::EnumerateInterfaces(bool bIPv4Supported, InterfaceList & interfaces, AddressList & addresses)
+    {
+        const ULONG flags = GAA_FLAG_SKIP_ANYCAST | GAA_FLAG_SKIP_MULTICAST | GAA_FLAG_SKIP_DNS_SERVER;
+        ULONG size = 16 * 1024;
+        std::vector<uint8_t> buffer;
+        ULONG result = ERROR_BUFFER_OVERFLOW;
+        for (uint16_t attempts = 0; attempts < 3 && result == ERROR_BUFFER_OVERFLOW; ++attempts)
+        {
+            buffer.resize(size);
+            result = GetAdaptersAddresses(AF_UNSPEC, flags, nullptr, reinterpret_cast<PIP_ADAPTER_ADDRESSES>(buffer.data()), &size);
+        }
+
+        if (result != ERROR_SUCCESS)
+        {
+            LOG_ERROR("NetIf", "GetAdaptersAddresses failed %d", result);
+            return false;
+        }
+
+        for (auto adapter = reinterpret_cast<PIP_ADAPTER_ADDRESSES>(buffer.data()); adapter; adapter = adapter->Next)
+        {
+            if (adapter->OperStatus != IfOperStatusUp || adapter->IfType == IF_TYPE_SOFTWARE_LOOPBACK)
+                continue;
+
+            auto index = adapter->IfIndex ? adapter->IfIndex : adapter->Ipv6IfIndex;
+            Interface item = { adapter->AdapterName, index,
+                adapter->IfType == IF_TYPE_TUNNEL || adapter->IfType == IF_TYPE_PPP };
+            interfaces.push_back(item);
+
+            for (auto unicast = adapter->FirstUnicastAddress; unicast; unicast = unicast->Next)
+            {
+                // tentative, duplicate and deprecated addresses are not used
+                if (unicast->DadState != IpDadStatePreferred)
+                    continue;
+
+                auto sa = unicast->Address.lpSockaddr;
+                boost::asio::ip::address address;
+                if (sa->sa_family == AF_INET)
+                {
+                    address = boost::asio::ip::address_v4(ntohl(reinterpret_cast<sockaddr_in*>(sa)->sin_addr.s_addr));
+                }
+                else if (sa->sa_family == AF_INET6)
+                {
+                    boost::asio::ip::address_v6::bytes_type bytes;
+                    memcpy(bytes.data(), &reinterpret_cast<sockaddr_in6*>(sa)->sin6_addr, bytes.size());
+                    address = boost::asio::ip::address_v6(bytes);
+                }
+                else
+                {
+                    continue;
+                }
+
+                auto ip = address.to_string();
+                if (IsUsable(ip, bIPv4Supported))
+                {
+                    LocalAddress local = { ip, std::string(), index, 0, address.is_v6(), false };
+                    addresses.push_back(local);
+                }
+            }
+        }
+        return true;
+    }
+
+    bool InterfaceMonitor::Start(bool bIPv4Supported, const ChangeHandler & handler)
+    {
+        assert(!m_Thread.joinable());
+
+        AddressList addresses;
+        if (!Enumerate(bIPv4Supported, addresses))
+            return false;
+
+        {
+            std::lock_guard<decltype(m_Mutex)> locker(m_Mutex);
+            m_Addresses.swap(addresses);
+            m_Handler = handler;
+            m_bIPv4Supported = bIPv4Supported;
+        }
+
+        m_Events[0] = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+        m_Events[1] = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+
+        // the callback runs on a system thread, it only wakes up the monitor thread
+        HANDLE notify = nullptr;
+        if (!m_Events[0] || !m_Events[1] || NotifyUnicastIpAddressChange(AF_UNSPEC, OnAddressNotify, m_Events[0], FALSE, &notify) != NO_ERROR)
+        {
+            LOG_ERROR("NetIf", "NotifyUnicastIpAddressChange failed");
+            Stop();
+            return false;
+        }
+        m_Notify = notify;
+
+        m_bQuit = false;
+        m_Thread = std::thread(InterfaceMonitor::MonitorThread, this);
+        return true;
+    }
+
+    void InterfaceMonitor::Stop()
+    {
+        if (m_Notify)
+        {
+            CancelMibChangeNotify2(static_cast<HANDLE>(m_Notify));
+            m_Notify = nullptr;
+        }
+
+        m_bQuit = true;
+        if (m_Events[1])
+            SetEvent(m_Events[1]);
+
+        if (m_Thread.joinable())
+            m_Thread.join();
+
+        for (auto& event : m_Events)
+        {
+            if (event)
+                CloseHandle(event);
+            event = nullptr;
+        }
+    }
+
+    void InterfaceMonitor::MonitorThread(InterfaceMonitor * pThis)
+    {
+        assert(pThis);
+
+        while (!pThis->m_bQuit)
+        {
+            auto result = WaitForMultipleObjects(2, pThis->m_Events, FALSE, INFINITE);
+            if (result != WAIT_OBJECT_0)
+                break;
+
+            pThis->OnChanged();
+        }
+    }
+#else
+    bool InterfaceMonitor::EnumerateInterfaces(bool bIPv4Supported, InterfaceList & interfaces, AddressList & addresses)
+    {
+        int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+        if (fd < 0)
+        {
+            LOG_ERROR("NetIf", "netlink socket failed %d", errno);
+            return false;
+        }
+
+        std::vector<uint32_t> down;
+        bool bResult = NetlinkDump(fd, RTM_GETLINK, [&](const nlmsghdr* header) {
+            if (header->nlmsg_type != RTM_NEWLINK)
+                return;
+
+            auto info = reinterpret_cast<const ifinfomsg*>(NLMSG_DATA(header));
+            if (!(info->ifi_flags & IFF_UP) || (info->ifi_flags & IFF_LOOPBACK))
+            {
+                down.push_back(info->ifi_index);
+                return;
+            }
+
+            Interface item = { std::string(), static_cast<uint32_t>(info->ifi_index), false };
+            auto len = IFLA_PAYLOAD(header);
+            for (auto attr = IFLA_RTA(info); RTA_OK(attr, len); attr = RTA_NEXT(attr, len))
+            {
+                if (attr->rta_type == IFLA_IFNAME)
+                    item.m_Name = reinterpret_cast<const char*>(RTA_DATA(attr));
+            }
+
+            // tun devices have no link layer, the other tunnels have their own ARPHRD
+            item.m_bVPN = (info->ifi_flags & IFF_POINTOPOINT) || info->ifi_type == ARPHRD_NONE ||
+                info->ifi_type == ARPHRD_TUNNEL || info->ifi_type == ARPHRD_TUNNEL6 || info->ifi_type == ARPHRD_SIT ||
+                info->ifi_type == ARPHRD_IPGRE || info->ifi_type == ARPHRD_PPP || IsTunnelName(item.m_Name);
+            interfaces.push_back(item);
+        });
+
+        bResult = bResult && NetlinkDump(fd, RTM_GETADDR, [&](const nlmsghdr* header) {
+            if (header->nlmsg_type != RTM_NEWADDR)
+                return;
+
+            auto info = reinterpret_cast<const ifaddrmsg*>(NLMSG_DATA(header));
+            if (std::find(down.begin(), down.end(), info->ifa_index) != down.end())
+                return;
+
+            uint32_t flags = info->ifa_flags;
+            const rtattr *address = nullptr;
+            const rtattr *local   = nullptr;
+            auto len = IFA_PAYLOAD(header);
+            for (auto attr = IFA_RTA(info); RTA_OK(attr, len); attr = RTA_NEXT(attr, len))
+            {
+                switch (attr->rta_type)
+                {
+                case IFA_ADDRESS: address = attr; break;
+                case IFA_LOCAL:   local = attr; break;
+#ifdef IFA_FLAGS
+                case IFA_FLAGS:   flags = *reinterpret_cast<const uint32_t*>(RTA_DATA(attr)); break;
+#endif
+                default: break;
+                }
+            }
+
+            // tentative, duplicate and deprecated addresses are not used
+            if (flags & (IFA_F_TENTATIVE | IFA_F_DADFAILED | IFA_F_DEPRECATED))
+                return;
+
+            // on a point-to-point link IFA_ADDRESS is the peer, IFA_LOCAL the local address
+            auto attr = local ? local : address;
+            if (!attr)
+                return;
+
+            boost::asio::ip::address ip;
+            if (info->ifa_family == AF_INET && RTA_PAYLOAD(attr) == 4)
+            {
+                boost::asio::ip::address_v4::bytes_type bytes;
+                memcpy(bytes.data(), RTA_DATA(attr), bytes.size());
+                ip = boost::asio::ip::address_v4(bytes);
+            }
+            else if (info->ifa_family == AF_INET6 && RTA_PAYLOAD(attr) == 16)
+            {
+                boost::asio::ip::address_v6::bytes_type bytes;
+                memcpy(bytes.data(), RTA_DATA(attr), bytes.size());
+                ip = boost::asio::ip::address_v6(bytes);
+            }
+            else
+            {
+                return;
+            }
+
+            auto str = ip.to_string();
+            if (IsUsable(str, bIPv4Supported))
+            {
+                LocalAddress item = { str, std::string(), info->ifa_index, 0, ip.is_v6(), false };
+                addresses.push_back(item);
+            }
+        });
+
+        close(fd);
+        if (!bResult)
+            LOG_ERROR("NetIf", "netlink dump failed");
+        return bResult;
+    }
+
+    bool InterfaceMonitor::Start(bool bIPv4Supported, const ChangeHandler & handler)
+    {
+        assert(!m_Thread.joinable());
+
+        m_Netlink = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_ROUTE);
+        if (m_Netlink < 0)
+        {
+            LOG_ERROR("NetIf", "netlink socket failed %d", errno);
+            return false;
+        }
+
+        // subscribed before the first dump, a change in between is not lost
+        sockaddr_nl groups = {};
+        groups.nl_family = AF_NETLINK;
+        groups.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR;
+        if (bind(m_Netlink, reinterpret_cast<sockaddr*>(&groups), sizeof(groups)) < 0 || pipe(m_Wakeup) < 0)
+        {
+            LOG_ERROR("NetIf", "netlink subscribe failed %d", errno);
+            Stop();
+            return false;
+        }
+
+        AddressList addresses;
+        if (!Enumerate(bIPv4Supported, addresses))
+        {
+            Stop();
+            return false;
+        }
+
+        {
+            std::lock_guard<decltype(m_Mutex)> locker(m_Mutex);
+            m_Addresses.swap(addresses);
+            m_Handler = handler;
+            m_bIPv4Supported = bIPv4Supported;
+        }
+
+        m_bQuit = false;
+        m_Thread = std::thread(InterfaceMonitor::MonitorThread, this);
+        return true;
+    }
+
+    void InterfaceMonitor::Stop()
+    {
+        m_bQuit = true;
+        if (m_Wakeup[1] >= 0)
+        {
+            char wakeup = 0;
+            if (write(m_Wakeup[1], &wakeup, sizeof(wakeup)) < 0)
+                LOG_WARNING("NetIf", "wakeup monitor thread failed %d", errno);
+        }
+
+        if (m_Thread.joinable())
+            m_Thread.join();
+
+        for (auto fd : { m_Netlink, m_Wakeup[0], m_Wakeup[1] })
+        {
+            if (fd >= 0)
+                close(fd);
+        }
+        m_Netlink = m_Wakeup[0] = m_Wakeup[1] = -1;
+    }
+
+    void InterfaceMonitor::MonitorThread(InterfaceMonitor * pThis)
+    {
+        assert(pThis);
+
+        alignas(nlmsghdr) char buffer[16 * 1024];
+        while (!pThis->m_bQuit)
+        {
+            pollfd fds[2] = { { pThis->m_Netlink, POLLIN, 0 }, { pThis->m_Wakeup[0], POLLIN, 0 } };
+            if (poll(fds, 2, -1) < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                break;
+            }
+
+            if (fds[1].revents || pThis->m_bQuit)
+                break;
+
+            // a network switch comes as a burst of messages, they are drained and answered by one dump
+            bool bChanged = false;
+            ssize_t bytes;
+            while ((bytes = recv(pThis->m_Netlink, buffer, sizeof(buffer), 0)) > 0)
+            {
+                auto len = static_cast<uint32_t>(bytes);
+                for (auto header = reinterpret_cast<const nlmsghdr*>(buffer); NLMSG_OK(header, len); header = NLMSG_NEXT(header, len))
+                {
+                    switch (header->nlmsg_type)
+                    {
+                    case RTM_NEWLINK:
+                    case RTM_DELLINK:
+                    case RTM_NEWADDR:
+                    case RTM_DELADDR:
+                        bChanged = true;
+                        break;
+
+                    default:
+                        break;
+                    }
+                }
+            }
+
+            // ENOBUFS, the socket overflowed and messages were lost
+            if (bChanged || (bytes < 0 && errno == ENOBUFS))
+                pThis->OnChanged();
+        }
+    }
+#endif
+
+    InterfaceMonitor::AddressList InterfaceMonitor::Addresses() const
+    {
+        std::lock_guard<decltype(m_Mutex)> locker(m_Mutex);
+        return m_Addresses;
+    }
+
+    void InterfaceMonitor::OnChanged()
+    {
+        AddressList addresses;
+        if (!Enumerate(m_bIPv4Supported, addresses))
+            return;
+
+        ChangeHandler handler;
+        {
+            std::lock_guard<decltype(m_Mutex)> locker(m_Mutex);
+            bool bSame = addresses.size() == m_Addresses.size() &&
+                std::equal(addresses.begin(), addresses.end(), m_Addresses.begin(), [](const LocalAddress& lhs, const LocalAddress& rhs) {
+                return lhs.m_IP == rhs.m_IP && lhs.m_LocalPref == rhs.m_LocalPref;
+            });
+
+            if (bSame)
+                return;
+
+            m_Addresses = addresses;
+            handler = m_Handler;
+        }
+
+        LOG_INFO("NetIf", "local addresses changed, %d usable", addresses.size());
+        if (handler)
+            handler(addresses);
+    }
+}
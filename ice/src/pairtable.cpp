@@ -0,0 +1,150 @@
+#include "pairtable.h"
+
+#include <algorithm>
+
+namespace ICE {
+    CandPeerTable::Handle CandPeerTable::Add(uint64_t pri, uint16_t local, uint16_t remote, uint32_t foundation, uint8_t compId)
+    {
+        if (IsFull())
+            return sInvalidHandle;
+
+        auto peer = static_cast<Handle>(m_Priority.size());
+        m_Priority.push_back(pri);
+        m_State.push_back(State::Frozen);
+        m_LocalIdx.push_back(local);
+        m_RemoteIdx.push_back(remote);
+        m_Foundation.push_back(foundation);
+        m_CompId.push_back(compId);
+        m_Flags.push_back(0);
+
+        Stats stats = {};
+        stats.m_SRTT = sUnknownRTT;
+        m_Stats.push_back(stats);
+        m_Order.push_back(peer);
+
+        // order is rebuilt by Sort() once all the pairs are formed
+        m_bSorted = false;
+        return peer;
+    }
+
+    CandPeerTable::Handle CandPeerTable::Insert(uint64_t pri, uint16_t local, uint16_t remote, uint32_t foundation, uint8_t compId)
+    {
+        assert(m_bSorted);
+
+        auto peer = Add(pri, local, remote, foundation, compId);
+        if (peer == sInvalidHandle)
+            return peer;
+
+        // a pair added after forming (e.g. peer reflexive) goes straight into its place
+        m_Order.pop_back();
+        m_Order.insert(OrderPosition(pri), peer);
+        m_bSorted = true;
+        return peer;
+    }
+
+    void CandPeerTable::Update(Handle peer, uint64_t pri, uint16_t local, uint16_t remote, uint32_t foundation)
+    {
+        assert(peer < Size());
+
+        m_Priority[peer]    = pri;
+        m_LocalIdx[peer]    = local;
+        m_RemoteIdx[peer]   = remote;
+        m_Foundation[peer]  = foundation;
+
+        // the priority may have changed
+        m_bSorted = false;
+    }
+
+    void CandPeerTable::Sort()
+    {
+        /*
+        RFC8445[6.1.2.3.  Computing Pair Priority and Ordering Pairs]
+        decreasing order of priority, pairs with the same priority keep the order they were formed
+        */
+        std::stable_sort(m_Order.begin(), m_Order.end(), [this](Handle a, Handle b) {
+            return m_Priority[a] > m_Priority[b];
+        });
+        m_bSorted = true;
+    }
+
+    void CandPeerTable::Reorder(Handle peer)
+    {
+        // only 'peer' changed its priority since the last Sort()
+        auto itor = std::find(m_Order.begin(), m_Order.end(), peer);
+        assert(itor != m_Order.end());
+
+        m_Order.erase(itor);
+        m_Order.insert(OrderPosition(m_Priority[peer]), peer);
+        m_bSorted = true;
+    }
+
+    void CandPeerTable::Truncate(uint16_t size)
+    {
+        assert(m_bSorted);
+        if (size >= Size())
+            return;
+
+        // keep the first 'size' pairs in priority order, compacted so that a handle equals its rank
+        m_Order.resize(size);
+        Gather(m_Priority, m_Order);
+        Gather(m_State, m_Order);
+        Gather(m_LocalIdx, m_Order);
+        Gather(m_RemoteIdx, m_Order);
+        Gather(m_Foundation, m_Order);
+        Gather(m_CompId, m_Order);
+        Gather(m_Flags, m_Order);
+        Gather(m_Stats, m_Order);
+
+        for (Handle peer = 0; peer < size; ++peer)
+            m_Order[peer] = peer;
+    }
+
+    void CandPeerTable::Clear()
+    {
+        m_Priority.clear();
+        m_State.clear();
+        m_LocalIdx.clear();
+        m_RemoteIdx.clear();
+        m_Foundation.clear();
+        m_CompId.clear();
+        m_Flags.clear();
+        m_Stats.clear();
+        m_Order.clear();
+        m_bSorted = true;
+    }
+
+    void CandPeerTable::OnRTTSample(Handle peer, uint32_t rtt)
+    {
+        /*
+        RFC6298[2.  The Basic Algorithm]
+        the first sample sets SRTT = R, RTTVAR = R/2, the next ones
+        RTTVAR = 3/4 * RTTVAR + 1/4 * |SRTT - R|, SRTT = 7/8 * SRTT + 1/8 * R
+        */
+        auto& stats = m_Stats[peer];
+        if (stats.m_SRTT == sUnknownRTT)
+        {
+            stats.m_SRTT   = rtt;
+            stats.m_RTTVar = rtt / 2;
+            return;
+        }
+
+        auto delta = stats.m_SRTT > rtt ? stats.m_SRTT - rtt : rtt - stats.m_SRTT;
+        stats.m_RTTVar = (3 * stats.m_RTTVar + delta) / 4;
+        stats.m_SRTT   = (7 * stats.m_SRTT + rtt) / 8;
+    }
+
+    void CandPeerTable::OnReceived(Handle peer, uint16_t bytes)
+    {
+        auto& stats = m_Stats[peer];
+        ++stats.m_PacketsReceived;
+        stats.m_BytesReceived += bytes;
+        stats.m_LastActivity = std::chrono::steady_clock::now();
+    }
+
+    CandPeerTable::HandleContainer::iterator CandPeerTable::OrderPosition(uint64_t pri)
+    {
+        return std::upper_bound(m_Order.begin(), m_Order.end(), pri, [this](uint64_t value, Handle peer) {
+            return value > m_Priority[peer];
+        });
+    }
+}
@@ -0,0 +1,291 @@
+#include "responder.h"
+#include "stunmsg.h"
+
+#include <string.h>
+
+namespace {
+    inline uint16_t Get16(const uint8_t* buf)
+    {
+        return static_cast<uint16_t>((buf[0] << 8) | buf[1]);
+    }
+
+    inline uint32_t Get32(const uint8_t* buf)
+    {
+        return (uint32_t(buf[0]) << 24) | (uint32_t(buf[1]) << 16) | (uint32_t(buf[2]) << 8) | uint32_t(buf[3]);
+    }
+
+    inline uint64_t Get64(const uint8_t* buf)
+    {
+        return (uint64_t(Get32(buf)) << 32) | Get32(buf + 4);
+    }
+
+    inline void Put16(uint8_t* buf, uint16_t value)
+    {
+        buf[0] = static_cast<uint8_t>(value >> 8);
+        buf[1] = static_cast<uint8_t>(value);
+    }
+
+    inline void Put32(uint8_t* buf, uint32_t value)
+    {
+        Put16(buf, static_cast<uint16_t>(value >> 16));
+        Put16(buf + 2, static_cast<uint16_t>(value));
+    }
+
+    inline uint16_t PaddedSize(uint16_t size)
+    {
+        return static_cast<uint16_t>((size + 3) & ~3);
+    }
+}
+
+namespace ICE {
+    BindingResponder::BindingResponder() :
+        m_bControlling(true), m_Tiebreaker(0)
+    {
+    }
+
+    void BindingResponder::Credentials(const std::string & ufrag, const std::string & pwd)
+    {
+        CredentialPtr credential(new Credential{ ufrag, pwd });
+        std::atomic_store(&m_Current, credential);
+    }
+
+    void BindingResponder::Restart(const std::string & ufrag, const std::string & pwd)
+    {
+        CredentialPtr credential(new Credential{ ufrag, pwd });
+        std::atomic_store(&m_Previous, std::atomic_load(&m_Current));
+        std::atomic_store(&m_Current, credential);
+    }
+
+    void BindingResponder::Retire()
+    {
+        std::atomic_store(&m_Previous, CredentialPtr());
+    }
+
+    bool BindingResponder::IsUsername(const Credential * credential, const uint8_t * username, uint16_t length)
+    {
+        if (!credential)
+            return false;
+
+        // RFC8445 7.3.1.2 USERNAME = local ufrag:remote ufrag
+        auto& ufrag = credential->m_Ufrag;
+        return length > ufrag.length() && !memcmp(username, ufrag.data(), ufrag.length()) && username[ufrag.length()] == ':';
+    }
+
+    void BindingResponder::Role(bool bControlling, uint64_t tiebreaker)
+    {
+        m_Tiebreaker  = tiebreaker;
+        m_bControlling = bControlling;
+    }
+
+    BindingResponder::Result BindingResponder::Respond(const STUN::PACKET::stun_packet & request, uint16_t size, const boost::asio::ip::udp::endpoint & from,
+        STUN::PACKET::stun_packet & response, uint16_t & responseSize) const
+    {
+        responseSize = 0;
+        if (size < STUN::sStunHeaderLength || request.MsgId() != STUN::MsgType::BindingRequest)
+            return Result::NotRequest;
+
+        auto length = request.Length();
+        if (length + STUN::sStunHeaderLength > size || (length & 3))
+            return Result::Discard;
+
+        /*
+        RFC5389[15.  STUN Attributes]
+        walk the attributes in place, anything following MESSAGE-INTEGRITY except FINGERPRINT is ignored
+        */
+        auto attr = request.Attributes();
+        const uint8_t *username = nullptr;
+        uint16_t username_len   = 0;
+        int32_t integrity       = -1;
+        int32_t fingerprint     = -1;
+        uint16_t role           = 0;
+        uint64_t tiebreaker     = 0;
+
+        for (uint16_t offset = 0; offset + sizeof(STUN::ATTR::Header) <= length;)
+        {
+            // FINGERPRINT MUST be the last attribute
+            if (fingerprint >= 0)
+                return Result::Discard;
+
+            auto type = static_cast<STUN::ATTR::Id>(Get16(&attr[offset]));
+            auto len  = Get16(&attr[offset + 2]);
+            auto value = offset + sizeof(STUN::ATTR::Header);
+            if (value + len > length)
+                return Result::Discard;
+
+            switch (type)
+            {
+            case STUN::ATTR::Id::Username:
+                if (integrity < 0)
+                {
+                    username     = &attr[value];
+                    username_len = len;
+                }
+                break;
+
+            case STUN::ATTR::Id::MessageIntegrity:
+                if (integrity < 0 && len == STUN::sSHA1Size)
+                    integrity = offset;
+                break;
+
+            case STUN::ATTR::Id::Fingerprint:
+                if (len != 4)
+                    return Result::Discard;
+                fingerprint = offset;
+                break;
+
+            case STUN::ATTR::Id::IceControlling:
+            case STUN::ATTR::Id::IceControlled:
+                if (integrity < 0 && len == sizeof(uint64_t))
+                {
+                    role       = static_cast<uint16_t>(type);
+                    tiebreaker = Get64(&attr[value]);
+                }
+                break;
+
+            default:
+                break;
+            }
+            offset = static_cast<uint16_t>(value + PaddedSize(len));
+        }
+
+        if (fingerprint >= 0 && Get32(&attr[fingerprint + sizeof(STUN::ATTR::Header)]) !=
+            STUN::MessagePacket::ComputeFingerprint(request, static_cast<uint16_t>(fingerprint)))
+            return Result::Discard;
+
+        /*
+        RFC5389[10.1.2.  Receiving a Request or Indication]
+        no USERNAME or MESSAGE-INTEGRITY -> 400, unknown USERNAME or bad HMAC -> 401,
+        neither carries MESSAGE-INTEGRITY
+        */
+        if (!username || integrity < 0)
+        {
+            responseSize = WriteError(request, STUN::ErrorCode::BadRequest, "Bad Request", nullptr, response);
+            return Result::BadRequest;
+        }
+
+        // the credentials of the request are held until the response is sealed
+        auto credential = std::atomic_load(&m_Current);
+        bool bPrevious = false;
+        if (!IsUsername(credential.get(), username, username_len))
+        {
+            credential = std::atomic_load(&m_Previous);
+            bPrevious  = true;
+        }
+
+        if (!IsUsername(credential.get(), username, username_len))
+        {
+            responseSize = WriteError(request, STUN::ErrorCode::Unauthorized, "Unauthorized", nullptr, response);
+            return Result::Unauthorized;
+        }
+
+        auto& pwd = credential->m_Pwd;
+        STUN::SHA1 digest;
+        STUN::MessagePacket::ComputeMsgIntegrity(request, static_cast<uint16_t>(integrity), pwd, digest);
+        if (memcmp(digest, &attr[integrity + sizeof(STUN::ATTR::Header)], sizeof(digest)))
+        {
+            responseSize = WriteError(request, STUN::ErrorCode::Unauthorized, "Unauthorized", nullptr, response);
+            return Result::Unauthorized;
+        }
+
+        /*
+        RFC8445[7.3.1.1.  Detecting and Repairing Role Conflicts]
+        the agent keeping its role answers 487, the other one switches and answers success
+        */
+        if (role)
+        {
+            bool bControlling = m_bControlling;
+            auto bPeerControlling = static_cast<STUN::ATTR::Id>(role) == STUN::ATTR::Id::IceControlling;
+            if (bPeerControlling == bControlling && (m_Tiebreaker >= tiebreaker) == bControlling)
+            {
+                responseSize = WriteError(request, STUN::ErrorCode::RoleConflict, "Role Conflict", &pwd, response);
+                return Result::RoleConflict;
+            }
+        }
+
+        responseSize = WriteSuccess(request, from, pwd, response);
+        return bPrevious ? Result::Previous : Result::Success;
+    }
+
+    uint16_t BindingResponder::WriteError(const STUN::PACKET::stun_packet & request, STUN::ErrorCode code, const char * reason, const std::string * pwd,
+        STUN::PACKET::stun_packet & response) const
+    {
+        response.MsgId(STUN::MsgType::BindingErrResp);
+        response.TransId(request.TransId());
+
+        /*
+        RFC5389[15.6.  ERROR-CODE]
+        */
+        auto attr = response.Attributes();
+        auto reason_len = static_cast<uint16_t>(strlen(reason));
+        auto len = static_cast<uint16_t>(4 + reason_len);
+
+        Put16(&attr[0], static_cast<uint16_t>(STUN::ATTR::Id::ErrorCode));
+        Put16(&attr[2], len);
+        attr[4] = 0;
+        attr[5] = 0;
+        attr[6] = static_cast<uint8_t>(static_cast<uint16_t>(code) / 100);
+        attr[7] = static_cast<uint8_t>(static_cast<uint16_t>(code) % 100);
+        memcpy(&attr[8], reason, reason_len);
+        memset(&attr[8 + reason_len], 0, PaddedSize(len) - len);
+
+        return Seal(response, static_cast<uint16_t>(sizeof(STUN::ATTR::Header) + PaddedSize(len)), pwd);
+    }
+
+    uint16_t BindingResponder::WriteSuccess(const STUN::PACKET::stun_packet & request, const boost::asio::ip::udp::endpoint & from, const std::string & pwd,
+        STUN::PACKET::stun_packet & response) const
+    {
+        response.MsgId(STUN::MsgType::BindingResp);
+        response.TransId(request.TransId());
+
+        /*
+        RFC5389[15.2.  XOR-MAPPED-ADDRESS]
+        port XOR the high 16 bits of the magic cookie, IPv4 XOR the magic cookie,
+        IPv6 XOR magic cookie + transaction id
+        */
+        auto attr = response.Attributes();
+        auto address = from.address();
+        uint16_t len = address.is_v4() ? 8 : 20;
+
+        Put16(&attr[0], static_cast<uint16_t>(STUN::ATTR::Id::XorMappedAddress));
+        Put16(&attr[2], len);
+        attr[4] = 0;
+        attr[5] = static_cast<uint8_t>(address.is_v4() ? STUN::AddressFamily::IPv4 : STUN::AddressFamily::IPv6);
+        Put16(&attr[6], static_cast<uint16_t>(from.port() ^ (STUN::sMagicCookie >> 16)));
+
+        if (address.is_v4())
+        {
+            Put32(&attr[8], static_cast<uint32_t>(address.to_v4().to_ulong()) ^ STUN::sMagicCookie);
+        }
+        else
+        {
+            auto bytes = address.to_v6().to_bytes();
+            auto& id = request.TransId();
+            for (size_t i = 0; i < bytes.size(); ++i)
+                attr[8 + i] = bytes[i] ^ id[i];
+        }
+
+        return Seal(response, static_cast<uint16_t>(sizeof(STUN::ATTR::Header) + len), &pwd);
+    }
+
+    uint16_t BindingResponder::Seal(STUN::PACKET::stun_packet & response, uint16_t offset, const std::string * pwd) const
+    {
+        auto attr = response.Attributes();
+
+        if (pwd)
+        {
+            Put16(&attr[offset], static_cast<uint16_t>(STUN::ATTR::Id::MessageIntegrity));
+            Put16(&attr[offset + 2], static_cast<uint16_t>(STUN::sSHA1Size));
+            STUN::MessagePacket::ComputeMsgIntegrity(response, offset, *pwd,
+                *reinterpret_cast<STUN::SHA1*>(&attr[offset + sizeof(STUN::ATTR::Header)]));
+            offset += sizeof(STUN::ATTR::MessageIntegrity);
+        }
+
+        Put16(&attr[offset], static_cast<uint16_t>(STUN::ATTR::Id::Fingerprint));
+        Put16(&attr[offset + 2], 4);
+        Put32(&attr[offset + sizeof(STUN::ATTR::Header)], STUN::MessagePacket::ComputeFingerprint(response, offset));
+        offset += sizeof(STUN::ATTR::Fingerprint);
+
+        response.Length(offset);
+        return offset + STUN::sStunHeaderLength;
+    }
+}
\ No newline at end of file
@@ -4,15 +4,20 @@
 #include "media.h"
 #include "stream.h"
 #include "pg_log.h"
+#include "pg_hash.h"
 
-#include <boost/tokenizer.hpp>
-#include <boost/lexical_cast.hpp>
 #include <boost/asio.hpp>
+#include <boost/algorithm/string/predicate.hpp>
 
-#include <sstream>
+#include <limits>
+#include <algorithm>
+#include <string.h>
+#include <type_traits>
 #include <assert.h>
 
 namespace SDPDEF {
+    using StringView = boost::string_view;
+
     static const std::string nettype = "IN";
     static const std::string candtype = "typ";
     static const std::string reladdr = "raddr";
@@ -26,8 +31,13 @@ namespace SDPDEF {
     static const std::string candidate_line = "a=candidate:";
     static const std::string remotecand_line = "a=remote-candidates:";
     static const std::string icepwd_line = "a=ice-pwd:";
-    static const std::string iceufrag_line = "ice-ufrag:";
+    static const std::string iceufrag_line = "a=ice-ufrag:";
     static const std::string rtcp_line = "a=rtcp:";
+    static const std::string iceoptions_line = "a=ice-options:";
+    static const std::string bundle_line = "a=group:BUNDLE";
+    static const std::string mid_line = "a=mid:";
+    static const std::string rtcpmux_line = "a=rtcp-mux";
+    static const std::string bundleonly_line = "a=bundle-only";
     static const std::string CRLF = "\r\n";
     static const std::string host_cand_type = "host";
     static const std::string srflx_cand_type = "srflx";
@@ -40,11 +50,35 @@ namespace SDPDEF {
     static const std::string TCP_ACT = "tcp-act";
     static const std::string TCP_PASS = "tcp-pass";
 
+    /* attribute names, the part of an a= line before ':' */
+    static const StringView candidate_attr("candidate");
+    static const StringView remotecand_attr("remote-candidates");
+    static const StringView icepwd_attr("ice-pwd");
+    static const StringView iceufrag_attr("ice-ufrag");
+    static const StringView rtcp_attr("rtcp");
+    static const StringView iceoptions_attr("ice-options");
+    static const StringView icelite_attr("ice-lite");
+    static const StringView group_attr("group");
+    static const StringView mid_attr("mid");
+    static const StringView rtcpmux_attr("rtcp-mux");
+    static const StringView bundleonly_attr("bundle-only");
+    static const StringView bundle_semantics("BUNDLE");
+
+    /* ice-options tags */
+    static const StringView trickle_option("trickle");
+    static const StringView ice2_option("ice2");
+
     static const uint16_t min_cand_content_num = 8;
     static const uint16_t nonhost_cand_content_num = 12;
     static const uint16_t media_content_num = 4;
     static const uint16_t remote_cands_num = 3; // at least 
     static const uint16_t cline_content_num = 3;
+    static const uint16_t max_cline_addresses = 256;   /* a multicast range larger than this is refused, not expanded */
+
+    /* reserved for an encoded SDP, its session part, each m-section and each a=candidate */
+    static const size_t session_size_hint = 256;
+    static const size_t media_size_hint = 128;
+    static const size_t candidate_size_hint = 128;
 
     /*
     RFC5245 [15.1.  "candidate" Attribute]
@@ -94,10 +128,167 @@ namespace SDPDEF {
         connaddr,
     };
 
-    static const boost::char_separator<char> whitespace_separator(" ");
-    static const boost::char_separator<char> slash_separator("/");
+    /*
+    RFC4566[5.  SDP Specification]
+    an SDP is a sequence of <type>=<value> lines ended by CRLF, a bare LF is
+    accepted as well. the lines are handed out as views into the SDP, nothing is copied
+    */
+    class LineReader {
+    public:
+        explicit LineReader(StringView sdp) :
+            m_Rest(sdp)
+        {
+        }
+
+        bool Next(StringView& line)
+        {
+            while (!m_Rest.empty())
+            {
+                auto end = m_Rest.find('\n');
+                line = m_Rest.substr(0, end);
+                if (end == StringView::npos)
+                    m_Rest.clear();
+                else
+                    m_Rest.remove_prefix(end + 1);
+
+                if (!line.empty() && line.back() == '\r')
+                    line.remove_suffix(1);
+
+                if (!line.empty())
+                    return true;
+            }
+            return false;
+        }
+
+    private:
+        StringView m_Rest;
+    };
+
+    /* the fields of a value separated by 'separator', runs of separators are skipped */
+    class FieldReader {
+    public:
+        FieldReader(StringView value, char separator = ' ') :
+            m_Rest(value), m_Separator(separator)
+        {
+        }
+
+        bool Next(StringView& field)
+        {
+            while (!m_Rest.empty() && m_Rest.front() == m_Separator)
+                m_Rest.remove_prefix(1);
+
+            if (m_Rest.empty())
+                return false;
+
+            auto end = m_Rest.find(m_Separator);
+            field = m_Rest.substr(0, end);
+            if (end == StringView::npos)
+                m_Rest.clear();
+            else
+                m_Rest.remove_prefix(end);
+            return true;
+        }
+
+        /* reads up to 'max' fields, returns the number read */
+        uint16_t Read(StringView* fields, uint16_t max)
+        {
+            uint16_t count = 0;
+            while (count < max && Next(fields[count]))
+                ++count;
+            return count;
+        }
+
+    private:
+        StringView  m_Rest;
+        const char  m_Separator;
+    };
+
+    /* appends to the caller's buffer, numbers are formatted by hand without locale or stream */
+    class Writer {
+    public:
+        explicit Writer(std::string& buffer) :
+            m_Buffer(buffer)
+        {
+        }
+
+        Writer& Write(StringView text)
+        {
+            m_Buffer.append(text.data(), text.size());
+            return *this;
+        }
+
+        Writer& Write(char c)
+        {
+            m_Buffer.push_back(c);
+            return *this;
+        }
+
+        Writer& Number(uint64_t value)
+        {
+            char digits[20];
+            auto pos = sizeof(digits);
+            do
+            {
+                digits[--pos] = static_cast<char>('0' + value % 10);
+                value /= 10;
+            } while (value);
+
+            m_Buffer.append(digits + pos, sizeof(digits) - pos);
+            return *this;
+        }
+
+    private:
+        std::string &m_Buffer;
+    };
+
+    /* a=<attribute> or a=<attribute>:<value> */
+    void SplitAttribute(StringView attribute, StringView& name, StringView& value)
+    {
+        auto colon = attribute.find(':');
+        name  = attribute.substr(0, colon);
+        value = colon == StringView::npos ? StringView() : attribute.substr(colon + 1);
+    }
+
+    /* unsigned decimal without sign or spaces, false on overflow */
+    template<class T>
+    bool ToNumber(StringView field, T& value)
+    {
+        static_assert(std::is_unsigned<T>::value && sizeof(T) <= sizeof(uint32_t), "unsigned up to 32 bits");
+
+        if (field.empty() || field.size() > std::numeric_limits<T>::digits10 + 1)
+            return false;
+
+        uint64_t result = 0;
+        for (auto itor = field.begin(); itor != field.end(); ++itor)
+        {
+            if (*itor < '0' || *itor > '9')
+                return false;
+            result = result * 10 + (*itor - '0');
+        }
 
-    using CharToken = boost::tokenizer<boost::char_separator<char>>;
+        if (result > std::numeric_limits<T>::max())
+            return false;
+
+        value = static_cast<T>(result);
+        return true;
+    }
+
+    /* the address of a candidate line, copied on the stack to be NUL terminated */
+    bool ToAddress(StringView ip, uint16_t port, ICE::TransportAddress& address)
+    {
+        char buffer[64];
+        if (ip.size() >= sizeof(buffer))
+            return false;
+
+        memcpy(buffer, ip.data(), ip.size());
+        buffer[ip.size()] = 0;
+        return ICE::TransportAddress::Parse(buffer, port, address);
+    }
+
+    std::string ToString(StringView view)
+    {
+        return std::string(view.data(), view.size());
+    }
 
     const std::string& addrtype(const std::string& ip)
     {
@@ -114,31 +305,51 @@ namespace SDPDEF {
         return isUDP ? "UDP" : "TCP";
     }
 
-    bool IsValidAttrPos(std::string::size_type pos)
+    bool IsValidAddrType(StringView addr)
     {
-        return pos != std::string::npos;
-    }
-
-    bool IsValidCandType(const std::string& candtype)
-    {
-        return candtype == host_cand_type ||
-            candtype == srflx_cand_type ||
-            candtype == prflx_cand_type ||
-            candtype == relay_cand_type;
+        return addr == StringView(ipv4) || addr == StringView(ipv6);
     }
+}
 
-    bool IsValidAddrType(const std::string& addr)
+/* the lines of one m-section, views into the SDP being decoded */
+struct CSDP::MediaSection {
+    using Lines = std::vector<boost::string_view>;
+
+    boost::string_view  m_MLine;
+    boost::string_view  m_Rtcp;
+    boost::string_view  m_IceUfrag;
+    boost::string_view  m_IcePwd;
+    boost::string_view  m_Mid;
+    bool                m_bRtcp;
+    bool                m_bRtcpMux;
+    bool                m_bBundleOnly;
+    bool                m_bUfrag;
+    bool                m_bPwd;
+    uint8_t             m_IceOptions;
+    Lines               m_Candidates;       /* values of a=candidate */
+    Lines               m_RemoteCandidates; /* values of a=remote-candidates */
+
+    void Reset(boost::string_view mline)
     {
-        return addr == ipv4 || addr == ipv6;
+        // the line containers keep their capacity from one m-section to the next
+        m_MLine = mline;
+        m_bRtcp = m_bUfrag = m_bPwd = m_bRtcpMux = m_bBundleOnly = false;
+        m_Mid.clear();
+        m_IceOptions = 0;
+        m_Candidates.clear();
+        m_RemoteCandidates.clear();
     }
-}
+};
 
-CSDP::CSDP()
+CSDP::CSDP(STUN::RemoteFoundationInterner* foundations) :
+    m_FoundationIds(foundations), m_IceOptions(0), m_bIceLite(false)
 {
 }
 
 CSDP::~CSDP()
 {
+    for (auto itor = m_RemoteMedias.begin(); itor != m_RemoteMedias.end(); ++itor)
+        delete itor->second;
 }
 
 /*
@@ -159,590 +370,757 @@ CSDP::~CSDP()
     srflx raddr $L-PRIV-1.IP rport $L-PRIV-1.PORT
 */
 
-bool CSDP::Decode(const std::string & offer)
+bool CSDP::Decode(const std::string & offer, const MediaFilter& wanted)
 {
-    // decode c-line
-    auto pos = offer.find(SDPDEF::c_line);
-    if (!SDPDEF::IsValidAttrPos(pos) || !DecodeCLine(offer.substr(pos, offer.find(SDPDEF::CRLF, pos))))
+    // one pass over the lines, an m-section is decoded once the next m= or the end is reached
+    SDPDEF::LineReader reader(offer);
+    SDPDEF::StringView line;
+    MediaSection section;
+    SectionIndex skipped = { 0, 0 };
+    bool bInMedia = false;
+    bool bSkip = false;
+    bool bSesUfrag = false;
+    bool bSesPwd = false;
+
+    if (offer.size() > std::numeric_limits<uint32_t>::max())
     {
-        LOG_ERROR("CSDP", "Invalid c-line %s", offer.substr(pos, offer.find(SDPDEF::CRLF, pos)).c_str());
+        LOG_ERROR("SDP", "SDP too large [%d]", static_cast<int>(offer.size() >> 20));
         return false;
     }
 
-    auto mline_pos = offer.find(SDPDEF::m_line);
-    if (!SDPDEF::IsValidAttrPos(mline_pos))
+    while (reader.Next(line))
+    {
+        if (line.size() < 2 || line[1] != '=')
+        {
+            LOG_ERROR("SDP", "Invalid line %.*s", static_cast<int>(line.size()), line.data());
+            return false;
+        }
+
+        // the lines of an m-section nobody wants are not looked at
+        if (bSkip && line[0] != 'm')
+            continue;
+
+        auto value = line.substr(2);
+        switch (line[0])
+        {
+        case 'm':
+        {
+            if (bSkip)
+            {
+                skipped.m_Length = static_cast<uint32_t>(line.data() - offer.data()) - skipped.m_Offset;
+                m_Skipped.push_back(skipped);
+            }
+            else if (bInMedia)
+            {
+                if (!DecodeMediaSection(section, bSesUfrag))
+                    return false;
+            }
+            else if (bSesUfrag != bSesPwd)
+            {
+                // check if ice-pwd and ice-ufrag existed in session section
+                LOG_ERROR("SDP", "invalid ice-pwd, ice-ufrag attribute");
+                return false;
+            }
+
+            SDPDEF::StringView type;
+            bSkip = wanted && SDPDEF::FieldReader(value).Next(type) && !wanted(type);
+            skipped.m_Offset = static_cast<uint32_t>(line.data() - offer.data());
+            section.Reset(value);
+            bInMedia = true;
+            break;
+        }
+
+        case 'c':
+            if (!DecodeCLine(value))
+            {
+                LOG_ERROR("CSDP", "Invalid c-line %.*s", static_cast<int>(value.size()), value.data());
+                return false;
+            }
+            break;
+
+        case 'a':
+        {
+            SDPDEF::StringView name, attr;
+            SDPDEF::SplitAttribute(value, name, attr);
+            if (!bInMedia)
+            {
+                if (name == SDPDEF::icepwd_attr)
+                {
+                    m_IcePwd.assign(attr.data(), attr.size());
+                    bSesPwd = true;
+                }
+                else if (name == SDPDEF::iceufrag_attr)
+                {
+                    m_IceUfrag.assign(attr.data(), attr.size());
+                    bSesUfrag = true;
+                }
+                else if (name == SDPDEF::iceoptions_attr)
+                    m_IceOptions |= DecodeIceOptions(attr);
+                else if (name == SDPDEF::icelite_attr)
+                    m_bIceLite = true;
+                else if (name == SDPDEF::group_attr)
+                    DecodeGroup(attr);
+            }
+            else if (name == SDPDEF::candidate_attr)
+                section.m_Candidates.push_back(attr);
+            else if (name == SDPDEF::remotecand_attr)
+                section.m_RemoteCandidates.push_back(attr);
+            else if (name == SDPDEF::icepwd_attr)
+            {
+                section.m_IcePwd = attr;
+                section.m_bPwd = true;
+            }
+            else if (name == SDPDEF::iceufrag_attr)
+            {
+                section.m_IceUfrag = attr;
+                section.m_bUfrag = true;
+            }
+            else if (name == SDPDEF::rtcp_attr)
+            {
+                section.m_Rtcp = attr;
+                section.m_bRtcp = true;
+            }
+            else if (name == SDPDEF::iceoptions_attr)
+                section.m_IceOptions |= DecodeIceOptions(attr);
+            else if (name == SDPDEF::mid_attr)
+                section.m_Mid = attr;
+            else if (name == SDPDEF::rtcpmux_attr)
+                section.m_bRtcpMux = true;
+            else if (name == SDPDEF::bundleonly_attr)
+                section.m_bBundleOnly = true;
+            break;
+        }
+
+        default:
+            break;
+        }
+    }
+
+    if (!bInMedia)
     {
         LOG_ERROR("SDP", "Invlaid m-line");
         return false;
     }
 
-    // check if ice-pwd and ice-ufrag existed in session section
-    bool bUfragPwdExisted = false;
-    auto session_section = offer.substr(0, mline_pos);
-    auto ice_pwd_pos = session_section.find(SDPDEF::icepwd_line);
-    auto ice_ufrag_pos = session_section.find(SDPDEF::iceufrag_line);
+    if (bSkip)
+    {
+        skipped.m_Length = static_cast<uint32_t>(offer.size()) - skipped.m_Offset;
+        m_Skipped.push_back(skipped);
+    }
+    else if (!DecodeMediaSection(section, bSesUfrag))
+        return false;
 
-    if (SDPDEF::IsValidAttrPos(ice_pwd_pos) != SDPDEF::IsValidAttrPos(ice_ufrag_pos))
+    // the c-lines of the skipped m-sections are not decoded
+    if (m_Cline.empty() && !m_RemoteMedias.empty())
     {
-        LOG_ERROR("SDP", "invalid ice-pwd, ice-ufrag attribute");
+        LOG_ERROR("CSDP", "no c-line");
         return false;
     }
+    return true;
+}
 
-    if (SDPDEF::IsValidAttrPos(ice_pwd_pos))
+uint8_t CSDP::DecodeIceOptions(boost::string_view options)
+{
+    /*
+    RFC8839[5.6.  "ice-options" Attribute]
+    ice-options = "ice-options:" ice-option-tag *(SP ice-option-tag), unknown tags are ignored
+    */
+    uint8_t flags = 0;
+    SDPDEF::FieldReader reader(options);
+    SDPDEF::StringView tag;
+    while (reader.Next(tag))
     {
-        bUfragPwdExisted = true;
-        auto pwd_end = session_section.find(SDPDEF::CRLF, ice_pwd_pos + SDPDEF::icepwd_line.length());
-        m_IcePwd = session_section.substr(ice_pwd_pos + SDPDEF::icepwd_line.length(), pwd_end - ice_pwd_pos - SDPDEF::icepwd_line.length());
-
-        auto ufrag_end = session_section.find(SDPDEF::CRLF, ice_ufrag_pos + SDPDEF::iceufrag_line.length());
-        m_IceUfrag = session_section.substr(ice_ufrag_pos + SDPDEF::iceufrag_line.length(),ufrag_end - ice_ufrag_pos - SDPDEF::iceufrag_line.length());
+        if (tag == SDPDEF::trickle_option)
+            flags |= IceOption::trickle;
+        else if (tag == SDPDEF::ice2_option)
+            flags |= IceOption::ice2;
     }
+    return flags;
+}
+
+void CSDP::DecodeGroup(boost::string_view group)
+{
+    /*
+    RFC5888[5.  Group Attribute]
+    a=group:<semantics> *(SP identification-tag), only BUNDLE groups are kept
+    */
+    SDPDEF::FieldReader reader(group);
+    SDPDEF::StringView field;
+    if (!reader.Next(field) || field != SDPDEF::bundle_semantics)
+        return;
+
+    BundleGroup bundle;
+    while (reader.Next(field))
+        bundle.push_back(SDPDEF::ToString(field));
 
-    do
+    if (!bundle.empty())
+        m_Bundles.push_back(std::move(bundle));
+}
+
+bool CSDP::IsBundled(boost::string_view mid) const
+{
+    for (auto itor = m_Bundles.begin(); itor != m_Bundles.end(); ++itor)
     {
-        auto next_mline_pos = offer.find(SDPDEF::m_line, mline_pos + SDPDEF::m_line.length());
-        auto media_line = offer.substr(mline_pos, next_mline_pos == std::string::npos ? next_mline_pos :  next_mline_pos - mline_pos);
-        std::auto_ptr<RemoteMedia> media(DecodeMediaLine(media_line, bUfragPwdExisted));
-        if (!media.get() || !m_RemoteMedias.insert(std::make_pair(media->Type(), media.get())).second)
+        for (auto mid_itor = itor->begin(); mid_itor != itor->end(); ++mid_itor)
         {
-            LOG_ERROR("SDP", "Decode Media Line Error");
-            return false;
+            if (mid == SDPDEF::StringView(*mid_itor))
+                return true;
         }
-        media.release();
-        mline_pos = next_mline_pos;
-    } while (SDPDEF::IsValidAttrPos(mline_pos));
+    }
+    return false;
+}
 
-    return true;
+const CSDP::RemoteMedia* CSDP::BundleTransport(const RemoteMedia & media) const
+{
+    if (media.Mid().empty())
+        return &media;
+
+    for (auto itor = m_Bundles.begin(); itor != m_Bundles.end(); ++itor)
+    {
+        if (std::find(itor->begin(), itor->end(), media.Mid()) == itor->end())
+            continue;
+
+        // the tagged m-section may be one which was not decoded
+        for (auto media_itor = m_RemoteMedias.begin(); media_itor != m_RemoteMedias.end(); ++media_itor)
+        {
+            if (media_itor->second->Mid() == itor->front())
+                return media_itor->second;
+        }
+        break;
+    }
+    return &media;
 }
 
 bool CSDP::Encode(const ICE::Session & session, std::string& offer)
 {
-    auto Medias = session.GetMedias();
-    assert(Medias.size());
+    auto& medias = session.GetMedias();
+    assert(medias.size());
 
-    auto config = session.Config();
+    auto& config = session.Config();
 
-    bool isIPv4 = boost::asio::ip::address::from_string(config.DefaultIP()).is_v4();
+    boost::system::error_code error;
+    bool isIPv4 = boost::asio::ip::address::from_string(config.DefaultIP(), error).is_v4();
+    if (error)
+    {
+        LOG_ERROR("SDP", "invalid default ip %s", config.DefaultIP().c_str());
+        return false;
+    }
+
+    // the buffer of the caller keeps its capacity, a renegotiation encodes without allocating
+    size_t cands = 0;
+    for (auto media_itor = medias.begin(); media_itor != medias.end(); ++media_itor)
+    {
+        if (media_itor->second->IsBundled())
+            continue;
+
+        auto& streams = media_itor->second->GetStreams();
+        for (auto stream_itor = streams.begin(); stream_itor != streams.end(); ++stream_itor)
+            cands += stream_itor->second->GetCandidates().size();
+    }
+
+    offer.clear();
+    offer.reserve(SDPDEF::session_size_hint + medias.size() * SDPDEF::media_size_hint + cands * SDPDEF::candidate_size_hint);
 
-    std::ostringstream offer_stream;
+    SDPDEF::Writer writer(offer);
+    auto version = static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
 
     // encode "v" line
-    offer_stream << SDPDEF::v_line
-        << "0" << SDPDEF::CRLF;
+    writer.Write(SDPDEF::v_line).Write('0').Write(SDPDEF::CRLF);
 
     // encode "o" line
-    offer_stream << SDPDEF::o_line
-        << config.UserName() << " "
-        << std::chrono::steady_clock::now().time_since_epoch().count() << " "
-        << std::chrono::steady_clock::now().time_since_epoch().count() << " "
-        << SDPDEF::nettype << " "
-        << SDPDEF::addrtype(isIPv4) << " "
-        << config.DefaultIP() << SDPDEF::CRLF;
+    writer.Write(SDPDEF::o_line)
+        .Write(config.UserName()).Write(' ')
+        .Number(version).Write(' ')
+        .Number(version).Write(' ')
+        .Write(SDPDEF::nettype).Write(' ')
+        .Write(SDPDEF::addrtype(isIPv4)).Write(' ')
+        .Write(config.DefaultIP()).Write(SDPDEF::CRLF);
 
     // encode "s" line
-    offer_stream << SDPDEF::s_line
-        << config.SessionName() << SDPDEF::CRLF;
+    writer.Write(SDPDEF::s_line).Write(config.SessionName()).Write(SDPDEF::CRLF);
 
     // encode "c" line
-    offer_stream << SDPDEF::c_line
-        << SDPDEF::nettype << " "
-        << SDPDEF::addrtype(isIPv4) << " "
-        << config.DefaultIP() << SDPDEF::CRLF;
+    writer.Write(SDPDEF::c_line)
+        .Write(SDPDEF::nettype).Write(' ')
+        .Write(SDPDEF::addrtype(isIPv4)).Write(' ')
+        .Write(config.DefaultIP()).Write(SDPDEF::CRLF);
 
     // encode "t" line
-    offer_stream << SDPDEF::t_line
-        << 0 << " "
-        << 0 << SDPDEF::CRLF;
+    writer.Write(SDPDEF::t_line).Write("0 0").Write(SDPDEF::CRLF);
 
+    // encode "a=ice-options", RFC8445 10
+    writer.Write(SDPDEF::iceoptions_line).Write(SDPDEF::ice2_option).Write(SDPDEF::CRLF);
 
-    //encode "a=candidate"
-    for (auto media_itor = Medias.begin(); media_itor != Medias.end(); ++media_itor)
-    {
-        auto *rtp = media_itor->second->GetStreamById(static_cast<uint16_t>(ICE::Media::ClassicID::RTP));
-
-        // encode "m" line
-        offer_stream << SDPDEF::m_line
-            << media_itor->first << " "
-            << rtp->GetHostPort() << " "
-            << rtp->GetTransportProtocol() << " "
-            << 0 << SDPDEF::CRLF;
-
-        // encode "rtcp" line
-        auto *rtcp = media_itor->second->GetStreamById(static_cast<uint16_t>(ICE::Media::ClassicID::RTCP));
-        assert(rtcp);
-        offer_stream << SDPDEF::rtcp_line
-            << rtcp->GetHostPort() << SDPDEF::CRLF;
-
-        // encode "a=ice-pwd"
-        offer_stream << SDPDEF::icepwd_line
-            << media_itor->second->IcePwd() << SDPDEF::CRLF;
-
-        //encode "a=ice-ufrag"
-        offer_stream << SDPDEF::iceufrag_line
-            << media_itor->second->IceUfrag() << SDPDEF::CRLF;
-
-        auto Streams = media_itor->second->GetStreams();
-        assert(Streams.size());
-        for (auto stream_itor = Streams.begin(); stream_itor != Streams.end(); ++stream_itor)
+    // encode "a=group:BUNDLE", the transport first as the tagged m-section, the mid is the media name
+    for (auto media_itor = medias.begin(); media_itor != medias.end(); ++media_itor)
+    {
+        bool bGroup = false;
+        for (auto bundled_itor = medias.begin(); bundled_itor != medias.end(); ++bundled_itor)
         {
-            auto& cands = stream_itor->second->GetCandidates();
-            const char* transport = SDPDEF::Transport(stream_itor->second->IsUDP());
+            if (bundled_itor->second->Transport() != media_itor->second)
+                continue;
 
-            for (auto& cand = cands.begin(); cand != cands.end(); ++cand)
-            {
-                /*
-                rfc5245
-                15.1.  "candidate" Attribute
-                */
-                offer_stream << SDPDEF::candidate_line
-                    << cand->first->Foundation() << " "
-                    << cand->first->ComponentId() << " "
-                    << transport << " "
-                    << cand->first->Priority() << " "
-                    << cand->first->TransationIP() << " "
-                    << cand->first->TransationPort() << " "
-                    << SDPDEF::candtype << " "
-                    << cand->first->TypeName();
-
-                if (!cand->first->IsHost())
-                {
-                    offer_stream << " "
-                        << SDPDEF::reladdr << " "
-                        << cand->first->RelatedIP() << " "
-                        << SDPDEF::relport << " "
-                        << cand->first->RelatedPort();
-                }
-                offer_stream << SDPDEF::CRLF;
-            }
+            if (!bGroup)
+                writer.Write(SDPDEF::bundle_line).Write(' ').Write(media_itor->first);
+            writer.Write(' ').Write(bundled_itor->first);
+            bGroup = true;
         }
+
+        if (bGroup)
+            writer.Write(SDPDEF::CRLF);
     }
 
+    ICE::Session::SelectedCandidates selected;
+    for (auto media_itor = medias.begin(); media_itor != medias.end(); ++media_itor)
+    {
+        if (!EncodeMedia(media_itor->first, *media_itor->second, offer))
+            return false;
+
+        /*
+        RFC8839[5.2.  "remote-candidates" Attribute]
+        once its checks concluded the controlling agent lists the remote candidates of the
+        selected pairs, the answerer then keeps these pairs
+        */
+        if (!session.SelectedRemoteCandidates(media_itor->first, selected))
+            continue;
 
-    offer = offer_stream.str();
-    return offer.length() > 0;
+        writer.Write(SDPDEF::remotecand_line);
+        for (auto itor = selected.begin(); itor != selected.end(); ++itor)
+        {
+            if (itor != selected.begin())
+                writer.Write(' ');
+            writer.Number(itor->first).Write(' ')
+                .Write(itor->second.IP()).Write(' ')
+                .Number(itor->second.m_Port);
+        }
+        writer.Write(SDPDEF::CRLF);
+    }
+    return true;
 }
 
-CSDP::RemoteMedia* CSDP::DecodeMediaLine(const std::string & mediaLine, bool bSesUfragPwdExisted)
+bool CSDP::EncodeMedia(const std::string & name, const ICE::Media & media, std::string & sdp)
 {
-    assert(SDPDEF::IsValidAttrPos(mediaLine.find(SDPDEF::m_line)));
+    auto *rtp = media.GetStreamById(static_cast<uint16_t>(ICE::Media::ClassicID::RTP));
+    auto *rtcp = media.GetStreamById(static_cast<uint16_t>(ICE::Media::ClassicID::RTCP));
+    if (!rtp || (!rtcp && !media.IsRtcpMux()))
+    {
+        LOG_ERROR("SDP", "media %s has no rtp or rtcp stream", name.c_str());
+        return false;
+    }
+
+    SDPDEF::Writer writer(sdp);
 
-    using Content = std::vector<std::string>;
+    /*
+    RFC8843[7.2.1.  Suggesting the Offerer BUNDLE Address:Port]
+    a bundled m-section is bundle-only with port 0, the ICE attributes and candidates
+    are only in the tagged m-section
+    */
+    if (media.IsBundled())
+    {
+        writer.Write(SDPDEF::m_line)
+            .Write(name).Write(' ')
+            .Write('0').Write(' ')
+            .Write(rtp->GetTransportProtocol()).Write(' ')
+            .Write('0').Write(SDPDEF::CRLF);
+
+        writer.Write(SDPDEF::mid_line).Write(name).Write(SDPDEF::CRLF);
+        writer.Write(SDPDEF::bundleonly_line).Write(SDPDEF::CRLF);
+        writer.Write(SDPDEF::rtcpmux_line).Write(SDPDEF::CRLF);
+        return true;
+    }
+
+    // encode "m" line
+    writer.Write(SDPDEF::m_line)
+        .Write(name).Write(' ')
+        .Number(rtp->GetHostPort()).Write(' ')
+        .Write(rtp->GetTransportProtocol()).Write(' ')
+        .Write('0').Write(SDPDEF::CRLF);
+
+    writer.Write(SDPDEF::mid_line).Write(name).Write(SDPDEF::CRLF);
+
+    // encode "rtcp" line, RFC5761 5.1.1 or "rtcp-mux"
+    if (media.IsRtcpMux())
+        writer.Write(SDPDEF::rtcpmux_line).Write(SDPDEF::CRLF);
+    else
+        writer.Write(SDPDEF::rtcp_line).Number(rtcp->GetHostPort()).Write(SDPDEF::CRLF);
 
-    // decode "m="
-    std::string info(mediaLine.substr(SDPDEF::m_line.length(), mediaLine.find(SDPDEF::CRLF) - SDPDEF::m_line.length()));
+    // encode "a=ice-pwd"
+    writer.Write(SDPDEF::icepwd_line).Write(media.IcePwd()).Write(SDPDEF::CRLF);
 
-    SDPDEF::CharToken token(info, SDPDEF::whitespace_separator);
+    //encode "a=ice-ufrag"
+    writer.Write(SDPDEF::iceufrag_line).Write(media.IceUfrag()).Write(SDPDEF::CRLF);
 
-    Content media_content;
-    for (auto itor = token.begin(); itor != token.end(); ++itor)
+    //encode "a=candidate"
+    auto& streams = media.GetStreams();
+    assert(streams.size());
+    for (auto stream_itor = streams.begin(); stream_itor != streams.end(); ++stream_itor)
+    {
+        auto& cands = stream_itor->second->GetCandidates();
+        for (auto cand_itor = cands.begin(); cand_itor != cands.end(); ++cand_itor)
+            EncodeCandidate(*cand_itor->first, stream_itor->second->IsUDP(), sdp);
+    }
+    return true;
+}
+
+void CSDP::EncodeCandidate(const STUN::Candidate & cand, bool bUDP, std::string & sdp)
+{
+    /*
+    rfc5245
+    15.1.  "candidate" Attribute
+    */
+    SDPDEF::Writer writer(sdp);
+    writer.Write(SDPDEF::candidate_line)
+        .Number(cand.Foundation()).Write(' ')    /* the interned id, 1*32ice-char */
+        .Number(cand.ComponentId()).Write(' ')
+        .Write(SDPDEF::Transport(bUDP)).Write(' ')
+        .Number(cand.Priority()).Write(' ')
+        .Write(cand.TransationIP()).Write(' ')
+        .Number(cand.TransationPort()).Write(' ')
+        .Write(SDPDEF::candtype).Write(' ')
+        .Write(cand.TypeName());
+
+    if (!cand.IsHost())
     {
-        media_content.push_back(*itor);
+        writer.Write(' ')
+            .Write(SDPDEF::reladdr).Write(' ')
+            .Write(cand.RelatedIP()).Write(' ')
+            .Write(SDPDEF::relport).Write(' ')
+            .Number(cand.RelatedPort());
     }
+    writer.Write(SDPDEF::CRLF);
+}
 
+bool CSDP::DecodeMediaSection(const MediaSection & section, bool bSesUfragPwdExisted)
+{
     /*
     rfc4566
     m=<media> <port>/<number of ports> <proto> <fmt>
     */
-    if (media_content.size() < SDPDEF::media_content_num)
+    SDPDEF::StringView media_content[SDPDEF::media_content_num];
+    if (SDPDEF::FieldReader(section.m_MLine).Read(media_content, SDPDEF::media_content_num) < SDPDEF::media_content_num)
     {
-        LOG_ERROR("SDP", "Decode SDP, illegal m= %s", info.c_str());
-        return nullptr;
+        LOG_ERROR("SDP", "Decode SDP, illegal m= %.*s", static_cast<int>(section.m_MLine.size()), section.m_MLine.data());
+        return false;
     }
 
     /*
-    decode a=rtcp:
+    RFC3605 a=rtcp:<port> [<nettype> <addrtype> <connection-address>]
     */
-    auto rtcp_pos = mediaLine.find(SDPDEF::rtcp_line);
-    if (SDPDEF::IsValidAttrPos(rtcp_pos))
+    if (section.m_bRtcp)
     {
-        auto rtcp_content = mediaLine.substr(rtcp_pos + SDPDEF::rtcp_line.length(),
-            mediaLine.find(SDPDEF::CRLF, rtcp_pos) - rtcp_pos - SDPDEF::rtcp_line.length());
-        try
+        SDPDEF::StringView rtcp_port;
+        uint16_t port;
+        if (!SDPDEF::FieldReader(section.m_Rtcp).Next(rtcp_port) || !SDPDEF::ToNumber(rtcp_port, port))
         {
-            boost::lexical_cast<uint16_t>(rtcp_content);
-        }
-        catch (const std::exception&)
-        {
-            LOG_WARNING("SDP", "Decode SDP, illegal rtcp content a=rtcp:%s", rtcp_content);
-            return nullptr;
+            LOG_WARNING("SDP", "Decode SDP, illegal rtcp content a=rtcp:%.*s", static_cast<int>(section.m_Rtcp.size()), section.m_Rtcp.data());
+            return false;
         }
     }
 
     /*
     RFC5245[15.4.]
-    decode ice-ufrag and ice-pwd
+    decode ice-ufrag and ice-pwd, RFC8843 a bundled m-section shares the ones of the tagged m-section
     */
-    auto ice_ufrag_pos = mediaLine.find(SDPDEF::iceufrag_line);
-    auto ice_pwd_pos = mediaLine.find(SDPDEF::icepwd_line);
-
-    bool bUfragExisted = SDPDEF::IsValidAttrPos(ice_ufrag_pos);
-    bool bPwdExisted = SDPDEF::IsValidAttrPos(ice_pwd_pos);
-
-    if ((bUfragExisted != bPwdExisted) || (!bSesUfragPwdExisted && !bUfragExisted))
+    bool bShared = section.m_bBundleOnly || (!section.m_Mid.empty() && IsBundled(section.m_Mid));
+    if ((section.m_bUfrag != section.m_bPwd) || (!bSesUfragPwdExisted && !section.m_bUfrag && !bShared))
     {
         LOG_ERROR("Session", "Decode SDP, illegal ufrag or pwd");
-        return nullptr;
+        return false;
     }
 
-    std::string ice_ufrag = "";
-    std::string ice_pwd = "";
-
-    if (bUfragExisted)
-    {
-        assert(bPwdExisted);
-        ice_ufrag = mediaLine.substr(ice_ufrag_pos + SDPDEF::iceufrag_line.length(), mediaLine.find(SDPDEF::CRLF, ice_ufrag_pos) - ice_ufrag_pos - SDPDEF::iceufrag_line.length());
-        ice_pwd = mediaLine.substr(ice_pwd_pos + SDPDEF::icepwd_line.length(), mediaLine.find(SDPDEF::CRLF, ice_pwd_pos) - ice_pwd_pos - SDPDEF::icepwd_line.length());
-    }
+    auto& type = media_content[static_cast<uint16_t>(SDPDEF::MediaAttrIndex::media)];
+    std::auto_ptr<RemoteMedia> remoteMedia(new RemoteMedia(SDPDEF::ToString(type), SDPDEF::ToString(section.m_IcePwd), SDPDEF::ToString(section.m_IceUfrag),
+        m_IceOptions | section.m_IceOptions));
+    remoteMedia->m_Mid.assign(section.m_Mid.data(), section.m_Mid.size());
+    remoteMedia->m_bRtcpMux = section.m_bRtcpMux;
 
     /*
-    RFC5245[15.1.  "candidate" Attribute]
-    Decode a=candidate
+    the records of the m-section are placed in the arena in one go, then grouped by
+    component so pairing walks contiguous memory
     */
-
-    std::auto_ptr<RemoteMedia> remoteMedia(new RemoteMedia(media_content[static_cast<uint16_t>(SDPDEF::MediaAttrIndex::media)],ice_pwd, ice_ufrag));
-
-    for (auto cand_finder = mediaLine.find(SDPDEF::candidate_line); SDPDEF::IsValidAttrPos(cand_finder);
-        cand_finder = mediaLine.find(SDPDEF::candidate_line, cand_finder + SDPDEF::candidate_line.length()))
+    if (section.m_Candidates.size() > 0xFFFF)
     {
-        assert(SDPDEF::IsValidAttrPos(cand_finder));
-        auto cand_end_pos = mediaLine.find(SDPDEF::CRLF, cand_finder);
-        auto info_len = cand_end_pos == std::string::npos ? cand_end_pos : cand_end_pos - cand_finder - SDPDEF::candidate_line.length();
-
-        Content cand_content;
-        auto info = mediaLine.substr(cand_finder + SDPDEF::candidate_line.length(), info_len);
-
-        SDPDEF::CharToken token(info, SDPDEF::whitespace_separator);
-
-        for (auto itor = token.begin(); itor != token.end(); ++itor)
-            cand_content.push_back(*itor);
-
-        // check content number
-        if (cand_content.size() < SDPDEF::min_cand_content_num)
-        {
-            LOG_ERROR("Session", "Decode SDP, invalid candidate[host size invalid]: %s", mediaLine.substr(cand_finder, cand_end_pos).c_str());
-            return nullptr;
-        }
-
-        // check 'typ'
-        if (cand_content[static_cast<uint16_t>(SDPDEF::CandAttrIndex::typ)] != SDPDEF::typ)
-        {
-            LOG_ERROR("Session", "Decode SDP, candidate typ Must be \'typ\' :%s", mediaLine.substr(cand_finder, cand_end_pos).c_str());
-            return nullptr;
-        }
-
-        // check 'candidate_type' must be 'host, srflx,prflx,relay'
-        auto candtype = cand_content[static_cast<uint16_t>(SDPDEF::CandAttrIndex::candtype)];
-        if (!SDPDEF::IsValidCandType(candtype))
-        {
-            LOG_ERROR("Session", "Decode SDP, invalid candidate type :%s", candtype.c_str());
-            return nullptr;
-        }
-
-        // if is non-host-candidate, check content number
-        bool isHostCand = (candtype == SDPDEF::host_cand_type);
-        if (!isHostCand && cand_content.size() < SDPDEF::nonhost_cand_content_num)
-        {
-            LOG_ERROR("Session", "Decode SDP, invalid candidate[non-host size invalid]: %s", mediaLine.substr(cand_finder, cand_end_pos).c_str());
-            return nullptr;
-        }
+        LOG_ERROR("SDP", "too many candidates [%d]", static_cast<int>(section.m_Candidates.size()));
+        return false;
+    }
 
-        // check 'raddr' and 'rport '
-        if (!isHostCand &&
-            (cand_content[static_cast<uint16_t>(SDPDEF::CandAttrIndex::raddr)] != SDPDEF::reladdr) &&
-            (cand_content[static_cast<uint16_t>(SDPDEF::CandAttrIndex::rport)] != SDPDEF::relport))
-        {
-            LOG_ERROR("Session", "Decode SDP, invalid raddr or rport: %s", mediaLine.substr(cand_finder, cand_end_pos).c_str());
-            return nullptr;
-        }
+    auto cands = m_Arena.AllocateArray<STUN::RemoteCandidate>(section.m_Candidates.size());
+    uint16_t count = 0;
+    for (auto itor = section.m_Candidates.begin(); itor != section.m_Candidates.end(); ++itor)
+    {
+        // a candidate which cannot be used is left with component 0
+        STUN::RemoteCandidate cand;
+        if (!DecodeCandidate(*itor, cand))
+            return false;
 
-        cand_content[static_cast<uint16_t>(SDPDEF::CandAttrIndex::transport)];
+        if (cand.m_CompId)
+            cands[count++] = cand;
+    }
 
-        uint32_t compId, priority;
-        uint16_t conn_port(0), conn_rport(0);
-        try
-        {
-            priority = boost::lexical_cast<uint32_t>(cand_content[static_cast<uint16_t>(SDPDEF::CandAttrIndex::priority)]);
-            compId = boost::lexical_cast<uint8_t>(cand_content[static_cast<uint8_t>(SDPDEF::CandAttrIndex::compId)]);
-            conn_port = boost::lexical_cast<uint16_t>(cand_content[static_cast<uint16_t>(SDPDEF::CandAttrIndex::conn_port)]);
-            if (!isHostCand)
-                conn_rport = boost::lexical_cast<uint16_t>(cand_content[static_cast<uint16_t>(SDPDEF::CandAttrIndex::conn_rport)]);
-        }
-        catch (const std::exception&)
-        {
-            LOG_ERROR("Session", "Decode SDP, invalid priority, component, or port");
-            return nullptr;
-        }
+    std::stable_sort(cands, cands + count, [](const STUN::RemoteCandidate& a, const STUN::RemoteCandidate& b) {
+        return a.m_CompId < b.m_CompId;
+    });
+    remoteMedia->AssignCandidates(cands, count);
 
-        if (candtype == SDPDEF::host_cand_type)
-        {
-            if (!remoteMedia->AddHostCandidate(compId, priority,
-                cand_content[static_cast<uint8_t>(SDPDEF::CandAttrIndex::foundation)],
-                cand_content[static_cast<uint8_t>(SDPDEF::CandAttrIndex::conn_addr)],
-                conn_port))
-            {
-                LOG_ERROR("SDP", "add host candidate failed");
-                return nullptr;
-            }
-        }
-        else if (candtype == SDPDEF::srflx_cand_type)
+    /*
+        RFC5245 [15.2.  "remote-candidates" Attribute]
+        remote-candidate = component-ID SP connection-address SP port
+     */
+    for (auto itor = section.m_RemoteCandidates.begin(); itor != section.m_RemoteCandidates.end(); ++itor)
+    {
+        SDPDEF::FieldReader reader(*itor);
+        SDPDEF::StringView r_cand_content[SDPDEF::remote_cands_num];
+        uint16_t count;
+        while ((count = reader.Read(r_cand_content, SDPDEF::remote_cands_num)) > 0)
         {
-            if (!remoteMedia->AddSrflxCandidate(compId, priority,
-                cand_content[static_cast<uint8_t>(SDPDEF::CandAttrIndex::foundation)],
-                cand_content[static_cast<uint8_t>(SDPDEF::CandAttrIndex::conn_addr)],conn_port,
-                cand_content[static_cast<uint8_t>(SDPDEF::CandAttrIndex::conn_raddr)], conn_rport))
+            uint8_t compId;
+            uint16_t port;
+            if (count < SDPDEF::remote_cands_num ||
+                !SDPDEF::ToNumber(r_cand_content[static_cast<uint16_t>(SDPDEF::RemoteCandsIndex::compId)], compId) ||
+                !SDPDEF::ToNumber(r_cand_content[static_cast<uint16_t>(SDPDEF::RemoteCandsIndex::connPort)], port))
             {
-                LOG_ERROR("SDP", "add srflx candidate failed");
-                return nullptr;
+                LOG_ERROR("SDP", "remote-candidates content invalid: %.*s", static_cast<int>(itor->size()), itor->data());
+                return false;
             }
-        }
-        else if (candtype == SDPDEF::relay_cand_type)
-        {
-            if (!remoteMedia->AddRelayCandidate(compId, priority,
-                cand_content[static_cast<uint8_t>(SDPDEF::CandAttrIndex::foundation)],
-                cand_content[static_cast<uint8_t>(SDPDEF::CandAttrIndex::conn_addr)], conn_port,
-                cand_content[static_cast<uint8_t>(SDPDEF::CandAttrIndex::conn_raddr)], conn_rport))
+
+            RemoteMedia::SelectedCand selected;
+            selected.m_CompId = compId;
+            if (!SDPDEF::ToAddress(r_cand_content[static_cast<uint16_t>(SDPDEF::RemoteCandsIndex::connAddr)], port, selected.m_Addr))
             {
-                LOG_ERROR("SDP", "add relay candidate failed");
-                return nullptr;
+                auto& addr = r_cand_content[static_cast<uint16_t>(SDPDEF::RemoteCandsIndex::connAddr)];
+                LOG_WARNING("SDP", "skip remote candidate with address %.*s", static_cast<int>(addr.size()), addr.data());
+                continue;
             }
+            remoteMedia->m_Selected.push_back(selected);
         }
     }
 
-
-    /*
-        RFC5245 [15.2.  "remote-candidates" Attribute]
-     */
-    for (auto r_cand_finer = mediaLine.find(SDPDEF::remotecand_line); SDPDEF::IsValidAttrPos(r_cand_finer);
-        r_cand_finer = mediaLine.find(SDPDEF::remotecand_line, r_cand_finer + SDPDEF::remotecand_line.length()))
+    if (!m_RemoteMedias.insert(std::make_pair(remoteMedia->Type(), remoteMedia.get())).second)
     {
-        auto end_pos    = mediaLine.find(SDPDEF::CRLF, r_cand_finer);
-        auto info_len   = end_pos == std::string::npos ? end_pos : end_pos - r_cand_finer - SDPDEF::remotecand_line.length();
-        Content r_cand_content;
-        auto info = mediaLine.substr(end_pos + SDPDEF::remotecand_line.length(), info_len);
-        SDPDEF::CharToken token(info, SDPDEF::whitespace_separator);
-
-        for (auto itor = token.begin(); itor != token.end(); ++itor)
-            r_cand_content.push_back(*itor);
-
-        if (r_cand_content.size() % SDPDEF::remote_cands_num)
-        {
-            LOG_ERROR("SDP", "remote-candidates content invalid: %s",
-                mediaLine.substr(end_pos + SDPDEF::remotecand_line.length(), end_pos).c_str());
-            return nullptr;
-        }
-
-        
-        r_cand_finer = end_pos;
+        LOG_ERROR("SDP", "Decode Media Line Error, duplicated media %s", remoteMedia->Type().c_str());
+        return false;
     }
-    return remoteMedia.release();
+
+    remoteMedia.release();
+    return true;
 }
 
-bool CSDP::DecodeCLine(const std::string & cline)
+bool CSDP::DecodeCandidate(boost::string_view candidate, STUN::RemoteCandidate & cand)
 {
     /*
-      rfc4566[5.7.  Connection Data ("c=")]
-     */
-
-    assert(cline.find(SDPDEF::c_line) == 0);
-
-    auto end_pos = cline.find(SDPDEF::CRLF);
-    auto info = cline.substr(SDPDEF::c_line.length(), end_pos - SDPDEF::c_line.length());
-    SDPDEF::CharToken token(info, SDPDEF::whitespace_separator);
+    RFC5245[15.1.  "candidate" Attribute]
+    Decode a=candidate, the extension attributes after rel-port are ignored
+    */
+    SDPDEF::StringView cand_content[static_cast<uint16_t>(SDPDEF::CandAttrIndex::max_support_attr)];
+    auto count = SDPDEF::FieldReader(candidate).Read(cand_content, static_cast<uint16_t>(SDPDEF::CandAttrIndex::max_support_attr));
 
-    std::vector<std::string> content;
-    for (auto itor = token.begin(); itor != token.end(); ++itor)
+    // check content number
+    if (count < SDPDEF::min_cand_content_num)
     {
-        content.push_back(*itor);
+        LOG_ERROR("Session", "Decode SDP, invalid candidate[host size invalid]: %.*s", static_cast<int>(candidate.size()), candidate.data());
+        return false;
     }
 
-
-    if (content.size() != SDPDEF::cline_content_num)
+    // check 'typ'
+    if (cand_content[static_cast<uint16_t>(SDPDEF::CandAttrIndex::typ)] != SDPDEF::StringView(SDPDEF::typ))
+    {
+        LOG_ERROR("Session", "Decode SDP, candidate typ Must be \'typ\' :%.*s", static_cast<int>(candidate.size()), candidate.data());
         return false;
+    }
 
-    if (content[static_cast<uint16_t>(SDPDEF::CLineIndex::nettype)] != SDPDEF::nettype)
+    // check 'candidate_type' must be 'host, srflx,prflx,relay'
+    auto& candtype = cand_content[static_cast<uint16_t>(SDPDEF::CandAttrIndex::candtype)];
+    auto isHostCand = candtype == SDPDEF::StringView(SDPDEF::host_cand_type);
+    auto isSrflxCand = candtype == SDPDEF::StringView(SDPDEF::srflx_cand_type);
+    auto isPrflxCand = candtype == SDPDEF::StringView(SDPDEF::prflx_cand_type);
+    auto isRelayCand = candtype == SDPDEF::StringView(SDPDEF::relay_cand_type);
+    if (!isHostCand && !isSrflxCand && !isPrflxCand && !isRelayCand)
     {
-        LOG_ERROR("SDP", "Invalid nettype %s", content[static_cast<uint16_t>(SDPDEF::CLineIndex::nettype)].c_str());
+        LOG_ERROR("Session", "Decode SDP, invalid candidate type :%.*s", static_cast<int>(candtype.size()), candtype.data());
         return false;
     }
 
-    auto addrtype = content[static_cast<uint16_t>(SDPDEF::CLineIndex::addrtype)];
-    if (!SDPDEF::IsValidAddrType(addrtype))
+    // if is non-host-candidate, check content number, 'raddr' and 'rport'
+    if (!isHostCand &&
+        (count < SDPDEF::nonhost_cand_content_num ||
+        cand_content[static_cast<uint16_t>(SDPDEF::CandAttrIndex::raddr)] != SDPDEF::StringView(SDPDEF::reladdr) ||
+        cand_content[static_cast<uint16_t>(SDPDEF::CandAttrIndex::rport)] != SDPDEF::StringView(SDPDEF::relport)))
     {
-        LOG_ERROR("SDP", "Invalid addrtype :%s", addrtype.c_str());
+        LOG_ERROR("Session", "Decode SDP, invalid raddr or rport: %.*s", static_cast<int>(candidate.size()), candidate.data());
         return false;
     }
 
-    SDPDEF::CharToken connaaddr_token(content[static_cast<uint16_t>(SDPDEF::CLineIndex::connaddr)], SDPDEF::slash_separator);
-
-    std::vector<std::string> connaddr_content;
-    for (auto itor = connaaddr_token.begin(); itor != connaaddr_token.end(); ++itor)
+    uint8_t compId;
+    uint32_t priority;
+    uint16_t conn_port(0), conn_rport(0);
+    if (!SDPDEF::ToNumber(cand_content[static_cast<uint16_t>(SDPDEF::CandAttrIndex::priority)], priority) ||
+        !SDPDEF::ToNumber(cand_content[static_cast<uint16_t>(SDPDEF::CandAttrIndex::compId)], compId) || !compId ||
+        !SDPDEF::ToNumber(cand_content[static_cast<uint16_t>(SDPDEF::CandAttrIndex::conn_port)], conn_port) ||
+        (!isHostCand && !SDPDEF::ToNumber(cand_content[static_cast<uint16_t>(SDPDEF::CandAttrIndex::conn_rport)], conn_rport)))
     {
-        connaddr_content.push_back(*itor);
+        LOG_ERROR("Session", "Decode SDP, invalid priority, component, or port");
+        return false;
     }
 
+    cand = STUN::RemoteCandidate();
+    cand.m_Priority = priority;
+    cand.m_Protocol = ICE::Protocol::udp;
+    cand.m_Type = isHostCand ? STUN::Candidate::TypeRef::host :
+        isSrflxCand ? STUN::Candidate::TypeRef::server_reflexive :
+        isPrflxCand ? STUN::Candidate::TypeRef::peer_reflexive : STUN::Candidate::TypeRef::relayed;
 
-    if (SDPDEF::ipv4 == addrtype)
+    // only UDP candidates are paired, RFC6544 TCP candidates are skipped
+    auto& transport = cand_content[static_cast<uint16_t>(SDPDEF::CandAttrIndex::transport)];
+    if (!boost::algorithm::iequals(transport, SDPDEF::StringView(SDPDEF::UDP)))
     {
-        if (connaddr_content.size() <= 3)
-        {
-            if (!m_Cline.insert(std::make_pair(connaddr_content[0], true)).second)
-            {
-                LOG_ERROR("SDP", "save CLine error");
-                return false;
-            }
-            if (connaddr_content.size() > 1)
-            {
-                try
-                {
-                    auto ttl = boost::lexical_cast<uint16_t>(connaddr_content[1]); // TTL
-
-                    // mulitcast
-                    if (connaddr_content.size() > 2)
-                    {
-                        auto number_of_addr = boost::lexical_cast<uint16_t>(connaddr_content[2]); // number of number of addresses
-
-                        uint16_t last_number = boost::lexical_cast<uint16_t>(*connaddr_content[0].rbegin());
-                        std::string ip = connaddr_content[0].substr(0, connaddr_content[0].length() - 1);
-                        for (decltype(number_of_addr)i = 0; i < number_of_addr - 1; ++i)
-                        {
-                            if (!m_Cline.insert(std::make_pair(ip + boost::lexical_cast<char>(++last_number), true)).second)
-                            {
-                                LOG_ERROR("SDP", "save CLine error");
-                                return false;
-                            }
-                        }
-                    }
-                }
-                catch (const std::exception&)
-                {
-                    LOG_ERROR("SDP", "Invalid CLine");
-                    return false;
-                }
-            }
-        }
-        else
-        {
-            LOG_ERROR("SDP", "Invalid CLine");
-            return false;
-        }
+        LOG_INFO("SDP", "skip %.*s candidate", static_cast<int>(transport.size()), transport.data());
+        return true;
     }
-    else
-    {
-        if (connaddr_content.size() > 2)
-        {
-            LOG_ERROR("SDP", "invlaid CLine with IPv6 addrtype");
-            return false;
-        }
 
-        if (!m_Cline.insert(std::make_pair(connaddr_content[0], false)).second)
-        {
-            LOG_ERROR("SDP", "Cannot Save CLine");
-            return false;
-        }
-
-        if (connaddr_content.size() == 2)
-        {
-            //TTL
-        }
+    // an address which is no IP literal (FQDN, mDNS) cannot be checked, the candidate is skipped
+    if (!SDPDEF::ToAddress(cand_content[static_cast<uint16_t>(SDPDEF::CandAttrIndex::conn_addr)], conn_port, cand.m_Addr))
+    {
+        auto& addr = cand_content[static_cast<uint16_t>(SDPDEF::CandAttrIndex::conn_addr)];
+        LOG_WARNING("SDP", "skip candidate with address %.*s", static_cast<int>(addr.size()), addr.data());
+        return true;
     }
 
+    if (!isHostCand && !SDPDEF::ToAddress(cand_content[static_cast<uint16_t>(SDPDEF::CandAttrIndex::conn_raddr)], conn_rport, cand.m_Related))
+        cand.m_Related = ICE::TransportAddress();
+
+    InternFoundation(cand_content[static_cast<uint16_t>(SDPDEF::CandAttrIndex::foundation)], cand);
+    cand.m_CompId = compId;
     return true;
 }
 
-
-CSDP::RemoteMedia::~RemoteMedia()
+void CSDP::InternFoundation(boost::string_view foundation, STUN::RemoteCandidate & cand)
 {
-    for (auto itor = m_Cands.begin(); itor != m_Cands.end(); ++itor)
+    auto found = m_Foundations.Find(foundation);
+    if (!found)
     {
-        assert(itor->second);
-
-        for (auto cand_itor = itor->second->begin(); cand_itor != itor->second->end(); ++cand_itor)
-            delete *cand_itor;
-
-        delete itor->second;
+        auto copy = m_Arena.CopyString(foundation.data(), foundation.size());
+        auto id = m_FoundationIds ? m_FoundationIds->Intern(foundation) : static_cast<uint32_t>(m_Foundations.Size());
+        Foundation interned = { copy, id };
+        found = m_Foundations.Insert(boost::string_view(copy, foundation.size()), interned).first;
     }
+
+    cand.m_Foundation   = found->m_Foundation;
+    cand.m_FoundationId = found->m_Id;
 }
 
-bool CSDP::RemoteMedia::AddHostCandidate(uint8_t compId, uint32_t pri, const std::string & foundation, const std::string & baseIP, uint16_t basePort)
+size_t CSDP::ViewHash::operator()(boost::string_view view) const
 {
-    std::auto_ptr<STUN::HostCandidate> cand(new STUN::HostCandidate(compId, pri, foundation, baseIP, basePort));
-
-    if (cand.get() && AddCandidate(compId, cand.get()))
-    {
-        cand.release();
-        return true;
-    }
-    return false;
+    return PG::FNV1a(view.data(), view.size());
 }
 
-bool CSDP::RemoteMedia::AddSrflxCandidate(uint8_t compId, uint32_t pri, const std::string & foundation, const std::string & baseIP, uint16_t basePort, const std::string & relatedIP, uint16_t relatedPort)
+bool CSDP::DecodeCLine(boost::string_view cline)
 {
-    std::auto_ptr<STUN::SrflxCandidate> cand(new STUN::SrflxCandidate(compId, pri, foundation, baseIP, basePort, relatedIP, relatedPort));
+    /*
+      rfc4566[5.7.  Connection Data ("c=")]
+      c=<nettype> <addrtype> <connection-address>
+     */
+    SDPDEF::FieldReader reader(cline);
+    SDPDEF::StringView content[SDPDEF::cline_content_num + 1];
+    if (reader.Read(content, SDPDEF::cline_content_num + 1) != SDPDEF::cline_content_num)
+        return false;
 
-    if (cand.get() && AddCandidate(compId, cand.get()))
+    auto& nettype = content[static_cast<uint16_t>(SDPDEF::CLineIndex::nettype)];
+    if (nettype != SDPDEF::StringView(SDPDEF::nettype))
     {
-        cand.release();
-        return true;
+        LOG_ERROR("SDP", "Invalid nettype %.*s", static_cast<int>(nettype.size()), nettype.data());
+        return false;
     }
-    return false;
-}
-
-bool CSDP::RemoteMedia::AddPrflxCandidate(uint8_t compId, uint32_t pri, const std::string & foundation, const std::string & baseIP, uint16_t basePort, const std::string & relatedIP, uint16_t relatedPort)
-{
-    std::auto_ptr<STUN::SrflxCandidate> cand(new STUN::SrflxCandidate(compId, pri, foundation, baseIP, basePort, relatedIP, relatedPort));
 
-    if (cand.get() && AddCandidate(compId, cand.get()))
+    auto& addrtype = content[static_cast<uint16_t>(SDPDEF::CLineIndex::addrtype)];
+    if (!SDPDEF::IsValidAddrType(addrtype))
     {
-        cand.release();
-        return true;
+        LOG_ERROR("SDP", "Invalid addrtype :%.*s", static_cast<int>(addrtype.size()), addrtype.data());
+        return false;
     }
 
-    return false;
-}
-
-bool CSDP::RemoteMedia::AddRelayCandidate(uint8_t compId, uint32_t pri, const std::string & foundation, const std::string & baseIP, uint16_t basePort, const std::string & relatedIP, uint16_t relatedPort)
-{
-    std::auto_ptr<STUN::RelayedCandidate> cand(new STUN::RelayedCandidate(compId, pri, foundation, baseIP, basePort, relatedIP, relatedPort));
+    /*
+     IP4 <address>[/<ttl>[/<number of addresses>]]
+     IP6 <address>[/<number of addresses>]
+     */
+    auto bIPv4 = addrtype == SDPDEF::StringView(SDPDEF::ipv4);
+    SDPDEF::StringView connaddr_content[4];
+    auto count = SDPDEF::FieldReader(content[static_cast<uint16_t>(SDPDEF::CLineIndex::connaddr)], '/').Read(connaddr_content, 4);
+    if (count > (bIPv4 ? 3 : 2))
+    {
+        LOG_ERROR("SDP", "Invalid CLine");
+        return false;
+    }
 
-    if (cand.get() && AddCandidate(compId, cand.get()))
+    uint16_t ttl = 0, number_of_addr = 1;
+    if ((bIPv4 && count > 1 && !SDPDEF::ToNumber(connaddr_content[1], ttl)) ||
+        (count == (bIPv4 ? 3 : 2) && !SDPDEF::ToNumber(connaddr_content[count - 1], number_of_addr)))
     {
-        cand.release();
-        return true;
+        LOG_ERROR("SDP", "Invalid CLine");
+        return false;
     }
 
-    return false;
-}
+    // the same address may be repeated at session and media level
+    auto ip = SDPDEF::ToString(connaddr_content[0]);
+    m_Cline[ip] = bIPv4;
+    if (number_of_addr <= 1)
+        return true;
 
-bool CSDP::RemoteMedia::AddCandidate(uint8_t compId, STUN::Candidate *can)
-{
-    assert(can);
-    auto itor = m_Cands.find(compId);
+    // every address of the range is kept, a peer cannot make a short line expand into many
+    if (number_of_addr > SDPDEF::max_cline_addresses)
+    {
+        LOG_ERROR("SDP", "Invalid CLine, too many multicast addresses [%d]", number_of_addr);
+        return false;
+    }
 
-    CandContainer *container = nullptr;
+    // mulitcast, the addresses following the base address
+    boost::system::error_code error;
+    auto base = boost::asio::ip::address::from_string(ip, error);
+    if (error || base.is_v4() != bIPv4)
+    {
+        LOG_ERROR("SDP", "Invalid CLine multicast address %s", ip.c_str());
+        return false;
+    }
 
-    if (itor == m_Cands.end())
+    if (bIPv4)
     {
-        container = new CandContainer;
-        if (!container || !m_Cands.insert(std::make_pair(compId, container)).second)
-        {
-            LOG_ERROR("Session", "Not enough memory to create Candidate");
-            delete container;
-            return false;
-        }
+        auto first = base.to_v4().to_ulong();
+        for (uint16_t i = 1; i < number_of_addr; ++i)
+            m_Cline[boost::asio::ip::address_v4(static_cast<uint32_t>(first + i)).to_string()] = true;
     }
     else
     {
-        assert(itor->second);
-        container = itor->second;
+        auto bytes = base.to_v6().to_bytes();
+        for (uint16_t i = 1; i < number_of_addr; ++i)
+        {
+            // big endian increment of the address
+            for (auto byte = bytes.rbegin(); byte != bytes.rend() && !++*byte; ++byte);
+            m_Cline[boost::asio::ip::address_v6(bytes).to_string()] = false;
+        }
     }
+    return true;
+}
 
-    assert(container);
 
-    if (!container->insert(can).second)
+const CSDP::RemoteMedia::Component* CSDP::RemoteMedia::FindComponent(uint8_t compId) const
+{
+    for (auto itor = m_Cands.begin(); itor != m_Cands.end(); ++itor)
     {
-        LOG_ERROR("Session", "Add Candidate Failed");
-        return false;
+        if (itor->m_CompId == compId)
+            return &*itor;
     }
+    return nullptr;
+}
 
-    return true;
+void CSDP::RemoteMedia::AssignCandidates(const STUN::RemoteCandidate * cands, uint16_t count)
+{
+    m_Cands.clear();
+    for (uint16_t i = 0; i < count; ++i)
+    {
+        if (m_Cands.empty() || m_Cands.back().m_CompId != cands[i].m_CompId)
+        {
+            Component component = { cands[i].m_CompId, 0, &cands[i] };
+            m_Cands.push_back(component);
+        }
+        ++m_Cands.back().m_Count;
+    }
 }
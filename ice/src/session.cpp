@@ -3,68 +3,66 @@
 #include "media.h"
 #include "sdp.h"
 #include "candidate.h"
+#include "stunmsg.h"
 
 #include "pg_log.h"
 
 #include <boost/asio.hpp>
 
 #include <assert.h>
+#include <string.h>
+#include <algorithm>
 
 namespace {
     using namespace ICE;
-    bool FormingCandidatePairs(Session::CandPeerContainer& candPeers, const Media &lMedia, const CSDP::RemoteMedia& rMedia, bool bControlling)
+    bool FormingCandidatePairs(CheckList& checklist, const Media &lMedia, const CSDP::RemoteMedia& rMedia, bool bControlling)
     {
-        auto lstream_container = lMedia.GetStreams();
-        auto rcands_container = rMedia.Candidates();
+        auto& lstream_container = lMedia.GetStreams();
 
         for (auto lstream_itor = lstream_container.begin(); lstream_itor != lstream_container.end(); ++lstream_itor)
         {
-            auto rcands_itor = rcands_container.find(lstream_itor->first);
-            if (rcands_itor == rcands_container.end())
+            auto component = rMedia.FindComponent(lstream_itor->first);
+            if (!component && rMedia.IsTrickle())
+            {
+                // RFC8838 the candidates of the component are trickled later
+                continue;
+            }
+
+            if (!component)
             {
                 LOG_ERROR("Session", "remote candidates has no corresponding +local candidate [%d]", lstream_itor->first);
                 return false;
             }
 
-            auto rcands_container = rcands_itor->second;
-            assert(rcands_container);
-
-            auto &lstream = lstream_itor->second;
+            auto lstream = lstream_itor->second;
             assert(lstream);
 
-            auto lcands_container = lstream->GetCandidates();
-            for (auto rcand_itor = rcands_container->begin(); rcand_itor != rcands_container->end(); ++rcands_itor)
+            // both sides hold binary addresses, nothing is parsed per pair
+            auto& lcands_container = lstream->GetCandidates();
+            for (uint16_t i = 0; i < component->m_Count; ++i)
             {
-                auto rcand = *rcand_itor;
-                assert(rcand);
+                auto& rcand = component->m_Cands[i];
+                auto rcand_family = rcand.m_Addr.IsIPv4();
 
                 for (auto lcand_itor = lcands_container.begin(); lcand_itor != lcands_container.end(); ++lcand_itor)
                 {
                     auto lcand = lcand_itor->first;
                     assert(lcand && lcand->ComponentId() == lstream_itor->first);
-                    assert(lcand->ComponentId() == rcand->ComponentId());
+                    assert(lcand->ComponentId() == rcand.m_CompId);
+
+                    if (lcand->Address().IsIPv4() != rcand_family)
+                        continue;
 
-                    auto lcand_family = boost::asio::ip::address::from_string(lcand->TransationIP()).is_v4();
-                    auto rcand_family = boost::asio::ip::address::from_string(rcand->TransationIP()).is_v4();
-                    if ((lcand_family == rcand_family) &&
-                        (lcand->Protocol() == rcand->Protocol() && lcand->Protocol() == Protocol::udp) ||
-                        (lcand->Protocol() != rcand->Protocol() && lcand->Protocol() != Protocol::udp && rcand->Protocol() != Protocol::udp))
+                    if ((lcand->Protocol() == rcand.m_Protocol && lcand->Protocol() == Protocol::udp) ||
+                        (lcand->Protocol() != rcand.m_Protocol && lcand->Protocol() != Protocol::udp && rcand.m_Protocol != Protocol::udp))
                     {
-                        /*
-                        RFC8445[6.1.2.3.  Computing Pair Priority and Ordering Pairs]
-                        Let G be the priority for the candidate provided by the controlling agent.
-                        Let D be the priority for the candidate provided by the controlled agent
-                        pair priority = 2^32*MIN(G,D) + 2*MAX(G,D) + (G>D?1:0)
-                        */
-                        auto G = bControlling ? lcand->Priority() : rcand->Priority();
-                        auto D = bControlling ? rcand->Priority() : lcand->Priority();
-
-                        uint64_t priority = ((uint64_t)1 << 32) * std::min(G, D) + 2 * std::max(G, D) + (G > D ? 1 : 0);
-                        auto itor = candPeers.find(priority);
-                        assert(itor == candPeers.end());
-                        if (candPeers.insert(std::make_pair(priority, Session::CandidatePeer(priority, lcand, rcand))).second)
+                        auto priority = bControlling ?
+                            CheckList::PairPriority(lcand->Priority(), rcand.m_Priority) :
+                            CheckList::PairPriority(rcand.m_Priority, lcand->Priority());
+                        if (!checklist.AddPeer(priority, lcand, &rcand, lstream))
                         {
                             LOG_ERROR("Session", "Cannot Create Peer");
+                            return false;
                         }
                     }
                 }
@@ -72,16 +70,59 @@ namespace {
         }
         return true;
     }
+
+    /* compares the source of a packet with a remote candidate without formatting either address */
+    bool IsFrom(const boost::asio::ip::udp::endpoint& from, const TransportAddress& address)
+    {
+        if (from.port() != address.m_Port)
+            return false;
+
+        auto ip = from.address();
+        auto bytes = ip.is_v4() ? boost::asio::ip::address_v6::v4_mapped(ip.to_v4()).to_bytes() : ip.to_v6().to_bytes();
+        return !memcmp(bytes.data(), address.m_IP, sizeof(address.m_IP));
+    }
+
+    uint64_t ConsentKey(STUN::TransIdConstRef id)
+    {
+        uint64_t key;
+        memcpy(&key, &id[sizeof(id) - sizeof(key)], sizeof(key));
+        return key;
+    }
+
+    /* the m-sections of the media the session has are decoded, the others only indexed */
+    CSDP::MediaFilter LocalMedia(const Session::MediaContainer& medias)
+    {
+        return [&medias](boost::string_view type) {
+            return medias.find(std::string(type.data(), type.size())) != medias.end();
+        };
+    }
+
+    /* the remote m-section whose candidates and credentials the media is checked with, RFC8843 the tagged one when bundled */
+    const CSDP::RemoteMedia* FindRemote(const CSDP& sdp, const std::string& media)
+    {
+        auto& remoteMedia = sdp.GetRemoteMedia();
+        auto itor = remoteMedia.find(media);
+        return itor != remoteMedia.end() ? sdp.BundleTransport(*itor->second) : nullptr;
+    }
+
+    void ReleaseCheckLists(Session::CheckListContainer& checklists)
+    {
+        for (auto itor = checklists.begin(); itor != checklists.end(); ++itor)
+            delete itor->second;
+        checklists.clear();
+    }
 }
 
 namespace ICE {
     Session::Session(const std::string& defaultIP) :
-        m_Config(PG::GenerateRandom64(), defaultIP)
+        m_Config(PG::GenerateRandom64(), defaultIP), m_Negotiation(Negotiation::Stable), m_bReleaseRetired(false), m_NextCheckList(0),
+        m_RTO(0), m_Ta(0), m_Rc(0), m_Rm(0), m_Tr(0), m_ConsentInterval(0), m_ConsentTimeout(0), m_bTeardown(false)
     {
     }
 
     Session::~Session()
     {
+        StopChecking();
     }
 
     bool Session::CreateMedia(const MediaAttr& mediaAttr, const CAgentConfig& config)
@@ -92,16 +133,36 @@ namespace ICE {
             return false;
         }
 
-        std::auto_ptr<Media> media(new Media);
+        /*
+        RFC8843[6.  Protocol Overview]
+        a bundled media gathers nothing, it is sent over the transport of the tagged media,
+        RTP bundled MUST use rtcp-mux (9.1)
+        */
+        const Media* transport = nullptr;
+        if (!mediaAttr.m_Bundle.empty())
+        {
+            auto transport_itor = m_Medias.find(mediaAttr.m_Bundle);
+            if (transport_itor == m_Medias.end() || transport_itor->second->IsBundled() || !transport_itor->second->IsRtcpMux())
+            {
+                LOG_ERROR("Session", "Media [%s] cannot be bundled on [%s]", mediaAttr.m_Name.c_str(), mediaAttr.m_Bundle.c_str());
+                return false;
+            }
+            transport = transport_itor->second;
+        }
+
+        std::auto_ptr<Media> media(transport ? new Media(transport) : new Media(mediaAttr.m_bRtcpMux));
         if (!media.get())
         {
             LOG_ERROR("Session", "Not Enough memory to create Media");
             return false;
         }
 
-
-        for (auto itor = mediaAttr.m_StreamAttrs.begin(); itor != mediaAttr.m_StreamAttrs.end(); ++itor)
+        for (auto itor = mediaAttr.m_StreamAttrs.begin(); itor != mediaAttr.m_StreamAttrs.end() && !transport; ++itor)
         {
+            // RFC5761 rtcp is multiplexed on the rtp component
+            if (mediaAttr.m_bRtcpMux && itor->m_CompId != static_cast<uint8_t>(Media::ClassicID::RTP))
+                continue;
+
             if (!media->CreateStream(itor->m_CompId, itor->m_Protocol, itor->m_HostIP, itor->m_HostPort, config))
             {
                 LOG_ERROR("Session", "Media [%s] Create Stream failed [%d] [%s:%d]", mediaAttr.m_Name, itor->m_CompId, itor->m_HostIP.c_str(), itor->m_HostPort);
@@ -119,73 +180,1015 @@ namespace ICE {
         return true;
     }
 
-    bool Session::ConnectivityCheck(const std::string & offer)
+    bool Session::ConnectivityCheck(const std::string & offer, const CAgentConfig& config)
     {
-        CSDP sdp;
-        if (!sdp.Decode(offer))
+        std::unique_ptr<CSDP> sdp(new CSDP(&m_RemoteFoundations));
+        if (!sdp->Decode(offer, LocalMedia(m_Medias)))
         {
             LOG_ERROR("Session", "Invalid Offer");
             return false;
         }
 
-        auto& remoteMedia = sdp.GetRemoteMedia();
+        if (!ApplyRemote(std::move(sdp), config, config.Role() == STUN::AgentRole::Controlling))
+            return false;
 
+        // the answer to our offer completes the exchange
+        m_Negotiation = Negotiation::Stable;
+        return true;
+    }
+
+    bool Session::ApplyRemote(std::unique_ptr<CSDP> sdp, const CAgentConfig& config, bool bControlling)
+    {
+        /*
+        RFC8445[6.1.1.  Determining Role]
+        with a lite peer the full agent MUST take the controlling role
+        */
+        if (sdp->IsIceLite())
+            bControlling = true;
+
+        // a restart keeps the selected pairs, consent goes on over them until the switchover
+        bool bRestart = false;
+        {
+            std::lock_guard<decltype(m_CheckMutex)> locker(m_CheckMutex);
+            if (!m_CheckLists.empty() && !m_bTeardown && IsUpdate(*sdp))
+                return UpdateCheckLists(std::move(sdp));
+
+            bRestart = !m_ConsentCheckLists.empty() && !m_bTeardown;
+        }
+
+        if (!bRestart)
+            StopChecking();
+
+        CheckListContainer checklists;
+        StreamCheckLists   stream_checklists;
+
+        /*
+        RFC8445[6.1.2.5.  Removing Lower-Priority Pairs]
+        the limit applies to the whole checklist set, share it among the checklists
+        */
+        size_t transports = 0;
         for (auto local_itor = m_Medias.begin(); local_itor != m_Medias.end(); ++local_itor)
         {
+            if (!local_itor->second->IsBundled())
+            {
+                ++transports;
+                continue;
+            }
+
+            // RFC8843 the peer MUST have bundled the media with its transport as well
+            auto rmedia = FindRemote(*sdp, local_itor->first);
+            auto transport_itor = std::find_if(m_Medias.begin(), m_Medias.end(), [&local_itor](const MediaContainer::value_type& media) {
+                return media.second == local_itor->second->Transport();
+            });
+            if (!rmedia || transport_itor == m_Medias.end() || rmedia != FindRemote(*sdp, transport_itor->first))
+            {
+                LOG_ERROR("Session", "local Media[%s] is not bundled by the remote", local_itor->first.c_str());
+                return false;
+            }
+        }
 
-            auto rmedia_itor = remoteMedia.find(local_itor->first);
-            if (rmedia_itor == remoteMedia.end())
+        auto peers_limit = static_cast<uint16_t>(std::max<size_t>(1, config.CandPairsLimits() / std::max<size_t>(1, transports)));
+
+        // one checklist per transport, the media bundled on it share it
+        for (auto local_itor = m_Medias.begin(); local_itor != m_Medias.end(); ++local_itor)
+        {
+            if (local_itor->second->IsBundled())
+                continue;
+
+            auto rmedia = FindRemote(*sdp, local_itor->first);
+            if (!rmedia)
             {
                 LOG_ERROR("Session", "local Media[%s] has no corresponding remote media", local_itor->first.c_str());
+                ReleaseCheckLists(checklists);
                 return false;
             }
 
-            auto& local_stream = local_itor->second->GetStreams();
+            auto lmedia = local_itor->second;
+
+            /*
+            RFC5761[5.1.1.  SDP Offer/Answer Procedures]
+            a peer without a=rtcp-mux sends RTCP on its own component, a media created rtcp-mux
+            only has no stream for it, falling back to separate ports is not supported
+            */
+            if (lmedia->IsRtcpMux() && !rmedia->IsRtcpMux())
+            {
+                LOG_ERROR("Session", "local Media[%s] is rtcp-mux only, the remote media does not multiplex", local_itor->first.c_str());
+                ReleaseCheckLists(checklists);
+                return false;
+            }
+
+            // RFC5245 15.4 media level ice-ufrag/ice-pwd overrides the session level
+            auto& remote_ufrag = rmedia->IceUfrag().length() ? rmedia->IceUfrag() : sdp->IceUfrag();
+            auto& remote_pwd = rmedia->IcePwd().length() ? rmedia->IcePwd() : sdp->IcePwd();
+
+            std::auto_ptr<CheckList> checklist(new CheckList(lmedia->IceUfrag(), lmedia->IcePwd(), remote_ufrag, remote_pwd, config.Foundations()));
+            if (!checklist.get() || !FormingCandidatePairs(*checklist, *lmedia, *rmedia, bControlling))
+            {
+                LOG_ERROR("Session", "Media[%s] Forming Candidate Pairs failed", local_itor->first.c_str());
+                ReleaseCheckLists(checklists);
+                return false;
+            }
+
+            checklist->Controlling(bControlling);
+            checklist->SetNomination(config.NominationMode(), config.NominationThreshold());
+            checklist->SetFamilyInterleave(config.FamilyInterleave());
+            checklist->Prepare(peers_limit);
+
+            auto& streams = lmedia->GetStreams();
+            for (auto stream_itor = streams.begin(); stream_itor != streams.end(); ++stream_itor)
+                stream_checklists[stream_itor->second] = checklist.get();
+
+            checklists[local_itor->first] = checklist.release();
+        }
+
+        {
+            std::lock_guard<decltype(m_CheckMutex)> locker(m_CheckMutex);
+            if (bRestart)
+            {
+                for (auto itor = m_CheckLists.begin(); itor != m_CheckLists.end(); ++itor)
+                {
+                    if (std::find(m_ConsentCheckLists.begin(), m_ConsentCheckLists.end(), itor->second) == m_ConsentCheckLists.end())
+                    {
+                        // never completed, nothing flows over it
+                        delete itor->second;
+                        continue;
+                    }
+
+                    assert(m_PreviousCheckLists.find(itor->first) == m_PreviousCheckLists.end());
+                    m_PreviousCheckLists[itor->first] = itor->second;
+                }
+                m_CheckLists.clear();
+                m_PreviousSDPs.push_back(std::move(m_RemoteSDP));
+                for (auto update_itor = m_RemoteUpdates.begin(); update_itor != m_RemoteUpdates.end(); ++update_itor)
+                    m_PreviousSDPs.push_back(std::move(*update_itor));
+                m_RemoteUpdates.clear();
+            }
+
+            // the role is read by the check and response paths under the same lock, see SwitchRole
+            m_Config.Controlling(bControlling);
+            m_RemoteSDP.swap(sdp);
+            m_CheckLists.swap(checklists);
+            m_StreamCheckLists.swap(stream_checklists);
+            for (auto itor = m_StreamCheckLists.begin(); itor != m_StreamCheckLists.end(); ++itor)
+                const_cast<Stream*>(itor->first)->Responder().Role(bControlling, m_Config.Tiebreaker());
+            m_NextCheckList = 0;
+            m_RTO = config.RTO();
+            m_Ta  = config.Ta();
+            m_Rc  = config.Rc();
+            m_Rm  = config.Rm();
+            m_Tr  = config.Tr();
+            m_ConsentInterval = config.ConsentInterval();
+            m_ConsentTimeout  = config.ConsentTimeout();
+            m_bTeardown = false;
+        }
+
+        for (auto itor = m_StreamCheckLists.begin(); itor != m_StreamCheckLists.end(); ++itor)
+        {
+            auto stream = const_cast<Stream*>(itor->first);
+            stream->Responder().Credentials(itor->second->LocalUfrag(), itor->second->LocalPwd());
+
+            // the streams are still checking, the candidates gathered again have their threads already
+            if (bRestart)
+                continue;
+
+            if (!stream->RegisterEventListener(static_cast<uint16_t>(Stream::Message::Checking), this) || !stream->StartChecking())
+            {
+                LOG_ERROR("Session", "Stream [%d] Start Checking failed", stream->ComponentId());
+                StopChecking();
+                return false;
+            }
+        }
+
+        if (bRestart && m_TaTimer.IsRunning())
+            return true;
+
+        /*
+        RFC8445[6.1.4.2.  Performing Connectivity Checks]
+        checks are paced by Ta, the timer drives all checklists of the session
+        */
+        return m_TaTimer.Start(config.Ta(), [this] {
+            OnTaTimer();
+        });
+    }
+
+    bool Session::IsUpdate(const CSDP & sdp) const
+    {
+        // m_CheckMutex MUST be held
+        for (auto itor = m_CheckLists.begin(); itor != m_CheckLists.end(); ++itor)
+        {
+            auto rmedia = FindRemote(sdp, itor->first);
+            auto lmedia_itor = m_Medias.find(itor->first);
+            if (!rmedia || lmedia_itor == m_Medias.end())
+                return false;
+
+            /*
+            RFC8445[9.  ICE Restarts]
+            new credentials on either side restart ICE, the checklists are formed again
+            */
+            auto& remote_ufrag = rmedia->IceUfrag().length() ? rmedia->IceUfrag() : sdp.IceUfrag();
+            auto& remote_pwd = rmedia->IcePwd().length() ? rmedia->IcePwd() : sdp.IcePwd();
+            auto checklist = itor->second;
+            if (checklist->RemoteUfrag() != remote_ufrag || checklist->RemotePwd() != remote_pwd ||
+                checklist->LocalUfrag() != lmedia_itor->second->IceUfrag() || checklist->LocalPwd() != lmedia_itor->second->IcePwd())
+                return false;
+        }
+        return true;
+    }
+
+    bool Session::UpdateCheckLists(std::unique_ptr<CSDP> sdp)
+    {
+        // m_CheckMutex MUST be held, IsUpdate has matched every checklist with a remote media
+        bool bSuccess = true;
+        uint32_t added = 0, withdrawn = 0;
 
-            for (auto lstream_itor = local_stream.begin(); lstream_itor != local_stream.end(); ++lstream_itor)
+        for (auto itor = m_CheckLists.begin(); itor != m_CheckLists.end(); ++itor)
+        {
+            auto& checklist = *itor->second;
+            auto& rmedia = *FindRemote(*sdp, itor->first);
+            auto lmedia = m_Medias.find(itor->first)->second;
+
+            /*
+            RFC8839[5.2.  "remote-candidates" Attribute]
+            the controlling peer concluded, the pairs of the listed candidates are the selected ones
+            */
+            if (!rmedia.RemoteCandidates().empty())
             {
-                auto& rcands = rmedia_itor->second->Candidates();
-                for (auto rcand_itor = rcands.begin(); rcand_itor != rcands.end(); ++rcand_itor)
+                for (auto selected = rmedia.RemoteCandidates().begin(); selected != rmedia.RemoteCandidates().end(); ++selected)
                 {
-                    // find the same component id
-                    auto stream_itor = local_stream.find(rcand_itor->first);
-                    if (stream_itor == local_stream.end())
+                    auto peer = checklist.Selected(selected->m_CompId);
+                    if (peer != CheckList::sInvalidPeer && checklist.LocalCandidate(peer)->Address() == selected->m_Addr)
+                        continue;
+
+                    if (checklist.IsControlling())
+                    {
+                        LOG_WARNING("Session", "Media[%s] component [%d] remote candidates of a controlled peer ignored", itor->first.c_str(),
+                            selected->m_CompId);
+                        continue;
+                    }
+
+                    peer = checklist.Select(selected->m_CompId, selected->m_Addr);
+                    if (peer == CheckList::sInvalidPeer)
                     {
-                        LOG_ERROR("Session", "local media[%s] has no related component id:[%d] ", local_itor->first.c_str(), rcand_itor->first);
-                        return false;
+                        LOG_WARNING("Session", "Media[%s] component [%d] remote candidate %s:%d has no pair", itor->first.c_str(),
+                            selected->m_CompId, selected->m_Addr.IP().c_str(), selected->m_Addr.m_Port);
+                        continue;
                     }
 
-                    auto stream = stream_itor->second;
-                    auto& lcands = stream->GetCandidates();
-                    for (auto lcand_itor = lcands.begin(); lcand_itor != lcands.end(); ++lcand_itor)
+                    // the consent of the component moves to the selected pair
+                    for (auto consent_itor = m_Consents.begin(); consent_itor != m_Consents.end(); ++consent_itor)
                     {
-                        auto lcand = lcand_itor->first;
-                        assert(lcand->ComponentId() == rcand_itor->first);
+                        if (consent_itor->m_CheckList == &checklist && checklist.Peers().ComponentId(consent_itor->m_Peer) == selected->m_CompId)
+                            consent_itor->m_Peer = peer;
                     }
                 }
+
+                if (checklist.GetState() == CheckList::State::Completed &&
+                    std::find(m_ConsentCheckLists.begin(), m_ConsentCheckLists.end(), &checklist) == m_ConsentCheckLists.end())
+                {
+                    Switchover(itor->first);
+                    StartConsent(itor->first, checklist);
+                }
+                continue;
+            }
+
+            withdrawn += checklist.Withdraw([&rmedia](const STUN::RemoteCandidate& rcand) {
+                auto component = rmedia.FindComponent(rcand.m_CompId);
+                for (uint16_t i = 0; component && i < component->m_Count; ++i)
+                {
+                    if (component->m_Cands[i].m_Addr == rcand.m_Addr && component->m_Cands[i].m_Protocol == rcand.m_Protocol)
+                        return true;
+                }
+                return false;
+            });
+
+            // the candidates signaled before are found paired, only the new ones are added
+            auto peers = checklist.Peers().Size();
+            if (!FormingCandidatePairs(checklist, *lmedia, rmedia, checklist.IsControlling()))
+            {
+                LOG_ERROR("Session", "Media[%s] Forming Candidate Pairs failed", itor->first.c_str());
+                bSuccess = false;
             }
+            added += checklist.Peers().Size() - peers;
         }
+
+        // the new pairs reference the candidates of this description
+        if (added)
+            m_RemoteUpdates.push_back(std::move(sdp));
+
+        LOG_INFO("Session", "remote description updated, %u pairs added, %u withdrawn", added, withdrawn);
+        return bSuccess;
+    }
+
+    bool Session::Restart(const CAgentConfig & config)
+    {
+        // the candidates retired by the last restart go before new ones are retired
+        if (m_bReleaseRetired.exchange(false))
+            ReleaseRetired();
+
+        for (auto itor = m_Medias.begin(); itor != m_Medias.end(); ++itor)
+        {
+            auto media = const_cast<Media*>(itor->second);
+            if (media->IsBundled())
+                continue;
+
+            if (!media->Restart(config))
+            {
+                LOG_ERROR("Session", "Media [%s] restart failed", itor->first.c_str());
+                return false;
+            }
+
+            // checks with the new credentials may come as soon as the offer is out
+            auto& streams = media->GetStreams();
+            for (auto stream_itor = streams.begin(); stream_itor != streams.end(); ++stream_itor)
+                stream_itor->second->Responder().Restart(media->IceUfrag(), media->IcePwd());
+        }
+        return true;
+    }
+
+    void Session::OnTeardown(const TeardownHandler & handler)
+    {
+        std::lock_guard<decltype(m_CheckMutex)> locker(m_CheckMutex);
+        m_TeardownHandler = handler;
+    }
+
+    bool Session::SelectedPairStats(const std::string & media, uint8_t compId, CandPeerTable::Stats & stats)
+    {
+        std::lock_guard<decltype(m_CheckMutex)> locker(m_CheckMutex);
+
+        // media goes on over the previous checklist until the one of a restart completes
+        const CheckListContainer* containers[] = { &m_CheckLists, &m_PreviousCheckLists };
+        for (auto container : containers)
+        {
+            auto itor = container->find(media);
+            if (itor == container->end())
+                continue;
+
+            auto peer = itor->second->Selected(compId);
+            if (peer != CheckList::sInvalidPeer)
+            {
+                stats = itor->second->Peers().GetStats(peer);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool Session::SelectedRemoteCandidates(const std::string & media, SelectedCandidates & selected) const
+    {
+        selected.clear();
+
+        std::lock_guard<decltype(m_CheckMutex)> locker(m_CheckMutex);
+        auto itor = m_CheckLists.find(media);
+        auto lmedia_itor = m_Medias.find(media);
+        if (!m_Config.IsControlling() || itor == m_CheckLists.end() || lmedia_itor == m_Medias.end() ||
+            itor->second->GetState() != CheckList::State::Completed)
+            return false;
+
+        auto& streams = lmedia_itor->second->GetStreams();
+        for (auto stream_itor = streams.begin(); stream_itor != streams.end(); ++stream_itor)
+        {
+            auto compId = static_cast<uint8_t>(stream_itor->first);
+            auto peer = itor->second->Selected(compId);
+            if (peer == CheckList::sInvalidPeer)
+                return false;
+
+            selected.push_back(std::make_pair(compId, itor->second->RemoteCandidate(peer)->m_Addr));
+        }
+        return !selected.empty();
     }
 
     bool Session::MakeOffer(std::string & offer)
     {
         CSDP sdp;
-        return sdp.Encode(*this, offer);
+        if (!sdp.Encode(*this, offer))
+            return false;
+
+        m_Negotiation = Negotiation::LocalOffer;
+        return true;
+    }
+
+    bool Session::MakeAnswer(const std::string & remoteOffer, const CAgentConfig& config, std::string & answer)
+    {
+        /*
+        RFC3264[4.  Protocol Operation]
+        no new offer may be made while one is outstanding, an offer received then is glare
+        */
+        if (m_Negotiation != Negotiation::Stable)
+        {
+            LOG_ERROR("Session", "remote offer while the local offer is outstanding");
+            return false;
+        }
+
+        std::unique_ptr<CSDP> sdp(new CSDP(&m_RemoteFoundations));
+        if (!sdp->Decode(remoteOffer, LocalMedia(m_Medias)))
+        {
+            LOG_ERROR("Session", "Invalid Offer");
+            return false;
+        }
+
+        /*
+        RFC8445[6.1.1.  Determining Role]
+        the agent which sent the initial offer is controlling, the answerer is controlled,
+        later offers keep the roles, conflicts are left to the checks (7.3.1.1)
+        */
+        bool bControlling = false;
+        {
+            std::lock_guard<decltype(m_CheckMutex)> locker(m_CheckMutex);
+            bControlling = m_RemoteSDP && m_Config.IsControlling();
+        }
+
+        if (!ApplyRemote(std::move(sdp), config, bControlling))
+            return false;
+
+        CSDP local;
+        return local.Encode(*this, answer);
+    }
+
+    void Session::OnEventFired(PG::MsgEntity * pSender, PG::MsgEntity::MSG_ID msg_id, PG::MsgEntity::WPARAM wParam, PG::MsgEntity::LPARAM lParam)
+    {
+        assert(static_cast<Stream::Message>(msg_id) == Stream::Message::Checking);
+
+        auto stream = dynamic_cast<Stream*>(pSender);
+        auto packet = reinterpret_cast<const Stream::CheckingPacket*>(wParam);
+        assert(stream && packet);
+
+        std::lock_guard<decltype(m_CheckMutex)> locker(m_CheckMutex);
+        auto itor = m_StreamCheckLists.find(stream);
+        if (itor == m_StreamCheckLists.end())
+            return;
+
+        auto& checklist = *itor->second;
+        STUN::MessagePacket msg(packet->m_Packet, packet->m_Size);
+
+        switch (packet->m_Packet.MsgId())
+        {
+        case STUN::MsgType::BindingResp:
+            OnBindingResp(checklist, *packet, msg);
+            break;
+
+        case STUN::MsgType::BindingErrResp:
+            OnBindingErrResp(checklist, *packet, msg);
+            break;
+
+        case STUN::MsgType::BindingRequest:
+            OnBindingRequest(checklist, *packet, msg);
+            break;
+
+        default:
+            break;
+        }
+
+        if (checklist.GetState() != CheckList::State::Completed ||
+            std::find(m_ConsentCheckLists.begin(), m_ConsentCheckLists.end(), &checklist) != m_ConsentCheckLists.end())
+            return;
+
+        for (auto checklist_itor = m_CheckLists.begin(); checklist_itor != m_CheckLists.end(); ++checklist_itor)
+        {
+            if (checklist_itor->second == &checklist)
+            {
+                Switchover(checklist_itor->first);
+                StartConsent(checklist_itor->first, checklist);
+                break;
+            }
+        }
+    }
+
+    void Session::StopChecking()
+    {
+        m_TaTimer.Stop();
+        StopConsent();
+
+        StreamCheckLists   stream_checklists;
+        CheckListContainer checklists;
+        CheckListContainer previous_checklists;
+        {
+            std::lock_guard<decltype(m_CheckMutex)> locker(m_CheckMutex);
+            stream_checklists.swap(m_StreamCheckLists);
+            checklists.swap(m_CheckLists);
+            previous_checklists.swap(m_PreviousCheckLists);
+            m_PreviousSDPs.clear();
+            m_RemoteUpdates.clear();
+        }
+
+        // m_CheckMutex MUST NOT be held here, the checking threads hold the listener lock while waiting for it
+        for (auto itor = stream_checklists.begin(); itor != stream_checklists.end(); ++itor)
+            const_cast<Stream*>(itor->first)->UnregisterEventListenner(static_cast<uint16_t>(Stream::Message::Checking), this);
+
+        ReleaseCheckLists(checklists);
+        ReleaseCheckLists(previous_checklists);
+
+        m_bReleaseRetired = false;
+        ReleaseRetired();
+    }
+
+    void Session::Switchover(const std::string & media)
+    {
+        // m_CheckMutex MUST be held
+        auto itor = m_PreviousCheckLists.find(media);
+        if (itor == m_PreviousCheckLists.end())
+            return;
+
+        /*
+        RFC8445[9.  ICE Restarts]
+        the media moves to the pairs selected by the new checklist, the consent of
+        the old pairs ends here, their timers are dropped when they fire
+        */
+        auto previous = itor->second;
+        for (auto consent_itor = m_Consents.begin(); consent_itor != m_Consents.end(); ++consent_itor)
+        {
+            if (consent_itor->m_CheckList == previous)
+                consent_itor->m_CheckList = nullptr;
+        }
+
+        m_ConsentCheckLists.erase(std::remove(m_ConsentCheckLists.begin(), m_ConsentCheckLists.end(), previous), m_ConsentCheckLists.end());
+        m_PreviousCheckLists.erase(itor);
+        delete previous;
+        LOG_INFO("Session", "media [%s] switched over to the restarted checklist", media.c_str());
+
+        // joining the checking threads of the retired candidates is left to the Ta timer
+        if (m_PreviousCheckLists.empty())
+        {
+            m_PreviousSDPs.clear();
+            m_bReleaseRetired = true;
+        }
     }
 
-    bool Session::MakeAnswer(const std::string & remoteOffer, std::string & answer)
+    void Session::ReleaseRetired()
     {
+        // m_CheckMutex MUST NOT be held, the checking threads of the retired candidates are joined
+        for (auto itor = m_Medias.begin(); itor != m_Medias.end(); ++itor)
+        {
+            if (itor->second->IsBundled())
+                continue;
+
+            auto& streams = itor->second->GetStreams();
+            for (auto stream_itor = streams.begin(); stream_itor != streams.end(); ++stream_itor)
+            {
+                stream_itor->second->ReleaseRetired();
+                stream_itor->second->Responder().Retire();
+            }
+        }
+    }
+
+    void Session::OnTaTimer()
+    {
+        if (m_bReleaseRetired.exchange(false))
+            ReleaseRetired();
+
+        std::lock_guard<decltype(m_CheckMutex)> locker(m_CheckMutex);
+
+        // retransmissions are driven by each transaction's RTO, not by Ta
+        for (auto itor = m_CheckLists.begin(); itor != m_CheckLists.end(); ++itor)
+        {
+            CheckList::TransactionList retransmit;
+            itor->second->CollectRetransmissions(m_Rc, m_Rm, retransmit);
+            for (auto trans_itor = retransmit.begin(); trans_itor != retransmit.end(); ++trans_itor)
+                SendCheck(*itor->second, **trans_itor);
+        }
+
+        /*
+        RFC8445[6.1.4.2.  Performing Connectivity Checks]
+        one new check per Ta, the checklists are served in round robin
+        */
+        auto count = static_cast<uint16_t>(m_CheckLists.size());
+        for (uint16_t i = 0; i < count; ++i)
+        {
+            auto index = static_cast<uint16_t>((m_NextCheckList + i) % count);
+            auto itor = m_CheckLists.begin();
+            std::advance(itor, index);
+
+            auto checklist = itor->second;
+
+            // RFC8445 8.1.1 a pending nomination goes before ordinary checks
+            auto peer = checklist->NextNomination();
+            auto nominate = peer != CheckList::sInvalidPeer;
+            if (!nominate)
+                peer = checklist->NextCheck();
+
+            if (peer == CheckList::sInvalidPeer)
+                continue;
+
+            auto transaction = checklist->StartTransaction(peer, CheckRTO(*checklist, peer), nominate);
+            if (transaction)
+                SendCheck(*checklist, *transaction);
+
+            m_NextCheckList = static_cast<uint16_t>((index + 1) % count);
+            break;
+        }
+    }
+
+    uint32_t Session::CheckRTO(const CheckList & checklist, CheckList::Handle peer) const
+    {
+        /*
+        RFC8445[14.3.  RTO]
+        RTO = MAX (500ms, Ta * (Num-Waiting + Num-In-Progress)), the retransmissions of all
+        pending checks must not exceed the pace of Ta. the 500ms is replaced by the RTO measured
+        on the pair, the configured RTO until there is a sample
+        */
+        uint32_t pending = 0;
+        for (auto itor = m_CheckLists.begin(); itor != m_CheckLists.end(); ++itor)
+            pending += itor->second->PendingCount();
+
+        return std::max(checklist.RTO(peer, m_RTO), m_Ta * pending);
+    }
+
+    bool Session::SendCheck(CheckList & checklist, const CheckList::Transaction & transaction)
+    {
+        auto lcand = checklist.LocalCandidate(transaction.m_Peer);
+        auto rcand = checklist.RemoteCandidate(transaction.m_Peer);
+
+        /*
+        RFC8445[7.2.2.  Forming Credentials]
+        USERNAME = remote ufrag:local ufrag
+        */
+        STUN::RFC5389SubBindReqMsg msg(lcand->PeerReflexivePriority(), transaction.m_Id, STUN::ATTR::Role(transaction.m_bControlling, m_Config.Tiebreaker()));
+        msg.AddUsername(checklist.RemoteUfrag() + ":" + checklist.LocalUfrag());
+
+        if (transaction.m_bNominate)
+            msg.AddAttribute(STUN::ATTR::UseCandidate());
+
+        // RFC8445 7.2.2 short-term credential, keyed by the remote password
+        msg.AddMessageIntegrity(checklist.RemotePwd());
+        msg.AddFingerprint();
+
+        if (!checklist.PeerStream(transaction.m_Peer)->SendData(checklist.SenderCandidate(transaction.m_Peer), msg, rcand->m_Addr.IP(), rcand->m_Addr.m_Port))
+        {
+            LOG_WARNING("Session", "send check [%s:%d]->[%s:%d] failed", lcand->TransationIP().c_str(), lcand->TransationPort(),
+                rcand->m_Addr.IP().c_str(), rcand->m_Addr.m_Port);
+            return false;
+        }
+
+        checklist.OnSent(transaction.m_Peer, msg.GetLength());
         return true;
     }
-    Session::CandidatePeer::CandidatePeer(uint64_t PRI, const STUN::Candidate * lcand, const STUN::Candidate * rcand)
+
+    void Session::OnBindingResp(CheckList & checklist, const Stream::CheckingPacket & packet, const STUN::MessagePacket & msg)
+    {
+        if (OnConsentResp(packet, msg, true))
+            return;
+
+        auto transaction = checklist.FindTransaction(msg.TransationId());
+        if (!transaction)
+        {
+            LOG_WARNING("Session", "Binding response with unknown transaction id, discards");
+            return;
+        }
+
+        if (!STUN::MessagePacket::VerifyMsgIntegrity(msg, checklist.RemotePwd()))
+        {
+            LOG_WARNING("Session", "Binding response from [%s:%d] failed MESSAGE-INTEGRITY, discards", packet.m_From.address().to_string().c_str(), packet.m_From.port());
+            return;
+        }
+
+        auto peer_index = transaction->m_Peer;
+        auto nominate   = transaction->m_bNominate;
+        checklist.EndTransaction(msg.TransationId());
+        checklist.OnReceived(peer_index, packet.m_Size);
+
+        auto rcand = checklist.RemoteCandidate(peer_index);
+
+        /*
+        RFC8445[7.2.5.2.1.  Non-Symmetric Transport Addresses]
+        the source of the response MUST equal the destination of the request
+        */
+        if (!IsFrom(packet.m_From, rcand->m_Addr))
+        {
+            LOG_WARNING("Session", "non-symmetric response from [%s:%d], pair failed", packet.m_From.address().to_string().c_str(), packet.m_From.port());
+            checklist.OnFailed(peer_index, nominate);
+            return;
+        }
+
+        // the foundation of the pair checked, a learned prflx local candidate has its own
+        auto foundation = CheckList::PairFoundation(checklist.LocalCandidate(peer_index)->Foundation(), rcand->m_FoundationId);
+
+        const STUN::ATTR::XorMappedAddress *mapped = nullptr;
+        if (!nominate && msg.GetAttribute(mapped))
+            checklist.OnMappedAddress(peer_index, mapped->IP(), mapped->Port());
+
+        checklist.OnSucceeded(peer_index, nominate);
+
+        /*
+        RFC8445[7.2.5.3.3.  Updating Checklist and Candidate Pair States]
+        unfreeze the pairs with the same foundation in all checklists
+        */
+        for (auto itor = m_CheckLists.begin(); itor != m_CheckLists.end(); ++itor)
+            itor->second->Unfreeze(foundation);
+    }
+
+    void Session::OnBindingErrResp(CheckList & checklist, const Stream::CheckingPacket & packet, const STUN::MessagePacket & msg)
+    {
+        if (OnConsentResp(packet, msg, false))
+            return;
+
+        auto transaction = checklist.FindTransaction(msg.TransationId());
+        if (!transaction)
+        {
+            LOG_WARNING("Session", "Binding error response with unknown transaction id, discards");
+            return;
+        }
+
+        /*
+        RFC5389[10.1.3.  Receiving a Response]
+        only a 400 or 420 may come without MESSAGE-INTEGRITY, any other error response
+        has to be authenticated before it fails the pair or switches the role
+        */
+        const STUN::ATTR::ErrorCode *error_code = nullptr;
+        auto code = msg.GetAttribute(error_code) ? error_code->Code() : 0;
+        if (code != static_cast<uint16_t>(STUN::ErrorCode::BadRequest) && code != static_cast<uint16_t>(STUN::ErrorCode::UnknownAttribute) &&
+            !STUN::MessagePacket::VerifyMsgIntegrity(msg, checklist.RemotePwd()))
+        {
+            LOG_WARNING("Session", "Binding error response [%d] from [%s:%d] failed MESSAGE-INTEGRITY, discards", code,
+                packet.m_From.address().to_string().c_str(), packet.m_From.port());
+            return;
+        }
+
+        auto peer_index = transaction->m_Peer;
+        auto nominate   = transaction->m_bNominate;
+        auto bSentControlling = transaction->m_bControlling;
+        checklist.EndTransaction(msg.TransationId());
+        checklist.OnReceived(peer_index, packet.m_Size);
+
+        /*
+        RFC8445[7.2.5.1.  Role Conflict]
+        switch to the opposite of the role the request was sent with and enqueue the pair
+        as a triggered check, the 487s of the other checks sent in that role change nothing
+        */
+        if (code == static_cast<uint16_t>(STUN::ErrorCode::RoleConflict))
+        {
+            if (m_Config.IsControlling() == bSentControlling)
+            {
+                LOG_INFO("Session", "role conflict reported by peer, switch to %s", bSentControlling ? "controlled" : "controlling");
+                SwitchRole(!bSentControlling);
+            }
+            checklist.Trigger(peer_index);
+            return;
+        }
+
+        checklist.OnFailed(peer_index, nominate);
+    }
+
+    void Session::OnBindingRequest(CheckList & checklist, const Stream::CheckingPacket & packet, const STUN::MessagePacket & msg)
+    {
+        // the stream has authenticated and answered the request already
+        CheckRoleConflict(msg);
+
+        /*
+        RFC8445[7.3.1.4.  Triggered Checks]
+        */
+        auto peer = checklist.FindPeer(packet.m_LCand, packet.m_From.address().to_string(), packet.m_From.port());
+        if (peer == CheckList::sInvalidPeer)
+        {
+            const STUN::ATTR::Priority *priority = nullptr;
+            if (!msg.GetAttribute(priority))
+            {
+                LOG_WARNING("Session", "Binding request from [%s:%d] without PRIORITY", packet.m_From.address().to_string().c_str(), packet.m_From.port());
+                return;
+            }
+
+            peer = checklist.AddRemotePrflx(packet.m_LCand, packet.m_From.address().to_string(), packet.m_From.port(), priority->Pri());
+            if (peer == CheckList::sInvalidPeer)
+            {
+                LOG_WARNING("Session", "cannot add peer reflexive candidate [%s:%d]", packet.m_From.address().to_string().c_str(), packet.m_From.port());
+                return;
+            }
+        }
+
+        checklist.OnReceived(peer, packet.m_Size);
+
+        const STUN::ATTR::UseCandidate *use_candidate = nullptr;
+        if (!checklist.IsControlling() && msg.GetAttribute(use_candidate))
+            checklist.OnUseCandidate(peer);
+
+        checklist.Trigger(peer);
+    }
+
+    void Session::CheckRoleConflict(const STUN::MessagePacket & msg)
+    {
+        const STUN::ATTR::Role *role = nullptr;
+        if (!msg.GetAttribute(role))
+            return;
+
+        /*
+        RFC8445[7.3.1.1.  Detecting and Repairing Role Conflicts]
+        both agents claim the same role, the one with the larger tie-breaker keeps it,
+        the 487 of the agent keeping its role is sent by the stream's responder
+        */
+        auto bPeerControlling = role->Type() == STUN::ATTR::Id::IceControlling;
+        if (bPeerControlling != m_Config.IsControlling())
+            return;
+
+        // controlling with the larger tie-breaker or controlled with the smaller one keeps its role
+        auto bLarger = m_Config.Tiebreaker() >= role->TieBreaker();
+        if (bLarger == m_Config.IsControlling())
+            return;
+
+        LOG_INFO("Session", "role conflict, switch to %s", m_Config.IsControlling() ? "controlled" : "controlling");
+        SwitchRole(!m_Config.IsControlling());
+    }
+
+    void Session::SwitchRole(bool bControlling)
     {
-        assert(lcand && rcand);
-        assert(lcand->ComponentId() == rcand->ComponentId());
-        assert((lcand->Protocol() == rcand->Protocol() && lcand->Protocol() == Protocol::udp) ||
-            (lcand->Protocol() != rcand->Protocol() && lcand->Protocol() != Protocol::udp && rcand->Protocol() != Protocol::udp));
+        m_Config.Controlling(bControlling);
+        for (auto itor = m_CheckLists.begin(); itor != m_CheckLists.end(); ++itor)
+            itor->second->SwitchRole(m_Config.IsControlling());
+
+        for (auto itor = m_StreamCheckLists.begin(); itor != m_StreamCheckLists.end(); ++itor)
+            const_cast<Stream*>(itor->first)->Responder().Role(m_Config.IsControlling());
     }
 
-    Session::CandidatePeer::~CandidatePeer()
+    void Session::StartConsent(const std::string & media, CheckList & checklist)
     {
+        /*
+        RFC7675[5.1.  Expiration of Consent]
+        once ICE completed, consent is checked on the selected pairs every 5s randomised
+        by 0.8-1.2, it expires after 30s without an authenticated response
+        */
+        // registered as long as there are consents, a switchover may empty m_ConsentCheckLists
+        if (m_Consents.empty())
+            ConsentScheduler::Instance().Register(this);
+        m_ConsentCheckLists.push_back(&checklist);
+
+        auto now = Clock::now();
+        auto& components = checklist.Components();
+        for (auto itor = components.begin(); itor != components.end(); ++itor)
+        {
+            auto peer = checklist.Selected(*itor);
+            if (peer == CheckList::sInvalidPeer)
+                continue;
+
+            auto index = static_cast<ConsentScheduler::Cookie>(m_Consents.size());
+            Consent consent = { media, &checklist, peer, now, now, false };
+            m_Consents.push_back(consent);
+
+            // even cookies are consent checks, odd ones keepalives
+            ConsentScheduler::Instance().Schedule(this, index << 1,
+                PG::GenerateRandom<uint32_t>(m_ConsentInterval * 8 / 10, m_ConsentInterval * 12 / 10));
+            ConsentScheduler::Instance().Schedule(this, (index << 1) | 1, m_Tr);
+        }
+    }
+
+    void Session::StopConsent()
+    {
+        // m_CheckMutex MUST NOT be held, Unregister waits for OnConsentTimer to return
+        ConsentScheduler::Instance().Unregister(this);
+
+        std::lock_guard<decltype(m_CheckMutex)> locker(m_CheckMutex);
+        m_Consents.clear();
+        m_ConsentTransactions.clear();
+        m_ConsentCheckLists.clear();
+    }
+
+    void Session::OnConsentTimer(const ConsentScheduler::CookieList & due)
+    {
+        TeardownHandler handler;
+        std::string media;
+        {
+            std::lock_guard<decltype(m_CheckMutex)> locker(m_CheckMutex);
+            if (m_bTeardown)
+                return;
+
+            auto now = Clock::now();
+            auto timeout = std::chrono::milliseconds(m_ConsentTimeout);
+
+            // a response to a check older than the timeout cannot refresh consent anymore, the check is lost
+            for (auto itor = m_ConsentTransactions.begin(); itor != m_ConsentTransactions.end();)
+            {
+                if (now - itor->second.m_Sent <= timeout)
+                {
+                    ++itor;
+                    continue;
+                }
+
+                auto index = itor->second.m_Index;
+                if (index < m_Consents.size() && m_Consents[index].m_CheckList)
+                    m_Consents[index].m_CheckList->OnLost(m_Consents[index].m_Peer);
+                itor = m_ConsentTransactions.erase(itor);
+            }
+
+            for (auto itor = due.begin(); itor != due.end() && !m_bTeardown; ++itor)
+            {
+                auto index = *itor >> 1;
+                if (index >= m_Consents.size())
+                    continue;
+
+                // retired by a switchover, the timer is not scheduled again
+                auto& consent = m_Consents[index];
+                if (!consent.m_CheckList)
+                    continue;
+
+                auto& checklist = *consent.m_CheckList;
+                if (*itor & 1)
+                {
+                    /*
+                    RFC8445[11.  Keepalives]
+                    a Binding indication when nothing was sent on the pair for Tr
+                    */
+                    auto tr = std::chrono::milliseconds(m_Tr);
+                    auto idle = now - consent.m_LastSent;
+                    if (idle >= tr)
+                    {
+                        SendKeepalive(checklist, consent.m_Peer);
+                        consent.m_LastSent = now;
+                        idle = Clock::duration::zero();
+                    }
+
+                    auto delay = std::chrono::duration_cast<std::chrono::milliseconds>(tr - idle).count();
+                    ConsentScheduler::Instance().Schedule(this, *itor, static_cast<uint32_t>(delay));
+                    continue;
+                }
+
+                if (consent.m_bRevoked || now - consent.m_Fresh >= timeout)
+                {
+                    LOG_WARNING("Session", "media [%s] component [%d] lost consent", consent.m_Media.c_str(),
+                        checklist.LocalCandidate(consent.m_Peer)->ComponentId());
+                    m_bTeardown = true;
+                    media = consent.m_Media;
+                    handler = m_TeardownHandler;
+                    break;
+                }
+
+                // a consent check is an ordinary connectivity check without USE-CANDIDATE
+                CheckList::Transaction transaction = {};
+                STUN::MessagePacket::GenerateRFC5389TransationId(transaction.m_Id);
+                transaction.m_Peer   = consent.m_Peer;
+                transaction.m_bControlling = m_Config.IsControlling();
+                transaction.m_Sent   = 1;
+                transaction.m_RTO    = checklist.RTO(consent.m_Peer, m_RTO);
+                transaction.m_Start  = now;
+                transaction.m_Expire = now;
+
+                if (SendCheck(checklist, transaction))
+                {
+                    ConsentTransaction sent = { static_cast<uint32_t>(index), now };
+                    m_ConsentTransactions[ConsentKey(transaction.m_Id)] = sent;
+                    consent.m_LastSent = now;
+                }
+
+                ConsentScheduler::Instance().Schedule(this, *itor,
+                    PG::GenerateRandom<uint32_t>(m_ConsentInterval * 8 / 10, m_ConsentInterval * 12 / 10));
+            }
+        }
+
+        // the handler is free to destroy the session, nothing is touched after it
+        if (handler)
+            handler(this, media);
+    }
+
+    bool Session::OnConsentResp(const Stream::CheckingPacket & packet, const STUN::MessagePacket & msg, bool bSuccess)
+    {
+        auto itor = m_ConsentTransactions.find(ConsentKey(msg.TransationId()));
+        if (itor == m_ConsentTransactions.end())
+            return false;
+
+        auto index = itor->second.m_Index;
+        auto sent  = itor->second.m_Sent;
+        m_ConsentTransactions.erase(itor);
+        if (index >= m_Consents.size() || !m_Consents[index].m_CheckList)
+            return true;
+
+        auto& consent = m_Consents[index];
+        auto& checklist = *consent.m_CheckList;
+        if (!STUN::MessagePacket::VerifyMsgIntegrity(msg, checklist.RemotePwd()))
+        {
+            LOG_WARNING("Session", "consent response from [%s:%d] failed MESSAGE-INTEGRITY, discards", packet.m_From.address().to_string().c_str(), packet.m_From.port());
+            return true;
+        }
+
+        // consent checks are never retransmitted, every response is an RTT sample of the selected pair
+        auto now = Clock::now();
+        checklist.OnRTTSample(consent.m_Peer, static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(now - sent).count()));
+        checklist.OnReceived(consent.m_Peer, packet.m_Size);
+
+        if (!bSuccess)
+        {
+            // an authenticated error, except a role conflict, means the peer does not consent anymore
+            const STUN::ATTR::ErrorCode *error_code = nullptr;
+            if (!msg.GetAttribute(error_code) || error_code->Code() != static_cast<uint16_t>(STUN::ErrorCode::RoleConflict))
+                consent.m_bRevoked = true;
+            return true;
+        }
+
+        // RFC7675 5.1 only a response from the address the check was sent to refreshes consent
+        auto rcand = checklist.RemoteCandidate(consent.m_Peer);
+        if (IsFrom(packet.m_From, rcand->m_Addr))
+            consent.m_Fresh = now;
+        return true;
+    }
+
+    bool Session::SendKeepalive(CheckList & checklist, CheckList::Handle peer)
+    {
+        STUN::TransId id;
+        STUN::MessagePacket::GenerateRFC5389TransationId(id);
+
+        // RFC8445 11 a Binding indication, no authentication, FINGERPRINT only
+        STUN::MessagePacket msg(STUN::MsgType::BindingIndication, id);
+        msg.AddFingerprint();
+
+        auto rcand = checklist.RemoteCandidate(peer);
+        if (!checklist.PeerStream(peer)->SendData(checklist.SenderCandidate(peer), msg, rcand->m_Addr.IP(), rcand->m_Addr.m_Port))
+            return false;
+
+        checklist.OnSent(peer, msg.GetLength());
+        return true;
     }
 }
\ No newline at end of file
@@ -1,14 +1,17 @@
 #include "stream.h"
 #include "candidate.h"
+#include "foundation.h"
 #include "stunmsg.h"
 #include "agent.h"
 #include "channel.h"
+#include "turnclient.h"
 #include "pg_log.h"
 #include <iostream>
+#include <algorithm>
 
 namespace ICE {
     Stream::Stream(uint8_t compId, Protocol protocol, uint16_t localPref, const std::string & hostIp, uint16_t hostPort) :
-        m_CompId(compId), m_Protocol(protocol), m_LocalPref(localPref), m_HostIP(hostIp), m_HostPort(hostPort), m_State(State::Init), m_Quit(false),
+        m_CompId(compId), m_Protocol(protocol), m_LocalPref(localPref), m_ServerLocalPref(localPref), m_HostIP(hostIp), m_HostPort(hostPort), m_State(State::Init), m_Quit(false),
         m_GatherEventSub(this), m_PendingGatherCnt(0)
     {
         assert(hostPort);
@@ -18,8 +21,22 @@ namespace ICE {
 
     Stream::~Stream()
     {
+        ReleaseRetired();
+        StopChecking();
+
+        for (auto itor = m_TurnGatherThrds.begin(); itor != m_TurnGatherThrds.end(); ++itor)
+        {
+            if (itor->joinable())
+                itor->join();
+        }
+
         if (m_GatherThrd.joinable())
             m_GatherThrd.join();
+
+        // release the allocations while their channels are still open
+        for (auto itor = m_TurnClients.begin(); itor != m_TurnClients.end(); ++itor)
+            delete itor->second;
+        m_TurnClients.clear();
     }
 
     bool Stream::Create(const CAgentConfig& config)
@@ -29,13 +46,162 @@ namespace ICE {
 
     bool Stream::GatheringCandidate(const CAgentConfig& config)
     {
+        m_Foundations = config.Foundations();
+        assert(m_Foundations);
+
         // step 1> gather host candidate
-        if (!GatherHostCandidate(m_HostIP, m_HostPort, m_Protocol))
+        if (!GatherHostCandidates(config))
         {
             LOG_ERROR("Stream", "Gather Host Candidate Failed");
             return false;
         }
 
+        return GatherServerCandidates(config);
+    }
+
+    bool Stream::Regather(const CAgentConfig & config)
+    {
+        {
+            std::lock_guard<decltype(m_GatherMutex)> locker(m_GatherMutex);
+            if (m_PendingGatherCnt > 0)
+            {
+                LOG_WARNING("Stream", "Regather while gathering is in progress");
+                return false;
+            }
+        }
+
+        // nothing is pending, the threads of the last gathering have finished
+        if (m_GatherThrd.joinable())
+            m_GatherThrd.join();
+
+        for (auto itor = m_TurnGatherThrds.begin(); itor != m_TurnGatherThrds.end(); ++itor)
+        {
+            if (itor->joinable())
+                itor->join();
+        }
+        m_TurnGatherThrds.clear();
+        m_Foundations = config.Foundations();
+
+        // a host candidate is only retired when its address is gone
+        auto& addresses = config.LocalAddresses();
+        auto is_gone = [this, &addresses](const STUN::Candidate* cand) {
+            return IsMultihomed() && std::find_if(addresses.begin(), addresses.end(), [cand](const LocalAddress& address) {
+                return address.m_IP == cand->TransationIP();
+            }) == addresses.end();
+        };
+
+        {
+            std::lock_guard<decltype(m_CandsMutex)> locker(m_CandsMutex);
+            for (auto itor = m_Cands.begin(); itor != m_Cands.end();)
+            {
+                if (itor->first->IsHost() && !is_gone(itor->first))
+                {
+                    ++itor;
+                    continue;
+                }
+                m_RetiredCands.insert(*itor);
+                itor = m_Cands.erase(itor);
+            }
+        }
+
+        // new interfaces get their host candidates
+        if (IsMultihomed())
+            GatherHostCandidates(config);
+
+        return GatherServerCandidates(config);
+    }
+
+    void Stream::ReleaseRetired()
+    {
+        CandidateContainer  retired;
+        TurnClientContainer turns;
+        std::vector<std::thread> threads;
+        {
+            std::lock_guard<decltype(m_CandsMutex)> locker(m_CandsMutex);
+            retired.swap(m_RetiredCands);
+            for (auto itor = retired.begin(); itor != retired.end(); ++itor)
+            {
+                auto turn_itor = m_TurnClients.find(itor->first);
+                if (turn_itor != m_TurnClients.end())
+                {
+                    // the Refresh deleting the allocation goes out before the channel is closed
+                    turn_itor->second->Release();
+                    turns.insert(*turn_itor);
+                    m_TurnClients.erase(turn_itor);
+                }
+
+                itor->second->Close();
+                auto thread_itor = m_CheckingThrds.find(itor->first);
+                if (thread_itor != m_CheckingThrds.end())
+                {
+                    threads.push_back(std::move(thread_itor->second));
+                    m_CheckingThrds.erase(thread_itor);
+                }
+            }
+        }
+
+        // m_CandsMutex MUST NOT be held here, the checking threads take it to send
+        for (auto itor = threads.begin(); itor != threads.end(); ++itor)
+        {
+            if (itor->joinable())
+                itor->join();
+        }
+
+        for (auto itor = turns.begin(); itor != turns.end(); ++itor)
+            delete itor->second;
+
+        std::lock_guard<decltype(m_CandsMutex)> locker(m_CandsMutex);
+        for (auto itor = retired.begin(); itor != retired.end(); ++itor)
+        {
+            LOG_INFO("Stream", "%s Candidate Released, [%s:%d]", itor->first->TypeName(), itor->first->TransationIP().c_str(), itor->first->TransationPort());
+            delete itor->second;
+            m_FreeCands.push_back(const_cast<STUN::Candidate*>(itor->first));
+        }
+    }
+
+    bool Stream::IsMultihomed() const
+    {
+        if (m_HostIP.empty())
+            return true;
+
+        boost::system::error_code error;
+        auto address = boost::asio::ip::address::from_string(m_HostIP, error);
+        return !error && address.is_unspecified();
+    }
+
+    bool Stream::GatherHostCandidates(const CAgentConfig & config)
+    {
+        if (!IsMultihomed())
+            return GatherHostCandidate(m_HostIP, m_HostPort, m_Protocol, config.LocalPreference(m_HostIP, m_LocalPref));
+
+        /*
+        RFC8445[5.1.1.1.  Host Candidates]
+        a host candidate for each IP address of each interface of the host,
+        ranked by their RFC8421 local preference
+        */
+        auto& addresses = config.LocalAddresses();
+        uint16_t gathered = 0;
+        for (auto itor = addresses.begin(); itor != addresses.end(); ++itor)
+        {
+            bool bExisted = false;
+            {
+                std::lock_guard<decltype(m_CandsMutex)> locker(m_CandsMutex);
+                for (auto cand_itor = m_Cands.begin(); cand_itor != m_Cands.end() && !bExisted; ++cand_itor)
+                    bExisted = cand_itor->first->IsHost() && cand_itor->first->TransationIP() == itor->m_IP;
+            }
+
+            if (bExisted || GatherHostCandidate(itor->m_IP, m_HostPort, m_Protocol, itor->m_LocalPref))
+                ++gathered;
+            else
+                LOG_WARNING("Stream", "Gather Host Candidate on [%s] %s failed", itor->m_Interface.c_str(), itor->m_IP.c_str());
+        }
+        return gathered > 0;
+    }
+
+    bool Stream::GatherServerCandidates(const CAgentConfig & config)
+    {
+        m_ServerLocalPref = config.LocalPreference(config.DefaultIP(), m_LocalPref);
+
         auto &stun_server   = config.StunServer();
         auto &port_range    = config.GetPortRange();
 
@@ -49,7 +215,9 @@ namespace ICE {
         auto &turn_server = config.TurnServer();
         for (auto itor = turn_server.begin(); itor != turn_server.end(); ++itor)
         {
-            GatherRelayedCandidate(config.DefaultIP(), port_range.Lower(), port_range.Upper(), itor->first, itor->second);
+            std::string username, password;
+            config.TurnCredential(itor->first, username, password);
+            GatherRelayedCandidate(config.DefaultIP(), port_range.Lower(), port_range.Upper(), itor->first, itor->second, username, password);
             std::unique_lock<decltype(m_TaMutex)> locker(m_TaMutex);
             m_TaCond.wait_for(locker, std::chrono::milliseconds(config.Ta()));
         }
@@ -60,7 +228,7 @@ namespace ICE {
         return true;
     }
 
-    bool Stream::GatherHostCandidate(const std::string & ip, uint16_t port, Protocol protocol)
+    bool Stream::GatherHostCandidate(const std::string & ip, uint16_t port, Protocol protocol, uint16_t localPref)
     {
         std::auto_ptr<Channel> channel(nullptr);
         switch (protocol)
@@ -84,15 +252,11 @@ namespace ICE {
         if (!channel.get())
             return false;
 
-        std::auto_ptr<STUN::HostCandidate> cand(new STUN::HostCandidate(m_CompId, m_LocalPref, ip, port));
-
-        if(!cand.get())
-            return false;
+        auto cand = STUN::HostCandidate(*m_Foundations, m_CompId, localPref, ip, port);
         {
             std::lock_guard<decltype(m_CandsMutex)> locker(m_CandsMutex);
-            if (m_Cands.insert(std::make_pair(cand.get(), channel.get())).second)
+            if (AddCandidate(cand, channel.get(), nullptr))
             {
-                cand.release();
                 channel.release();
                 LOG_INFO("Stream", "Host Candidate Created : [%s:%d]", ip.c_str(), port);
                 return true;
@@ -146,11 +310,272 @@ namespace ICE {
         return true;
     }
 
-    bool Stream::GatherRelayedCandidate(const std::string & ip, uint16_t lowerPort, uint16_t upperPort, const std::string & turnServer, uint16_t turnPort)
+    bool Stream::GatherRelayedCandidate(const std::string & ip, uint16_t lowerPort, uint16_t upperPort, const std::string & turnServer, uint16_t turnPort,
+        const std::string& username, const std::string& password)
+    {
+        std::auto_ptr<UDPChannel> channel(CreateChannel<UDPChannel>(ip, lowerPort, upperPort, m_MaxTries));
+        if (!channel.get() || !channel->BindRemote(turnServer, turnPort))
+        {
+            LOG_ERROR("Stream", "Create Channel Failed while tried to gather relayed candidate from [%s]", turnServer.c_str());
+            return false;
+        }
+
+        std::auto_ptr<TurnClient> turn;
+        try
+        {
+            turn.reset(new TurnClient(channel.get(), turnServer, turnPort, username, password));
+        }
+        catch (const std::exception& e)
+        {
+            LOG_ERROR("Stream", "invalid turn server [%s], exception %s", turnServer.c_str(), e.what());
+            return false;
+        }
+
+        {
+            std::lock_guard<decltype(m_GatherMutex)> locker(m_GatherMutex);
+            m_PendingGatherCnt++;
+        }
+
+        // Allocate blocks for up to 39.5s, it runs on its own thread like the stun gathering
+        m_TurnGatherThrds.push_back(std::thread(Stream::TurnGatheringThread, this, turn.release(), channel.release()));
+        return true;
+    }
+
+    void Stream::TurnGatheringThread(Stream * pThis, TurnClient * turn, UDPChannel * channel)
+    {
+        assert(pThis && turn && channel);
+
+        if (turn->Allocate())
+        {
+            /*
+            RFC8445[5.1.1.2.  Server-Reflexive and Relayed Candidates]
+            the related address of a relayed candidate is the mapped address
+            */
+            auto cand = STUN::RelayedCandidate(*pThis->m_Foundations, pThis->m_CompId, pThis->m_ServerLocalPref,
+                turn->RelayedIP(), turn->RelayedPort(), turn->MappedIP(), turn->MappedPort(), turn->ServerIP());
+
+            std::lock_guard<decltype(pThis->m_CandsMutex)> locker(pThis->m_CandsMutex);
+            if (pThis->AddCandidate(cand, channel, turn))
+            {
+                LOG_INFO("Stream", "RelayedCandidate Created, [%s:%d]", turn->RelayedIP().c_str(), turn->RelayedPort());
+                turn = nullptr;
+            }
+        }
+
+        if (turn)
+        {
+            delete turn;
+            delete channel;
+        }
+
+        {
+            std::lock_guard<decltype(pThis->m_GatherMutex)> locker(pThis->m_GatherMutex);
+            pThis->m_PendingGatherCnt--;
+        }
+
+        pThis->m_TaCond.notify_one();
+        if (pThis->m_PendingGatherCnt <= 0)
+            pThis->m_WaitingGatherCond.notify_one();
+    }
+
+    bool Stream::StartChecking()
     {
+        if (!IsUDP())
+        {
+            LOG_ERROR("Stream", "Connectivity check only supported on UDP stream");
+            return false;
+        }
+
+        std::lock_guard<decltype(m_CandsMutex)> locker(m_CandsMutex);
+        if (!m_CheckingThrds.empty())
+            return true;
+
+        m_Quit = false;
+        for (auto itor = m_Cands.begin(); itor != m_Cands.end(); ++itor)
+        {
+            auto channel = dynamic_cast<UDPChannel*>(itor->second);
+            assert(channel);
+            auto turn_itor = m_TurnClients.find(itor->first);
+            auto turn = turn_itor == m_TurnClients.end() ? nullptr : turn_itor->second;
+            m_CheckingThrds[itor->first] = std::thread(Stream::CheckingThread, this, itor->first, channel, turn);
+        }
         return true;
     }
 
+    const STUN::Candidate* Stream::AddCandidate(const STUN::Candidate & candidate, Channel * channel, TurnClient * turn)
+    {
+        // m_CandsMutex MUST be held
+        STUN::Candidate *cand = nullptr;
+        if (m_FreeCands.empty())
+        {
+            m_CandStore.push_back(candidate);
+            cand = &m_CandStore.back();
+        }
+        else
+        {
+            cand = m_FreeCands.back();
+            m_FreeCands.pop_back();
+            *cand = candidate;
+        }
+
+        m_Cands[cand] = channel;
+
+        if (turn)
+            m_TurnClients[cand] = turn;
+
+        // a candidate gathered again by an ICE restart joins the checks already running
+        if (!m_CheckingThrds.empty())
+        {
+            auto udp = dynamic_cast<UDPChannel*>(channel);
+            assert(udp);
+            m_CheckingThrds[cand] = std::thread(Stream::CheckingThread, this, cand, udp, turn);
+        }
+        return cand;
+    }
+
+    void Stream::StopChecking()
+    {
+        m_Quit = true;
+        {
+            std::lock_guard<decltype(m_CandsMutex)> locker(m_CandsMutex);
+            if (m_CheckingThrds.empty())
+                return;
+
+            // close channel to wakeup checking threads
+            for (auto itor = m_Cands.begin(); itor != m_Cands.end(); ++itor)
+                itor->second->Close();
+
+            for (auto itor = m_RetiredCands.begin(); itor != m_RetiredCands.end(); ++itor)
+                itor->second->Close();
+        }
+
+        for (auto itor = m_CheckingThrds.begin(); itor != m_CheckingThrds.end(); ++itor)
+        {
+            if (itor->second.joinable())
+                itor->second.join();
+        }
+        m_CheckingThrds.clear();
+    }
+
+    bool Stream::SendData(const STUN::Candidate* lcand, const STUN::MessagePacket& msg, const std::string& ip, uint16_t port)
+    {
+        assert(lcand);
+
+        std::lock_guard<decltype(m_CandsMutex)> locker(m_CandsMutex);
+        // a retired candidate carries media until the new pair is selected
+        auto itor = m_Cands.find(lcand);
+        if (itor == m_Cands.end())
+        {
+            itor = m_RetiredCands.find(lcand);
+            if (itor == m_RetiredCands.end())
+            {
+                LOG_ERROR("Stream", "SendData, unknown local candidate [%s:%d]", lcand->TransationIP().c_str(), lcand->TransationPort());
+                return false;
+            }
+        }
+
+        auto channel = dynamic_cast<UDPChannel*>(itor->second);
+        assert(channel);
+
+        try
+        {
+            boost::asio::ip::udp::endpoint ep(boost::asio::ip::address::from_string(ip), port);
+
+            auto turn_itor = m_TurnClients.find(lcand);
+            if (turn_itor != m_TurnClients.end())
+                return turn_itor->second->Send(ep, msg.GetData(), msg.GetLength()) > 0;
+
+            return channel->Write(msg.GetData(), msg.GetLength(), ep) > 0;
+        }
+        catch (const std::exception& e)
+        {
+            LOG_ERROR("Stream", "SendData to [%s:%d] exception %s", ip.c_str(), port, e.what());
+            return false;
+        }
+    }
+
+    void Stream::CheckingThread(Stream * pThis, const STUN::Candidate * lcand, UDPChannel * channel, TurnClient * turn)
+    {
+        assert(pThis && lcand && channel);
+
+        STUN::PACKET::stun_packet packet;
+        STUN::PACKET::stun_packet relayed;
+        STUN::PACKET::stun_packet response;
+        boost::asio::ip::udp::endpoint from;
+
+        while (!pThis->m_Quit)
+        {
+            auto bytes = channel->Read(&packet, sizeof(packet), from);
+            if (bytes < 0)
+                break;
+
+            if (!bytes)
+                continue;
+
+            if (!turn)
+            {
+                if (STUN::MessagePacket::IsValidStunPacket(packet, bytes))
+                    pThis->OnCheckingPacket(lcand, channel, turn, from, packet, static_cast<uint16_t>(bytes), response);
+                continue;
+            }
+
+            /*
+            RFC8656[12.6.  Receiving a ChannelData Message]
+            everything on a relayed candidate comes from the server, the peer is
+            given by the channel number or by XOR-PEER-ADDRESS of a Data indication
+            */
+            boost::asio::ip::udp::endpoint peer;
+            const uint8_t *payload = nullptr;
+            uint16_t payload_size  = 0;
+
+            if (TurnClient::IsChannelData(&packet, static_cast<uint16_t>(bytes)))
+            {
+                if (!turn->OnChannelData(&packet, static_cast<uint16_t>(bytes), peer, payload, payload_size))
+                    continue;
+            }
+            else if (STUN::MessagePacket::IsValidStunPacket(packet, bytes))
+            {
+                if (turn->OnStunPacket(packet, static_cast<uint16_t>(bytes)) || packet.MsgId() != STUN::MsgType::DataIndication)
+                    continue;
+
+                STUN::MessagePacket msg(packet, static_cast<uint16_t>(bytes));
+                if (!turn->OnDataIndication(msg, peer, payload, payload_size))
+                    continue;
+            }
+            else
+            {
+                continue;
+            }
+
+            if (payload_size > sizeof(relayed))
+                continue;
+
+            memcpy(&relayed, payload, payload_size);
+            if (STUN::MessagePacket::IsValidStunPacket(relayed, payload_size))
+                pThis->OnCheckingPacket(lcand, channel, turn, peer, relayed, payload_size, response);
+        }
+    }
+
+    void Stream::OnCheckingPacket(const STUN::Candidate * lcand, UDPChannel * channel, TurnClient * turn, const boost::asio::ip::udp::endpoint & from,
+        const STUN::PACKET::stun_packet & packet, uint16_t size, STUN::PACKET::stun_packet & response)
+    {
+        // Binding requests are answered from the socket they arrived on before the session sees them
+        uint16_t response_size = 0;
+        auto result = m_Responder.Respond(packet, size, from, response, response_size);
+        if (response_size)
+        {
+            auto bytes = turn ? turn->Send(from, &response, response_size) : channel->Write(&response, response_size, from);
+            if (bytes <= 0)
+                LOG_WARNING("Stream", "send Binding response to [%s:%d] failed", from.address().to_string().c_str(), from.port());
+        }
+
+        if (result == BindingResponder::Result::NotRequest || result == BindingResponder::Result::Success)
+        {
+            CheckingPacket checking = { lcand, from, packet, size };
+            NotifyListener(static_cast<uint16_t>(Message::Checking), (WPARAM)&checking, (LPARAM)lcand);
+        }
+    }
+
     void Stream::WaitGatheringDoneThread(Stream * pThis)
     {
         assert(pThis);
@@ -166,20 +591,14 @@ namespace ICE {
             auto helper = *itor;
             if (helper->IsOK())
             {
-                std::auto_ptr<STUN::SrflxCandidate> cand(new STUN::SrflxCandidate(pThis->m_CompId,
-                    pThis->m_LocalPref,
+                auto cand = STUN::SrflxCandidate(*pThis->m_Foundations, pThis->m_CompId,
+                    pThis->m_ServerLocalPref,
                     helper->m_Channel->IP(), helper->m_Channel->Port(),
-                    helper->m_RelatedIP, helper->m_RelatedPort, helper->m_StunIP));
+                    helper->m_RelatedIP, helper->m_RelatedPort, helper->m_StunIP);
 
-                if (cand.get())
-                {
-                    std::lock_guard<decltype(pThis->m_CandsMutex)> locker(pThis->m_CandsMutex);
-                    if (pThis->m_Cands.insert(std::make_pair(cand.get(), helper->m_Channel)).second)
-                    {
-                        LOG_INFO("Stream", "SrflxCandidate Created, [%s:%d]", helper->m_Channel->IP().c_str(), helper->m_Channel->Port());
-                        cand.release();
-                    }
-                }
+                std::lock_guard<decltype(pThis->m_CandsMutex)> locker(pThis->m_CandsMutex);
+                if (pThis->AddCandidate(cand, helper->m_Channel, nullptr))
+                    LOG_INFO("Stream", "SrflxCandidate Created, [%s:%d]", helper->m_Channel->IP().c_str(), helper->m_Channel->Port());
             }
             (*itor)->Unsubscribe(&pThis->m_GatherEventSub);
         }
@@ -0,0 +1,40 @@
+#include "streamdef.h"
+
+#include <string.h>
+#include <boost/asio/ip/address.hpp>
+
+namespace ICE {
+    bool TransportAddress::Parse(const char * ip, uint16_t port, TransportAddress & address)
+    {
+        boost::system::error_code error;
+        auto addr = boost::asio::ip::address::from_string(ip, error);
+        if (error)
+            return false;
+
+        auto bytes = addr.is_v4() ? boost::asio::ip::address_v6::v4_mapped(addr.to_v4()).to_bytes() : addr.to_v6().to_bytes();
+        memcpy(address.m_IP, bytes.data(), sizeof(address.m_IP));
+        address.m_Port = port;
+        return true;
+    }
+
+    bool TransportAddress::IsIPv4() const
+    {
+        // ::ffff:a.b.c.d
+        static const uint8_t prefix[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xFF };
+        return !memcmp(m_IP, prefix, sizeof(prefix));
+    }
+
+    std::string TransportAddress::IP() const
+    {
+        boost::asio::ip::address_v6::bytes_type bytes;
+        memcpy(bytes.data(), m_IP, bytes.size());
+
+        boost::asio::ip::address_v6 addr(bytes);
+        return IsIPv4() ? addr.to_v4().to_string() : addr.to_string();
+    }
+
+    bool TransportAddress::operator==(const TransportAddress & other) const
+    {
+        return m_Port == other.m_Port && !memcmp(m_IP, other.m_IP, sizeof(m_IP));
+    }
+}
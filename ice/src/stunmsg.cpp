@@ -19,12 +19,13 @@ namespace STUN {
         m_Attributes[id] = m_AttrLength;
         auto pBuf = &m_StunPacket.Attributes()[m_AttrLength];
         m_AttrLength += size;
+        m_StunPacket.Length(m_AttrLength);
         return pBuf;
     }
 
     uint16_t MessagePacket::CalcAttrEncodeSize(uint16_t contentSize, uint16_t& paddingSize, uint16_t header_size /*= 4*/) const
     {
-        paddingSize = CalcPaddingSize(contentSize);
+        paddingSize = CalcPaddingSize(contentSize) - contentSize;
         return paddingSize + contentSize + header_size;
     }
 
@@ -67,6 +68,56 @@ namespace STUN {
         reinterpret_cast<uint64_t*>(pBuf)[0] = reinterpret_cast<const uint64_t*>(&attr)[0];
     }
 
+    void MessagePacket::AddAttribute(const ATTR::Lifetime & attr)
+    {
+        if (HasAttribute(attr.Type()))
+        {
+            LOG_WARNING("STUN-MSG", "Lifetime attribute already existed");
+            return;
+        }
+
+        static_assert(sizeof(ATTR::Lifetime) == 8, "Lifetime Must be 8 bytes");
+
+        auto pBuf = AllocAttribute(attr.Type(), sizeof(attr));
+        assert(pBuf);
+        reinterpret_cast<uint64_t*>(pBuf)[0] = reinterpret_cast<const uint64_t*>(&attr)[0];
+    }
+
+    void MessagePacket::AddAttribute(const ATTR::RequestedTransport & attr)
+    {
+        if (HasAttribute(attr.Type()))
+        {
+            LOG_WARNING("STUN-MSG", "RequestedTransport attribute already existed");
+            return;
+        }
+
+        static_assert(sizeof(ATTR::RequestedTransport) == 8, "RequestedTransport Must be 8 bytes");
+
+        auto pBuf = AllocAttribute(attr.Type(), sizeof(attr));
+        assert(pBuf);
+        reinterpret_cast<uint64_t*>(pBuf)[0] = reinterpret_cast<const uint64_t*>(&attr)[0];
+    }
+
+    void MessagePacket::AddAttribute(const ATTR::ChannelNumber & attr)
+    {
+        if (HasAttribute(attr.Type()))
+        {
+            LOG_WARNING("STUN-MSG", "ChannelNumber attribute already existed");
+            return;
+        }
+
+        static_assert(sizeof(ATTR::ChannelNumber) == 8, "ChannelNumber Must be 8 bytes");
+
+        auto pBuf = AllocAttribute(attr.Type(), sizeof(attr));
+        assert(pBuf);
+        reinterpret_cast<uint64_t*>(pBuf)[0] = reinterpret_cast<const uint64_t*>(&attr)[0];
+    }
+
+    void MessagePacket::AddData(const void * data, uint16_t size)
+    {
+        AddTextAttribute(ATTR::Id::Data, data, size);
+    }
+
     void MessagePacket::AddAttribute(const ATTR::UseCandidate & attr)
     {
         if (HasAttribute(attr.Type()))
@@ -80,7 +131,6 @@ namespace STUN {
 
         auto pBuf = AllocAttribute(attr.Type(), sizeof(ATTR::UseCandidate));
         assert(pBuf);
-        m_Attributes[attr.Type()] = m_AttrLength;
         reinterpret_cast<uint32_t*>(pBuf)[0] = reinterpret_cast<const uint32_t*>(&attr)[0];
     }
 
@@ -96,7 +146,8 @@ namespace STUN {
             auto content_len  = packet.Length();
             uint16_t attr_len = 0;
 
-            for(decltype(content_len) i = 0 ; i < content_len;  i += attr_len + sizeof(ATTR::Header))
+            // attribute values are padded to 4 bytes
+            for(decltype(content_len) i = 0 ; i < content_len;  i += CalcPaddingSize(attr_len) + sizeof(ATTR::Header))
             {
                 ATTR::Id id = static_cast<ATTR::Id>(PG::network_to_host(reinterpret_cast<const uint16_t*>(&attr[i])[0]));
                 attr_len    = PG::network_to_host(reinterpret_cast<const uint16_t*>(&attr[i])[1]);
@@ -124,6 +175,13 @@ namespace STUN {
                 case STUN::ATTR::Id::Fingerprint:
                 case STUN::ATTR::Id::IceControlled:
                 case STUN::ATTR::Id::IceControlling:
+                case STUN::ATTR::Id::ChannelNumber:
+                case STUN::ATTR::Id::Lifetime:
+                case STUN::ATTR::Id::XorPeerAddress:
+                case STUN::ATTR::Id::Data:
+                case STUN::ATTR::Id::XorRelayedAddress:
+                case STUN::ATTR::Id::RequestedTransport:
+                case STUN::ATTR::Id::DontFragment:
                     m_Attributes[id] = i;
                     break;
 
@@ -159,7 +217,7 @@ namespace STUN {
         const uint8_t* source = reinterpret_cast<const uint8_t*>(&attr);
 
         reinterpret_cast<uint64_t*>(pBuf)[0]     = reinterpret_cast<const uint64_t*>(source)[0];
-        reinterpret_cast<uint32_t*>(&pBuf[4])[0] = reinterpret_cast<const uint32_t*>(&source[4])[0];
+        reinterpret_cast<uint32_t*>(&pBuf[8])[0] = reinterpret_cast<const uint32_t*>(&source[8])[0];
     }
 
     void MessagePacket::AddAttribute(const ATTR::ChangeRequest & attr)
@@ -202,7 +260,7 @@ namespace STUN {
 
         const uint8_t* source = reinterpret_cast<const uint8_t*>(&attr);
         reinterpret_cast<uint64_t*>(pBuf)[0] = reinterpret_cast<const uint64_t*>(source)[0];
-        reinterpret_cast<uint32_t*>(&pBuf[4])[0] = reinterpret_cast<const uint32_t*>(&source[4])[0];
+        reinterpret_cast<uint32_t*>(&pBuf[8])[0] = reinterpret_cast<const uint32_t*>(&source[8])[0];
     }
 
     void MessagePacket::AddAttribute(const ATTR::Role &attr)
@@ -224,7 +282,7 @@ namespace STUN {
 
         const uint8_t* source = reinterpret_cast<const uint8_t*>(&attr);
         reinterpret_cast<uint64_t*>(pBuf)[0] = reinterpret_cast<const uint64_t*>(source)[0];
-        reinterpret_cast<uint32_t*>(&pBuf[4])[0] = reinterpret_cast<const uint32_t*>(&source[4])[0];
+        reinterpret_cast<uint32_t*>(&pBuf[8])[0] = reinterpret_cast<const uint32_t*>(&source[8])[0];
     }
 
     void MessagePacket::AddSoftware(const std::string& desc)
@@ -237,16 +295,16 @@ namespace STUN {
     {
         assert(realm.length() < ATTR::sTextLimite);
 
-        //AddTextAttribute(ATTR::Id::Realm, realm.data(), realm.length());
+        AddTextAttribute(ATTR::Id::Realm, realm.data(), static_cast<uint16_t>(realm.length()));
     }
 
     void MessagePacket::AddErrorCode(uint16_t clsCode, uint16_t number, const std::string& reason)
     {
         assert(reason.length() < ATTR::sTextLimite);
-        uint16_t padding_size = 0;
         uint16_t reason_length = static_cast<uint16_t>(reason.length());
 
-        auto size = CalcPaddingSize(reason_length, padding_size);
+        auto size = CalcPaddingSize(reason_length);
+        auto padding_size = size - reason_length;
 
         // ErrorCode attribute size = HEADER + 4 bytes + reason
         auto pBuf = AllocAttribute(ATTR::Id::ErrorCode, size + sizeof(ATTR::Header) + 4);
@@ -258,20 +316,22 @@ namespace STUN {
 
         reinterpret_cast<uint16_t*>(pBuf)[0] = PG::host_to_network(static_cast<uint16_t>(ATTR::Id::ErrorCode));
         // error code length = reason length + 4 bytes
-        reinterpret_cast<uint16_t*>(pBuf)[0] = PG::host_to_network(static_cast<uint16_t>(reason_length + 4));
+        reinterpret_cast<uint16_t*>(pBuf)[1] = PG::host_to_network(static_cast<uint16_t>(reason_length + 4));
+        reinterpret_cast<uint16_t*>(pBuf)[2] = 0;
 
         ATTR::ErrorCode *pErrorCode = reinterpret_cast<ATTR::ErrorCode*>(pBuf);
         pErrorCode->Class(clsCode);
         pErrorCode->Number(number);
 
-        memcpy(pBuf + 4 + reason_length, 0, padding_size);
+        memcpy(pBuf + sizeof(ATTR::Header) + 4, reason.data(), reason_length);
+        memset(pBuf + sizeof(ATTR::Header) + 4 + reason_length, 0, padding_size);
     }
 
     void MessagePacket::AddNonce(const std::string& nonce)
     {
         assert(nonce.length() < ATTR::sTextLimite);
 
-        //AddTextAttribute(ATTR::Id::Nonce, nonce.data(), nonce.length());
+        AddTextAttribute(ATTR::Id::Nonce, nonce.data(), static_cast<uint16_t>(nonce.length()));
     }
 
     void MessagePacket::AddPassword(const std::string& password)
@@ -300,7 +360,7 @@ namespace STUN {
         uint16_t content_size = cnt * sizeof(ATTR::Id);
         auto size = CalcPaddingSize(content_size);
 
-        auto pBuf = AllocAttribute(STUN::ATTR::Id::UnknownAttributes, size + content_size + 4);
+        auto pBuf = AllocAttribute(STUN::ATTR::Id::UnknownAttributes, size + 4);
         if (!pBuf)
         {
             LOG_ERROR("STUN-MSG", "Not Enough for unknownattribute");
@@ -365,6 +425,63 @@ namespace STUN {
         return xorMap;
     }
 
+    const ATTR::XorPeerAddress* MessagePacket::GetAttribute(const ATTR::XorPeerAddress *& peer) const
+    {
+        auto itor = m_Attributes.find(ATTR::Id::XorPeerAddress);
+        peer = (itor == m_Attributes.end()) ?
+            nullptr : reinterpret_cast<const ATTR::XorPeerAddress*>(&m_StunPacket.Attributes()[itor->second]);
+
+        return peer;
+    }
+
+    const ATTR::XorRelayedAddress* MessagePacket::GetAttribute(const ATTR::XorRelayedAddress *& relayed) const
+    {
+        auto itor = m_Attributes.find(ATTR::Id::XorRelayedAddress);
+        relayed = (itor == m_Attributes.end()) ?
+            nullptr : reinterpret_cast<const ATTR::XorRelayedAddress*>(&m_StunPacket.Attributes()[itor->second]);
+
+        return relayed;
+    }
+
+    const ATTR::Lifetime* MessagePacket::GetAttribute(const ATTR::Lifetime *& lifetime) const
+    {
+        auto itor = m_Attributes.find(ATTR::Id::Lifetime);
+        lifetime = (itor == m_Attributes.end()) ?
+            nullptr : reinterpret_cast<const ATTR::Lifetime*>(&m_StunPacket.Attributes()[itor->second]);
+
+        return lifetime;
+    }
+
+    const ATTR::RequestedTransport* MessagePacket::GetAttribute(const ATTR::RequestedTransport *& transport) const
+    {
+        auto itor = m_Attributes.find(ATTR::Id::RequestedTransport);
+        transport = (itor == m_Attributes.end()) ?
+            nullptr : reinterpret_cast<const ATTR::RequestedTransport*>(&m_StunPacket.Attributes()[itor->second]);
+
+        return transport;
+    }
+
+    const ATTR::ChannelNumber* MessagePacket::GetAttribute(const ATTR::ChannelNumber *& channel) const
+    {
+        auto itor = m_Attributes.find(ATTR::Id::ChannelNumber);
+        channel = (itor == m_Attributes.end()) ?
+            nullptr : reinterpret_cast<const ATTR::ChannelNumber*>(&m_StunPacket.Attributes()[itor->second]);
+
+        return channel;
+    }
+
+    bool MessagePacket::GetDataAttribute(const uint8_t *& data, uint16_t & size) const
+    {
+        auto itor = m_Attributes.find(ATTR::Id::Data);
+        if (itor == m_Attributes.end())
+            return false;
+
+        auto header = reinterpret_cast<const ATTR::Header*>(&m_StunPacket.Attributes()[itor->second]);
+        data = &m_StunPacket.Attributes()[itor->second + sizeof(ATTR::Header)];
+        size = header->ContentLength();
+        return true;
+    }
+
     const ATTR::Role* MessagePacket::GetAttribute(const ATTR::Role *& role) const
     {
         auto itor = m_Attributes.find(ATTR::Id::IceControlled);
@@ -395,6 +512,15 @@ namespace STUN {
         return useCan;
     }
 
+    const ATTR::ErrorCode* MessagePacket::GetAttribute(const ATTR::ErrorCode *& errCode) const
+    {
+        auto itor = m_Attributes.find(ATTR::Id::ErrorCode);
+        errCode = (itor == m_Attributes.end()) ?
+            nullptr : reinterpret_cast<const ATTR::ErrorCode*>(&m_StunPacket.Attributes()[itor->second]);
+
+        return errCode;
+    }
+
     const ATTR::Software* MessagePacket::GetAttribute(const ATTR::Software *& software) const
     {
         auto itor = m_Attributes.find(ATTR::Id::Software);
@@ -467,8 +593,81 @@ namespace STUN {
         return unknowAttrs;
     }
 
+    void MessagePacket::AddMessageIntegrity(const std::string & key)
+    {
+        if (HasAttribute(ATTR::Id::MessageIntegrity))
+        {
+            LOG_WARNING("STUN-MSG", "MessageIntegrity attribute already existed");
+            return;
+        }
+
+        auto offset = m_AttrLength;
+        auto pBuf = AllocAttribute(ATTR::Id::MessageIntegrity, sizeof(ATTR::MessageIntegrity));
+        if (!pBuf)
+        {
+            LOG_ERROR("STUN-MSG", "Not Enough Memory for MessageIntegrity");
+            return;
+        }
+
+        reinterpret_cast<uint16_t*>(pBuf)[0] = PG::host_to_network(static_cast<uint16_t>(ATTR::Id::MessageIntegrity));
+        reinterpret_cast<uint16_t*>(pBuf)[1] = PG::host_to_network(static_cast<uint16_t>(sSHA1Size));
+        ComputeMsgIntegrity(m_StunPacket, offset, key, *reinterpret_cast<SHA1*>(pBuf + sizeof(ATTR::Header)));
+    }
+
+    void MessagePacket::AddFingerprint()
+    {
+        if (HasAttribute(ATTR::Id::Fingerprint))
+        {
+            LOG_WARNING("STUN-MSG", "Fingerprint attribute already existed");
+            return;
+        }
+
+        auto offset = m_AttrLength;
+        auto pBuf = AllocAttribute(ATTR::Id::Fingerprint, sizeof(ATTR::Fingerprint));
+        if (!pBuf)
+        {
+            LOG_ERROR("STUN-MSG", "Not Enough Memory for Fingerprint");
+            return;
+        }
+
+        reinterpret_cast<uint16_t*>(pBuf)[0] = PG::host_to_network(static_cast<uint16_t>(ATTR::Id::Fingerprint));
+        reinterpret_cast<uint16_t*>(pBuf)[1] = PG::host_to_network(static_cast<uint16_t>(4));
+        reinterpret_cast<uint32_t*>(pBuf)[1] = PG::host_to_network(ComputeFingerprint(m_StunPacket, offset));
+    }
+
+    void MessagePacket::ComputeMsgIntegrity(const PACKET::stun_packet & packet, uint16_t offset, const std::string & key, SHA1 & sha1)
+    {
+        /*
+        RFC5389[15.4.  MESSAGE-INTEGRITY]
+        HMAC-SHA1 over the message up to the attribute, the length in the header
+        counts up to the end of MESSAGE-INTEGRITY
+        */
+        uint8_t header[sStunHeaderLength];
+        memcpy(header, &packet, sizeof(header));
+        reinterpret_cast<uint16_t*>(header)[1] = PG::host_to_network(static_cast<uint16_t>(offset + sizeof(ATTR::MessageIntegrity)));
+
+        PG::HmacSHA1(key.data(), key.length(), header, sizeof(header), packet.Attributes(), offset, sha1);
+    }
+
+    uint32_t MessagePacket::ComputeFingerprint(const PACKET::stun_packet & packet, uint16_t offset)
+    {
+        /*
+        RFC5389[15.5.  FINGERPRINT]
+        CRC-32 of the message up to the attribute XOR'ed with 0x5354554e
+        */
+        uint8_t header[sStunHeaderLength];
+        memcpy(header, &packet, sizeof(header));
+        reinterpret_cast<uint16_t*>(header)[1] = PG::host_to_network(static_cast<uint16_t>(offset + sizeof(ATTR::Fingerprint)));
+
+        auto crc = PG::CRC32(header, sizeof(header));
+        return PG::CRC32(packet.Attributes(), offset, crc) ^ 0x5354554e;
+    }
+
     void MessagePacket::ComputeSHA1(const MessagePacket & packet, const std::string & key,SHA1Ref sha1)
     {
+        auto itor = packet.m_Attributes.find(ATTR::Id::MessageIntegrity);
+        auto offset = (itor == packet.m_Attributes.end()) ? packet.m_AttrLength : itor->second;
+        ComputeMsgIntegrity(packet.m_StunPacket, offset, key, *sha1);
     }
 
     bool MessagePacket::VerifyMsgIntegrity(const MessagePacket & packet, const std::string & key)
@@ -478,16 +677,19 @@ namespace STUN {
         if (!packet.GetAttribute(pMsgIntegrity))
             return false;
 
-        uint16_t data_len = packet.GetLength();
-        data_len -= 20 + 4; // length of MessageIntegrity attribute;
+        SHA1 sha1;
+        ComputeSHA1(packet, key, &sha1);
+        return 0 == memcmp(sha1, pMsgIntegrity->Digest(), sizeof(sha1));
+    }
 
-        const ATTR::Fingerprint *pFingerprint = nullptr;
-        if (packet.GetAttribute(pFingerprint))
-        {
-            data_len -= 8; // length of Fingerprint attribute;
-        }
+    bool MessagePacket::VerifyFingerprint(const MessagePacket & packet)
+    {
+        auto itor = packet.m_Attributes.find(ATTR::Id::Fingerprint);
+        if (itor == packet.m_Attributes.end())
+            return true;
 
-        return true;
+        auto pFingerprint = reinterpret_cast<const ATTR::Fingerprint*>(&packet.m_StunPacket.Attributes()[itor->second]);
+        return pFingerprint->CRC32() == ComputeFingerprint(packet.m_StunPacket, itor->second);
     }
 
     bool MessagePacket::IsValidStunPacket(const PACKET::stun_packet& packet, uint16_t packet_size)
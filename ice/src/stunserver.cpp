@@ -0,0 +1,194 @@
+#include "stunserver.h"
+#include "stunmsg.h"
+
+#include "pg_log.h"
+#include "pg_hash.h"
+
+namespace {
+    inline uint32_t Hash(uint32_t hash, const boost::asio::ip::udp::endpoint& ep)
+    {
+        auto address = ep.address();
+        if (address.is_v4())
+        {
+            auto bytes = address.to_v4().to_bytes();
+            hash = PG::FNV1a(bytes.data(), bytes.size(), hash);
+        }
+        else
+        {
+            auto bytes = address.to_v6().to_bytes();
+            hash = PG::FNV1a(bytes.data(), bytes.size(), hash);
+        }
+
+        uint8_t port[2] = { static_cast<uint8_t>(ep.port() >> 8), static_cast<uint8_t>(ep.port()) };
+        return PG::FNV1a(port, sizeof(port), hash);
+    }
+}
+
+namespace STUN {
+    Server::Server(const std::string & ip, uint16_t port, uint16_t workers /*= 1*/) :
+        m_IP(ip), m_Port(port), m_Workers(workers ? workers : 1), m_Quit(false), m_Answered(0),
+        m_Mapping(NatMapping::None), m_PublicIP(0), m_LowPort(0), m_UpperPort(0)
+    {
+    }
+
+    Server::~Server()
+    {
+        Stop();
+    }
+
+    bool Server::SimulateNat(NatMapping mapping, const std::string & publicIP, uint16_t lowPort, uint16_t upperPort)
+    {
+        assert(!IsRunning());
+
+        if (mapping == NatMapping::None)
+        {
+            m_Mapping = mapping;
+            return true;
+        }
+
+        boost::system::error_code error;
+        auto address = boost::asio::ip::address::from_string(publicIP, error);
+        if (error || !address.is_v4() || !lowPort || lowPort > upperPort)
+        {
+            LOG_ERROR("StunServer", "invalid NAT mapping [%s] [%d-%d]", publicIP.c_str(), lowPort, upperPort);
+            return false;
+        }
+
+        m_Mapping   = mapping;
+        m_PublicIP  = static_cast<uint32_t>(address.to_v4().to_ulong());
+        m_LowPort   = lowPort;
+        m_UpperPort = upperPort;
+        return true;
+    }
+
+    bool Server::Start()
+    {
+        assert(!IsRunning());
+
+        if (!m_Channel.Bind(m_IP, m_Port))
+        {
+            LOG_ERROR("StunServer", "bind [%s:%d] failed", m_IP.c_str(), m_Port);
+            return false;
+        }
+
+        /*
+         every worker waits on the same socket, the kernel hands each datagram to one of them.
+         non blocking, a worker which lost the datagram to another one goes back to waiting
+         */
+        boost::system::error_code error;
+        m_Channel.Socket().non_blocking(true, error);
+
+        m_Quit = false;
+        for (uint16_t i = 0; i < m_Workers; ++i)
+            m_WorkerThrds.push_back(std::thread(Server::WorkerThread, this));
+
+        LOG_INFO("StunServer", "listening on [%s:%d] with %d workers", m_IP.c_str(), m_Port, m_Workers);
+        return true;
+    }
+
+    void Server::Stop()
+    {
+        if (!IsRunning())
+            return;
+
+        // closing the socket does not wake a blocked recvfrom on linux, the workers poll m_Quit
+        m_Quit = true;
+        for (auto itor = m_WorkerThrds.begin(); itor != m_WorkerThrds.end(); ++itor)
+        {
+            if (itor->joinable())
+                itor->join();
+        }
+        m_WorkerThrds.clear();
+        m_Channel.Close();
+    }
+
+    void Server::WorkerThread(Server * pThis)
+    {
+        assert(pThis);
+
+        PACKET::stun_packet packet;
+        boost::asio::ip::udp::endpoint from;
+
+        while (!pThis->m_Quit)
+        {
+            /*
+             a read error does not end the worker, winsock reports WSAECONNRESET on the
+             socket once an ICMP port unreachable came back from a client which went away
+             */
+            auto bytes = pThis->m_Channel.Read(&packet, sizeof(packet), from, sPollInterval);
+            if (bytes <= 0)
+                continue;
+
+            if (MessagePacket::IsValidStunPacket(packet, bytes) && pThis->Answer(packet, static_cast<uint16_t>(bytes), from))
+                ++pThis->m_Answered;
+        }
+    }
+
+    bool Server::Answer(const PACKET::stun_packet & request, uint16_t size, const boost::asio::ip::udp::endpoint & from)
+    {
+        // RFC5389 7.3 only Binding requests are served, anything else is silently dropped
+        if (request.MsgId() != MsgType::BindingRequest)
+            return false;
+
+        uint32_t ip   = 0;
+        uint16_t port = 0;
+        if (!Map(from, ip, port))
+        {
+            RFC5389BindErrorRespMsg resp(request.TransId(), 5, 0, "Server Error");
+            m_Channel.Write(resp.GetData(), resp.GetLength(), from);
+            return false;
+        }
+
+        /*
+        RFC5389[7.3.3.  Processing a Success Response]
+        RFC5389 clients get XOR-MAPPED-ADDRESS, RFC3489 clients (no magic cookie) MAPPED-ADDRESS
+        */
+        if (PG::host_to_network(sMagicCookie) == reinterpret_cast<const uint32_t*>(request.TransId())[0])
+        {
+            ATTR::XorMappedAddress address;
+            address.Address(ip);
+            address.Port(port);
+
+            RFC5389BindRespMsg resp(request.TransId(), address);
+            resp.AddFingerprint();
+            return m_Channel.Write(resp.GetData(), resp.GetLength(), from) > 0;
+        }
+        else
+        {
+            ATTR::MappedAddress address;
+            address.Address(ip);
+            address.Port(port);
+
+            BindingRespMsg resp(request.TransId());
+            resp.AddAttribute(address);
+            return m_Channel.Write(resp.GetData(), resp.GetLength(), from) > 0;
+        }
+    }
+
+    bool Server::Map(const boost::asio::ip::udp::endpoint & from, uint32_t & ip, uint16_t & port) const
+    {
+        if (m_Mapping == NatMapping::None)
+        {
+            // the message codec only encodes IPv4 mapped addresses
+            if (!from.address().is_v4())
+                return false;
+
+            ip   = static_cast<uint32_t>(from.address().to_v4().to_ulong());
+            port = from.port();
+            return true;
+        }
+
+        /*
+        RFC4787[4.1.  Address and Port Mapping]
+        the mapping is derived from the source (and the server address for a symmetric NAT)
+        so it is stable across runs without keeping any state
+        */
+        auto hash = Hash(PG::sFNV1aBasis, from);
+        if (m_Mapping == NatMapping::AddressPortDependent)
+            hash = PG::FNV1a(m_IP.data(), m_IP.length(), hash) ^ m_Port;
+
+        ip   = m_PublicIP;
+        port = static_cast<uint16_t>(m_LowPort + hash % (static_cast<uint32_t>(m_UpperPort - m_LowPort) + 1));
+        return true;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,571 @@
+#include "turnclient.h"
+#include "channel.h"
+
+#include "pg_crypto.h"
+#include "pg_log.h"
+
+namespace {
+    /* RFC5389 7.2.1 */
+    const uint32_t sRetransmission[] = { 500, 1000, 2000, 4000, 8000, 16000, 8000 };
+    const uint16_t sMaxSent         = sizeof(sRetransmission) / sizeof(sRetransmission[0]);
+    const uint32_t sTimerInterval   = 250;
+
+    bool IsTurnResponse(STUN::MsgType type)
+    {
+        switch (type)
+        {
+        case STUN::MsgType::AllocateResp:
+        case STUN::MsgType::AllocateErrResp:
+        case STUN::MsgType::RefreshResp:
+        case STUN::MsgType::RefreshErrResp:
+        case STUN::MsgType::CreatePermissionResp:
+        case STUN::MsgType::CreatePermissionErrResp:
+        case STUN::MsgType::ChannelBindResp:
+        case STUN::MsgType::ChannelBindErrResp:
+            return true;
+
+        default:
+            return false;
+        }
+    }
+
+    bool IsErrorResponse(STUN::MsgType type)
+    {
+        // class bits C1 C0 = 11
+        return (static_cast<uint16_t>(type) & 0x0110) == 0x0110;
+    }
+}
+
+namespace ICE {
+    TurnClient::TurnClient(UDPChannel * channel, const std::string & serverIP, uint16_t serverPort, const std::string & username, const std::string & password) :
+        m_Channel(channel), m_Server(boost::asio::ip::address::from_string(serverIP), serverPort), m_ServerIP(serverIP),
+        m_Username(username), m_Password(password),
+        m_bAllocated(false), m_RelayedPort(0), m_MappedPort(0), m_Lifetime(0), m_NextChannel(sMinChannel)
+    {
+        assert(m_Channel);
+    }
+
+    TurnClient::~TurnClient()
+    {
+        Release();
+    }
+
+    bool TurnClient::Allocate(uint32_t lifetime /*= sDefaultLifetime*/)
+    {
+        assert(!m_bAllocated);
+
+        /*
+        RFC8656[7.1.  Sending an Allocate Request]
+        the first request goes out without credentials, the 401 carries REALM and NONCE
+        */
+        bool bSigned = false;
+        for (uint16_t attempts = 0; attempts < 3; ++attempts)
+        {
+            STUN::TransId id;
+            STUN::MessagePacket::GenerateRFC5389TransationId(id);
+
+            STUN::MessagePacket request(STUN::MsgType::AllocateRequest, id);
+            request.AddAttribute(STUN::ATTR::RequestedTransport());
+            request.AddAttribute(STUN::ATTR::Lifetime(lifetime));
+            {
+                std::lock_guard<decltype(m_Mutex)> locker(m_Mutex);
+                bSigned = m_Nonce.length() > 0;
+                if (bSigned)
+                    Sign(request);
+                else
+                    request.AddFingerprint();
+            }
+
+            STUN::PACKET::stun_packet response;
+            uint16_t size = 0;
+            if (!Transact(request, response, size))
+            {
+                LOG_ERROR("TurnClient", "Allocate on [%s:%d] timeout", m_ServerIP.c_str(), m_Server.port());
+                return false;
+            }
+
+            STUN::MessagePacket msg(response, size);
+            if (response.MsgId() == STUN::MsgType::AllocateResp)
+                return OnAllocated(msg);
+
+            const STUN::ATTR::ErrorCode *error = nullptr;
+            auto code = msg.GetAttribute(error) ? error->Code() : 0;
+
+            // a 401 to a signed request means the credentials are wrong, a 438 only asks for a fresh nonce
+            if (((code == static_cast<uint16_t>(STUN::ErrorCode::Unauthorized) && !bSigned) ||
+                code == static_cast<uint16_t>(STUN::ErrorCode::StaleNonce)) && UpdateNonce(msg))
+                continue;
+
+            LOG_ERROR("TurnClient", "Allocate on [%s:%d] failed, error %d", m_ServerIP.c_str(), m_Server.port(), code);
+            return false;
+        }
+        return false;
+    }
+
+    void TurnClient::Release()
+    {
+        m_Timer.Stop();
+
+        std::lock_guard<decltype(m_Mutex)> locker(m_Mutex);
+        if (!m_bAllocated)
+            return;
+
+        // RFC8656 7.2 a Refresh with LIFETIME 0 deletes the allocation, nobody waits for the answer
+        SendRequest(STUN::MsgType::RefreshRequest, Endpoint(), 0, 0);
+        m_Requests.clear();
+        m_Bindings.clear();
+        m_ChannelPeers.clear();
+        m_Permissions.clear();
+        m_bAllocated = false;
+    }
+
+    bool TurnClient::CreatePermission(const Endpoint & peer)
+    {
+        std::lock_guard<decltype(m_Mutex)> locker(m_Mutex);
+        if (!m_bAllocated)
+            return false;
+
+        if (!SendRequest(STUN::MsgType::CreatePermissionRequest, peer, 0, 0))
+            return false;
+
+        m_Permissions[peer.address()] = Clock::now() + std::chrono::seconds(sPermissionRefresh);
+        return true;
+    }
+
+    bool TurnClient::ChannelBind(const Endpoint & peer)
+    {
+        std::lock_guard<decltype(m_Mutex)> locker(m_Mutex);
+        if (!m_bAllocated)
+            return false;
+
+        auto itor = m_Bindings.find(peer);
+        if (itor != m_Bindings.end())
+            return true;
+
+        if (m_NextChannel > sMaxChannel)
+        {
+            LOG_WARNING("TurnClient", "no channel number left for [%s:%d]", peer.address().to_string().c_str(), peer.port());
+            return false;
+        }
+
+        /*
+        RFC8656[12.1.  Sending a ChannelBind Request]
+        the binding also installs the permission for the peer
+        */
+        auto channel = m_NextChannel++;
+        if (!SendRequest(STUN::MsgType::ChannelBindRequest, peer, channel, 0))
+            return false;
+
+        Binding binding = { channel, false, Clock::now() + std::chrono::seconds(sChannelRefresh) };
+        m_Bindings[peer] = binding;
+        return true;
+    }
+
+    int16_t TurnClient::Send(const Endpoint & peer, const void * data, uint16_t size)
+    {
+        uint16_t channel = 0;
+        bool bBound = false;
+        {
+            std::lock_guard<decltype(m_Mutex)> locker(m_Mutex);
+            auto itor = m_Bindings.find(peer);
+            if (itor != m_Bindings.end())
+            {
+                channel = itor->second.m_Channel;
+                bBound  = itor->second.m_bBound;
+            }
+        }
+
+        if (bBound)
+        {
+            /*
+            RFC8656[12.4.  The ChannelData Message]
+            4 bytes header, channel number and length, no padding over UDP
+            */
+            uint8_t buffer[sChannelDataHeaderLength + STUN::sStunHeaderLength + STUN::sStunPacketLength];
+            if (size > sizeof(buffer) - sChannelDataHeaderLength)
+                return -1;
+
+            buffer[0] = static_cast<uint8_t>(channel >> 8);
+            buffer[1] = static_cast<uint8_t>(channel);
+            buffer[2] = static_cast<uint8_t>(size >> 8);
+            buffer[3] = static_cast<uint8_t>(size);
+            memcpy(&buffer[sChannelDataHeaderLength], data, size);
+
+            auto bytes = m_Channel->Write(buffer, static_cast<int16_t>(size + sChannelDataHeaderLength), m_Server);
+            return bytes > 0 ? static_cast<int16_t>(bytes - sChannelDataHeaderLength) : bytes;
+        }
+
+        if (!channel && !ChannelBind(peer))
+            return -1;
+
+        if (!peer.address().is_v4())
+        {
+            LOG_WARNING("TurnClient", "Send indication to IPv6 peer [%s] not supported", peer.address().to_string().c_str());
+            return -1;
+        }
+
+        /*
+        RFC8656[11.1.  Forming a Send Indication]
+        used until the channel is bound
+        */
+        STUN::TransId id;
+        STUN::MessagePacket::GenerateRFC5389TransationId(id);
+
+        STUN::ATTR::XorPeerAddress address;
+        address.Address(static_cast<uint32_t>(peer.address().to_v4().to_ulong()));
+        address.Port(peer.port());
+
+        STUN::MessagePacket msg(STUN::MsgType::SendIndication, id);
+        msg.AddAttribute(address);
+        msg.AddData(data, size);
+
+        return m_Channel->Write(msg.GetData(), msg.GetLength(), m_Server) > 0 ? size : -1;
+    }
+
+    bool TurnClient::OnStunPacket(const STUN::PACKET::stun_packet & packet, uint16_t size)
+    {
+        if (!IsTurnResponse(packet.MsgId()))
+            return false;
+
+        STUN::MessagePacket msg(packet, size);
+
+        std::lock_guard<decltype(m_Mutex)> locker(m_Mutex);
+        auto itor = m_Requests.find(TransactionKey(msg.TransationId()));
+        if (itor == m_Requests.end())
+            return false;
+
+        auto request = itor->second;
+        m_Requests.erase(itor);
+        OnResponse(request, packet.MsgId(), msg);
+        return true;
+    }
+
+    bool TurnClient::OnChannelData(const void * data, uint16_t size, Endpoint & peer, const uint8_t *& payload, uint16_t & payloadSize) const
+    {
+        if (!IsChannelData(data, size))
+            return false;
+
+        auto bytes   = static_cast<const uint8_t*>(data);
+        auto channel = static_cast<uint16_t>((bytes[0] << 8) | bytes[1]);
+        auto length  = static_cast<uint16_t>((bytes[2] << 8) | bytes[3]);
+        if (length + sChannelDataHeaderLength > size)
+            return false;
+
+        {
+            std::lock_guard<decltype(m_Mutex)> locker(m_Mutex);
+            auto itor = m_ChannelPeers.find(channel);
+            if (itor == m_ChannelPeers.end())
+                return false;
+            peer = itor->second;
+        }
+
+        payload     = bytes + sChannelDataHeaderLength;
+        payloadSize = length;
+        return true;
+    }
+
+    bool TurnClient::OnDataIndication(const STUN::MessagePacket & msg, Endpoint & peer, const uint8_t *& payload, uint16_t & payloadSize) const
+    {
+        const STUN::ATTR::XorPeerAddress *address = nullptr;
+        if (!msg.GetAttribute(address) || !msg.GetDataAttribute(payload, payloadSize))
+            return false;
+
+        peer = Endpoint(boost::asio::ip::address_v4(address->Address()), address->Port());
+        return true;
+    }
+
+    bool TurnClient::IsChannelData(const void * data, uint16_t size)
+    {
+        // RFC8656 12 the first two bits of a ChannelData message are 0b01
+        return size >= sChannelDataHeaderLength && (static_cast<const uint8_t*>(data)[0] & 0xC0) == 0x40;
+    }
+
+    uint64_t TurnClient::TransactionKey(STUN::TransIdConstRef id)
+    {
+        uint64_t key;
+        memcpy(&key, &id[sizeof(id) - sizeof(key)], sizeof(key));
+        return key;
+    }
+
+    bool TurnClient::Transact(const STUN::MessagePacket & request, STUN::PACKET::stun_packet & response, uint16_t & size)
+    {
+        for (auto rto : sRetransmission)
+        {
+            if (m_Channel->Write(request.GetData(), request.GetLength(), m_Server) <= 0)
+                LOG_WARNING("TurnClient", "send request to [%s:%d] failed", m_ServerIP.c_str(), m_Server.port());
+
+            auto expire = Clock::now() + std::chrono::milliseconds(rto);
+            for (auto now = Clock::now(); now < expire; now = Clock::now())
+            {
+                Endpoint from;
+                auto remain = std::chrono::duration_cast<std::chrono::milliseconds>(expire - now).count();
+                auto bytes = m_Channel->Read(&response, sizeof(response), from, static_cast<uint32_t>(remain));
+                if (bytes < 0)
+                    return false;
+
+                if (!bytes)
+                    break;
+
+                if (from == m_Server && STUN::MessagePacket::IsValidStunPacket(response, bytes) &&
+                    !memcmp(response.TransId(), request.TransationId(), sizeof(response.TransId())))
+                {
+                    size = static_cast<uint16_t>(bytes);
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    bool TurnClient::UpdateNonce(const STUN::MessagePacket & msg)
+    {
+        const STUN::ATTR::Nonce *nonce = nullptr;
+        if (!msg.GetAttribute(nonce) || !nonce->ContentLength())
+            return false;
+
+        std::lock_guard<decltype(m_Mutex)> locker(m_Mutex);
+        m_Nonce = nonce->GetNonce();
+
+        const STUN::ATTR::Realm *realm = nullptr;
+        if (msg.GetAttribute(realm) && realm->ContentLength() && realm->GetRealm() != m_Realm)
+        {
+            /*
+            RFC5389[15.4.  MESSAGE-INTEGRITY]
+            key = MD5(username ":" realm ":" SASLprep(password))
+            */
+            m_Realm = realm->GetRealm();
+
+            PG::MD5 md5;
+            md5.Update(m_Username.data(), m_Username.length());
+            md5.Update(":", 1);
+            md5.Update(m_Realm.data(), m_Realm.length());
+            md5.Update(":", 1);
+            md5.Update(m_Password.data(), m_Password.length());
+
+            PG::MD5::Digest key;
+            md5.Final(key);
+            m_Key.assign(reinterpret_cast<const char*>(key), sizeof(key));
+        }
+        return m_Realm.length() > 0;
+    }
+
+    bool TurnClient::OnAllocated(const STUN::MessagePacket & msg)
+    {
+        std::lock_guard<decltype(m_Mutex)> locker(m_Mutex);
+        if (!STUN::MessagePacket::VerifyMsgIntegrity(msg, m_Key))
+        {
+            LOG_ERROR("TurnClient", "Allocate response from [%s:%d] failed MESSAGE-INTEGRITY", m_ServerIP.c_str(), m_Server.port());
+            return false;
+        }
+
+        const STUN::ATTR::XorRelayedAddress *relayed = nullptr;
+        if (!msg.GetAttribute(relayed))
+        {
+            LOG_ERROR("TurnClient", "Allocate response from [%s:%d] without XOR-RELAYED-ADDRESS", m_ServerIP.c_str(), m_Server.port());
+            return false;
+        }
+
+        m_RelayedIP   = relayed->IP();
+        m_RelayedPort = relayed->Port();
+
+        const STUN::ATTR::XorMappedAddress *mapped = nullptr;
+        if (msg.GetAttribute(mapped))
+        {
+            m_MappedIP   = mapped->IP();
+            m_MappedPort = mapped->Port();
+        }
+
+        const STUN::ATTR::Lifetime *lifetime = nullptr;
+        m_Lifetime   = msg.GetAttribute(lifetime) ? lifetime->Seconds() : sDefaultLifetime;
+        m_RefreshAt  = Clock::now() + std::chrono::seconds(m_Lifetime / 2);
+        m_bAllocated = true;
+
+        LOG_INFO("TurnClient", "Allocated [%s:%d] on [%s:%d], lifetime %d", m_RelayedIP.c_str(), m_RelayedPort,
+            m_ServerIP.c_str(), m_Server.port(), m_Lifetime);
+
+        return m_Timer.Start(sTimerInterval, [this] {
+            OnTimer();
+        });
+    }
+
+    void TurnClient::Sign(STUN::MessagePacket & msg) const
+    {
+        // RFC8656 7.1 long-term credentials on every request after the challenge
+        msg.AddUsername(m_Username);
+        msg.AddRealm(m_Realm);
+        msg.AddNonce(m_Nonce);
+        msg.AddMessageIntegrity(m_Key);
+        msg.AddFingerprint();
+    }
+
+    bool TurnClient::SendRequest(STUN::MsgType type, const Endpoint & peer, uint16_t channel, uint32_t lifetime)
+    {
+        STUN::TransId id;
+        STUN::MessagePacket::GenerateRFC5389TransationId(id);
+        STUN::MessagePacket msg(type, id);
+
+        switch (type)
+        {
+        case STUN::MsgType::RefreshRequest:
+            msg.AddAttribute(STUN::ATTR::Lifetime(lifetime));
+            break;
+
+        case STUN::MsgType::ChannelBindRequest:
+            msg.AddAttribute(STUN::ATTR::ChannelNumber(channel));
+            // fall through, both carry XOR-PEER-ADDRESS
+
+        case STUN::MsgType::CreatePermissionRequest:
+        {
+            if (!peer.address().is_v4())
+            {
+                LOG_WARNING("TurnClient", "IPv6 peer [%s] not supported", peer.address().to_string().c_str());
+                return false;
+            }
+
+            STUN::ATTR::XorPeerAddress address;
+            address.Address(static_cast<uint32_t>(peer.address().to_v4().to_ulong()));
+            address.Port(peer.port());
+            msg.AddAttribute(address);
+            break;
+        }
+
+        default:
+            assert(0);
+            return false;
+        }
+        Sign(msg);
+
+        Request request = { type, peer, channel, lifetime, 1, sRetransmission[0], Clock::now() + std::chrono::milliseconds(sRetransmission[0]),
+            std::vector<uint8_t>(msg.GetData(), msg.GetData() + msg.GetLength()) };
+        m_Requests[TransactionKey(id)] = request;
+
+        if (m_Channel->Write(msg.GetData(), msg.GetLength(), m_Server) <= 0)
+            LOG_WARNING("TurnClient", "send request [0x%x] to [%s:%d] failed", type, m_ServerIP.c_str(), m_Server.port());
+        return true;
+    }
+
+    void TurnClient::OnResponse(const Request & request, STUN::MsgType type, const STUN::MessagePacket & msg)
+    {
+        if (IsErrorResponse(type))
+        {
+            const STUN::ATTR::ErrorCode *error = nullptr;
+            auto code = msg.GetAttribute(error) ? error->Code() : 0;
+
+            /*
+            RFC8656[7.3.  Receiving a Refresh Response / 9.3 / 12.3]
+            438 only means the nonce expired, resend with the fresh one
+            */
+            const STUN::ATTR::Nonce *nonce = nullptr;
+            if (code == static_cast<uint16_t>(STUN::ErrorCode::StaleNonce) && msg.GetAttribute(nonce) && nonce->ContentLength())
+            {
+                m_Nonce = nonce->GetNonce();
+                SendRequest(request.m_Type, request.m_Peer, request.m_Channel, request.m_Lifetime);
+                return;
+            }
+
+            LOG_WARNING("TurnClient", "request [0x%x] for [%s:%d] failed, error %d", request.m_Type,
+                request.m_Peer.address().to_string().c_str(), request.m_Peer.port(), code);
+
+            if (request.m_Type == STUN::MsgType::ChannelBindRequest)
+            {
+                m_Bindings.erase(request.m_Peer);
+                m_ChannelPeers.erase(request.m_Channel);
+            }
+            else if (request.m_Type == STUN::MsgType::RefreshRequest && request.m_Lifetime)
+                m_bAllocated = false;
+            return;
+        }
+
+        if (!STUN::MessagePacket::VerifyMsgIntegrity(msg, m_Key))
+        {
+            LOG_WARNING("TurnClient", "response [0x%x] failed MESSAGE-INTEGRITY, discards", request.m_Type);
+            return;
+        }
+
+        switch (request.m_Type)
+        {
+        case STUN::MsgType::ChannelBindRequest:
+        {
+            auto itor = m_Bindings.find(request.m_Peer);
+            if (itor != m_Bindings.end() && itor->second.m_Channel == request.m_Channel)
+            {
+                itor->second.m_bBound = true;
+                m_ChannelPeers[request.m_Channel] = request.m_Peer;
+            }
+            break;
+        }
+
+        case STUN::MsgType::RefreshRequest:
+        {
+            const STUN::ATTR::Lifetime *lifetime = nullptr;
+            if (msg.GetAttribute(lifetime))
+                m_Lifetime = lifetime->Seconds();
+            m_RefreshAt = Clock::now() + std::chrono::seconds(m_Lifetime / 2);
+            break;
+        }
+
+        default:
+            break;
+        }
+    }
+
+    void TurnClient::OnTimer()
+    {
+        std::lock_guard<decltype(m_Mutex)> locker(m_Mutex);
+        if (!m_bAllocated)
+            return;
+
+        auto now = Clock::now();
+
+        // retransmissions, RFC5389 7.2.1
+        for (auto itor = m_Requests.begin(); itor != m_Requests.end();)
+        {
+            auto& request = itor->second;
+            if (now < request.m_Expire)
+            {
+                ++itor;
+                continue;
+            }
+
+            if (request.m_Sent >= sMaxSent)
+            {
+                LOG_WARNING("TurnClient", "request [0x%x] to [%s:%d] timeout", request.m_Type, m_ServerIP.c_str(), m_Server.port());
+                if (request.m_Type == STUN::MsgType::ChannelBindRequest)
+                    m_Bindings.erase(request.m_Peer);
+                itor = m_Requests.erase(itor);
+                continue;
+            }
+
+            request.m_RTO    = sRetransmission[request.m_Sent++];
+            request.m_Expire = now + std::chrono::milliseconds(request.m_RTO);
+            m_Channel->Write(request.m_Data.data(), static_cast<int16_t>(request.m_Data.size()), m_Server);
+            ++itor;
+        }
+
+        // RFC8656 7.1 refresh the allocation before the lifetime runs out
+        if (now >= m_RefreshAt)
+        {
+            m_RefreshAt = now + std::chrono::seconds(m_Lifetime / 2);
+            SendRequest(STUN::MsgType::RefreshRequest, Endpoint(), 0, m_Lifetime);
+        }
+
+        // RFC8656 9 / 12 permissions and channel bindings are refreshed by repeating the request
+        for (auto itor = m_Permissions.begin(); itor != m_Permissions.end(); ++itor)
+        {
+            if (now < itor->second)
+                continue;
+
+            itor->second = now + std::chrono::seconds(sPermissionRefresh);
+            SendRequest(STUN::MsgType::CreatePermissionRequest, Endpoint(itor->first, 0), 0, 0);
+        }
+
+        for (auto itor = m_Bindings.begin(); itor != m_Bindings.end(); ++itor)
+        {
+            if (!itor->second.m_bBound || now < itor->second.m_Refresh)
+                continue;
+
+            itor->second.m_Refresh = now + std::chrono::seconds(sChannelRefresh);
+            SendRequest(STUN::MsgType::ChannelBindRequest, itor->first, itor->second.m_Channel, 0);
+        }
+    }
+}
\ No newline at end of file
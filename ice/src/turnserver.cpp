@@ -0,0 +1,836 @@
+#include "turnserver.h"
+#include "stunmsg.h"
+#include "channel.h"
+
+#include "pg_crypto.h"
+#include "pg_flat_hash.h"
+#include "pg_timing_wheel.h"
+#include "pg_util.h"
+#include "pg_log.h"
+
+#include <thread>
+#include <algorithm>
+#include <stdio.h>
+
+namespace {
+    const uint16_t sChannelDataHeaderLength = 4;
+    const uint16_t sMinChannel              = 0x4000;
+    const uint16_t sMaxChannel              = 0x4FFF;
+    const uint32_t sDrainBatch              = 64;       /* datagrams read without going back to the reactor */
+    const uint8_t  sProtocolUDP             = 17;
+
+    /* splitmix64 finalizer, the packed 5-tuple has its constant bits at the bottom */
+    struct TupleHash {
+        size_t operator()(uint64_t key) const
+        {
+            key = (key ^ (key >> 30)) * 0xBF58476D1CE4E5B9ull;
+            key = (key ^ (key >> 27)) * 0x94D049BB133111EBull;
+            return static_cast<size_t>(key ^ (key >> 31));
+        }
+    };
+
+    struct Permission {
+        uint32_t    m_Address;
+        uint64_t    m_Expire;       /* wheel tick */
+    };
+
+    struct Binding {
+        uint16_t                        m_Channel;
+        boost::asio::ip::udp::endpoint  m_Peer;
+        uint64_t                        m_Expire;   /* wheel tick */
+    };
+
+    /* one bit per permitted address, a clear bit rejects a peer without scanning the permissions */
+    inline uint64_t PermissionBit(uint32_t address)
+    {
+        return 1ull << ((address * 0x9E3779B1u) >> 26);
+    }
+
+    inline STUN::MsgType ErrorType(STUN::MsgType request)
+    {
+        return static_cast<STUN::MsgType>(static_cast<uint16_t>(request) | 0x0110);
+    }
+}
+
+namespace STUN {
+    struct TurnServer::Allocation {
+        Allocation(boost::asio::io_service& service) :
+            m_Tuple(0), m_Key(nullptr), m_Relay(service), m_RelayIP(0), m_RelayPort(0),
+            m_Timer(PG::TimingWheel::sInvalidTimer), m_PermissionBits(0)
+        {
+        }
+
+        uint64_t                    m_Tuple;
+        Endpoint                    m_Client;
+        std::string                 m_Username;
+        const std::string          *m_Key;
+        std::vector<uint8_t>        m_AllocateResp;     /* answers a retransmitted Allocate, RFC8656 7.2 */
+        TransId                     m_AllocateId;
+        ICE::UDPChannel             m_Relay;
+        uint32_t                    m_RelayIP;
+        uint16_t                    m_RelayPort;
+        PG::TimingWheel::TimerId    m_Timer;
+        uint64_t                    m_PermissionBits;
+        std::vector<Permission>     m_Permissions;
+        std::vector<Binding>        m_Bindings;
+        Endpoint                    m_From;
+
+        // peer data is read behind room for the ChannelData header so it is relayed in place
+        uint8_t                     m_Buffer[sChannelDataHeaderLength + sizeof(PACKET::stun_packet)];
+    };
+
+    struct TurnServer::Shard {
+        Shard() :
+            m_Listener(m_Service), m_Ticker(m_Service), m_Relayed(0), m_AllocationCnt(0)
+        {
+        }
+
+        boost::asio::io_service                                 m_Service;
+        ICE::UDPChannel                                         m_Listener;
+        boost::asio::steady_timer                               m_Ticker;
+        PG::TimingWheel                                         m_Wheel;        /* 1 tick = 1 second */
+        PG::FlatHash<uint64_t, AllocationPtr, TupleHash>        m_Allocations;
+        std::thread                                             m_Thread;
+        Endpoint                                                m_From;
+        PACKET::stun_packet                                     m_Packet;
+        std::atomic<uint64_t>                                   m_Relayed;
+        std::atomic<uint64_t>                                   m_AllocationCnt;
+    };
+
+    TurnServer::TurnServer(const std::string & ip, uint16_t port, const std::string & relayIP, const std::string & realm, uint16_t shards /*= 1*/) :
+        m_IP(ip), m_Port(port), m_RelayIP(relayIP), m_Realm(realm), m_ShardCnt(shards ? shards : 1)
+    {
+        char nonce[17];
+        snprintf(nonce, sizeof(nonce), "%016llx", static_cast<unsigned long long>(PG::GenerateRandom64()));
+        m_Nonce = nonce;
+    }
+
+    TurnServer::~TurnServer()
+    {
+        Stop();
+    }
+
+    void TurnServer::AddUser(const std::string & username, const std::string & password)
+    {
+        assert(!IsRunning());
+
+        /*
+        RFC5389[15.4.  MESSAGE-INTEGRITY]
+        key = MD5(username ":" realm ":" SASLprep(password))
+        */
+        PG::MD5 md5;
+        md5.Update(username.data(), username.length());
+        md5.Update(":", 1);
+        md5.Update(m_Realm.data(), m_Realm.length());
+        md5.Update(":", 1);
+        md5.Update(password.data(), password.length());
+
+        PG::MD5::Digest key;
+        md5.Final(key);
+        m_Keys[username].assign(reinterpret_cast<const char*>(key), sizeof(key));
+    }
+
+    bool TurnServer::Start()
+    {
+        assert(!IsRunning());
+
+        boost::system::error_code error;
+        auto relay = boost::asio::ip::address::from_string(m_RelayIP, error);
+        if (error || !relay.is_v4() || relay.is_unspecified())
+        {
+            LOG_ERROR("TurnServer", "relay address [%s] MUST be a reachable IPv4 address", m_RelayIP.c_str());
+            return false;
+        }
+
+        auto shards = m_ShardCnt;
+#ifndef SO_REUSEPORT
+        if (shards > 1)
+            LOG_WARNING("TurnServer", "SO_REUSEPORT not available, runs 1 shard instead of %d", shards);
+        shards = 1;
+#endif
+        if (shards > 1 && !m_Port)
+        {
+            LOG_ERROR("TurnServer", "sharding needs a fixed port");
+            return false;
+        }
+
+        for (uint16_t i = 0; i < shards; ++i)
+        {
+            std::unique_ptr<Shard> shard(new Shard);
+            if (!shard->m_Listener.Bind(m_IP, m_Port, shards > 1))
+            {
+                LOG_ERROR("TurnServer", "bind [%s:%d] failed", m_IP.c_str(), m_Port);
+                m_Shards.clear();
+                return false;
+            }
+            shard->m_Listener.Socket().non_blocking(true, error);
+            m_Shards.push_back(std::move(shard));
+        }
+
+        for (auto& shard : m_Shards)
+        {
+            Receive(*shard);
+            Tick(*shard);
+
+            auto pShard = shard.get();
+            shard->m_Thread = std::thread([pShard] {
+                try
+                {
+                    pShard->m_Service.run();
+                }
+                catch (const std::exception& e)
+                {
+                    LOG_ERROR("TurnServer", "shard exception :%s", e.what());
+                }
+            });
+        }
+
+        LOG_INFO("TurnServer", "listening on [%s:%d] relay [%s] with %d shards", m_IP.c_str(), m_Port, m_RelayIP.c_str(), shards);
+        return true;
+    }
+
+    void TurnServer::Stop()
+    {
+        if (!IsRunning())
+            return;
+
+        for (auto& shard : m_Shards)
+        {
+            shard->m_Service.stop();
+            if (shard->m_Thread.joinable())
+                shard->m_Thread.join();
+        }
+
+        // close every socket and flush the aborted handlers so they drop their allocation references
+        for (auto& shard : m_Shards)
+        {
+            shard->m_Allocations.ForEach([](uint64_t, AllocationPtr& allocation) {
+                allocation->m_Relay.Close();
+            });
+            shard->m_Allocations.Clear();
+            shard->m_Listener.Close();
+            shard->m_Ticker.cancel();
+
+            shard->m_Service.reset();
+            shard->m_Service.poll();
+        }
+        m_Shards.clear();
+    }
+
+    uint64_t TurnServer::Relayed() const
+    {
+        uint64_t relayed = 0;
+        for (auto& shard : m_Shards)
+            relayed += shard->m_Relayed.load(std::memory_order_relaxed);
+        return relayed;
+    }
+
+    uint64_t TurnServer::Allocations() const
+    {
+        uint64_t allocations = 0;
+        for (auto& shard : m_Shards)
+            allocations += shard->m_AllocationCnt.load(std::memory_order_relaxed);
+        return allocations;
+    }
+
+    uint64_t TurnServer::FiveTuple(const Endpoint & client, uint16_t serverPort)
+    {
+        return (static_cast<uint64_t>(client.address().to_v4().to_ulong()) << 32) |
+            (static_cast<uint64_t>(client.port()) << 16) | serverPort;
+    }
+
+    void TurnServer::Receive(Shard & shard)
+    {
+        auto& socket = shard.m_Listener.Socket();
+        auto buffer  = boost::asio::buffer(&shard.m_Packet, sizeof(shard.m_Packet));
+
+        socket.async_receive_from(buffer, shard.m_From, [this, &shard, &socket, buffer](const boost::system::error_code& error, size_t bytes) {
+            if (error == boost::asio::error::operation_aborted)
+                return;
+
+            if (!error)
+                OnClientPacket(shard, reinterpret_cast<const uint8_t*>(&shard.m_Packet), static_cast<uint16_t>(bytes), shard.m_From);
+
+            // drain what is already queued, one reactor round trip per batch instead of per datagram
+            boost::system::error_code ec;
+            for (uint32_t i = 0; i < sDrainBatch; ++i)
+            {
+                auto size = socket.receive_from(buffer, shard.m_From, 0, ec);
+                if (ec == boost::asio::error::would_block)
+                    break;
+
+                if (!ec)
+                    OnClientPacket(shard, reinterpret_cast<const uint8_t*>(&shard.m_Packet), static_cast<uint16_t>(size), shard.m_From);
+            }
+            Receive(shard);
+        });
+    }
+
+    void TurnServer::ReceivePeer(Shard & shard, const AllocationPtr & allocation)
+    {
+        auto& socket = allocation->m_Relay.Socket();
+        auto buffer  = boost::asio::buffer(allocation->m_Buffer + sChannelDataHeaderLength, sizeof(allocation->m_Buffer) - sChannelDataHeaderLength);
+
+        socket.async_receive_from(buffer, allocation->m_From, [this, &shard, allocation, buffer](const boost::system::error_code& error, size_t bytes) {
+            if (error == boost::asio::error::operation_aborted || !allocation->m_Relay.Socket().is_open())
+                return;
+
+            if (!error)
+                OnPeerPacket(shard, *allocation, static_cast<uint16_t>(bytes), allocation->m_From);
+
+            boost::system::error_code ec;
+            for (uint32_t i = 0; i < sDrainBatch && allocation->m_Relay.Socket().is_open(); ++i)
+            {
+                auto size = allocation->m_Relay.Socket().receive_from(buffer, allocation->m_From, 0, ec);
+                if (ec == boost::asio::error::would_block)
+                    break;
+
+                if (!ec)
+                    OnPeerPacket(shard, *allocation, static_cast<uint16_t>(size), allocation->m_From);
+            }
+
+            if (allocation->m_Relay.Socket().is_open())
+                ReceivePeer(shard, allocation);
+        });
+    }
+
+    void TurnServer::Tick(Shard & shard)
+    {
+        shard.m_Ticker.expires_from_now(std::chrono::seconds(1));
+        shard.m_Ticker.async_wait([this, &shard](const boost::system::error_code& error) {
+            if (error)
+                return;
+
+            shard.m_Wheel.Advance();
+            Tick(shard);
+        });
+    }
+
+    void TurnServer::OnClientPacket(Shard & shard, const uint8_t * data, uint16_t size, const Endpoint & from)
+    {
+        if (!from.address().is_v4())
+            return;
+
+        /*
+        RFC8656[12.5.  Receiving a ChannelData Message]
+        the hot path: 5-tuple -> allocation -> channel -> peer, nothing is parsed
+        */
+        if (size >= sChannelDataHeaderLength && (data[0] & 0xC0) == 0x40)
+        {
+            auto channel = static_cast<uint16_t>((data[0] << 8) | data[1]);
+            auto length  = static_cast<uint16_t>((data[2] << 8) | data[3]);
+            if (length + sChannelDataHeaderLength > size)
+                return;
+
+            auto found = shard.m_Allocations.Find(FiveTuple(from, m_Port));
+            if (!found)
+                return;
+
+            auto& allocation = **found;
+            auto now = shard.m_Wheel.Now();
+            for (auto& binding : allocation.m_Bindings)
+            {
+                if (binding.m_Channel != channel)
+                    continue;
+
+                if (binding.m_Expire > now)
+                {
+                    boost::system::error_code error;
+                    allocation.m_Relay.Socket().send_to(boost::asio::buffer(data + sChannelDataHeaderLength, length), binding.m_Peer, 0, error);
+                    if (!error)
+                        shard.m_Relayed.fetch_add(1, std::memory_order_relaxed);
+                }
+                return;
+            }
+            return;
+        }
+
+        auto& packet = *reinterpret_cast<const PACKET::stun_packet*>(data);
+        if (!MessagePacket::IsValidStunPacket(packet, size))
+            return;
+
+        switch (packet.MsgId())
+        {
+        case MsgType::BindingRequest:
+            OnBindingRequest(shard, packet, from);
+            break;
+
+        case MsgType::AllocateRequest:
+        case MsgType::RefreshRequest:
+        case MsgType::CreatePermissionRequest:
+        case MsgType::ChannelBindRequest:
+            OnRequest(shard, packet, size, from);
+            break;
+
+        case MsgType::SendIndication:
+            OnSendIndication(shard, packet, size, from);
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    void TurnServer::OnPeerPacket(Shard & shard, Allocation & allocation, uint16_t size, const Endpoint & from)
+    {
+        if (!from.address().is_v4())
+            return;
+
+        // RFC8656 10.3 data from a peer without permission is silently discarded
+        auto address = static_cast<uint32_t>(from.address().to_v4().to_ulong());
+        if (!IsPermitted(shard, allocation, address))
+            return;
+
+        boost::system::error_code error;
+        auto now = shard.m_Wheel.Now();
+        for (auto& binding : allocation.m_Bindings)
+        {
+            if (binding.m_Peer != from || binding.m_Expire <= now)
+                continue;
+
+            /*
+            RFC8656[12.6.  Relaying Data from the Peer]
+            the header is written in front of the payload, no copy
+            */
+            allocation.m_Buffer[0] = static_cast<uint8_t>(binding.m_Channel >> 8);
+            allocation.m_Buffer[1] = static_cast<uint8_t>(binding.m_Channel);
+            allocation.m_Buffer[2] = static_cast<uint8_t>(size >> 8);
+            allocation.m_Buffer[3] = static_cast<uint8_t>(size);
+
+            shard.m_Listener.Socket().send_to(boost::asio::buffer(allocation.m_Buffer, size + sChannelDataHeaderLength), allocation.m_Client, 0, error);
+            if (!error)
+                shard.m_Relayed.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        /*
+        RFC8656[11.3.  Receiving a Data Indication]
+        no channel bound to the peer, falls back to a Data indication
+        */
+        TransId id;
+        MessagePacket::GenerateRFC5389TransationId(id);
+
+        ATTR::XorPeerAddress peer;
+        peer.Address(address);
+        peer.Port(from.port());
+
+        MessagePacket msg(MsgType::DataIndication, id);
+        msg.AddAttribute(peer);
+        msg.AddData(allocation.m_Buffer + sChannelDataHeaderLength, size);
+
+        shard.m_Listener.Socket().send_to(boost::asio::buffer(msg.GetData(), msg.GetLength()), allocation.m_Client, 0, error);
+        if (!error)
+            shard.m_Relayed.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void TurnServer::OnRequest(Shard & shard, const PACKET::stun_packet & packet, uint16_t size, const Endpoint & from)
+    {
+        MessagePacket msg(packet, size);
+        auto type = packet.MsgId();
+
+        std::string username;
+        const std::string *key = nullptr;
+        if (!Authenticate(shard, msg, from, username, key))
+            return;
+
+        if (type == MsgType::AllocateRequest)
+        {
+            OnAllocate(shard, msg, from, username, *key);
+            return;
+        }
+
+        // hold a reference, a Refresh may delete the allocation while it is handled
+        auto found = shard.m_Allocations.Find(FiveTuple(from, m_Port));
+        if (!found)
+        {
+            SendError(shard, type, msg.TransationId(), ErrorCode::AllocationMismatch, "Allocation Mismatch", from, key);
+            return;
+        }
+
+        auto allocation = *found;
+        if (allocation->m_Username != username)
+        {
+            SendError(shard, type, msg.TransationId(), ErrorCode::WrongCredentials, "Wrong Credentials", from, key);
+            return;
+        }
+
+        switch (type)
+        {
+        case MsgType::RefreshRequest:
+            OnRefresh(shard, *allocation, msg, from);
+            break;
+
+        case MsgType::CreatePermissionRequest:
+            OnCreatePermission(shard, *allocation, msg, from);
+            break;
+
+        case MsgType::ChannelBindRequest:
+            OnChannelBind(shard, *allocation, msg, from);
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    void TurnServer::OnSendIndication(Shard & shard, const PACKET::stun_packet & packet, uint16_t size, const Endpoint & from)
+    {
+        auto found = shard.m_Allocations.Find(FiveTuple(from, m_Port));
+        if (!found)
+            return;
+
+        /*
+        RFC8656[11.2.  Receiving a Send Indication]
+        indications are not authenticated, anything wrong is silently discarded
+        */
+        MessagePacket msg(packet, size);
+        const ATTR::XorPeerAddress *peer = nullptr;
+        const uint8_t *data = nullptr;
+        uint16_t length = 0;
+        if (!msg.GetAttribute(peer) || !msg.GetDataAttribute(data, length))
+            return;
+
+        auto& allocation = **found;
+        if (!IsPermitted(shard, allocation, peer->Address()))
+            return;
+
+        boost::system::error_code error;
+        Endpoint to(boost::asio::ip::address_v4(peer->Address()), peer->Port());
+        allocation.m_Relay.Socket().send_to(boost::asio::buffer(data, length), to, 0, error);
+        if (!error)
+            shard.m_Relayed.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void TurnServer::OnBindingRequest(Shard & shard, const PACKET::stun_packet & packet, const Endpoint & from)
+    {
+        // a TURN server is also a STUN server, RFC8656 2
+        ATTR::XorMappedAddress address;
+        address.Address(static_cast<uint32_t>(from.address().to_v4().to_ulong()));
+        address.Port(from.port());
+
+        RFC5389BindRespMsg resp(packet.TransId(), address);
+        resp.AddFingerprint();
+        shard.m_Listener.Write(resp.GetData(), resp.GetLength(), from);
+    }
+
+    bool TurnServer::Authenticate(Shard & shard, const MessagePacket & msg, const Endpoint & from, std::string & username, const std::string *& key)
+    {
+        auto type = reinterpret_cast<const PACKET::stun_packet*>(msg.GetData())->MsgId();
+
+        /*
+        RFC5389[10.2.2.  Receiving a Request]
+        no MESSAGE-INTEGRITY -> 401 with REALM and NONCE,
+        missing USERNAME/REALM/NONCE -> 400, stale NONCE -> 438, unknown user or bad HMAC -> 401
+        */
+        const ATTR::MessageIntegrity *integrity = nullptr;
+        if (!msg.GetAttribute(integrity))
+        {
+            SendError(shard, type, msg.TransationId(), ErrorCode::Unauthorized, "Unauthorized", from);
+            return false;
+        }
+
+        const ATTR::UserName *user = nullptr;
+        const ATTR::Realm *realm   = nullptr;
+        const ATTR::Nonce *nonce   = nullptr;
+        if (!msg.GetAttribute(user) || !msg.GetAttribute(realm) || !msg.GetAttribute(nonce) || !user->ContentLength())
+        {
+            SendError(shard, type, msg.TransationId(), ErrorCode::BadRequest, "Bad Request", from);
+            return false;
+        }
+
+        if (!nonce->ContentLength() || nonce->GetNonce() != m_Nonce)
+        {
+            SendError(shard, type, msg.TransationId(), ErrorCode::StaleNonce, "Stale Nonce", from);
+            return false;
+        }
+
+        username = user->Name();
+        auto itor = m_Keys.find(username);
+        if (itor == m_Keys.end() || !MessagePacket::VerifyMsgIntegrity(msg, itor->second))
+        {
+            SendError(shard, type, msg.TransationId(), ErrorCode::Unauthorized, "Unauthorized", from);
+            return false;
+        }
+
+        key = &itor->second;
+        return true;
+    }
+
+    void TurnServer::OnAllocate(Shard & shard, const MessagePacket & msg, const Endpoint & from, const std::string & username, const std::string & key)
+    {
+        auto tuple = FiveTuple(from, m_Port);
+        auto found = shard.m_Allocations.Find(tuple);
+        if (found)
+        {
+            // RFC8656 7.2 a retransmission gets the same answer, anything else 437
+            auto& allocation = **found;
+            if (!memcmp(allocation.m_AllocateId, msg.TransationId(), sizeof(allocation.m_AllocateId)))
+                shard.m_Listener.Write(allocation.m_AllocateResp.data(), static_cast<int16_t>(allocation.m_AllocateResp.size()), from);
+            else
+                SendError(shard, MsgType::AllocateRequest, msg.TransationId(), ErrorCode::AllocationMismatch, "Allocation Mismatch", from, &key);
+            return;
+        }
+
+        const ATTR::RequestedTransport *transport = nullptr;
+        if (!msg.GetAttribute(transport))
+        {
+            SendError(shard, MsgType::AllocateRequest, msg.TransationId(), ErrorCode::BadRequest, "Bad Request", from, &key);
+            return;
+        }
+
+        if (transport->Protocol() != sProtocolUDP)
+        {
+            SendError(shard, MsgType::AllocateRequest, msg.TransationId(), ErrorCode::UnsupportedTransport, "Unsupported Transport Protocol", from, &key);
+            return;
+        }
+
+        auto allocation = std::make_shared<Allocation>(shard.m_Service);
+        if (!allocation->m_Relay.Bind(m_RelayIP, 0))
+        {
+            SendError(shard, MsgType::AllocateRequest, msg.TransationId(), ErrorCode::InsufficientCapacity, "Insufficient Capacity", from, &key);
+            return;
+        }
+
+        boost::system::error_code error;
+        allocation->m_Relay.Socket().non_blocking(true, error);
+        allocation->m_Tuple     = tuple;
+        allocation->m_Client    = from;
+        allocation->m_Username  = username;
+        allocation->m_Key       = &key;
+        allocation->m_RelayIP   = static_cast<uint32_t>(boost::asio::ip::address::from_string(m_RelayIP).to_v4().to_ulong());
+        allocation->m_RelayPort = allocation->m_Relay.Port();
+        memcpy(allocation->m_AllocateId, msg.TransationId(), sizeof(allocation->m_AllocateId));
+
+        /*
+        RFC8656[7.2.  Receiving an Allocate Request]
+        a requested lifetime shorter than the default gets the default, longer ones are capped
+        */
+        const ATTR::Lifetime *requested = nullptr;
+        auto lifetime = msg.GetAttribute(requested) ? requested->Seconds() : sDefaultLifetime;
+        lifetime = std::min(std::max(lifetime, sDefaultLifetime), sMaxLifetime);
+
+        shard.m_Allocations.Insert(tuple, allocation);
+        shard.m_AllocationCnt.fetch_add(1, std::memory_order_relaxed);
+        Schedule(shard, *allocation, lifetime);
+        ReceivePeer(shard, allocation);
+
+        ATTR::XorRelayedAddress relayed;
+        relayed.Address(allocation->m_RelayIP);
+        relayed.Port(allocation->m_RelayPort);
+
+        ATTR::XorMappedAddress mapped;
+        mapped.Address(static_cast<uint32_t>(from.address().to_v4().to_ulong()));
+        mapped.Port(from.port());
+
+        MessagePacket resp(MsgType::AllocateResp, msg.TransationId());
+        resp.AddAttribute(relayed);
+        resp.AddAttribute(mapped);
+        resp.AddAttribute(ATTR::Lifetime(lifetime));
+        SendResponse(shard, resp, key, from);
+        allocation->m_AllocateResp.assign(resp.GetData(), resp.GetData() + resp.GetLength());
+
+        LOG_INFO("TurnServer", "allocated [%s:%d] for [%s:%d] user [%s], lifetime %d", m_RelayIP.c_str(), allocation->m_RelayPort,
+            from.address().to_string().c_str(), from.port(), username.c_str(), lifetime);
+    }
+
+    void TurnServer::OnRefresh(Shard & shard, Allocation & allocation, const MessagePacket & msg, const Endpoint & from)
+    {
+        /*
+        RFC8656[7.3.  Receiving a Refresh Request]
+        LIFETIME 0 deletes the allocation, otherwise it is extended like on Allocate
+        */
+        const ATTR::Lifetime *requested = nullptr;
+        auto lifetime = msg.GetAttribute(requested) ? requested->Seconds() : sDefaultLifetime;
+        if (lifetime)
+            lifetime = std::min(std::max(lifetime, sDefaultLifetime), sMaxLifetime);
+
+        auto key = allocation.m_Key;
+        if (lifetime)
+            Schedule(shard, allocation, lifetime);
+        else
+            Deallocate(shard, allocation.m_Tuple);
+
+        MessagePacket resp(MsgType::RefreshResp, msg.TransationId());
+        resp.AddAttribute(ATTR::Lifetime(lifetime));
+        SendResponse(shard, resp, *key, from);
+    }
+
+    void TurnServer::OnCreatePermission(Shard & shard, Allocation & allocation, const MessagePacket & msg, const Endpoint & from)
+    {
+        const ATTR::XorPeerAddress *peer = nullptr;
+        if (!msg.GetAttribute(peer))
+        {
+            SendError(shard, MsgType::CreatePermissionRequest, msg.TransationId(), ErrorCode::BadRequest, "Bad Request", from, allocation.m_Key);
+            return;
+        }
+
+        if (!InstallPermission(shard, allocation, peer->Address()))
+        {
+            SendError(shard, MsgType::CreatePermissionRequest, msg.TransationId(), ErrorCode::InsufficientCapacity, "Insufficient Capacity", from, allocation.m_Key);
+            return;
+        }
+
+        MessagePacket resp(MsgType::CreatePermissionResp, msg.TransationId());
+        SendResponse(shard, resp, *allocation.m_Key, from);
+    }
+
+    void TurnServer::OnChannelBind(Shard & shard, Allocation & allocation, const MessagePacket & msg, const Endpoint & from)
+    {
+        const ATTR::ChannelNumber *number = nullptr;
+        const ATTR::XorPeerAddress *peer  = nullptr;
+        if (!msg.GetAttribute(number) || !msg.GetAttribute(peer) || number->Channel() < sMinChannel || number->Channel() > sMaxChannel)
+        {
+            SendError(shard, MsgType::ChannelBindRequest, msg.TransationId(), ErrorCode::BadRequest, "Bad Request", from, allocation.m_Key);
+            return;
+        }
+
+        auto now     = shard.m_Wheel.Now();
+        auto channel = number->Channel();
+        Endpoint ep(boost::asio::ip::address_v4(peer->Address()), peer->Port());
+
+        allocation.m_Bindings.erase(std::remove_if(allocation.m_Bindings.begin(), allocation.m_Bindings.end(), [now](const Binding& binding) {
+            return binding.m_Expire <= now;
+        }), allocation.m_Bindings.end());
+
+        /*
+        RFC8656[12.2.  Receiving a ChannelBind Request]
+        a channel is bound to one peer and a peer to one channel, anything else is 400
+        */
+        Binding *bound = nullptr;
+        for (auto& binding : allocation.m_Bindings)
+        {
+            if ((binding.m_Channel == channel) != (binding.m_Peer == ep))
+            {
+                SendError(shard, MsgType::ChannelBindRequest, msg.TransationId(), ErrorCode::BadRequest, "Bad Request", from, allocation.m_Key);
+                return;
+            }
+
+            if (binding.m_Channel == channel)
+                bound = &binding;
+        }
+
+        if ((!bound && allocation.m_Bindings.size() >= sMaxChannels) || !InstallPermission(shard, allocation, peer->Address()))
+        {
+            SendError(shard, MsgType::ChannelBindRequest, msg.TransationId(), ErrorCode::InsufficientCapacity, "Insufficient Capacity", from, allocation.m_Key);
+            return;
+        }
+
+        if (bound)
+        {
+            bound->m_Expire = now + sChannelLifetime;
+        }
+        else
+        {
+            Binding binding = { channel, ep, now + sChannelLifetime };
+            allocation.m_Bindings.push_back(binding);
+        }
+
+        MessagePacket resp(MsgType::ChannelBindResp, msg.TransationId());
+        SendResponse(shard, resp, *allocation.m_Key, from);
+    }
+
+    bool TurnServer::InstallPermission(Shard & shard, Allocation & allocation, uint32_t address)
+    {
+        auto now = shard.m_Wheel.Now();
+
+        // expired permissions are only dropped here, the bitmap is rebuilt with them
+        allocation.m_PermissionBits = 0;
+        Permission *existed = nullptr;
+        for (auto itor = allocation.m_Permissions.begin(); itor != allocation.m_Permissions.end();)
+        {
+            if (itor->m_Expire <= now)
+            {
+                itor = allocation.m_Permissions.erase(itor);
+                continue;
+            }
+
+            if (itor->m_Address == address)
+                existed = &*itor;
+
+            allocation.m_PermissionBits |= PermissionBit(itor->m_Address);
+            ++itor;
+        }
+
+        if (existed)
+        {
+            existed->m_Expire = now + sPermissionLifetime;
+            return true;
+        }
+
+        if (allocation.m_Permissions.size() >= sMaxPermissions)
+            return false;
+
+        Permission permission = { address, now + sPermissionLifetime };
+        allocation.m_Permissions.push_back(permission);
+        allocation.m_PermissionBits |= PermissionBit(address);
+        return true;
+    }
+
+    bool TurnServer::IsPermitted(const Shard & shard, const Allocation & allocation, uint32_t address) const
+    {
+        if (!(allocation.m_PermissionBits & PermissionBit(address)))
+            return false;
+
+        auto now = shard.m_Wheel.Now();
+        for (auto& permission : allocation.m_Permissions)
+        {
+            if (permission.m_Address == address)
+                return permission.m_Expire > now;
+        }
+        return false;
+    }
+
+    void TurnServer::Schedule(Shard & shard, Allocation & allocation, uint32_t lifetime)
+    {
+        shard.m_Wheel.Cancel(allocation.m_Timer);
+
+        auto tuple = allocation.m_Tuple;
+        allocation.m_Timer = shard.m_Wheel.Schedule(lifetime, [this, &shard, tuple] {
+            LOG_INFO("TurnServer", "allocation [%llx] expired", tuple);
+            Deallocate(shard, tuple);
+        });
+    }
+
+    void TurnServer::Deallocate(Shard & shard, uint64_t tuple)
+    {
+        auto found = shard.m_Allocations.Find(tuple);
+        if (!found)
+            return;
+
+        // closing aborts the pending read, its handler releases the last reference
+        auto allocation = *found;
+        shard.m_Wheel.Cancel(allocation->m_Timer);
+        allocation->m_Relay.Close();
+        shard.m_Allocations.Erase(tuple);
+        shard.m_AllocationCnt.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    void TurnServer::SendError(Shard & shard, MsgType type, TransIdConstRef id, ErrorCode code, const char * reason, const Endpoint & to,
+        const std::string * key /*= nullptr*/)
+    {
+        auto value = static_cast<uint16_t>(code);
+
+        MessagePacket msg(ErrorType(type), id);
+        msg.AddErrorCode(value / 100, value % 100, reason);
+
+        // RFC5389 10.2.2 the challenge carries REALM and NONCE
+        if (code == ErrorCode::Unauthorized || code == ErrorCode::StaleNonce)
+        {
+            msg.AddRealm(m_Realm);
+            msg.AddNonce(m_Nonce);
+        }
+
+        if (key)
+            msg.AddMessageIntegrity(*key);
+        msg.AddFingerprint();
+
+        shard.m_Listener.Write(msg.GetData(), msg.GetLength(), to);
+    }
+
+    void TurnServer::SendResponse(Shard & shard, MessagePacket & msg, const std::string & key, const Endpoint & to)
+    {
+        msg.AddMessageIntegrity(key);
+        msg.AddFingerprint();
+        shard.m_Listener.Write(msg.GetData(), msg.GetLength(), to);
+    }
+}
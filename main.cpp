@@ -4,6 +4,7 @@
 #include "session.h"
 #include "pg_log.h"
 #include "sdp.h"
+#include "stunserver.h"
 #include <boost/asio.hpp>
 #include <thread>
 
@@ -25,30 +26,45 @@ static std::mutex sMutex;
 static std::condition_variable sCond;
 static bool bRecved = false;
 
-int main() 
+int main(int argc, char* argv[])
 {
     ICE::CAgentConfig config;
     ICE::CAgent agent;
 
-    config.AddStunServer("64.235.150.11",3478);
-    config.AddStunServer("216.93.246.18", 3478);
+    // "--local-stun" gathers against an embedded server instead of the public ones
+    std::unique_ptr<STUN::Server> stun_server;
+    if (argc > 1 && !strcmp(argv[1], "--local-stun"))
+    {
+        stun_server.reset(new STUN::Server(config.DefaultIP(), 3478));
+        if (!stun_server->Start())
+            return 1;
+        config.AddStunServer(config.DefaultIP(), 3478);
+    }
+    else
+    {
+        config.AddStunServer("64.235.150.11",3478);
+        config.AddStunServer("216.93.246.18", 3478);
+    }
+    agent.AgentConfig(config);
 
     Endpoint ep(config.DefaultIP());
     ICE::Session session(config.DefaultIP());
+    // no host ip, the streams gather host candidates on every local address
     ICE::MediaAttr videoMedia = {
         "video",
         {
-            ICE::MediaAttr::StreamAttr{ ICE::Protocol::udp, 1, 10000, config.DefaultIP() },
-            ICE::MediaAttr::StreamAttr{ ICE::Protocol::udp, 2, 10001, config.DefaultIP() },
-        }
+            ICE::MediaAttr::StreamAttr{ ICE::Protocol::udp, 1, 10000, std::string() },
+        },
+        std::string(),
+        true
     };
 
+    // audio is bundled on the transport of video, it gathers nothing
     ICE::MediaAttr audioMedia = {
         "audio",
-        {
-            ICE::MediaAttr::StreamAttr{ ICE::Protocol::udp, 1, 10010, config.DefaultIP() },
-            ICE::MediaAttr::StreamAttr{ ICE::Protocol::udp, 2, 10011, config.DefaultIP() },
-        }
+        {},
+        "video",
+        true
     };
     std::string offer;
     if (session.CreateMedia(videoMedia, config) && (session.CreateMedia(audioMedia, config)))
@@ -74,6 +90,15 @@ int main()
             LOG_ERROR("Decode", "Error");
         }
 
+        // the agent refreshed its local addresses, ICE restarts on them and the new offer has to be signalled again
+        agent.WatchInterfaces([&agent, &session](const ICE::InterfaceMonitor::AddressList&) {
+            std::string restart_offer;
+            if (session.Restart(agent.AgentConfig()) && session.MakeOffer(restart_offer))
+                LOG_INFO("Main", "interfaces changed, ICE restarted\n%s", restart_offer.c_str());
+            else
+                LOG_ERROR("Main", "interfaces changed, ICE restart failed");
+        });
+
         try
         {
             boost::asio::ip::udp::endpoint remoteEp(ep.m_signal_socket.local_endpoint().address(), 32000);
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <vector>
+#include <memory>
+#include <type_traits>
+
+namespace PG {
+    /*
+     bump allocator for objects sharing one lifetime, memory is carved from blocks of
+     sBlockSize and only given back when the arena is destroyed. no destructor is ever run,
+     only trivially destructible objects may live in it
+     */
+    class Arena {
+    public:
+        static const size_t sBlockSize = 4096;
+
+    public:
+        Arena() :
+            m_Used(0), m_Capacity(0)
+        {
+        }
+
+        void* Allocate(size_t size, size_t align)
+        {
+            auto offset = (m_Used + align - 1) & ~(align - 1);
+            if (m_Blocks.empty() || offset + size > m_Capacity)
+            {
+                // new[] is aligned for any fundamental type, a large request gets a block of its own
+                auto capacity = size > sBlockSize ? size : sBlockSize;
+                m_Blocks.push_back(std::unique_ptr<uint8_t[]>(new uint8_t[capacity]));
+                m_Capacity = capacity;
+                offset = 0;
+            }
+
+            m_Used = offset + size;
+            return m_Blocks.back().get() + offset;
+        }
+
+        /* uninitialized, the caller fills the elements */
+        template<class T>
+        T* AllocateArray(size_t count)
+        {
+            static_assert(std::is_trivially_destructible<T>::value, "the arena never runs destructors");
+            return count ? static_cast<T*>(Allocate(sizeof(T) * count, alignof(T))) : nullptr;
+        }
+
+        /* NUL terminated copy */
+        const char* CopyString(const char* str, size_t length)
+        {
+            auto copy = static_cast<char*>(Allocate(length + 1, 1));
+            memcpy(copy, str, length);
+            copy[length] = 0;
+            return copy;
+        }
+
+    private:
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+
+    private:
+        std::vector<std::unique_ptr<uint8_t[]>> m_Blocks;
+        size_t  m_Used;         /* bytes used in the last block */
+        size_t  m_Capacity;     /* size of the last block */
+    };
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace PG {
+    /*
+     RFC3174 US Secure Hash Algorithm 1 (SHA1)
+     no allocation, the context lives on the caller's stack
+     */
+    class SHA1 {
+    public:
+        static const uint32_t sDigestSize = 20;
+        static const uint32_t sBlockSize  = 64;
+
+        using Digest = uint8_t[sDigestSize];
+
+    public:
+        SHA1() { Reset(); }
+
+        void Reset();
+        void Update(const void* data, size_t size);
+        void Final(Digest& digest);
+
+    private:
+        void Transform(const uint8_t* block);
+
+    private:
+        uint32_t m_State[5];
+        uint64_t m_Length;   /* in bytes */
+        uint8_t  m_Buffer[sBlockSize];
+        uint32_t m_BufferSize;
+    };
+
+    /*
+     RFC1321 MD5, only used to derive the RFC5389 long-term credential key
+     */
+    class MD5 {
+    public:
+        static const uint32_t sDigestSize = 16;
+        static const uint32_t sBlockSize  = 64;
+
+        using Digest = uint8_t[sDigestSize];
+
+    public:
+        MD5() { Reset(); }
+
+        void Reset();
+        void Update(const void* data, size_t size);
+        void Final(Digest& digest);
+
+    private:
+        void Transform(const uint8_t* block);
+
+    private:
+        uint32_t m_State[4];
+        uint64_t m_Length;   /* in bytes */
+        uint8_t  m_Buffer[sBlockSize];
+        uint32_t m_BufferSize;
+    };
+
+    /*
+     RFC2104 HMAC, the message is given as two parts so a caller can patch a header
+     without copying the message
+     */
+    void HmacSHA1(const void* key, size_t keySize, const void* head, size_t headSize, const void* data, size_t dataSize, SHA1::Digest& digest);
+
+    inline void HmacSHA1(const void* key, size_t keySize, const void* data, size_t dataSize, SHA1::Digest& digest)
+    {
+        HmacSHA1(key, keySize, data, dataSize, nullptr, 0, digest);
+    }
+
+    /* ISO/IEC 13239 CRC-32 as used by RFC5389 FINGERPRINT */
+    uint32_t CRC32(const void* data, size_t size, uint32_t crc = 0);
+}
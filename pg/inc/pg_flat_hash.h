@@ -0,0 +1,153 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <utility>
+#include <functional>
+#include <assert.h>
+
+namespace PG {
+    /*
+     open addressing hash table with linear probing and backward shift deletion,
+     keys and values live in one contiguous array so a lookup touches one or two cache lines
+     and nothing is allocated per element; Key and Value MUST be cheap to move
+     */
+    template<class Key, class Value, class Hash = std::hash<Key>, class Equal = std::equal_to<Key>>
+    class FlatHash {
+    public:
+        FlatHash(size_t capacity = 16) :
+            m_Size(0)
+        {
+            size_t slots = 16;
+            while (slots < capacity * 2)
+                slots <<= 1;
+            m_Slots.resize(slots);
+        }
+
+        size_t Size() const { return m_Size; }
+        bool Empty() const { return m_Size == 0; }
+
+        Value* Find(const Key& key)
+        {
+            auto index = Lookup(key);
+            return index == sNotFound ? nullptr : &m_Slots[index].m_Value;
+        }
+
+        const Value* Find(const Key& key) const
+        {
+            return const_cast<FlatHash*>(this)->Find(key);
+        }
+
+        /* returns the existing value if key is already there */
+        std::pair<Value*, bool> Insert(const Key& key, const Value& value)
+        {
+            // keep the load factor under 1/2 so probe sequences stay short
+            if ((m_Size + 1) * 2 > m_Slots.size())
+                Grow();
+
+            auto mask = m_Slots.size() - 1;
+            for (auto index = m_Hash(key) & mask;; index = (index + 1) & mask)
+            {
+                auto& slot = m_Slots[index];
+                if (!slot.m_bUsed)
+                {
+                    slot.m_Key   = key;
+                    slot.m_Value = value;
+                    slot.m_bUsed = true;
+                    ++m_Size;
+                    return std::make_pair(&slot.m_Value, true);
+                }
+
+                if (m_Equal(slot.m_Key, key))
+                    return std::make_pair(&slot.m_Value, false);
+            }
+        }
+
+        bool Erase(const Key& key)
+        {
+            auto index = Lookup(key);
+            if (index == sNotFound)
+                return false;
+
+            /*
+             backward shift: pull every following element of the cluster back
+             unless it already sits at or after its home slot, so no tombstone is left
+             */
+            auto mask = m_Slots.size() - 1;
+            for (auto next = (index + 1) & mask; m_Slots[next].m_bUsed; next = (next + 1) & mask)
+            {
+                auto home = m_Hash(m_Slots[next].m_Key) & mask;
+                if (((next - home) & mask) >= ((next - index) & mask))
+                {
+                    m_Slots[index] = std::move(m_Slots[next]);
+                    index = next;
+                }
+            }
+
+            m_Slots[index] = Slot();
+            --m_Size;
+            return true;
+        }
+
+        void Clear()
+        {
+            for (auto& slot : m_Slots)
+                slot = Slot();
+            m_Size = 0;
+        }
+
+        template<class Visitor>
+        void ForEach(Visitor visitor)
+        {
+            for (auto& slot : m_Slots)
+            {
+                if (slot.m_bUsed)
+                    visitor(slot.m_Key, slot.m_Value);
+            }
+        }
+
+    private:
+        struct Slot {
+            Slot() : m_bUsed(false) {}
+
+            Key     m_Key;
+            Value   m_Value;
+            bool    m_bUsed;
+        };
+
+        static const size_t sNotFound = static_cast<size_t>(-1);
+
+        size_t Lookup(const Key& key) const
+        {
+            auto mask = m_Slots.size() - 1;
+            for (auto index = m_Hash(key) & mask;; index = (index + 1) & mask)
+            {
+                auto& slot = m_Slots[index];
+                if (!slot.m_bUsed)
+                    return sNotFound;
+
+                if (m_Equal(slot.m_Key, key))
+                    return index;
+            }
+        }
+
+        void Grow()
+        {
+            std::vector<Slot> slots(m_Slots.size() * 2);
+            slots.swap(m_Slots);
+            m_Size = 0;
+
+            for (auto& slot : slots)
+            {
+                if (slot.m_bUsed)
+                    Insert(slot.m_Key, slot.m_Value);
+            }
+        }
+
+    private:
+        std::vector<Slot>   m_Slots;
+        size_t              m_Size;
+        Hash                m_Hash;
+        Equal               m_Equal;
+    };
+}
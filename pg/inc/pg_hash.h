@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace PG {
+    /*
+     32 bit FNV-1a, for the in-memory tables only, the values are not meant to be stored.
+     a key spread over several buffers is hashed by passing the previous result as the basis
+     */
+    static const uint32_t sFNV1aBasis = 2166136261U;
+
+    inline uint32_t FNV1a(const void* data, size_t size, uint32_t hash = sFNV1aBasis)
+    {
+        auto bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; ++i)
+            hash = (hash ^ bytes[i]) * 16777619U;
+        return hash;
+    }
+}
@@ -1,16 +1,43 @@
 #pragma once
 
 #include <boost/asio.hpp>
+#include <functional>
+#include <memory>
 
 namespace PG {
+    /*
+     all timers share one io_service which is driven by a single service thread,
+     so scheduling N timers costs no extra thread.
+     */
     class timer {
     public:
-        timer() {}
-        virtual ~timer() {}
+        using TimeoutHandler = std::function<void()>;
 
     public:
+        timer();
+        virtual ~timer();
+
+    public:
+        bool Start(uint32_t intervalMS, const TimeoutHandler& handler, bool bRepeat = true);
+        void Stop();
+        bool IsRunning() const;
+
+    private:
+        timer(const timer&) = delete;
+        timer& operator=(const timer&) = delete;
+
+    private:
+        struct Context;
+        using ContextPtr = std::shared_ptr<Context>;
+
+        static void Schedule(const ContextPtr& context, uint64_t generation);
+        static void OnTimeout(const ContextPtr& context, uint64_t generation, const boost::system::error_code& error);
+        static void StartService();
+
+    private:
+        ContextPtr m_Context;
 
     protected:
         static boost::asio::io_service sIOService;
     };
-};
\ No newline at end of file
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <functional>
+
+namespace PG {
+    /*
+     hierarchical timing wheel (Varghese & Lauck), 4 levels of 64 slots,
+     schedule and cancel are O(1), each tick only visits one slot,
+     timers further than 2^24 ticks are clamped to the last level.
+     it is NOT thread safe and has no clock of its own: the owner calls
+     Advance() from one thread, typically from a PG::timer or an io_service timer
+     */
+    class TimingWheel {
+    public:
+        using TimerId = uint64_t;
+        using Handler = std::function<void()>;
+
+        static const TimerId sInvalidTimer = 0;
+
+    public:
+        TimingWheel();
+        virtual ~TimingWheel();
+
+    public:
+        /* handler runs from Advance() once delayTicks ticks have elapsed, a delay of 0 fires on the next tick */
+        TimerId Schedule(uint64_t delayTicks, const Handler& handler);
+        bool Cancel(TimerId id);
+
+        /* moves the wheel forward, firing every expired timer */
+        void Advance(uint64_t ticks = 1);
+
+        uint64_t Now() const { return m_Now; }
+        size_t Size() const { return m_Size; }
+
+    private:
+        TimingWheel(const TimingWheel&) = delete;
+        TimingWheel& operator=(const TimingWheel&) = delete;
+
+    private:
+        static const uint32_t sLevels    = 4;
+        static const uint32_t sSlotBits  = 6;
+        static const uint32_t sSlots     = 1 << sSlotBits;
+        static const uint32_t sSlotMask  = sSlots - 1;
+        static const uint32_t sNil       = static_cast<uint32_t>(-1);
+
+        /* nodes are pooled and linked by index, a slot is the head of a doubly linked list */
+        struct Node {
+            uint64_t    m_Expire;
+            uint32_t    m_Prev;
+            uint32_t    m_Next;
+            uint32_t    m_Generation;
+            uint32_t    m_Slot;         /* level * sSlots + slot, sNil when free */
+            Handler     m_Handler;
+        };
+
+        void Link(uint32_t index);
+        void Unlink(uint32_t index);
+        void Release(uint32_t index);
+        void Cascade(uint32_t level);
+
+    private:
+        std::vector<Node>       m_Nodes;
+        std::vector<uint32_t>   m_Free;
+        uint32_t                m_Heads[sLevels * sSlots];
+        uint64_t                m_Now;
+        size_t                  m_Size;
+    };
+}
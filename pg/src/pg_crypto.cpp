@@ -0,0 +1,320 @@
+#include "pg_crypto.h"
+
+#include <string.h>
+
+namespace {
+    inline uint32_t RotateLeft(uint32_t value, uint32_t bits)
+    {
+        return (value << bits) | (value >> (32 - bits));
+    }
+
+    struct CRC32Table {
+        CRC32Table()
+        {
+            for (uint32_t i = 0; i < 256; ++i)
+            {
+                uint32_t crc = i;
+                for (int bit = 0; bit < 8; ++bit)
+                    crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : (crc >> 1);
+                m_Table[i] = crc;
+            }
+        }
+
+        uint32_t m_Table[256];
+    };
+
+    const CRC32Table sCRC32Table;
+}
+
+namespace PG {
+    void SHA1::Reset()
+    {
+        m_State[0] = 0x67452301;
+        m_State[1] = 0xEFCDAB89;
+        m_State[2] = 0x98BADCFE;
+        m_State[3] = 0x10325476;
+        m_State[4] = 0xC3D2E1F0;
+        m_Length = 0;
+        m_BufferSize = 0;
+    }
+
+    void SHA1::Update(const void * data, size_t size)
+    {
+        auto bytes = static_cast<const uint8_t*>(data);
+        m_Length += size;
+
+        if (m_BufferSize)
+        {
+            auto fill = sBlockSize - m_BufferSize;
+            if (size < fill)
+            {
+                memcpy(&m_Buffer[m_BufferSize], bytes, size);
+                m_BufferSize += static_cast<uint32_t>(size);
+                return;
+            }
+
+            memcpy(&m_Buffer[m_BufferSize], bytes, fill);
+            Transform(m_Buffer);
+            bytes += fill;
+            size -= fill;
+            m_BufferSize = 0;
+        }
+
+        for (; size >= sBlockSize; bytes += sBlockSize, size -= sBlockSize)
+            Transform(bytes);
+
+        if (size)
+        {
+            memcpy(m_Buffer, bytes, size);
+            m_BufferSize = static_cast<uint32_t>(size);
+        }
+    }
+
+    void SHA1::Final(Digest & digest)
+    {
+        auto bits = m_Length * 8;
+
+        // 0x80, zeros up to 56 mod 64, then the message length in bits as big endian
+        static const uint8_t padding[sBlockSize] = { 0x80 };
+        auto pad_size = (m_BufferSize < 56) ? (56 - m_BufferSize) : (sBlockSize + 56 - m_BufferSize);
+        Update(padding, pad_size);
+
+        uint8_t length[8];
+        for (int i = 0; i < 8; ++i)
+            length[i] = static_cast<uint8_t>(bits >> (56 - i * 8));
+        Update(length, sizeof(length));
+
+        for (int i = 0; i < 5; ++i)
+        {
+            digest[i * 4 + 0] = static_cast<uint8_t>(m_State[i] >> 24);
+            digest[i * 4 + 1] = static_cast<uint8_t>(m_State[i] >> 16);
+            digest[i * 4 + 2] = static_cast<uint8_t>(m_State[i] >> 8);
+            digest[i * 4 + 3] = static_cast<uint8_t>(m_State[i]);
+        }
+        Reset();
+    }
+
+    void SHA1::Transform(const uint8_t * block)
+    {
+        uint32_t w[80];
+        for (int i = 0; i < 16; ++i)
+            w[i] = (uint32_t(block[i * 4]) << 24) | (uint32_t(block[i * 4 + 1]) << 16) | (uint32_t(block[i * 4 + 2]) << 8) | uint32_t(block[i * 4 + 3]);
+
+        for (int i = 16; i < 80; ++i)
+            w[i] = RotateLeft(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+        auto a = m_State[0], b = m_State[1], c = m_State[2], d = m_State[3], e = m_State[4];
+        for (int i = 0; i < 80; ++i)
+        {
+            uint32_t f, k;
+            if (i < 20)
+            {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999;
+            }
+            else if (i < 40)
+            {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            }
+            else if (i < 60)
+            {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            }
+            else
+            {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+
+            auto temp = RotateLeft(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = RotateLeft(b, 30);
+            b = a;
+            a = temp;
+        }
+
+        m_State[0] += a;
+        m_State[1] += b;
+        m_State[2] += c;
+        m_State[3] += d;
+        m_State[4] += e;
+    }
+
+    void MD5::Reset()
+    {
+        m_State[0] = 0x67452301;
+        m_State[1] = 0xEFCDAB89;
+        m_State[2] = 0x98BADCFE;
+        m_State[3] = 0x10325476;
+        m_Length = 0;
+        m_BufferSize = 0;
+    }
+
+    void MD5::Update(const void * data, size_t size)
+    {
+        auto bytes = static_cast<const uint8_t*>(data);
+        m_Length += size;
+
+        if (m_BufferSize)
+        {
+            auto fill = sBlockSize - m_BufferSize;
+            if (size < fill)
+            {
+                memcpy(&m_Buffer[m_BufferSize], bytes, size);
+                m_BufferSize += static_cast<uint32_t>(size);
+                return;
+            }
+
+            memcpy(&m_Buffer[m_BufferSize], bytes, fill);
+            Transform(m_Buffer);
+            bytes += fill;
+            size -= fill;
+            m_BufferSize = 0;
+        }
+
+        for (; size >= sBlockSize; bytes += sBlockSize, size -= sBlockSize)
+            Transform(bytes);
+
+        if (size)
+        {
+            memcpy(m_Buffer, bytes, size);
+            m_BufferSize = static_cast<uint32_t>(size);
+        }
+    }
+
+    void MD5::Final(Digest & digest)
+    {
+        auto bits = m_Length * 8;
+
+        // same padding as SHA1 but the length is little endian
+        static const uint8_t padding[sBlockSize] = { 0x80 };
+        auto pad_size = (m_BufferSize < 56) ? (56 - m_BufferSize) : (sBlockSize + 56 - m_BufferSize);
+        Update(padding, pad_size);
+
+        uint8_t length[8];
+        for (int i = 0; i < 8; ++i)
+            length[i] = static_cast<uint8_t>(bits >> (i * 8));
+        Update(length, sizeof(length));
+
+        for (int i = 0; i < 4; ++i)
+        {
+            digest[i * 4 + 0] = static_cast<uint8_t>(m_State[i]);
+            digest[i * 4 + 1] = static_cast<uint8_t>(m_State[i] >> 8);
+            digest[i * 4 + 2] = static_cast<uint8_t>(m_State[i] >> 16);
+            digest[i * 4 + 3] = static_cast<uint8_t>(m_State[i] >> 24);
+        }
+        Reset();
+    }
+
+    void MD5::Transform(const uint8_t * block)
+    {
+        static const uint32_t k[64] = {
+            0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+            0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+            0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+            0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+            0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+            0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+            0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+            0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391,
+        };
+
+        static const uint32_t r[64] = {
+            7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+            5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20,
+            4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+            6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21,
+        };
+
+        uint32_t w[16];
+        for (int i = 0; i < 16; ++i)
+            w[i] = uint32_t(block[i * 4]) | (uint32_t(block[i * 4 + 1]) << 8) | (uint32_t(block[i * 4 + 2]) << 16) | (uint32_t(block[i * 4 + 3]) << 24);
+
+        auto a = m_State[0], b = m_State[1], c = m_State[2], d = m_State[3];
+        for (int i = 0; i < 64; ++i)
+        {
+            uint32_t f, g;
+            if (i < 16)
+            {
+                f = (b & c) | (~b & d);
+                g = i;
+            }
+            else if (i < 32)
+            {
+                f = (d & b) | (~d & c);
+                g = (5 * i + 1) % 16;
+            }
+            else if (i < 48)
+            {
+                f = b ^ c ^ d;
+                g = (3 * i + 5) % 16;
+            }
+            else
+            {
+                f = c ^ (b | ~d);
+                g = (7 * i) % 16;
+            }
+
+            auto temp = d;
+            d = c;
+            c = b;
+            b = b + RotateLeft(a + f + k[i] + w[g], r[i]);
+            a = temp;
+        }
+
+        m_State[0] += a;
+        m_State[1] += b;
+        m_State[2] += c;
+        m_State[3] += d;
+    }
+
+    void HmacSHA1(const void * key, size_t keySize, const void * head, size_t headSize, const void * data, size_t dataSize, SHA1::Digest & digest)
+    {
+        uint8_t key_block[SHA1::sBlockSize] = { 0 };
+        SHA1 sha1;
+
+        // keys longer than the block size are hashed first
+        if (keySize > SHA1::sBlockSize)
+        {
+            SHA1::Digest key_digest;
+            sha1.Update(key, keySize);
+            sha1.Final(key_digest);
+            memcpy(key_block, key_digest, sizeof(key_digest));
+        }
+        else if (keySize)
+        {
+            memcpy(key_block, key, keySize);
+        }
+
+        uint8_t pad[SHA1::sBlockSize];
+        for (uint32_t i = 0; i < SHA1::sBlockSize; ++i)
+            pad[i] = key_block[i] ^ 0x36;
+
+        SHA1::Digest inner;
+        sha1.Update(pad, sizeof(pad));
+        if (headSize)
+            sha1.Update(head, headSize);
+        if (dataSize)
+            sha1.Update(data, dataSize);
+        sha1.Final(inner);
+
+        for (uint32_t i = 0; i < SHA1::sBlockSize; ++i)
+            pad[i] = key_block[i] ^ 0x5C;
+
+        sha1.Update(pad, sizeof(pad));
+        sha1.Update(inner, sizeof(inner));
+        sha1.Final(digest);
+    }
+
+    uint32_t CRC32(const void * data, size_t size, uint32_t crc /*= 0*/)
+    {
+        auto bytes = static_cast<const uint8_t*>(data);
+        crc = ~crc;
+        for (size_t i = 0; i < size; ++i)
+            crc = sCRC32Table.m_Table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+        return ~crc;
+    }
+}
@@ -1,5 +1,155 @@
 #include "pg_timer.h"
+#include "pg_log.h"
+
+#include <thread>
+#include <mutex>
+#include <assert.h>
+
+namespace {
+    class TimerService {
+    public:
+        TimerService(boost::asio::io_service& service) :
+            m_Service(service), m_Work(new boost::asio::io_service::work(service))
+        {
+            m_Thread = std::thread([this] {
+                for (;;)
+                {
+                    try
+                    {
+                        m_Service.run();
+                        break;
+                    }
+                    catch (const std::exception& e)
+                    {
+                        LOG_ERROR("Timer", "timer handler exception :%s", e.what());
+                    }
+                }
+            });
+        }
+
+        ~TimerService()
+        {
+            m_Work.reset();
+            m_Service.stop();
+            if (m_Thread.joinable())
+                m_Thread.join();
+        }
+
+    private:
+        boost::asio::io_service&                        m_Service;
+        std::unique_ptr<boost::asio::io_service::work>  m_Work;
+        std::thread                                     m_Thread;
+    };
+}
 
 namespace PG {
     boost::asio::io_service timer::sIOService;
-}
\ No newline at end of file
+
+    /*
+     the context is shared with the pending async_wait handler,
+     so a timer can be destroyed while its handler is still queued in the io_service
+     */
+    struct timer::Context {
+        Context(boost::asio::io_service& service) :
+            m_Timer(service), m_Interval(0), m_Generation(0), m_bRepeat(false), m_bRunning(false)
+        {
+        }
+
+        boost::asio::steady_timer m_Timer;
+        std::recursive_mutex      m_Mutex;
+        TimeoutHandler            m_Handler;
+        uint32_t                  m_Interval;
+        uint64_t                  m_Generation;
+        bool                      m_bRepeat;
+        bool                      m_bRunning;
+    };
+
+    timer::timer() :
+        m_Context(std::make_shared<Context>(sIOService))
+    {
+        StartService();
+    }
+
+    timer::~timer()
+    {
+        Stop();
+    }
+
+    bool timer::Start(uint32_t intervalMS, const TimeoutHandler& handler, bool bRepeat /*= true*/)
+    {
+        assert(intervalMS && handler);
+
+        std::lock_guard<decltype(m_Context->m_Mutex)> locker(m_Context->m_Mutex);
+        if (m_Context->m_bRunning)
+        {
+            LOG_WARNING("Timer", "timer already started");
+            return false;
+        }
+
+        m_Context->m_Handler  = handler;
+        m_Context->m_Interval = intervalMS;
+        m_Context->m_bRepeat  = bRepeat;
+        m_Context->m_bRunning = true;
+        m_Context->m_Timer.expires_from_now(std::chrono::milliseconds(intervalMS));
+        Schedule(m_Context, m_Context->m_Generation);
+        return true;
+    }
+
+    void timer::Stop()
+    {
+        /*
+         m_Mutex is held while the handler runs, so once Stop() returns the handler
+         is guaranteed not to be executing (unless Stop() is called from the handler itself)
+         */
+        std::lock_guard<decltype(m_Context->m_Mutex)> locker(m_Context->m_Mutex);
+        if (!m_Context->m_bRunning)
+            return;
+
+        m_Context->m_bRunning = false;
+        ++m_Context->m_Generation;
+
+        boost::system::error_code error;
+        m_Context->m_Timer.cancel(error);
+    }
+
+    bool timer::IsRunning() const
+    {
+        std::lock_guard<decltype(m_Context->m_Mutex)> locker(m_Context->m_Mutex);
+        return m_Context->m_bRunning;
+    }
+
+    void timer::Schedule(const ContextPtr& context, uint64_t generation)
+    {
+        context->m_Timer.async_wait([context, generation](const boost::system::error_code& error) {
+            OnTimeout(context, generation, error);
+        });
+    }
+
+    void timer::OnTimeout(const ContextPtr& context, uint64_t generation, const boost::system::error_code& error)
+    {
+        std::lock_guard<decltype(context->m_Mutex)> locker(context->m_Mutex);
+        if (error == boost::asio::error::operation_aborted || !context->m_bRunning || generation != context->m_Generation)
+            return;
+
+        context->m_Handler();
+
+        // handler may stop the timer
+        if (!context->m_bRunning || generation != context->m_Generation)
+            return;
+
+        if (!context->m_bRepeat)
+        {
+            context->m_bRunning = false;
+            return;
+        }
+
+        // keep a fixed rate, do not accumulate the handler's execution time
+        context->m_Timer.expires_at(context->m_Timer.expires_at() + std::chrono::milliseconds(context->m_Interval));
+        Schedule(context, generation);
+    }
+
+    void timer::StartService()
+    {
+        static TimerService sService(sIOService);
+    }
+}
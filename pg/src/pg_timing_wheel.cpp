@@ -0,0 +1,154 @@
+#include "pg_timing_wheel.h"
+
+#include <assert.h>
+#include <utility>
+
+namespace PG {
+    TimingWheel::TimingWheel() :
+        m_Now(0), m_Size(0)
+    {
+        for (auto& head : m_Heads)
+            head = sNil;
+    }
+
+    TimingWheel::~TimingWheel()
+    {
+    }
+
+    TimingWheel::TimerId TimingWheel::Schedule(uint64_t delayTicks, const Handler & handler)
+    {
+        assert(handler);
+
+        uint32_t index;
+        if (m_Free.empty())
+        {
+            index = static_cast<uint32_t>(m_Nodes.size());
+            m_Nodes.push_back(Node());
+            m_Nodes[index].m_Generation = 0;
+        }
+        else
+        {
+            index = m_Free.back();
+            m_Free.pop_back();
+        }
+
+        auto& node = m_Nodes[index];
+        node.m_Expire  = m_Now + (delayTicks ? delayTicks : 1);
+        node.m_Handler = handler;
+        Link(index);
+        ++m_Size;
+
+        return (static_cast<uint64_t>(node.m_Generation) << 32) | (index + 1);
+    }
+
+    bool TimingWheel::Cancel(TimerId id)
+    {
+        auto index = static_cast<uint32_t>(id & 0xFFFFFFFF);
+        if (!index || index > m_Nodes.size())
+            return false;
+
+        --index;
+        auto& node = m_Nodes[index];
+        if (node.m_Slot == sNil || node.m_Generation != static_cast<uint32_t>(id >> 32))
+            return false;
+
+        Unlink(index);
+        Release(index);
+        return true;
+    }
+
+    void TimingWheel::Advance(uint64_t ticks /*= 1*/)
+    {
+        while (ticks--)
+        {
+            if (!m_Size)
+            {
+                m_Now += ticks + 1;
+                return;
+            }
+
+            ++m_Now;
+
+            // a level is cascaded into the lower ones each time all the levels below it wrap
+            for (uint32_t level = 1; level < sLevels; ++level)
+            {
+                if (m_Now & ((1ull << (sSlotBits * level)) - 1))
+                    break;
+                Cascade(level);
+            }
+
+            auto& head = m_Heads[m_Now & sSlotMask];
+            while (head != sNil)
+            {
+                auto index = head;
+                Unlink(index);
+
+                // the handler may schedule new timers and grow m_Nodes, so take it out first
+                auto handler = std::move(m_Nodes[index].m_Handler);
+                Release(index);
+                handler();
+            }
+        }
+    }
+
+    void TimingWheel::Link(uint32_t index)
+    {
+        auto& node = m_Nodes[index];
+        assert(node.m_Expire >= m_Now);
+
+        // timers beyond the last level are parked there and cascaded again later
+        const uint64_t limit = (1ull << (sSlotBits * sLevels)) - 1;
+        auto target = node.m_Expire - m_Now > limit ? m_Now + limit : node.m_Expire;
+        auto delta  = target - m_Now;
+
+        uint32_t level = 0;
+        while (level < sLevels - 1 && delta >= (1ull << (sSlotBits * (level + 1))))
+            ++level;
+
+        auto slot = level * sSlots + static_cast<uint32_t>((target >> (sSlotBits * level)) & sSlotMask);
+        node.m_Slot = slot;
+        node.m_Prev = sNil;
+        node.m_Next = m_Heads[slot];
+        if (node.m_Next != sNil)
+            m_Nodes[node.m_Next].m_Prev = index;
+        m_Heads[slot] = index;
+    }
+
+    void TimingWheel::Unlink(uint32_t index)
+    {
+        auto& node = m_Nodes[index];
+        if (node.m_Prev != sNil)
+            m_Nodes[node.m_Prev].m_Next = node.m_Next;
+        else
+            m_Heads[node.m_Slot] = node.m_Next;
+
+        if (node.m_Next != sNil)
+            m_Nodes[node.m_Next].m_Prev = node.m_Prev;
+
+        node.m_Prev = node.m_Next = sNil;
+    }
+
+    void TimingWheel::Release(uint32_t index)
+    {
+        auto& node = m_Nodes[index];
+        node.m_Slot = sNil;
+        node.m_Handler = nullptr;
+        ++node.m_Generation;
+        m_Free.push_back(index);
+        --m_Size;
+    }
+
+    void TimingWheel::Cascade(uint32_t level)
+    {
+        auto slot = level * sSlots + static_cast<uint32_t>((m_Now >> (sSlotBits * level)) & sSlotMask);
+        auto index = m_Heads[slot];
+        m_Heads[slot] = sNil;
+
+        while (index != sNil)
+        {
+            auto next = m_Nodes[index].m_Next;
+            Link(index);
+            index = next;
+        }
+    }
+}
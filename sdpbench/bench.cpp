@@ -0,0 +1,247 @@
+#include "sdp.h"
+#include "session.h"
+#include "media.h"
+#include "stream.h"
+#include "agent.h"
+#include "pg_log.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+/*
+ sdpbench [rounds] [medias] [port]
+
+ Decode: a generated corpus of remote descriptions, 1-16 m-lines with 2-50 candidates
+ each, IPv4 and IPv6, full SDPs and trickle fragments (RFC8840), decoded 'rounds' times.
+ Encode: the offer of a loopback session with 'medias' m-lines and the trickle fragment
+ of each of its candidates, the host ports of rtp and rtcp start at 'port'.
+ allocations are counted by the replaced global operator new
+ */
+namespace {
+    const char* sIP = "127.0.0.1";
+
+    std::atomic<uint64_t> sAllocations(0);
+
+    using Clock = std::chrono::steady_clock;
+
+    std::string Address(std::mt19937& rng, bool bIPv6)
+    {
+        char address[64];
+        if (bIPv6)
+            snprintf(address, sizeof(address), "2001:db8:%x:%x::%x", static_cast<unsigned>(rng() & 0xFFFF),
+                static_cast<unsigned>(rng() & 0xFFFF), static_cast<unsigned>(rng() & 0xFFFF));
+        else
+            snprintf(address, sizeof(address), "10.%u.%u.%u", static_cast<unsigned>(rng() & 0xFF),
+                static_cast<unsigned>(rng() & 0xFF), static_cast<unsigned>(rng() & 0xFF) | 1);
+        return address;
+    }
+
+    /* host, srflx and relay candidates of both components, as a browser gathers them */
+    void AppendCandidates(std::string& sdp, std::mt19937& rng, uint16_t count, bool bIPv6)
+    {
+        static const char* sTypes[] = { "host", "srflx", "relay" };
+        char line[256];
+        for (uint16_t i = 0; i < count; ++i)
+        {
+            auto compId = static_cast<unsigned>(1 + i % 2);
+            auto type = i / 2 % 3;
+            auto priority = static_cast<unsigned>(((126 - type * 50) << 24) | ((65535 - i) << 8) | (256 - compId));
+            auto port = static_cast<unsigned>(10000 + rng() % 50000);
+            auto address = Address(rng, bIPv6);
+            if (!type)
+            {
+                snprintf(line, sizeof(line), "a=candidate:%u %u UDP %u %s %u typ host\r\n", i / 6, compId, priority, address.c_str(), port);
+            }
+            else
+            {
+                auto related = Address(rng, bIPv6);
+                snprintf(line, sizeof(line), "a=candidate:%u %u UDP %u %s %u typ %s raddr %s rport %u\r\n", i / 6, compId, priority,
+                    address.c_str(), port, sTypes[type], related.c_str(), static_cast<unsigned>(10000 + rng() % 50000));
+            }
+            sdp += line;
+        }
+    }
+
+    /* the m-sections of a description are told apart by their media, as the session names its medias */
+    std::string MediaName(uint16_t index)
+    {
+        return index ? "video" + (index > 1 ? std::to_string(index) : std::string()) : "audio";
+    }
+
+    std::string MakeSDP(std::mt19937& rng, uint16_t medias, uint16_t cands, bool bIPv6)
+    {
+        std::string sdp;
+        sdp += "v=0\r\no=- 4611731400430051336 2 IN IP4 127.0.0.1\r\ns=-\r\nt=0 0\r\n";
+        sdp += bIPv6 ? "c=IN IP6 " : "c=IN IP4 ";
+        sdp += Address(rng, bIPv6) + "\r\n";
+        sdp += "a=ice-ufrag:8hhY\r\na=ice-pwd:asd88fgpdd777uzjYhagZg\r\na=ice-options:trickle ice2\r\n";
+        sdp += "a=group:BUNDLE";
+        for (uint16_t i = 0; i < medias; ++i)
+            sdp += " " + std::to_string(i);
+        sdp += "\r\n";
+
+        for (uint16_t i = 0; i < medias; ++i)
+        {
+            sdp += "m=" + MediaName(i) + (i ? " 9 UDP/TLS/RTP/SAVPF 96 97\r\n" : " 9 UDP/TLS/RTP/SAVPF 111\r\n");
+            sdp += "a=mid:" + std::to_string(i) + "\r\na=rtcp-mux\r\na=sendrecv\r\n";
+            AppendCandidates(sdp, rng, cands, bIPv6);
+        }
+        return sdp;
+    }
+
+    /* RFC8840 9.  a trickled candidate, the m-section it belongs to and the credentials */
+    std::string MakeFragment(std::mt19937& rng, uint16_t cands, bool bIPv6)
+    {
+        std::string sdp;
+        sdp += "a=ice-ufrag:8hhY\r\na=ice-pwd:asd88fgpdd777uzjYhagZg\r\n";
+        sdp += "m=audio 9 UDP/TLS/RTP/SAVPF 0\r\n";
+        sdp += bIPv6 ? "c=IN IP6 ::\r\n" : "c=IN IP4 0.0.0.0\r\n";
+        sdp += "a=mid:0\r\n";
+        AppendCandidates(sdp, rng, cands, bIPv6);
+        return sdp;
+    }
+}
+
+void* operator new(size_t size)
+{
+    ++sAllocations;
+    if (auto p = malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    free(p);
+}
+
+int main(int argc, char* argv[])
+{
+    uint32_t rounds = static_cast<uint32_t>(argc > 1 ? atoi(argv[1]) : 100);
+    uint16_t medias = static_cast<uint16_t>(argc > 2 ? atoi(argv[2]) : 4);
+    uint16_t port   = static_cast<uint16_t>(argc > 3 ? atoi(argv[3]) : 36000);
+    if (!rounds || !medias || medias > 16)
+        return 1;
+
+    // every 4th entry is a trickle fragment, m-lines and candidates cycle through their ranges
+    std::mt19937 rng(0x5D9);
+    std::vector<std::string> corpus;
+    size_t bytes = 0;
+    for (uint16_t i = 0; i < 256; ++i)
+    {
+        auto cands = static_cast<uint16_t>(2 + i * 7 % 49);
+        bool bIPv6 = (i & 1) != 0;
+        corpus.push_back(i % 4 == 3 ? MakeFragment(rng, cands, bIPv6) : MakeSDP(rng, static_cast<uint16_t>(1 + i % 16), cands, bIPv6));
+        bytes += corpus.back().size();
+    }
+
+    for (auto itor = corpus.begin(); itor != corpus.end(); ++itor)
+    {
+        CSDP sdp;
+        if (!sdp.Decode(*itor))
+        {
+            LOG_ERROR("Bench", "corpus entry %d does not decode", static_cast<int>(itor - corpus.begin()));
+            return 1;
+        }
+    }
+
+    auto allocations = sAllocations.load();
+    auto start = Clock::now();
+    for (uint32_t round = 0; round < rounds; ++round)
+    {
+        for (auto itor = corpus.begin(); itor != corpus.end(); ++itor)
+        {
+            CSDP sdp;
+            sdp.Decode(*itor);
+        }
+    }
+    auto elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    auto decoded = static_cast<double>(rounds) * corpus.size();
+    allocations = sAllocations - allocations;
+
+    LOG_INFO("Bench", "decode %d SDPs, %d bytes avg", static_cast<int>(corpus.size()), static_cast<int>(bytes / corpus.size()));
+    LOG_INFO("Bench", "decode %.0f ns/SDP, %.1f allocations/SDP", elapsed / decoded, allocations / decoded);
+
+    ICE::CAgentConfig config;
+    ICE::Session session(sIP);
+    for (uint16_t i = 0; i < medias; ++i)
+    {
+        auto rtp = static_cast<uint16_t>(port + i * 2);
+        ICE::MediaAttr attr = { MediaName(i), {
+            ICE::MediaAttr::StreamAttr{ ICE::Protocol::udp, 1, rtp, sIP },
+            ICE::MediaAttr::StreamAttr{ ICE::Protocol::udp, 2, static_cast<uint16_t>(rtp + 1), sIP } } };
+        if (!session.CreateMedia(attr, config))
+            return 1;
+    }
+
+    // the offer buffer keeps its capacity from one round to the next, like a renegotiation
+    std::string offer;
+    allocations = sAllocations.load();
+    start = Clock::now();
+    for (uint32_t round = 0; round < rounds; ++round)
+    {
+        CSDP sdp;
+        if (!sdp.Encode(session, offer))
+            return 1;
+    }
+    elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    allocations = sAllocations - allocations;
+
+    LOG_INFO("Bench", "encode %d m-lines, %d bytes", medias, static_cast<int>(offer.size()));
+    LOG_INFO("Bench", "encode %.0f ns/SDP, %.1f allocations/SDP", elapsed / rounds, static_cast<double>(allocations) / rounds);
+
+    std::string fragment;
+    uint64_t fragments = 0;
+    allocations = sAllocations.load();
+    start = Clock::now();
+    for (uint32_t round = 0; round < rounds; ++round)
+    {
+        auto& all = session.GetMedias();
+        for (auto media_itor = all.begin(); media_itor != all.end(); ++media_itor)
+        {
+            auto& streams = media_itor->second->GetStreams();
+            for (auto stream_itor = streams.begin(); stream_itor != streams.end(); ++stream_itor)
+            {
+                auto& cands = stream_itor->second->GetCandidates();
+                for (auto cand_itor = cands.begin(); cand_itor != cands.end(); ++cand_itor)
+                {
+                    fragment.clear();
+                    CSDP::EncodeCandidate(*cand_itor->first, stream_itor->second->IsUDP(), fragment);
+                    ++fragments;
+                }
+            }
+        }
+    }
+    elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    allocations = sAllocations - allocations;
+
+    if (fragments)
+        LOG_INFO("Bench", "trickle %.0f ns/candidate, %.1f allocations/candidate", elapsed / fragments, static_cast<double>(allocations) / fragments);
+    return 0;
+}
@@ -0,0 +1,36 @@
+#include "sdp.h"
+#include "foundation.h"
+
+#include <stdint.h>
+#include <string>
+
+/*
+ libFuzzer harness of CSDP::Decode, built with -fsanitize=fuzzer,address together with the
+ ice and pg sources, the seeds are in sdpbench/corpus
+
+ sdpfuzz sdpbench/corpus
+ */
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    std::string text(reinterpret_cast<const char*>(data), size);
+
+    // every m-section decoded
+    {
+        CSDP sdp;
+        sdp.Decode(text);
+    }
+
+    // skipped m-sections are only indexed, twice into one interner as a session applies an update
+    STUN::RemoteFoundationInterner foundations;
+    for (int i = 0; i < 2; ++i)
+    {
+        CSDP sdp(&foundations);
+        if (sdp.Decode(text, [](boost::string_view type) { return type == "audio"; }))
+        {
+            auto& medias = sdp.GetRemoteMedia();
+            for (auto itor = medias.begin(); itor != medias.end(); ++itor)
+                sdp.BundleTransport(*itor->second);
+        }
+    }
+    return 0;
+}
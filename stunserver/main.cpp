@@ -0,0 +1,45 @@
+#include "stunserver.h"
+#include "pg_log.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+
+/*
+ stunserver [ip] [port] [workers] [eim|symmetric public-ip low-port upper-port]
+
+ stand-alone RFC5389 Binding server for offline gathering and CI benchmarks,
+ prints the number of answered requests every second
+ */
+int main(int argc, char* argv[])
+{
+    std::string ip = argc > 1 ? argv[1] : "0.0.0.0";
+    uint16_t port = static_cast<uint16_t>(argc > 2 ? atoi(argv[2]) : 3478);
+    uint16_t workers = static_cast<uint16_t>(argc > 3 ? atoi(argv[3]) : std::thread::hardware_concurrency());
+
+    STUN::Server server(ip, port, workers);
+
+    if (argc > 4)
+    {
+        auto mapping = !strcmp(argv[4], "symmetric") ? STUN::Server::NatMapping::AddressPortDependent : STUN::Server::NatMapping::EndpointIndependent;
+        if (argc < 8 || !server.SimulateNat(mapping, argv[5], static_cast<uint16_t>(atoi(argv[6])), static_cast<uint16_t>(atoi(argv[7]))))
+        {
+            LOG_ERROR("Main", "usage: stunserver [ip] [port] [workers] [eim|symmetric public-ip low-port upper-port]");
+            return 1;
+        }
+    }
+
+    if (!server.Start())
+        return 1;
+
+    uint64_t last = 0;
+    while (1)
+    {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        auto answered = server.Answered();
+        LOG_INFO("Main", "answered %llu, %llu/s", answered, answered - last);
+        last = answered;
+    }
+    return 0;
+}
@@ -0,0 +1,158 @@
+#include "turnserver.h"
+#include "turnclient.h"
+#include "channel.h"
+#include "pg_log.h"
+
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <memory>
+
+/*
+ turnbench [clients] [seconds] [payload] [shards] [peers]
+
+ loopback benchmark of the relay: every simulated client allocates on a local TurnServer,
+ binds a channel to one of the peer sockets and blasts RTP sized ChannelData,
+ the peers count what comes out of the relay
+ */
+namespace {
+    const char*    sIP       = "127.0.0.1";
+    const uint16_t sPort     = 34780;
+    const char*    sUsername = "bench";
+    const char*    sPassword = "bench";
+
+    struct Client {
+        ICE::UDPChannel                     m_Channel;
+        std::unique_ptr<ICE::TurnClient>    m_Turn;
+        boost::asio::ip::udp::endpoint      m_Peer;
+    };
+
+    std::atomic_bool      sQuit(false);
+    std::atomic<uint64_t> sSent(0);
+    std::atomic<uint64_t> sReceived(0);
+
+    /* the client socket carries the TURN responses, they have to be handed back to the client */
+    void ClientReader(Client* client)
+    {
+        STUN::PACKET::stun_packet packet;
+        boost::asio::ip::udp::endpoint from;
+        while (!sQuit)
+        {
+            auto bytes = client->m_Channel.Read(&packet, sizeof(packet), from, 100);
+            if (bytes < 0)
+                break;
+
+            if (bytes && STUN::MessagePacket::IsValidStunPacket(packet, bytes))
+                client->m_Turn->OnStunPacket(packet, static_cast<uint16_t>(bytes));
+        }
+    }
+
+    void ClientSender(Client* client, uint16_t payload)
+    {
+        // 12 bytes RTP header + payload, the content does not matter to the relay
+        std::vector<uint8_t> rtp(payload, 0x80);
+        uint64_t sent = 0;
+        while (!sQuit)
+        {
+            if (client->m_Turn->Send(client->m_Peer, rtp.data(), payload) > 0)
+                ++sent;
+        }
+        sSent += sent;
+    }
+
+    void PeerReader(ICE::UDPChannel* peer)
+    {
+        uint8_t buffer[2048];
+        boost::asio::ip::udp::endpoint from;
+        uint64_t received = 0;
+        while (!sQuit)
+        {
+            auto bytes = peer->Read(buffer, sizeof(buffer), from, 100);
+            if (bytes < 0)
+                break;
+
+            if (bytes > 0 && ++received % 1024 == 0)
+                sReceived += 1024;
+        }
+        sReceived += received % 1024;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    uint16_t clients = static_cast<uint16_t>(argc > 1 ? atoi(argv[1]) : 4);
+    uint32_t seconds = static_cast<uint32_t>(argc > 2 ? atoi(argv[2]) : 5);
+    uint16_t payload = static_cast<uint16_t>(argc > 3 ? atoi(argv[3]) : 172);
+    uint16_t shards  = static_cast<uint16_t>(argc > 4 ? atoi(argv[4]) : std::thread::hardware_concurrency());
+    uint16_t peers   = static_cast<uint16_t>(argc > 5 ? atoi(argv[5]) : 2);
+
+    STUN::TurnServer server(sIP, sPort, sIP, "bench", shards);
+    server.AddUser(sUsername, sPassword);
+    if (!server.Start())
+        return 1;
+
+    std::vector<std::unique_ptr<ICE::UDPChannel>> peerChannels;
+    for (uint16_t i = 0; i < peers; ++i)
+    {
+        std::unique_ptr<ICE::UDPChannel> peer(new ICE::UDPChannel);
+        if (!peer->Bind(sIP, 0))
+            return 1;
+        peerChannels.push_back(std::move(peer));
+    }
+
+    std::vector<std::unique_ptr<Client>> simulated;
+    for (uint16_t i = 0; i < clients; ++i)
+    {
+        std::unique_ptr<Client> client(new Client);
+        if (!client->m_Channel.Bind(sIP, 0))
+            return 1;
+
+        client->m_Turn.reset(new ICE::TurnClient(&client->m_Channel, sIP, sPort, sUsername, sPassword));
+        if (!client->m_Turn->Allocate())
+        {
+            LOG_ERROR("Bench", "client %d Allocate failed", i);
+            return 1;
+        }
+
+        auto& peer = peerChannels[i % peers];
+        client->m_Peer = boost::asio::ip::udp::endpoint(boost::asio::ip::address::from_string(peer->IP()), peer->Port());
+        simulated.push_back(std::move(client));
+    }
+
+    std::vector<std::thread> threads;
+    for (auto& peer : peerChannels)
+        threads.push_back(std::thread(PeerReader, peer.get()));
+
+    for (auto& client : simulated)
+    {
+        threads.push_back(std::thread(ClientReader, client.get()));
+        client->m_Turn->ChannelBind(client->m_Peer);
+    }
+
+    // let the ChannelBind transactions complete so the run only measures ChannelData
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    auto relayed = server.Relayed();
+
+    auto start = std::chrono::steady_clock::now();
+    for (auto& client : simulated)
+        threads.push_back(std::thread(ClientSender, client.get(), payload));
+
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    sQuit = true;
+    for (auto& thread : threads)
+        thread.join();
+
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    relayed = server.Relayed() - relayed;
+
+    LOG_INFO("Bench", "%d clients, %d shards, %d bytes payload, %.1fs", clients, shards, payload, elapsed);
+    LOG_INFO("Bench", "sent     %llu pkt, %.0f pkt/s", static_cast<uint64_t>(sSent), sSent / elapsed);
+    LOG_INFO("Bench", "relayed  %llu pkt, %.0f pkt/s, %.1f Mbit/s", relayed, relayed / elapsed, relayed * payload * 8 / elapsed / 1e6);
+    LOG_INFO("Bench", "received %llu pkt, %.0f pkt/s", static_cast<uint64_t>(sReceived), sReceived / elapsed);
+
+    simulated.clear();
+    server.Stop();
+    return 0;
+}
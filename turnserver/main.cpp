@@ -0,0 +1,48 @@
+#include "turnserver.h"
+#include "pg_log.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+
+/*
+ turnserver ip port relay-ip realm [shards] [username:password ...]
+
+ stand-alone RFC8656 relay, prints the allocations and the relayed packets every second
+ */
+int main(int argc, char* argv[])
+{
+    if (argc < 5)
+    {
+        LOG_ERROR("Main", "usage: turnserver ip port relay-ip realm [shards] [username:password ...]");
+        return 1;
+    }
+
+    uint16_t shards = static_cast<uint16_t>(argc > 5 ? atoi(argv[5]) : std::thread::hardware_concurrency());
+    STUN::TurnServer server(argv[1], static_cast<uint16_t>(atoi(argv[2])), argv[3], argv[4], shards);
+
+    for (int i = 6; i < argc; ++i)
+    {
+        auto separator = strchr(argv[i], ':');
+        if (!separator)
+        {
+            LOG_ERROR("Main", "invalid user [%s], expects username:password", argv[i]);
+            return 1;
+        }
+        server.AddUser(std::string(argv[i], separator), separator + 1);
+    }
+
+    if (!server.Start())
+        return 1;
+
+    uint64_t last = 0;
+    while (1)
+    {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        auto relayed = server.Relayed();
+        LOG_INFO("Main", "allocations %llu, relayed %llu, %llu/s", server.Allocations(), relayed, relayed - last);
+        last = relayed;
+    }
+    return 0;
+}